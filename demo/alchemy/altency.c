@@ -194,6 +194,7 @@ static void display(void *cookie)
 		config.histogram_size = need_histo() ? histogram_size : 0;
 		config.histogram_bucketsize = bucketsize;
 		config.freeze_max = freeze_max;
+		config.worst_count = 0;
 
 		ret = ioctl(devfd, RTTST_RTIOC_TMBENCH_START, &config);
 		if (ret) {
@@ -395,6 +396,8 @@ static void cleanup(void)
 		overall.histogram_min = histogram_min;
 		overall.histogram_max = histogram_max;
 		overall.histogram_avg = histogram_avg;
+		overall.histogram_hdr = NULL;
+		overall.worst = NULL;
 		ioctl(devfd, RTTST_RTIOC_TMBENCH_STOP, &overall);
 		gminj = overall.result.min;
 		gmaxj = overall.result.max;
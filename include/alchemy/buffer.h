@@ -70,6 +70,29 @@ struct RT_BUFFER_INFO {
 
 typedef struct RT_BUFFER_INFO RT_BUFFER_INFO;
 
+/**
+ * @brief Buffer span descriptor
+ * @anchor RT_BUFFER_SPAN
+ *
+ * This structure describes an area of the buffer memory returned by
+ * rt_buffer_reserve() or rt_buffer_peek(). Such area may wrap at the
+ * end of the buffer, in which case it is split in two contiguous
+ * parts.
+ */
+struct RT_BUFFER_SPAN {
+	/**
+	 * Start addresses of the leading and trailing parts.
+	 */
+	void *ptr[2];
+	/**
+	 * Lengths of the leading and trailing parts (in bytes). The
+	 * trailing part is empty unless the area wraps.
+	 */
+	size_t len[2];
+};
+
+typedef struct RT_BUFFER_SPAN RT_BUFFER_SPAN;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -129,6 +152,58 @@ ssize_t rt_buffer_read(RT_BUFFER *bf,
 				    alchemy_rel_timeout(timeout, &ts));
 }
 
+ssize_t rt_buffer_reserve_timed(RT_BUFFER *bf,
+				RT_BUFFER_SPAN *span, size_t size,
+				const struct timespec *abs_timeout);
+
+static inline
+ssize_t rt_buffer_reserve_until(RT_BUFFER *bf,
+				RT_BUFFER_SPAN *span, size_t size,
+				RTIME timeout)
+{
+	struct timespec ts;
+	return rt_buffer_reserve_timed(bf, span, size,
+				       alchemy_abs_timeout(timeout, &ts));
+}
+
+static inline
+ssize_t rt_buffer_reserve(RT_BUFFER *bf,
+			  RT_BUFFER_SPAN *span, size_t size,
+			  RTIME timeout)
+{
+	struct timespec ts;
+	return rt_buffer_reserve_timed(bf, span, size,
+				       alchemy_rel_timeout(timeout, &ts));
+}
+
+int rt_buffer_commit(RT_BUFFER *bf, size_t size);
+
+ssize_t rt_buffer_peek_timed(RT_BUFFER *bf,
+			     RT_BUFFER_SPAN *span, size_t size,
+			     const struct timespec *abs_timeout);
+
+static inline
+ssize_t rt_buffer_peek_until(RT_BUFFER *bf,
+			     RT_BUFFER_SPAN *span, size_t size,
+			     RTIME timeout)
+{
+	struct timespec ts;
+	return rt_buffer_peek_timed(bf, span, size,
+				    alchemy_abs_timeout(timeout, &ts));
+}
+
+static inline
+ssize_t rt_buffer_peek(RT_BUFFER *bf,
+		       RT_BUFFER_SPAN *span, size_t size,
+		       RTIME timeout)
+{
+	struct timespec ts;
+	return rt_buffer_peek_timed(bf, span, size,
+				    alchemy_rel_timeout(timeout, &ts));
+}
+
+int rt_buffer_consume(RT_BUFFER *bf, size_t size);
+
 int rt_buffer_clear(RT_BUFFER *bf);
 
 int rt_buffer_inquire(RT_BUFFER *bf,
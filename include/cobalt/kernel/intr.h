@@ -33,6 +33,7 @@
 #define XN_IRQ_STATMASK	 (XN_IRQ_NONE|XN_IRQ_HANDLED)
 #define XN_IRQ_PROPAGATE 0x100
 #define XN_IRQ_DISABLE   0x200
+#define XN_IRQ_WAKE_THREAD 0x400
 
 /* Init flags. */
 #define XN_IRQTYPE_SHARED  0x1
@@ -45,6 +46,7 @@
 #define _XN_IRQSTAT_DISABLED  (1 << XN_IRQSTAT_DISABLED)
 
 struct xnintr;
+struct xnintr_thread;
 struct xnsched;
 
 typedef int (*xnisr_t)(struct xnintr *intr);
@@ -83,12 +85,25 @@ struct xnintr {
 	const char *name;
 	/** Descriptor maintenance lock. */
 	raw_spinlock_t lock;
+	/** Handler thread, NULL unless threaded. */
+	struct xnintr_thread *thread;
 #ifdef CONFIG_XENO_OPT_STATS
 	/** Statistics. */
 	struct xnirqstat *stats;
 #endif
 };
 
+struct xnintr_thread_attr {
+	/** Priority of the handler thread in the RT class. */
+	int prio;
+	/** CPUs the handler thread may run on. */
+	cpumask_t affinity;
+	/** Number of events to coalesce before waking up the thread. */
+	unsigned int batch;
+	/** Maximum time (ns) an event may wait for the batch to fill. */
+	xnticks_t delay;
+};
+
 struct xnintr_iterator {
     int cpu;		/** Current CPU in iteration. */
     unsigned long hits;	/** Current hit counter. */
@@ -122,6 +137,12 @@ int xnintr_init(struct xnintr *intr,
 
 void xnintr_destroy(struct xnintr *intr);
 
+int xnintr_init_thread(struct xnintr *intr,
+		       xnisr_t handler,
+		       const struct xnintr_thread_attr *attr);
+
+void xnintr_destroy_thread(struct xnintr *intr);
+
 int xnintr_attach(struct xnintr *intr,
 		  void *cookie);
 
@@ -85,6 +85,11 @@ struct a4l_buffer {
 	/* Theshold below which the user process should not be
 	   awakened */
 	unsigned long wake_count;
+
+	/* Delay (in us) after which a process waiting for the
+	   threshold is awakened anyway, provided some data is
+	   available */
+	unsigned long wake_timeout;
 };
 
 static inline void __dump_buffer_counters(struct a4l_buffer *buf)
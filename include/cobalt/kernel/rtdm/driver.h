@@ -834,8 +834,29 @@ typedef int (*rtdm_irq_handler_t)(rtdm_irq_t *irq_handle);
 #define RTDM_IRQ_HANDLED		XN_IRQ_HANDLED
 /** Request interrupt disabling on exit */
 #define RTDM_IRQ_DISABLE		XN_IRQ_DISABLE
+/** Run the threaded handler, see rtdm_irq_request_threaded() */
+#define RTDM_IRQ_WAKE_THREAD		XN_IRQ_WAKE_THREAD
 /** @} RTDM_IRQ_xxx */
 
+/**
+ * Threaded interrupt handler parameters
+ *
+ * @see rtdm_irq_request_threaded()
+ */
+struct rtdm_irq_thread_params {
+	/** Priority of the handler thread, see also
+	 * @ref rtdmtaskprio "Task Priority Range" */
+	int priority;
+	/** CPUs the handler thread may run on */
+	cpumask_t affinity;
+	/** Number of events to coalesce before running the handler,
+	 * zero or one for no coalescing */
+	unsigned int batch;
+	/** Maximum delay an event may wait for the batch to fill (ns),
+	 * required if @a batch is greater than one */
+	nanosecs_rel_t delay;
+};
+
 /**
  * Retrieve IRQ handler argument
  *
@@ -854,12 +875,20 @@ int rtdm_irq_request(rtdm_irq_t *irq_handle, unsigned int irq_no,
 		     rtdm_irq_handler_t handler, unsigned long flags,
 		     const char *device_name, void *arg);
 
+int rtdm_irq_request_threaded(rtdm_irq_t *irq_handle, unsigned int irq_no,
+			      rtdm_irq_handler_t handler,
+			      rtdm_irq_handler_t thread_fn,
+			      unsigned long flags, const char *device_name,
+			      void *arg,
+			      const struct rtdm_irq_thread_params *params);
+
 #ifndef DOXYGEN_CPP /* Avoid static inline tags for RTDM in doxygen */
 static inline int rtdm_irq_free(rtdm_irq_t *irq_handle)
 {
 	if (!XENO_ASSERT(COBALT, xnsched_root_p()))
 		return -EPERM;
 	xnintr_detach(irq_handle);
+	xnintr_destroy_thread(irq_handle);
 	return 0;
 }
 
@@ -31,6 +31,7 @@ struct rtdm_fd;
 struct _rtdm_mmap_request;
 struct xnselector;
 struct cobalt_ppd;
+struct rtdm_ring_req;
 
 /**
  * @file
@@ -232,6 +233,26 @@ unsigned long
 rtdm_get_unmapped_area_handler(struct rtdm_fd *fd,
 			       unsigned long len, unsigned long pgoff,
 			       unsigned long flags);
+/**
+ * Ring submission handler
+ *
+ * When present, this optional handler receives the requests
+ * submitted through a RTDM ring for the file descriptor, before the
+ * RTDM core falls back to calling the regular I/O handlers.
+ *
+ * @param[in] fd File descriptor
+ * @param[in,out] req Request descriptor
+ *
+ * @return The result of the operation if completed on the spot,
+ * -EIOCBQUEUED if the driver accepted the request, in which case it
+ * shall post the result later on with rtdm_ring_complete(), or
+ * -ENOSYS for requesting the generic processing.
+ *
+ * @note The handler runs on behalf of the thread owning the ring,
+ * rtdm_ring_complete() may be called from any context.
+ */
+int rtdm_submit_handler(struct rtdm_fd *fd, struct rtdm_ring_req *req);
+
 /**
  * @anchor rtdm_fd_ops
  * @brief RTDM file operation descriptor.
@@ -289,6 +310,9 @@ struct rtdm_fd_ops {
 					   unsigned long len,
 					   unsigned long pgoff,
 					   unsigned long flags);
+	/** See rtdm_submit_handler(). */
+	int (*submit)(struct rtdm_fd *fd,
+		      struct rtdm_ring_req *req);
 };
 
 /** @} File operation handlers */
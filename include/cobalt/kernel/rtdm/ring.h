@@ -0,0 +1,56 @@
+/*
+ * Xenomai is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef _COBALT_RTDM_RING_H
+#define _COBALT_RTDM_RING_H
+
+#include <linux/list.h>
+#include <rtdm/rtdm.h>
+#include <rtdm/uapi/ring.h>
+
+struct rtdm_ring;
+
+/**
+ * @ingroup rtdm_device_register
+ * @brief I/O request submitted through a RTDM ring
+ *
+ * A request is passed to the ->submit() handler of the target file
+ * descriptor, which may either complete it on the spot by returning
+ * the result, or accept it by returning -EIOCBQUEUED. In the latter
+ * case, the driver owns the request until it calls
+ * rtdm_ring_complete(), which it must do before its ->close()
+ * handler returns.
+ */
+struct rtdm_ring_req {
+	/** Submission entry, as copied from the ring. */
+	struct rtdm_ring_sqe sqe;
+	/**
+	 * Kernel address of the buffer for RTDM_RING_F_FIXED
+	 * requests, NULL otherwise. Unlike the user buffer, this
+	 * memory may be accessed from any context, including
+	 * interrupt handlers.
+	 */
+	void *kbuf;
+	/** Free for use by the driver while it owns the request. */
+	struct list_head next;
+	/* Private to the ring. */
+	struct rtdm_ring *ring;
+	void __user *ubuf;
+	int type;
+};
+
+void rtdm_ring_complete(struct rtdm_ring_req *req, int result);
+
+#endif /* !_COBALT_RTDM_RING_H */
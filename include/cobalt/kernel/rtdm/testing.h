@@ -30,6 +30,9 @@ struct compat_rttst_overall_bench_res {
 	compat_uptr_t histogram_avg;
 	compat_uptr_t histogram_min;
 	compat_uptr_t histogram_max;
+	compat_uptr_t histogram_hdr;
+	compat_uptr_t worst;
+	int nr_worst;
 };
 
 #define RTTST_RTIOC_TMBENCH_STOP_COMPAT \
@@ -35,10 +35,17 @@
 #define XNSCHED_QUOTA_NR_PRIO	\
 	(XNSCHED_QUOTA_MAX_PRIO - XNSCHED_QUOTA_MIN_PRIO + 1)
 
+/* Max. nesting level of thread groups. */
+#define XNSCHED_QUOTA_MAX_DEPTH	4
+
+/* Group may run on budget left unused by others. */
+#define XNSCHED_QUOTA_BORROW	0x1
+
 extern struct xnsched_class xnsched_class_quota;
 
 struct xnsched_quota_group {
 	struct xnsched *sched;
+	struct xnsched_quota_group *parent;
 	xnticks_t quota_ns;
 	xnticks_t quota_peak_ns;
 	xnticks_t run_start_ns;
@@ -47,8 +54,12 @@ struct xnsched_quota_group {
 	struct list_head members;
 	struct list_head expired;
 	struct list_head next;
+	struct list_head borrow_next;
 	int nr_active;
 	int nr_threads;
+	int nr_children;
+	int depth;
+	int flags;
 	int tgid;
 	int quota_percent;
 	int quota_peak_percent;
@@ -56,9 +67,12 @@ struct xnsched_quota_group {
 
 struct xnsched_quota {
 	xnticks_t period_ns;
+	xnticks_t lend_ns;
 	struct xntimer refill_timer;
 	struct xntimer limit_timer;
 	struct list_head groups;
+	struct list_head borrowers;
+	struct xnsched_quota_group *borrower;
 };
 
 static inline int xnsched_quota_init_thread(struct xnthread *thread)
@@ -71,7 +85,8 @@ static inline int xnsched_quota_init_thread(struct xnthread *thread)
 
 int xnsched_quota_create_group(struct xnsched_quota_group *tg,
 			       struct xnsched *sched,
-			       int *quota_sum_r);
+			       struct xnsched_quota_group *parent,
+			       int flags, int *quota_sum_r);
 
 int xnsched_quota_destroy_group(struct xnsched_quota_group *tg,
 				int force,
@@ -470,6 +470,31 @@ struct xnvfile_snapshot_ops {
 	 * read-only vfiles.
 	 */
 	ssize_t (*store)(struct xnvfile_input *input);
+	/**
+	 * @anchor snapshot_encode
+	 * This handler converts a collected record to its binary
+	 * representation, as returned by reading the ".bin" companion
+	 * entry of the vfile.
+	 *
+	 * @param it A pointer to the current snapshot iterator.
+	 *
+	 * @param data A pointer to the collected record to encode.
+	 *
+	 * @param rec A pointer to the binary record to fill in, which
+	 * size is vfile->recsz. This area is zeroed on entry, so that
+	 * unused bytes compare equal from one snapshot to the next.
+	 *
+	 * @return zero if the call succeeds, otherwise a negative
+	 * error code which is passed back to the reader.
+	 *
+	 * @note This handler is optional. It is called without the
+	 * vfile lock held, after the data collection phase. The
+	 * encoded records should only carry values which actually
+	 * changed when the object state did, so that incremental
+	 * reads remain cheap.
+	 */
+	int (*encode)(struct xnvfile_snapshot_iterator *it,
+		      void *data, void *rec);
 };
 
 /**
@@ -509,6 +534,9 @@ struct xnvfile_snapshot {
 	size_t datasz;
 	struct xnvfile_rev_tag *tag;
 	struct xnvfile_snapshot_ops *ops;
+	size_t recsz;
+	int rectype;
+	struct proc_dir_entry *binpde;
 };
 
 /**
@@ -624,6 +652,8 @@ void __vfile_hostlock_put(struct xnvfile *vfile);
 static inline
 void xnvfile_destroy_snapshot(struct xnvfile_snapshot *vfile)
 {
+	if (vfile->binpde)
+		proc_remove(vfile->binpde);
 	xnvfile_destroy(&vfile->entry);
 }
 
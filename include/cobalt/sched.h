@@ -25,6 +25,12 @@
 #include <cobalt/wrappers.h>
 #include <cobalt/uapi/sched.h>
 
+struct sched_tp_budget {
+	int ptid;
+	struct timespec budget;
+	struct timespec period;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -56,6 +62,10 @@ int sched_setconfig_np(int cpu, int policy,
 ssize_t sched_getconfig_np(int cpu, int policy,
 			   union sched_config *config, size_t *len_r);
 
+int sched_tp_compile_np(const struct sched_tp_budget *budgets,
+			int nr_budgets, union sched_config *config,
+			size_t *len_r);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,7 @@
 #define _COBALT_SYS_COBALT_H
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <signal.h>
 #include <pthread.h>
 #include <sched.h>
@@ -30,6 +31,7 @@
 #include <boilerplate/list.h>
 #include <cobalt/uapi/kernel/synch.h>
 #include <cobalt/uapi/kernel/vdso.h>
+#include <cobalt/uapi/kernel/vfile.h>
 #include <cobalt/uapi/corectl.h>
 #include <cobalt/uapi/mutex.h>
 #include <cobalt/uapi/event.h>
@@ -47,6 +49,18 @@ struct cobalt_tsd_hook {
 	struct pvholder next;
 };
 
+struct cobalt_vfile_reader {
+	int fd;
+	unsigned int type;
+	char *buf;
+	size_t bufsz;
+	void *recs;
+	size_t recsz;
+	int nrec;
+	unsigned int generation;
+	unsigned long long date;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -134,6 +148,19 @@ void cobalt_register_tsd_hook(struct cobalt_tsd_hook *th);
 
 void cobalt_assert_nrt(void);
 
+int cobalt_vfile_open(struct cobalt_vfile_reader *r,
+		      const char *path, unsigned int type);
+
+int cobalt_vfile_update(struct cobalt_vfile_reader *r);
+
+const void *cobalt_vfile_get(struct cobalt_vfile_reader *r, int index);
+
+void cobalt_vfile_close(struct cobalt_vfile_reader *r);
+
+int cobalt_doorbell_create(int efd, int flags);
+
+int cobalt_doorbell_ring(int fd, uint64_t count);
+
 /* Use cobalt_assert_nrt() instead of: */
 __deprecated void assert_nrt(void);
 __deprecated void assert_nrt_fast(void);
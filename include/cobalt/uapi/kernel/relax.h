@@ -0,0 +1,109 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_KERNEL_RELAX_H
+#define _COBALT_UAPI_KERNEL_RELAX_H
+
+#include <linux/types.h>
+#include <cobalt/uapi/signal.h>
+
+/*
+ * Layout of the relax trace rings, as mapped read-only from
+ * /proc/xenomai/debug/relax-ring:
+ *
+ * [struct cobalt_relax_trace + nr_cpus ring heads]
+ * [nr_events x struct cobalt_relax_event] for CPU0
+ * ...
+ * [nr_events x struct cobalt_relax_event] for CPU(nr_cpus - 1)
+ * [string table]
+ *
+ * Each CPU has a single producer, so the rings are lockless. The
+ * n-th event logged on a CPU (counting from zero) goes to slot
+ * (n & (nr_events - 1)), and its sequence number is set to n + 1
+ * once the record is complete, before the ring head moves to n +
+ * 1. The sequence number reads as zero while the slot is being
+ * updated. Readers may therefore consume the events in place,
+ * checking that the sequence number they read before and after
+ * looking at a record matches the expected value, which means
+ * that the record was not overwritten meanwhile.
+ *
+ * Map and executable names are stored once in the string table
+ * which only grows, events refer to them by offset. Offset zero
+ * denotes an unknown name. Strings below strtab_len are complete.
+ */
+#define COBALT_RELAX_MAGIC	0x52454c58
+#define COBALT_RELAX_ABI	1
+#define COBALT_RELAX_NAMELEN	32
+
+struct cobalt_relax_frame {
+	/* PC value, relative to the base of the mapping. */
+	__u64 pc;
+	/* Offset of the mapping name in the string table. */
+	__u32 mapname;
+	__u32 __pad;
+};
+
+struct cobalt_relax_event {
+	__u32 seq;
+	__u32 pid;
+	/* Monotonic date of the relax request (ns). */
+	__u64 date;
+	__u32 proghash;
+	/* Offset of the executable path in the string table. */
+	__u32 exe_path;
+	/* SIGDEBUG_* reason code. */
+	__u32 reason;
+	__u32 depth;
+	char thread[COBALT_RELAX_NAMELEN];
+	struct cobalt_relax_frame backtrace[SIGSHADOW_BACKTRACE_DEPTH];
+};
+
+struct cobalt_relax_ring {
+	__u32 head;
+	__u32 __pad[15];	/* One ring head per cache line. */
+};
+
+struct cobalt_relax_trace {
+	__u32 magic;
+	__u32 abi;
+	__u32 size;
+	__u32 nr_cpus;
+	__u32 nr_events;
+	__u32 event_offset;
+	__u32 strtab_offset;
+	__u32 strtab_size;
+	__u32 strtab_len;
+	__u32 __pad[7];
+	struct cobalt_relax_ring rings[0];
+};
+
+static inline struct cobalt_relax_event *
+cobalt_relax_event(const struct cobalt_relax_trace *t, int cpu, __u32 n)
+{
+	struct cobalt_relax_event *events;
+
+	events = (struct cobalt_relax_event *)
+		((char *)t + t->event_offset) + cpu * t->nr_events;
+
+	return events + (n & (t->nr_events - 1));
+}
+
+static inline const char *
+cobalt_relax_string(const struct cobalt_relax_trace *t, __u32 offset)
+{
+	return (const char *)t + t->strtab_offset + offset;
+}
+
+#endif /* !_COBALT_UAPI_KERNEL_RELAX_H */
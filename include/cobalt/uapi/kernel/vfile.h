@@ -0,0 +1,121 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_KERNEL_VFILE_H
+#define _COBALT_UAPI_KERNEL_VFILE_H
+
+#include <linux/types.h>
+#include <cobalt/uapi/kernel/limits.h>
+
+/*
+ * Binary output of the snapshot vfiles, read from their ".bin"
+ * companion entries in /proc/xenomai, e.g. sched/acct.bin.
+ *
+ * A read from offset zero returns a header, followed by hdr.nemit
+ * cells, each made of a struct cobalt_vfile_record immediately
+ * followed by hdr.recsz bytes of record data. All cells are 64bit
+ * aligned.
+ *
+ * hdr.generation is the revision of the object set the snapshot was
+ * taken from. When COBALT_VFILE_DELTA is set, the set did not change
+ * since the previous read from the same file descriptor, and only
+ * the records which differ from that previous read are sent. Each
+ * cell tells the index of its record among the hdr.nrec records of
+ * the snapshot.
+ */
+#define COBALT_VFILE_MAGIC	0x58564246 /* XVBF */
+#define COBALT_VFILE_ABI	1
+
+#define COBALT_VFILE_DELTA	0x1
+
+/* Record types. */
+#define COBALT_VFILE_THREAD	1
+#define COBALT_VFILE_HEAP	2
+#define COBALT_VFILE_TIMER	3
+
+struct cobalt_vfile_header {
+	__u32 magic;
+	__u16 abi;
+	__u16 flags;
+	__u32 type;
+	__u32 recsz;
+	__u32 nrec;
+	__u32 nemit;
+	__u32 generation;
+	__u32 __pad;
+	/* Monotonic date of the snapshot (ns). */
+	__u64 date;
+};
+
+struct cobalt_vfile_record {
+	__u32 index;
+	__u32 __pad;
+};
+
+/* sched/stat.bin, sched/acct.bin */
+struct cobalt_vfile_thread {
+	__u64 exectime_total;	/* ns */
+	__u64 period;
+	__u64 ssw;
+	__u64 csw;
+	__u64 xsc;
+	__u64 pf;
+	__u32 cpu;
+	__s32 pid;
+	__u32 state;
+	__s32 cprio;
+	char name[XNOBJECT_NAME_LEN];
+	char sched_class[16];
+};
+
+/* heap.bin */
+struct cobalt_vfile_heap {
+	__u64 size;
+	__u64 free;
+	char name[XNOBJECT_NAME_LEN];
+};
+
+/* timer/<clock>.bin */
+struct cobalt_vfile_timer {
+	__u64 interval;		/* ns */
+	__u32 cpu;
+	__u32 scheduled;
+	__u32 fired;
+	__u32 status;
+	char name[XNOBJECT_NAME_LEN];
+};
+
+static inline
+struct cobalt_vfile_record *
+cobalt_vfile_first(const struct cobalt_vfile_header *hdr)
+{
+	return (struct cobalt_vfile_record *)(hdr + 1);
+}
+
+static inline
+struct cobalt_vfile_record *
+cobalt_vfile_next(const struct cobalt_vfile_header *hdr,
+		  const struct cobalt_vfile_record *rec)
+{
+	return (struct cobalt_vfile_record *)
+		((char *)(rec + 1) + hdr->recsz);
+}
+
+static inline void *cobalt_vfile_data(const struct cobalt_vfile_record *rec)
+{
+	return (void *)(rec + 1);
+}
+
+#endif /* !_COBALT_UAPI_KERNEL_VFILE_H */
@@ -88,13 +88,19 @@ enum {
 	sched_quota_force_remove,
 	sched_quota_set,
 	sched_quota_get,
+	sched_quota_add_ex,
 };
 
+/* sched_quota_add_ex flags. */
+#define SCHED_QUOTA_BORROW  0x1
+
 struct __sched_config_quota {
 	int op;
 	union {
 		struct {
 			int pshared;
+			int parent;
+			int flags;
 		} add;
 		struct {
 			int tgid;
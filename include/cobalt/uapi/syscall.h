@@ -117,6 +117,7 @@
 #define sc_cobalt_backtrace			94
 #define sc_cobalt_serialdbg			95
 #define sc_cobalt_extend			96
+#define sc_cobalt_doorbell_create		97
 
 #define __NR_COBALT_SYSCALLS			128 /* Power of 2 */
 
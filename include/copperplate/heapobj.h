@@ -49,9 +49,30 @@ struct sysgroup {
 	struct listobj thread_list;
 	int heap_count;
 	struct listobj heap_list;
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+	int syncobj_count;
+	struct listobj syncobj_list;
+#endif
 	pthread_mutex_t lock;
 };
 
+struct heapobj_stats {
+	/** Size of the heap. */
+	size_t total;
+	/** Bytes in use, including the per-thread caches. */
+	size_t used;
+	/** Acquisitions of the heap lock. */
+	unsigned long lock_count;
+	/** Lock acquisitions which had to wait for another owner. */
+	unsigned long lock_contended;
+	/** Allocations served from a per-thread cache. */
+	unsigned long cache_hits;
+	/** Per-thread cache refills from the heap. */
+	unsigned long cache_refills;
+	/** Per-thread cache flushes to the heap. */
+	unsigned long cache_flushes;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -304,6 +325,9 @@ size_t heapobj_validate(struct heapobj *hobj,
 
 size_t heapobj_inquire(struct heapobj *hobj);
 
+void heapobj_inquire_stats(struct heapobj *hobj,
+			   struct heapobj_stats *stats);
+
 int heapobj_bind_session(const char *session);
 
 void heapobj_unbind_session(void);
@@ -417,6 +441,16 @@ static inline size_t heapobj_inquire(struct heapobj *hobj)
 	return pvheapobj_inquire(hobj);
 }
 
+static inline void heapobj_inquire_stats(struct heapobj *hobj,
+					 struct heapobj_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (hobj) {
+		stats->total = hobj->size;
+		stats->used = pvheapobj_inquire(hobj);
+	}
+}
+
 static inline int heapobj_bind_session(const char *session)
 {
 	return -ENOSYS;
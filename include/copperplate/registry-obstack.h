@@ -76,6 +76,21 @@ int fsobstack_grow_syncobj_drain(struct fsobstack *o,
 				 struct syncobj *sobj,
 				 struct fsobstack_syncops *ops);
 
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+
+int fsobstack_grow_syncobj_stats(struct fsobstack *o,
+				 struct syncobj *sobj);
+
+#else /* !CONFIG_XENO_SYNCOBJ_STATS */
+
+static inline int fsobstack_grow_syncobj_stats(struct fsobstack *o,
+					       struct syncobj *sobj)
+{
+	return 0;
+}
+
+#endif /* !CONFIG_XENO_SYNCOBJ_STATS */
+
 ssize_t fsobstack_pull(struct fsobstack *o,
 		       char *buf, size_t size);
 
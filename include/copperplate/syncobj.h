@@ -61,6 +61,42 @@ struct syncobj_corespec {
 
 #endif /* CONFIG_XENO_MERCURY */
 
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+
+#include <copperplate/heapobj.h>
+#include <copperplate/clockobj.h>
+
+/*
+ * Time histograms have log2 buckets, i.e. bucket #n counts the
+ * delays in the [2^n, 2^(n+1)) ns range, the last one collecting
+ * anything longer. Likewise for the count of waiters found by grant
+ * operations.
+ */
+#define SYNCOBJ_TIME_BUCKETS	32
+#define SYNCOBJ_WAITER_BUCKETS	8
+
+/*
+ * Lives in shared memory along with the syncobj, so that a peer
+ * process may read the counters.
+ */
+struct syncobj_stats {
+	char name[32];
+	pid_t cnode;
+	unsigned long grants;
+	unsigned long timeouts;
+	unsigned long flushes;
+	int max_waiters;
+	unsigned long wait_time[SYNCOBJ_TIME_BUCKETS];
+	unsigned long hold_time[SYNCOBJ_TIME_BUCKETS];
+	unsigned long waiters[SYNCOBJ_WAITER_BUCKETS];
+	ticks_t lock_date;
+#ifdef CONFIG_XENO_PSHARED
+	struct sysgroup_memspec memspec;
+#endif
+};
+
+#endif /* CONFIG_XENO_SYNCOBJ_STATS */
+
 struct syncobj {
 	unsigned int magic;
 	int flags;
@@ -71,6 +107,9 @@ struct syncobj {
 	int drain_count;
 	struct syncobj_corespec core;
 	fnref_type(void (*)(struct syncobj *sobj)) finalizer;
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+	struct syncobj_stats stats;
+#endif
 };
 
 #define syncobj_for_each_grant_waiter(sobj, pos)		\
@@ -122,6 +161,49 @@ static inline void __syncobj_check_locked(struct syncobj *sobj)
 
 #endif /* !CONFIG_XENO_DEBUG */
 
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+
+static inline int syncobj_histo_bucket(unsigned long long value,
+				       int nr_buckets)
+{
+	int n;
+
+	if (value == 0)
+		return 0;
+
+	n = 63 - __builtin_clzll(value);
+
+	return n < nr_buckets ? n : nr_buckets - 1;
+}
+
+/*
+ * Return the upper bound of the bucket the requested percentile of
+ * the samples falls in, zero if the histogram is empty.
+ */
+static inline
+unsigned long long syncobj_histo_percentile(const unsigned long *histo,
+					    int nr_buckets, int percent)
+{
+	unsigned long long total = 0, sum = 0;
+	int n;
+
+	for (n = 0; n < nr_buckets; n++)
+		total += histo[n];
+
+	if (total == 0)
+		return 0;
+
+	for (n = 0; n < nr_buckets - 1; n++) {
+		sum += histo[n];
+		if (sum * 100 >= total * percent)
+			break;
+	}
+
+	return 2ULL << n;
+}
+
+#endif /* CONFIG_XENO_SYNCOBJ_STATS */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -161,6 +243,23 @@ int syncobj_destroy(struct syncobj *sobj,
 
 void syncobj_uninit(struct syncobj *sobj);
 
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+
+void syncobj_set_name(struct syncobj *sobj, const char *name);
+
+void syncobj_get_stats(struct syncobj *sobj,
+		       struct syncobj_stats *stats);
+
+void syncobj_reset_stats(struct syncobj *sobj);
+
+#else /* !CONFIG_XENO_SYNCOBJ_STATS */
+
+static inline void syncobj_set_name(struct syncobj *sobj, const char *name)
+{
+}
+
+#endif /* !CONFIG_XENO_SYNCOBJ_STATS */
+
 static inline int syncobj_grant_wait_p(struct syncobj *sobj)
 {
 	__syncobj_check_locked(sobj);
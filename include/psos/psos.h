@@ -244,6 +244,21 @@ u_long q_vsend(u_long qid,
 	       void *msgbuf,
 	       u_long msglen);
 
+u_long q_vsend_batch(u_long qid,
+		     void *msgbuf,
+		     u_long msglen,
+		     u_long count,
+		     u_long *count_r);
+
+u_long q_vreceive_batch(u_long qid,
+			u_long flags,
+			u_long timeout,
+			void *msgbuf,
+			u_long msglen,
+			u_long count,
+			u_long *msglens,
+			u_long *count_r);
+
 u_long q_vurgent(u_long qid,
 		 void *msgbuf,
 		 u_long msglen);
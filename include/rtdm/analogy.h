@@ -83,6 +83,72 @@ typedef struct a4l_descriptor a4l_desc_t;
 
 /*! @} descriptor_sys */
 
+/*!
+  @addtogroup analogy_lib_stream
+  @{
+ */
+
+/**
+ * Maximum count of consumers sharing a stream
+ */
+#define A4L_STREAM_MAX_CONSUMERS 8
+
+/*!
+ * @brief Structure describing a zero-copy acquisition stream
+ * @see a4l_stream_open()
+ */
+
+struct a4l_stream {
+	a4l_desc_t *dsc;
+		     /**< Device descriptor. */
+	unsigned int idx_subd;
+			   /**< Input subdevice index. */
+	void *map;
+		   /**< Mapped ring-buffer. */
+	unsigned long size;
+			/**< Ring-buffer size. */
+	unsigned long head;
+			/**< Amount of data acquired so far. */
+	unsigned long tail;
+			/**< Amount of data released to the driver. */
+	unsigned int nr_consumers;
+			       /**< Consumers count. */
+	unsigned long cursor[A4L_STREAM_MAX_CONSUMERS];
+						    /**< Consumer positions. */
+};
+typedef struct a4l_stream a4l_stream_t;
+
+/*!
+ * @brief View on the data pending in a stream for a consumer, which
+ * may wrap at the end of the ring-buffer
+ * @see a4l_stream_peek()
+ */
+
+struct a4l_stream_span {
+	void *ptr[2];
+		  /**< Start addresses of the contiguous areas. */
+	unsigned long len[2];
+			  /**< Byte counts of the contiguous areas. */
+};
+typedef struct a4l_stream_span a4l_stream_span_t;
+
+/*! @} analogy_lib_stream */
+
+/*!
+ * @anchor ANALOGY_CONVERT_xxx   @name ANALOGY_CONVERT_xxx
+ * @brief Implementations of the conversion routines
+ * @see a4l_set_convert_isa()
+ * @{
+ */
+
+#define A4L_CONVERT_BEST	-1
+#define A4L_CONVERT_SCALAR	0
+#define A4L_CONVERT_SSE2	1
+#define A4L_CONVERT_AVX2	2
+#define A4L_CONVERT_NEON	3
+
+	  /*! @} ANALOGY_CONVERT_xxx */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -166,6 +232,9 @@ int a4l_set_wakesize(a4l_desc_t *dsc, unsigned long size);
 
 int a4l_get_wakesize(a4l_desc_t *dsc, unsigned long *size);
 
+int a4l_set_watermark(a4l_desc_t *dsc,
+		      unsigned long size, unsigned long us_timeout);
+
 int a4l_mark_bufrw(a4l_desc_t *dsc,
 		   unsigned int idx_subd,
 		   unsigned long cur, unsigned long *newp);
@@ -182,6 +251,19 @@ int a4l_async_read(a4l_desc_t *dsc,
 int a4l_async_write(a4l_desc_t *dsc,
 		    void *buf, size_t nbyte, unsigned long ms_timeout);
 
+int a4l_stream_open(a4l_desc_t *dsc, unsigned int idx_subd,
+		    unsigned int nr_consumers, a4l_stream_t *stm);
+
+int a4l_stream_close(a4l_stream_t *stm);
+
+int a4l_stream_wait(a4l_stream_t *stm, unsigned long ms_timeout);
+
+int a4l_stream_peek(a4l_stream_t *stm,
+		    unsigned int consumer, a4l_stream_span_t *span);
+
+int a4l_stream_consume(a4l_stream_t *stm,
+		       unsigned int consumer, unsigned long count);
+
 int a4l_snd_insnlist(a4l_desc_t *dsc, a4l_insnlst_t *arg);
 
 int a4l_snd_insn(a4l_desc_t *dsc, a4l_insn_t *arg);
@@ -230,6 +312,10 @@ int a4l_ftoraw(a4l_chinfo_t *chan,
 int a4l_dtoraw(a4l_chinfo_t *chan,
 	       a4l_rnginfo_t *rng, void *dst, double *src, int cnt);
 
+int a4l_set_convert_isa(int isa);
+
+int a4l_get_convert_isa(void);
+
 int a4l_read_calibration_file(char *name, struct a4l_calibration_data *data);
 
 int a4l_get_softcal_converter(struct a4l_polynomial *converter,
@@ -118,6 +118,7 @@
  *   - Option @ref CAN_RAW_FILTER : CAN filter list
  *   - Option @ref CAN_RAW_ERR_FILTER : CAN error mask
  *   - Option @ref CAN_RAW_LOOPBACK : CAN TX loopback to local sockets
+ *   - Option @ref CAN_RAW_TX_PRIORITY : Priority of the frames sent
  *   .
  * .
  * @n
@@ -180,9 +181,20 @@
  * @n
  * @anchor Send
  * <b>Send, Sendto, Sendmsg</b> @n
- * These functions send out CAN messages. Only one message per call can
- * be transmitted, so only one buffer with the correct length must be passed.
- * For @c SOCK_RAW, this is the size of struct can_frame. @n
+ * These functions send out CAN messages. Only one buffer must be
+ * passed. For @c SOCK_RAW, it contains from one up to @ref
+ * RTCAN_TX_BATCH_MAX struct can_frame, which are all sent with a
+ * single call. @n
+ * @n
+ * Frames waiting for a transmit slot of the controller are queued by
+ * priority, see @ref CAN_RAW_TX_PRIORITY. A frame may be handed to
+ * the controller by any task sending through the same interface. @n
+ * @n
+ * If @ref CAN_RAW_TX_TIMESTAMP is enabled on the socket, @c
+ * msg_control of <TT>struct msghdr</TT> must point to a buffer of one
+ * @ref nanosecs_abs_t per frame, which receives the time each frame
+ * was handed to the controller, or zero for frames not sent.
+ * Otherwise, @c msg_control is ignored. @n
  * @n
  * The following only applies to @c SOCK_RAW: If a socket address of
  * struct sockaddr_can is given, only @c can_ifindex is used. It is also
@@ -202,13 +214,18 @@
  * @n
  * Specific return values:
  * - Non-negative value equal to given buffer size (Indicating the
- *   successful completion of the function call. See also note.)
+ *   successful completion of the function call. See also note.) If
+ *   some frames of a batch could not be sent, the size of those which
+ *   were is returned.
  * - -EOPNOTSUPP (MSG_OOB flag is not supported.)
  * - -EINVAL (Unsupported flag detected @e or: Invalid length of socket
  *            address @e or: Invalid address family @e or: Data length code
  *            of CAN frame not between 0 and 15 @e or: CAN standard frame has
- *            got an ID not between 0 and 2031)
+ *            got an ID not between 0 and 2031 @e or: Timestamp buffer
+ *            missing or too small while @ref CAN_RAW_TX_TIMESTAMP is
+ *            enabled)
  * - -EMSGSIZE (Zero or more than one buffer passed or invalid size of buffer)
+ * - -ENOMEM (Not enough memory to queue a batch of frames)
  * - -EFAULT (It was not possible to access user space memory area at one
  *            of the specified addresses.)
  * - -ENXIO (Invalid CAN interface index - @c 0 is not allowed here - or
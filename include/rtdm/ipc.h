@@ -20,7 +20,89 @@
 #ifndef _RTDM_IPC_H
 #define _RTDM_IPC_H
 
+#include <sys/uio.h>
+#include <boilerplate/atomic.h>
 #include <rtdm/rtdm.h>
 #include <rtdm/uapi/ipc.h>
 
+/*
+ * Vectored access to a mapped BUFP ring (see BUFP_MAPPED). The
+ * readable or writable area is described by up to two I/O vectors,
+ * the second one covering the part which wraps around the end of the
+ * data area. Each side only moves its own index; the commit helpers
+ * return non-zero when the other side sleeps, in which case
+ * BUFP_RTIOC_NOTIFY should be issued to wake it up.
+ */
+
+static inline size_t __bufp_ring_vec(volatile struct bufp_ring_hdr *hdr,
+				     uint32_t off, size_t len,
+				     struct iovec iov[2])
+{
+	char *data = (char *)hdr + hdr->data_off;
+	size_t n;
+
+	off &= hdr->size - 1;
+	n = hdr->size - off;
+	if (n > len)
+		n = len;
+
+	iov[0].iov_base = data + off;
+	iov[0].iov_len = n;
+	iov[1].iov_base = data;
+	iov[1].iov_len = len - n;
+
+	return len;
+}
+
+static inline size_t bufp_ring_readv(volatile struct bufp_ring_hdr *hdr,
+				     struct iovec iov[2])
+{
+	uint32_t tail = hdr->tail, len = hdr->head - tail;
+
+	if (len > hdr->size)
+		len = hdr->size;
+
+	/* Read the data only after the index which published it. */
+	smp_rmb();
+
+	return __bufp_ring_vec(hdr, tail, len, iov);
+}
+
+static inline int bufp_ring_consume(volatile struct bufp_ring_hdr *hdr,
+				    size_t len)
+{
+	/* Done with the data before the space is handed back. */
+	smp_mb();
+	hdr->tail += len;
+	/* Publish the index before looking for a sleeping producer. */
+	smp_mb();
+
+	return hdr->waiters & BUFP_RING_WRWAIT;
+}
+
+static inline size_t bufp_ring_writev(volatile struct bufp_ring_hdr *hdr,
+				      struct iovec iov[2])
+{
+	uint32_t head = hdr->head, fill = head - hdr->tail, len;
+
+	len = fill > hdr->size ? 0 : hdr->size - fill;
+
+	/* Do not overwrite the space before it was released. */
+	smp_mb();
+
+	return __bufp_ring_vec(hdr, head, len, iov);
+}
+
+static inline int bufp_ring_produce(volatile struct bufp_ring_hdr *hdr,
+				    size_t len)
+{
+	/* Publish the data before the index. */
+	smp_wmb();
+	hdr->head += len;
+	/* Publish the index before looking for a sleeping consumer. */
+	smp_mb();
+
+	return hdr->waiters & BUFP_RING_RDWAIT;
+}
+
 #endif /* !_RTDM_IPC_H */
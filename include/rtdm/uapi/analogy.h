@@ -71,7 +71,8 @@ typedef struct a4l_buffer_info a4l_bufinfo_t;
 /* BUFCFG2 / BUFINFO2 ioctl argument structure */
 struct a4l_buffer_config2 {
 	unsigned long wake_count;
-	unsigned long reserved[3];
+	unsigned long wake_timeout;	/* in us, 0 means none */
+	unsigned long reserved[2];
 };
 typedef struct a4l_buffer_config2 a4l_bufcfg2_t;
 
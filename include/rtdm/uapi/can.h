@@ -344,6 +344,50 @@ struct can_ifreq {
 	} ifr_ifru;
 };
 
+/**
+ * Control block of a socket receive ring
+ *
+ * The control block is located at the start of the memory mapped
+ * from a socket after a ring was set up with @ref
+ * RTCAN_RTIOC_RING_SETUP. Indices are free-running and must be
+ * masked with @a nr_slots - 1 to obtain a slot number.
+ */
+struct can_ring_hdr {
+	/** Index of the next slot to be filled, updated by the driver */
+	uint32_t head;
+
+	/** Number of slots in the ring, a power of two */
+	uint32_t nr_slots;
+
+	/** Offset of the first slot from the start of the mapping */
+	uint32_t slot_off;
+
+	/** Size of the mapping */
+	uint32_t map_size;
+
+	/** Number of frames dropped because the ring was full */
+	uint32_t overruns;
+
+	/** Index of the next slot to be read, updated by the application */
+	uint32_t tail __attribute__ ((aligned(64)));
+};
+
+/**
+ * Receive ring slot
+ */
+struct can_ring_slot {
+	/** Received frame */
+	can_frame_t frame;
+
+	/** Reception timestamp */
+	nanosecs_abs_t timestamp;
+
+	/** Interface index the frame was received from */
+	int ifindex;
+
+	uint32_t reserved;
+};
+
 /*!
  * @anchor RTCAN_TIMESTAMPS   @name Timestamp switches
  * Arguments to pass to @ref RTCAN_RTIOC_TAKE_TIMESTAMP
@@ -352,6 +396,9 @@ struct can_ifreq {
 #define RTCAN_TAKE_TIMESTAMPS		1  /**< Do take timestamps */
 /** @} */
 
+/** Maximum number of frames passed to a single @ref Send "send" call */
+#define RTCAN_TX_BATCH_MAX		64
+
 #define RTIOC_TYPE_CAN  RTDM_CLASS_CAN
 
 /*!
@@ -452,6 +499,63 @@ struct can_ifreq {
  */
 #define CAN_RAW_LOOPBACK	0x3
 
+/**
+ * CAN TX priority
+ *
+ * Frames waiting for a transmit slot of a CAN controller are queued
+ * in priority order. Frames sent through a socket with a higher TX
+ * priority go first, frames of equal priority are ordered as the bus
+ * arbitration would do, i.e. by increasing CAN ID. The TX priority
+ * of a newly created socket is 0.
+ *
+ * @n
+ * @param [in] level @b SOL_CAN_RAW
+ *
+ * @param [in] optname @b CAN_RAW_TX_PRIORITY
+ *
+ * @param [in] optval Pointer to integer value, from 0 to
+ *                    @ref CAN_RAW_TX_PRIO_MAX.
+ *
+ * @param [in] optlen Size of int: sizeof(int).
+ *
+ * @coretags{task-unrestricted}
+ * @n
+ * Specific return values:
+ * - -EFAULT (It was not possible to access user space memory area at the
+ *            specified address.)
+ * - -EINVAL (Invalid length "optlen" or priority value)
+ */
+#define CAN_RAW_TX_PRIORITY	0x5
+
+/** Highest TX priority, see @ref CAN_RAW_TX_PRIORITY */
+#define CAN_RAW_TX_PRIO_MAX	7
+
+/**
+ * CAN TX timestamps
+ *
+ * When enabled, the @c msg_control buffer passed to @ref Send
+ * "sendmsg" receives the time each frame of the batch was handed to
+ * the controller. Otherwise, which is the default for a newly created
+ * socket, @c msg_control is ignored on send.
+ *
+ * @n
+ * @param [in] level @b SOL_CAN_RAW
+ *
+ * @param [in] optname @b CAN_RAW_TX_TIMESTAMP
+ *
+ * @param [in] optval Pointer to integer value, non-zero to enable.
+ *
+ * @param [in] optlen Size of int: sizeof(int).
+ *
+ * @coretags{task-unrestricted}
+ * @n
+ * Specific return values:
+ * - -EFAULT (It was not possible to access user space memory area at the
+ *            specified address.)
+ * - -EINVAL (Invalid length "optlen")
+ */
+#define CAN_RAW_TX_TIMESTAMP	0x6
+
 /**
  * CAN receive own messages
  *
@@ -760,6 +864,57 @@ struct can_ifreq {
  * @coretags{task-unrestricted}
  */
 #define RTCAN_RTIOC_SND_TIMEOUT	_IOW(RTIOC_TYPE_CAN, 0x0B, nanosecs_rel_t)
+
+/**
+ * Set up a receive ring shared with the application
+ *
+ * Once the ring is set up, frames accepted by the socket are stored
+ * into the ring instead of the socket buffer, and the application
+ * reads them from the memory mapped from the socket descriptor with
+ * @c mmap(), without issuing a system call per frame. The mapping
+ * starts with a struct can_ring_hdr control block followed by the
+ * array of struct can_ring_slot entries. The application consumes the
+ * slots between the @a tail and @a head indices, then advances @a
+ * tail. Timestamps are always stored into the slots.
+ *
+ * A ring can be set up only once during the lifetime of a socket.
+ *
+ * @param [in] arg Number of slots (a power of two, from 16 to 65536),
+ *                passed by value.
+ *
+ * @return 0 on success, otherwise:
+ * - -EINVAL: Invalid number of slots.
+ * - -EBUSY: A ring was already set up.
+ * - -ENOMEM: Not enough memory to allocate the ring.
+ *
+ * @coretags{secondary-only}
+ */
+#define RTCAN_RTIOC_RING_SETUP	_IOW(RTIOC_TYPE_CAN, 0x0C, unsigned int)
+
+/**
+ * Wait for frames in the receive ring
+ *
+ * Blocks the caller until the receive ring holds at least the given
+ * number of frames, or the reception timeout expires (see @ref
+ * RTCAN_RTIOC_RCV_TIMEOUT). The caller is woken up once, when the
+ * fill level reaches the requested count, so that a batch of frames
+ * costs a single wakeup.
+ *
+ * @param [in] arg Number of frames to wait for, passed by value.
+ *
+ * @return Number of frames available in the ring on success,
+ * otherwise:
+ * - -ENXIO: No ring was set up.
+ * - -EINVAL: The count is zero or exceeds the ring size.
+ * - -ETIMEDOUT: The timeout expired.
+ * - -EAGAIN: The timeout is @ref RTDM_TIMEOUT_NONE and not enough
+ *            frames are available.
+ * - -EBADF: The socket was closed.
+ * - -EINTR: The wait was interrupted.
+ *
+ * @coretags{primary-only}
+ */
+#define RTCAN_RTIOC_RING_WAIT	_IOW(RTIOC_TYPE_CAN, 0x0D, unsigned int)
 /** @} */
 
 #define CAN_ERR_DLC  8	/* dlc for error frames */
@@ -18,10 +18,46 @@
 #ifndef _RTDM_UAPI_GPIO_H
 #define _RTDM_UAPI_GPIO_H
 
+#include <linux/types.h>
+
+/*
+ * Timestamped edge event, as queued by the interrupt handler of a
+ * GPIO pin working in event queue mode.
+ */
+struct rtdm_gpio_event {
+	/* Monotonic date of the interrupt (ns). */
+	nanosecs_abs_t timestamp;
+	/* Per-pin interrupt count, including dropped events. */
+	__u32 sequence;
+	/* Pin level sampled by the interrupt handler. */
+	__s32 value;
+};
+
+/*
+ * Header of the event queue, followed by the ring of events in the
+ * memory area returned by mmap(2). The producer (interrupt handler)
+ * advances @head, the consumer advances @tail. Both are free-running
+ * counters, the ring index is obtained by masking them with
+ * (nr_events - 1).
+ */
+struct rtdm_gpio_evq_header {
+	__u32 head;
+	__u32 tail;
+	/* Events dropped due to the ring being full. */
+	__u32 overflows;
+	/* Ring size, always a power of two. */
+	__u32 nr_events;
+};
+
+#define rtdm_gpio_evq_ring(__hdr)				\
+	((struct rtdm_gpio_event *)((struct rtdm_gpio_evq_header *)(__hdr) + 1))
+
 #define GPIO_RTIOC_DIR_OUT		_IOW(RTDM_CLASS_GPIO, 0, int)
 #define GPIO_RTIOC_DIR_IN		_IO(RTDM_CLASS_GPIO, 1)
 #define GPIO_RTIOC_IRQEN		_IOW(RTDM_CLASS_GPIO, 2, int) /* GPIO trigger */
 #define GPIO_RTIOC_IRQDIS		_IO(RTDM_CLASS_GPIO, 3)
+#define GPIO_RTIOC_EVQ_SETUP		_IOW(RTDM_CLASS_GPIO, 4, int) /* ring size */
+#define GPIO_RTIOC_EVQ_STAT		_IOR(RTDM_CLASS_GPIO, 5, struct rtdm_gpio_evq_header)
 
 #define GPIO_TRIGGER_NONE		0x0 /* unspecified */
 #define GPIO_TRIGGER_EDGE_RISING	0x1
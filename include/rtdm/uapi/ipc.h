@@ -484,6 +484,8 @@ struct sockaddr_ipc {
 	rtipc_port_t sipc_port;
 };
 
+#define RTIOC_TYPE_RTIPC	RTDM_CLASS_RTIPC
+
 #define SOL_XDDP		311
 /**
  * @anchor sockopts_xddp @name XDDP socket options
@@ -765,6 +767,89 @@ struct sockaddr_ipc {
  * RT/non-RT
  */
 #define IDDP_POOLSZ		2
+/**
+ * IDDP message slab configuration
+ *
+ * A socket may receive datagrams into a cache of fixed-size message
+ * slots reserved at binding time, so that neither the sender nor the
+ * receiver has to go through a general purpose allocator in the fast
+ * path. Datagrams larger than the slot size, or received while all
+ * slots are busy, are still obtained from the socket pool (see @ref
+ * IDDP_POOLSZ), or from the system heap.
+ *
+ * It is not allowed to configure the slab after the socket was
+ * bound. However, multiple configuration calls are allowed prior to
+ * the binding; the last value set will be used.
+ *
+ * @param [in] level @ref sockopts_iddp "SOL_IDDP"
+ * @param [in] optname @b IDDP_SLAB
+ * @param [in] optval Pointer to a struct iddp_slab_config
+ * @param [in] optlen sizeof(struct iddp_slab_config)
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EFAULT (Invalid data address given)
+ * - -EALREADY (socket already bound)
+ * - -EINVAL (@a optlen is invalid, any field of *@a optval is zero
+ *   or exceeds the limits, or the slab would span more than 16 MiB)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define IDDP_SLAB		3
+/** @} */
+
+/**
+ * IDDP message slab configuration, see @ref IDDP_SLAB.
+ */
+struct iddp_slab_config {
+	/** Largest payload a slot may hold, up to 64 KiB. */
+	uint32_t msgsz;
+	/** Number of slots, up to 65536. */
+	uint32_t count;
+};
+
+/**
+ * @anchor iddp_batch @name IDDP batched I/O
+ * Sending and receiving multiple datagrams per call.
+ *
+ * These requests are the IDDP counterparts of sendmmsg(2) and
+ * recvmmsg(2). Each element of the @a msgvec array describes a
+ * datagram as with sendmsg(2) or recvmsg(2), scatter-gather vectors
+ * included, and receives the byte count transferred in its @a
+ * msg_len field. Only the first datagram of a receive batch may
+ * block, subsequent ones are picked only if readily available.
+ *
+ * The call returns the number of datagrams processed, or an error
+ * code if the very first one failed.
+ * @{ */
+/**
+ * Batched I/O request.
+ */
+struct iddp_mmsg_req {
+	/** Array of datagram descriptors. */
+	struct mmsghdr *msgvec;
+	/** Number of elements in @a msgvec, up to UIO_MAXIOV. */
+	unsigned int vlen;
+	/** MSG_* flags applying to every datagram. */
+	int flags;
+};
+
+/**
+ * Send a batch of datagrams.
+ *
+ * @par Calling context:
+ * RT (switches to primary mode)
+ */
+#define IDDP_RTIOC_SENDMMSG	_IOW(RTIOC_TYPE_RTIPC, 0x10, struct iddp_mmsg_req)
+/**
+ * Receive a batch of datagrams.
+ *
+ * @par Calling context:
+ * RT (switches to primary mode)
+ */
+#define IDDP_RTIOC_RECVMMSG	_IOW(RTIOC_TYPE_RTIPC, 0x11, struct iddp_mmsg_req)
 /** @} */
 
 #define SOL_BUFP		313
@@ -834,6 +919,132 @@ struct sockaddr_ipc {
  * RT/non-RT
  */
 #define BUFP_BUFSZ		2
+/**
+ * BUFP mapped mode
+ *
+ * Enabling this option before binding the socket makes the buffer
+ * space a ring which both endpoints may map in their address space
+ * via mmap(2), in order to exchange data by moving the ring indices
+ * directly (see struct bufp_ring_hdr), without issuing any system
+ * call except to block or to wake up the other side.
+ *
+ * In mapped mode, the buffer size set by @ref BUFP_BUFSZ is rounded
+ * up to the next power of two, at least one page. The regular
+ * sendmsg(), recvmsg(), read() and write() calls keep working on the
+ * ring, however direct accesses and system calls must not be mixed
+ * concurrently on the same side of the ring, which has a single
+ * producer and a single consumer.
+ *
+ * @param [in] level @ref sockopts_bufp "SOL_BUFP"
+ * @param [in] optname @b BUFP_MAPPED
+ * @param [in] optval Pointer to a variable of type int, non-zero
+ * enabling the mapped mode
+ * @param [in] optlen sizeof(int)
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EFAULT (Invalid data address given)
+ * - -EALREADY (socket already bound)
+ * - -EINVAL (@a optlen is invalid)
+ * .
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define BUFP_MAPPED		3
+/** @} */
+
+/**
+ * @anchor bufp_ring @name BUFP shared ring
+ * Direct access to the buffer of a BUFP socket in mapped mode.
+ *
+ * Calling mmap(2) with a zero offset on a BUFP socket bound in
+ * mapped mode (see @ref BUFP_MAPPED) maps its own ring, for
+ * consuming data. On any other BUFP socket connected to such
+ * endpoint, mmap(2) maps the ring of the peer, for producing
+ * data. The mapping starts with a struct bufp_ring_hdr, the data
+ * area follows at offset @a data_off.
+ *
+ * @a head and @a tail are free-running byte counters, the ring
+ * holds (head - tail) bytes starting at offset (tail & (size - 1))
+ * in the data area. The producer fills the ring then advances @a
+ * head, the consumer drains it then advances @a tail.
+ *
+ * Blocking is done via the @ref BUFP_RTIOC_WAIT_DATA and @ref
+ * BUFP_RTIOC_WAIT_SPACE requests. Before sleeping, the kernel raises
+ * a flag in @a waiters, after which the other side must issue @ref
+ * BUFP_RTIOC_NOTIFY once it has moved its index. select(2) does not
+ * notice direct index updates until such notification is issued.
+ * @{ */
+/**
+ * Header of a mapped BUFP ring.
+ */
+struct bufp_ring_hdr {
+	/** Producer index, in bytes. */
+	uint32_t head;
+	/** Size of the data area, a power of two. */
+	uint32_t size;
+	/** Offset of the data area from the start of the mapping. */
+	uint32_t data_off;
+	/** Size of the mapping. */
+	uint32_t map_size;
+	/** Sleeping sides, BUFP_RING_RDWAIT and/or BUFP_RING_WRWAIT. */
+	uint32_t waiters;
+	/** Consumer index, in bytes. */
+	uint32_t tail __attribute__((aligned(64)));
+};
+
+/** A consumer waits for data to be produced. */
+#define BUFP_RING_RDWAIT	0x1
+/** A producer waits for space to be released. */
+#define BUFP_RING_WRWAIT	0x2
+
+/**
+ * Wait for data in the mapped ring.
+ *
+ * @param [in] arg Minimum number of bytes to wait for, passed by
+ * value, between 1 and the ring size.
+ *
+ * @return The number of bytes readable from the ring upon success,
+ * otherwise:
+ *
+ * - -ENXIO (no ring is attached to the socket)
+ * - -EINVAL (invalid byte count)
+ * - -ETIMEDOUT (timeout set by SO_RCVTIMEO elapsed)
+ * - -EWOULDBLOCK (SO_RCVTIMEO is RTDM_TIMEOUT_NONE and no data)
+ * - -EINTR (unblocked by a signal)
+ * - -EIDRM (socket closed)
+ * .
+ *
+ * @par Calling context:
+ * RT (switches to primary mode)
+ */
+#define BUFP_RTIOC_WAIT_DATA	_IOW(RTIOC_TYPE_RTIPC, 0x00, unsigned int)
+/**
+ * Wait for free space in the mapped ring.
+ *
+ * @param [in] arg Minimum number of bytes to wait for, passed by
+ * value, between 1 and the ring size.
+ *
+ * @return The number of bytes writable to the ring upon success,
+ * otherwise the same error codes as @ref BUFP_RTIOC_WAIT_DATA, the
+ * timeout being set by SO_SNDTIMEO.
+ *
+ * @par Calling context:
+ * RT (switches to primary mode)
+ */
+#define BUFP_RTIOC_WAIT_SPACE	_IOW(RTIOC_TYPE_RTIPC, 0x01, unsigned int)
+/**
+ * Wake up the threads sleeping on the mapped ring and clear the @a
+ * waiters flags, after the ring indices were moved directly.
+ *
+ * @return 0 is returned upon success, otherwise -ENXIO if no ring is
+ * attached to the socket.
+ *
+ * @par Calling context:
+ * RT/non-RT
+ */
+#define BUFP_RTIOC_NOTIFY	_IO(RTIOC_TYPE_RTIPC, 0x02)
 /** @} */
 
 /**
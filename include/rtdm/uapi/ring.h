@@ -0,0 +1,118 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef _RTDM_UAPI_RING_H
+#define _RTDM_UAPI_RING_H
+
+#include <linux/types.h>
+
+/*
+ * Asynchronous I/O rings for RTDM file descriptors.
+ *
+ * A ring is obtained by opening /dev/rtdm/ring, sizing it with
+ * RTDM_RING_RTIOC_SETUP, then mapping it with mmap(2). The mapping
+ * starts with struct rtdm_ring_header, followed by the submission
+ * queue (SQ), the completion queue (CQ) and an optional buffer area,
+ * at the offsets given by the header.
+ *
+ * The application fills SQ entries then advances @sq_tail; a call to
+ * RTDM_RING_RTIOC_ENTER hands them over to the RTDM core, which
+ * advances @sq_head. Completions are posted to the CQ by the core
+ * (or by the driver directly, from any context), which advances
+ * @cq_tail; the application advances @cq_head after consuming
+ * them. All indexes are free-running counters, the slot is obtained
+ * by masking them with (entries - 1).
+ */
+
+#define RTDM_RING_OP_NOP	0
+#define RTDM_RING_OP_READ	1
+#define RTDM_RING_OP_WRITE	2
+#define RTDM_RING_OP_IOCTL	3
+#define RTDM_RING_OP_RECVMSG	4
+#define RTDM_RING_OP_SENDMSG	5
+
+/* @addr is an offset into the buffer area of the ring. */
+#define RTDM_RING_F_FIXED	0x1
+
+struct rtdm_ring_sqe {
+	__u8 opcode;
+	__u8 flags;
+	__u16 __pad;
+	__s32 fd;
+	/* Buffer, struct msghdr or ioctl argument. */
+	__u64 addr;
+	__u32 len;
+	/* MSG_* flags for RECVMSG/SENDMSG, request code for IOCTL. */
+	__u32 op_flags;
+	/* Passed back unmodified in the completion entry. */
+	__u64 user_data;
+};
+
+struct rtdm_ring_cqe {
+	__u64 user_data;
+	/* Return value of the operation, negated errno on failure. */
+	__s32 res;
+	__u32 flags;
+};
+
+struct rtdm_ring_header {
+	__u32 sq_head;
+	__u32 sq_tail;
+	__u32 sq_entries;
+	__u32 sq_off;
+	__u32 cq_head;
+	__u32 cq_tail;
+	__u32 cq_entries;
+	__u32 cq_off;
+	/* Completions dropped due to the CQ being full. */
+	__u32 cq_overflow;
+	__u32 buf_off;
+	__u32 buf_size;
+	__u32 map_size;
+};
+
+#define rtdm_ring_sq(__hdr)						\
+	((struct rtdm_ring_sqe *)((char *)(__hdr) + (__hdr)->sq_off))
+#define rtdm_ring_cq(__hdr)						\
+	((struct rtdm_ring_cqe *)((char *)(__hdr) + (__hdr)->cq_off))
+#define rtdm_ring_buf(__hdr)						\
+	((void *)((char *)(__hdr) + (__hdr)->buf_off))
+
+struct rtdm_ring_params {
+	/* Power of two. */
+	__u32 sq_entries;
+	/* Power of two, at least sq_entries. Zero means 2 * sq_entries. */
+	__u32 cq_entries;
+	/* Size of the buffer area for RTDM_RING_F_FIXED requests. */
+	__u32 buf_size;
+	/* On return, length of the memory area to map. */
+	__u32 map_size;
+};
+
+struct rtdm_ring_enter {
+	/* Number of SQ entries to submit. */
+	__u32 to_submit;
+	/* Wait until that many entries are available from the CQ. */
+	__u32 min_complete;
+	/* Wait timeout (ns), 0 = infinite, negative = no wait. */
+	__s64 timeout;
+};
+
+#define RTDM_SUBCLASS_RING		0
+
+#define RTDM_RING_RTIOC_SETUP		_IOWR(RTDM_CLASS_COBALT, 0, struct rtdm_ring_params)
+#define RTDM_RING_RTIOC_ENTER		_IOW(RTDM_CLASS_COBALT, 1, struct rtdm_ring_enter)
+
+#endif /* !_RTDM_UAPI_RING_H */
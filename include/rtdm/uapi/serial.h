@@ -90,6 +90,9 @@
 #define RTSER_FIFO_DEPTH_4		0x40
 #define RTSER_FIFO_DEPTH_8		0x80
 #define RTSER_FIFO_DEPTH_14		0xC0
+/** let the driver adapt the threshold to the traffic, starting from the
+ *  depth it is or-ed with */
+#define RTSER_FIFO_DEPTH_ADAPTIVE	0x100
 #define RTSER_DEF_FIFO_DEPTH		RTSER_FIFO_DEPTH_1
 /** @} */
 
@@ -270,6 +273,48 @@ typedef struct rtser_event {
 	nanosecs_abs_t	rxpend_timestamp;
 } rtser_event_t;
 
+/**
+ * Receive buffer chunk, see @ref RTSER_RTIOC_READ_CHUNKS
+ */
+typedef struct rtser_chunk {
+	/** reception timestamp of the characters in this chunk */
+	nanosecs_abs_t	timestamp;
+
+	/** number of characters in this chunk */
+	int		length;
+
+	int		reserved;
+} rtser_chunk_t;
+
+/**
+ * Bulk read request, see @ref RTSER_RTIOC_READ_CHUNKS
+ */
+typedef struct rtser_read_chunks {
+	/** destination buffer for the received characters */
+	void		*buf;
+
+	/** size of the destination buffer */
+	size_t		size;
+
+	/** array receiving the chunk descriptors */
+	struct rtser_chunk *chunks;
+
+	/** [in] number of entries in @a chunks, [out] number of entries
+	 *  filled */
+	int		nr_chunks;
+} rtser_read_chunks_t;
+
+/**
+ * Buffer sizes, see @ref RTSER_RTIOC_SET_BUFFERS
+ */
+typedef struct rtser_buffers {
+	/** size of the reception buffer, power of two, 0 to keep it */
+	int		rx_size;
+
+	/** size of the transmission buffer, power of two, 0 to keep it */
+	int		tx_size;
+} rtser_buffers_t;
+
 
 #define RTIOC_TYPE_SERIAL		RTDM_CLASS_SERIAL
 
@@ -310,6 +355,9 @@ typedef struct rtser_event {
  * - -ENOMEM is returned if a new history buffer for timestamps cannot be
  * allocated.
  *
+ * - -EBUSY is returned if the RX buffer was resized while the history
+ * buffer for timestamps was set up.
+ *
  * @coretags{task-unrestricted}
  *
  * @note If rtser_config contains a valid timestamp_history and the
@@ -396,6 +444,57 @@ typedef struct rtser_event {
  */
 #define RTSER_RTIOC_BREAK_CTL	\
 	_IOR(RTIOC_TYPE_SERIAL, 0x06, int)
+
+/**
+ * Read received characters along with their reception timestamps
+ *
+ * Characters received by the same interrupt are reported as a single
+ * chunk sharing one timestamp, so that a burst of input can be read
+ * with one call while preserving the timing of each part of it. The
+ * call waits for at least one character according to the reception
+ * timeout, then returns what is available, up to the size of the
+ * buffer or the number of chunk descriptors, whichever is reached
+ * first.
+ *
+ * @param[in,out] arg Pointer to a request (struct rtser_read_chunks)
+ *
+ * @return Number of characters read on success, otherwise:
+ *
+ * - -EINVAL is returned if the timestamp history is disabled, see
+ * @ref RTSER_RX_TIMESTAMP_HISTORY.
+ *
+ * - -EBUSY is returned if another task is already reading from the
+ * device.
+ *
+ * - -EAGAIN, -ETIMEDOUT, -EIO, -EPIPE or -EBADF are returned under the
+ * same conditions as for read().
+ *
+ * @coretags{primary-only}
+ */
+#define RTSER_RTIOC_READ_CHUNKS	\
+	_IOWR(RTIOC_TYPE_SERIAL, 0x07, struct rtser_read_chunks)
+
+/**
+ * Resize the reception and transmission buffers
+ *
+ * Pending characters are discarded from the resized buffers.
+ *
+ * @param[in] arg Pointer to the new sizes (struct rtser_buffers)
+ *
+ * @return 0 on success, otherwise:
+ *
+ * - -EINVAL is returned if a size is not a power of two, or out of the
+ * range supported by the driver.
+ *
+ * - -EBUSY is returned if a read or write operation is in progress, or
+ * if the timestamp history was switched on meanwhile.
+ *
+ * - -ENOMEM is returned if the new buffers cannot be allocated.
+ *
+ * @coretags{secondary-only}
+ */
+#define RTSER_RTIOC_SET_BUFFERS	\
+	_IOW(RTIOC_TYPE_SERIAL, 0x08, struct rtser_buffers)
 /** @} */
 
 /*!
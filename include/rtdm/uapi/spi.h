@@ -33,9 +33,42 @@ struct rtdm_spi_iobufs {
 	__u32 map_len;
 };
 
+/*
+ * Transfer descriptor for batched submission. @tx_buf and @rx_buf
+ * are user addresses, either may be zero: a zero @tx_buf clocks out
+ * null bytes, a zero @rx_buf discards the input. @fd designates the
+ * target slave, which must hang on the same master than the
+ * submitting file; -1 means the submitter itself.
+ */
+struct rtdm_spi_xfer {
+	__u64 tx_buf;
+	__u64 rx_buf;
+	__u32 len;
+	__s32 fd;
+	__u16 delay_us;	/* Pause after this transfer */
+	__u16 flags;
+	__s32 status;	/* Set on completion */
+};
+
+/* Keep CS asserted if the next transfer targets the same slave. */
+#define SPI_XFER_CS_KEEP	0x1
+
+struct rtdm_spi_batch {
+	__u64 xfers;	/* struct rtdm_spi_xfer[nr_xfers] */
+	__u32 nr_xfers;
+	__u32 seq;	/* Set by SPI_RTIOC_SUBMIT and SPI_RTIOC_COMPLETE */
+};
+
+#define SPI_BATCH_MAX_XFERS	64
+#define SPI_BATCH_MAX_DATA	65536
+/* Batches queued or awaiting collection, per file. */
+#define SPI_BATCH_MAX_QUEUED	8
+
 #define SPI_RTIOC_SET_CONFIG		_IOW(RTDM_CLASS_SPI, 0, struct rtdm_spi_config)
 #define SPI_RTIOC_GET_CONFIG		_IOR(RTDM_CLASS_SPI, 1, struct rtdm_spi_config)
 #define SPI_RTIOC_SET_IOBUFS		_IOR(RTDM_CLASS_SPI, 2, struct rtdm_spi_iobufs)
 #define SPI_RTIOC_TRANSFER		_IO(RTDM_CLASS_SPI, 3)
+#define SPI_RTIOC_SUBMIT		_IOWR(RTDM_CLASS_SPI, 4, struct rtdm_spi_batch)
+#define SPI_RTIOC_COMPLETE		_IOWR(RTDM_CLASS_SPI, 5, struct rtdm_spi_batch)
 
 #endif /* !_RTDM_UAPI_SPI_H */
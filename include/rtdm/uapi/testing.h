@@ -25,7 +25,7 @@
 
 #include <linux/types.h>
 
-#define RTTST_PROFILE_VER		2
+#define RTTST_PROFILE_VER		3
 
 typedef struct rttst_bench_res {
 	__s32 avg;
@@ -40,13 +40,77 @@ typedef struct rttst_interm_bench_res {
 	struct rttst_bench_res overall;
 } rttst_interm_bench_res_t;
 
+/*
+ * Timing breakdown of a sample, all dates are relative to the
+ * expected release date (ns). Stages which could not be observed
+ * read as RTTST_BENCH_NOSTAMP.
+ */
+typedef struct rttst_bench_sample {
+	/* Expected release date (monotonic ns). */
+	__u64 date;
+	/* Sampled latency. */
+	__s32 latency;
+	/* Entry of the core clock interrupt. */
+	__s32 irq;
+	/* Return from xnclock_tick(). */
+	__s32 tick;
+	/* Entry of the rescheduling procedure. */
+	__s32 sched;
+	/* Context switch to the sampling task. */
+	__s32 switched;
+	__s32 __pad;
+} rttst_bench_sample_t;
+
+#define RTTST_BENCH_NOSTAMP		(-2147483647 - 1)
+#define RTTST_BENCH_MAX_WORST		64
+
 typedef struct rttst_overall_bench_res {
 	struct rttst_bench_res result;
 	__s32 *histogram_avg;
 	__s32 *histogram_min;
 	__s32 *histogram_max;
+	/* RTTST_HDR_CELLS, if histogram_size was set. */
+	__s32 *histogram_hdr;
+	/* worst_count samples, by decreasing latency. */
+	struct rttst_bench_sample *worst;
+	int nr_worst;
 } rttst_overall_bench_res_t;
 
+/*
+ * Log-linear histogram of absolute latencies in nanoseconds,
+ * covering the whole 32bit range: values below 2^(SUBBITS + 1) have
+ * their own cell, then each power of two is split in 2^SUBBITS
+ * cells, i.e. the relative resolution is 1/16.
+ */
+#define RTTST_HDR_SUBBITS		4
+#define RTTST_HDR_CELLS			\
+	((32 - RTTST_HDR_SUBBITS + 1) << RTTST_HDR_SUBBITS)
+
+static inline unsigned int rttst_hdr_index(__u32 value)
+{
+	unsigned int shift;
+
+	if (value < (2U << RTTST_HDR_SUBBITS))
+		return value;
+
+	shift = 31 - __builtin_clz(value) - RTTST_HDR_SUBBITS;
+
+	return (shift << RTTST_HDR_SUBBITS) + (value >> shift);
+}
+
+/* Lowest value counted in a cell. */
+static inline __u64 rttst_hdr_value(unsigned int index)
+{
+	unsigned int shift;
+
+	if (index < (2U << RTTST_HDR_SUBBITS))
+		return index;
+
+	shift = (index >> RTTST_HDR_SUBBITS) - 1;
+
+	return (__u64)(index - (shift << RTTST_HDR_SUBBITS)) << shift;
+}
+
 #define RTTST_TMBENCH_INVALID		-1 /* internal use only */
 #define RTTST_TMBENCH_TASK		0
 #define RTTST_TMBENCH_HANDLER		1
@@ -59,6 +123,8 @@ typedef struct rttst_tmbench_config {
 	int histogram_size;
 	int histogram_bucketsize;
 	int freeze_max;
+	/* Number of worst samples to keep a breakdown of. */
+	int worst_count;
 } rttst_tmbench_config_t;
 
 struct rttst_swtest_task {
@@ -81,6 +147,20 @@ struct rttst_swtest_error {
 	unsigned int fp_val;
 };
 
+struct rttst_rtdm_irq_thread {
+	/* Input */
+	__u32 batch;		/* Events per run of the threaded handler */
+	__u32 nevents;		/* Events to raise */
+	__u64 delay;		/* Coalescing delay (ns) */
+	/* Output */
+	__u32 nhandled;		/* Events seen by the primary handler */
+	__u32 nruns_batch;	/* Runs once all events were raised */
+	__u32 nruns_delay;	/* Runs once the delay has elapsed */
+	__u32 nruns_free;	/* Runs once the IRQ was released */
+	__u32 nruns_late;	/* Runs a delay after the IRQ was released */
+	__u32 __pad;
+};
+
 #define RTTST_RTDM_NORMAL_CLOSE		0
 #define RTTST_RTDM_DEFER_CLOSE_CONTEXT	1
 
@@ -153,6 +233,9 @@ struct rttst_swtest_error {
   
 #define RTTST_RTIOC_RTDM_PING_SECONDARY \
 	_IOR(RTIOC_TYPE_TESTING, 0x43, __u32)
+
+#define RTTST_RTIOC_RTDM_IRQ_THREAD \
+	_IOWR(RTIOC_TYPE_TESTING, 0x44, struct rttst_rtdm_irq_thread)
   
 /** @} */
 
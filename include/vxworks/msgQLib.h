@@ -49,6 +49,12 @@ int msgQReceive(MSG_Q_ID msgQId, char *buf, UINT bytes, int timeout);
 STATUS msgQSend(MSG_Q_ID msgQId, const char *buf, UINT bytes,
 		int timeout, int prio);
 
+int msgQReceiveN(MSG_Q_ID msgQId, char *buf, UINT bytes,
+		 UINT *sizes, int nMsgs, int timeout);
+
+int msgQSendN(MSG_Q_ID msgQId, const char *buf, UINT bytes,
+	      int nMsgs, int timeout, int prio);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,7 @@
 #include <cobalt/kernel/arith.h>
 #include <cobalt/kernel/vdso.h>
 #include <cobalt/uapi/time.h>
+#include <cobalt/uapi/kernel/vfile.h>
 #include <asm/xenomai/calibration.h>
 #include <trace/events/cobalt-core.h>
 /**
@@ -449,10 +450,31 @@ static int timerlist_show(struct xnvfile_snapshot_iterator *it, void *data)
 	return 0;
 }
 
+static int timerlist_encode(struct xnvfile_snapshot_iterator *it,
+			    void *data, void *rec)
+{
+	struct cobalt_vfile_timer *t = rec;
+	struct vfile_clock_data *p = data;
+
+	/*
+	 * The remaining time to the next shot changes on every read,
+	 * so it is not part of the binary record.
+	 */
+	t->interval = p->interval;
+	t->cpu = p->cpu;
+	t->scheduled = p->scheduled;
+	t->fired = p->fired;
+	t->status = p->status;
+	memcpy(t->name, p->name, sizeof(t->name));
+
+	return 0;
+}
+
 static struct xnvfile_snapshot_ops timerlist_ops = {
 	.rewind = timerlist_rewind,
 	.next = timerlist_next,
 	.show = timerlist_show,
+	.encode = timerlist_encode,
 };
 
 static void init_timerlist_proc(struct xnclock *clock)
@@ -462,6 +484,8 @@ static void init_timerlist_proc(struct xnclock *clock)
 	clock->timer_vfile.datasz = sizeof(struct vfile_clock_data);
 	clock->timer_vfile.tag = &clock->timer_revtag;
 	clock->timer_vfile.ops = &timerlist_ops;
+	clock->timer_vfile.recsz = sizeof(struct cobalt_vfile_timer);
+	clock->timer_vfile.rectype = COBALT_VFILE_TIMER;
 
 	xnvfile_init_snapshot(clock->name, &clock->timer_vfile, &timerlist_vfroot);
 	xnvfile_priv(&clock->timer_vfile) = clock;
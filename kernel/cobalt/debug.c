@@ -23,11 +23,14 @@
 #include <linux/mm.h>
 #include <linux/signal.h>
 #include <linux/vmalloc.h>
+#include <linux/proc_fs.h>
 #include <cobalt/kernel/sched.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/clock.h>
 #include <cobalt/kernel/ppd.h>
 #include <cobalt/uapi/signal.h>
+#include <cobalt/uapi/kernel/relax.h>
+#include <rtdm/driver.h>
 #include <asm/xenomai/syscall.h>
 #include "posix/process.h"
 #include "debug.h"
@@ -46,6 +49,8 @@ EXPORT_SYMBOL_GPL(cobalt_debug_vfroot);
 
 struct hashed_symbol {
 	struct hashed_symbol *next;
+	/* Offset in the string table of the trace rings. */
+	u32 offset;
 	char symbol[0];
 };
 
@@ -53,6 +58,38 @@ static struct hashed_symbol *symbol_jhash[SYMBOL_HSLOTS];
 
 static struct xnheap memory_pool;
 
+static struct cobalt_relax_trace *relax_trace;
+
+/*
+ * Copy a symbol to the string table readers of the trace rings
+ * share, returning its offset, or zero if the table is full. Like
+ * the hash table, the string table is never flushed, so offsets
+ * remain valid for the lifetime of the rings.
+ */
+static u32 store_symbol(const char *symbol, size_t len)
+{
+	struct cobalt_relax_trace *t = relax_trace;
+	u32 off = t->strtab_len;
+
+	if (off + len + 1 > t->strtab_size)
+		return 0;
+
+	memcpy((char *)cobalt_relax_string(t, off), symbol, len + 1);
+	smp_wmb();
+	t->strtab_len = off + len + 1;
+
+	return off;
+}
+
+static inline u32 symbol_offset(const char *symbol)
+{
+	if (symbol == NULL)
+		return 0;
+
+	return ((struct hashed_symbol *)
+		(symbol - offsetof(struct hashed_symbol, symbol)))->offset;
+}
+
 /*
  * This is a permanent storage for ASCII strings which comes handy to
  * get a unique and constant reference to a symbol while preserving
@@ -90,6 +127,7 @@ static const char *hash_symbol(const char *symbol)
 	}
 
 	strcpy(p->symbol, symbol);
+	p->offset = store_symbol(symbol, len);
 	p->next = *h;
 	*h = p;
 done:
@@ -182,6 +220,13 @@ DEFINE_PRIVATE_XNLOCK(relax_lock);
  * post-processing, along with other data identifying the caller, and
  * made available through the /proc/xenomai/debug/relax vfile.
  *
+ * The vfile only keeps unique spots with hit counts, which is fine
+ * for post-mortem analysis. For continuous monitoring, every relax
+ * request is also logged with its timestamp into a per-CPU ring,
+ * which readers map from /proc/xenomai/debug/relax-ring and scan in
+ * place, with no formatting involved (see
+ * cobalt/uapi/kernel/relax.h).
+ *
  * Implementation-wise, xndebug_notify_relax and xndebug_trace_relax
  * routines are paired: first, xndebug_notify_relax sends a SIGSHADOW
  * request to userland when a relax spot is detected from
@@ -194,6 +239,41 @@ DEFINE_PRIVATE_XNLOCK(relax_lock);
  * executable mappings that could be involved).
  */
 
+static void log_relax_event(struct relax_spot *spot, const char *exe_path)
+{
+	struct cobalt_relax_trace *t = relax_trace;
+	struct cobalt_relax_event *e;
+	int cpu, n;
+	u32 head;
+
+	/*
+	 * We run over the root stage with preemption disabled,
+	 * nobody else may log to the ring of this CPU meanwhile.
+	 */
+	cpu = get_cpu();
+	head = t->rings[cpu].head;
+	e = cobalt_relax_event(t, cpu, head);
+	e->seq = 0;
+	smp_wmb();
+	e->date = xnclock_read_monotonic(&nkclock);
+	e->pid = spot->pid;
+	e->proghash = spot->proghash;
+	e->exe_path = symbol_offset(exe_path);
+	e->reason = spot->reason;
+	e->depth = spot->depth;
+	strlcpy(e->thread, spot->thread, sizeof(e->thread));
+	for (n = 0; n < spot->depth; n++) {
+		e->backtrace[n].pc = spot->backtrace[n].pc;
+		e->backtrace[n].mapname =
+			symbol_offset(spot->backtrace[n].mapname);
+	}
+	smp_wmb();
+	e->seq = head + 1;
+	smp_wmb();
+	t->rings[cpu].head = head + 1;
+	put_cpu();
+}
+
 void xndebug_notify_relax(struct xnthread *thread, int reason)
 {
 	xnthread_signal(thread, SIGSHADOW,
@@ -208,6 +288,7 @@ void xndebug_trace_relax(int nr, unsigned long *backtrace,
 	struct xnthread *thread;
 	struct relax_spot spot;
 	struct mm_struct *mm;
+	const char *exe_path;
 	struct file *file;
 	unsigned long pc;
 	char *mapname;
@@ -283,6 +364,8 @@ void xndebug_trace_relax(int nr, unsigned long *backtrace,
 	spot.pid = xnthread_host_pid(thread);
 	spot.reason = reason;
 	strcpy(spot.thread, thread->name);
+	exe_path = hash_symbol(thread->exe_path);
+	log_relax_event(&spot, exe_path);
 	hash = jhash2((u32 *)&spot, sizeof(spot) / sizeof(u32), 0);
 
 	xnlock_get(&relax_lock);
@@ -316,7 +399,7 @@ void xndebug_trace_relax(int nr, unsigned long *backtrace,
 		goto out;      /* Something is about to go wrong... */
 
 	memcpy(&p->spot, &spot, sizeof(p->spot));
-	p->exe_path = hash_symbol(thread->exe_path);
+	p->exe_path = exe_path;
 	p->hits = 1;
 	p->h_next = *h;
 	*h = p;
@@ -483,6 +566,77 @@ static struct xnvfile_regular relax_vfile = {
 	.entry = { .lockops = &relax_mutex.ops },
 };
 
+static int relax_ring_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct cobalt_relax_trace *t = relax_trace;
+
+	if (vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start > PAGE_ALIGN(t->size))
+		return -EINVAL;
+
+	/* Readers must not interfere with the producers. */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	if (xnarch_cache_aliasing())
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	return rtdm_mmap_vmem(vma, t);
+}
+
+static const struct file_operations relax_ring_fops = {
+	.owner = THIS_MODULE,
+	.mmap = relax_ring_mmap,
+};
+
+static int init_relax_rings(void)
+{
+	u32 nr_events, size, strtab_size = 64 * 1024;
+	struct cobalt_relax_trace *t;
+	size_t hdrsz;
+
+	nr_events = roundup_pow_of_two(CONFIG_XENO_OPT_DEBUG_TRACE_RINGSZ);
+	hdrsz = ALIGN(sizeof(*t) + nr_cpu_ids * sizeof(t->rings[0]),
+		      sizeof(u64));
+	size = PAGE_ALIGN(hdrsz + nr_cpu_ids * nr_events *
+			  sizeof(struct cobalt_relax_event) + strtab_size);
+
+	t = __vmalloc(size, GFP_KERNEL|__GFP_ZERO,
+		      xnarch_cache_aliasing() ?
+		      pgprot_noncached(PAGE_KERNEL) : PAGE_KERNEL);
+	if (t == NULL)
+		return -ENOMEM;
+
+	t->size = size;
+	t->nr_cpus = nr_cpu_ids;
+	t->nr_events = nr_events;
+	t->event_offset = hdrsz;
+	t->strtab_offset = hdrsz + nr_cpu_ids * nr_events *
+		sizeof(struct cobalt_relax_event);
+	t->strtab_size = size - t->strtab_offset;
+	/* Offset zero is the empty string, for unknown names. */
+	t->strtab_len = 1;
+	t->abi = COBALT_RELAX_ABI;
+	smp_wmb();
+	t->magic = COBALT_RELAX_MAGIC;
+	relax_trace = t;
+
+	if (proc_create("relax-ring", 0400, cobalt_debug_vfroot.entry.pde,
+			&relax_ring_fops) == NULL) {
+		vfree(t);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void cleanup_relax_rings(void)
+{
+	remove_proc_entry("relax-ring", cobalt_debug_vfroot.entry.pde);
+	vfree(relax_trace);
+}
+
 static inline int init_trace_relax(void)
 {
 	u32 size = CONFIG_XENO_OPT_DEBUG_TRACE_LOGSZ * 1024;
@@ -495,15 +649,26 @@ static inline int init_trace_relax(void)
 
 	ret = xnheap_init(&memory_pool, p, size);
 	if (ret)
-		return ret;
+		goto fail_heap;
 
 	xnheap_set_name(&memory_pool, "debug log");
 
+	ret = init_relax_rings();
+	if (ret)
+		goto fail_rings;
+
 	ret = xnvfile_init_regular("relax", &relax_vfile, &cobalt_debug_vfroot);
-	if (ret) {
-		xnheap_destroy(&memory_pool);
-		vfree(p);
-	}
+	if (ret)
+		goto fail_vfile;
+
+	return 0;
+
+fail_vfile:
+	cleanup_relax_rings();
+fail_rings:
+	xnheap_destroy(&memory_pool);
+fail_heap:
+	vfree(p);
 
 	return ret;
 }
@@ -513,6 +678,7 @@ static inline void cleanup_trace_relax(void)
 	void *p;
 
 	xnvfile_destroy_regular(&relax_vfile);
+	cleanup_relax_rings();
 	p = xnheap_get_membase(&memory_pool);
 	xnheap_destroy(&memory_pool);
 	vfree(p);
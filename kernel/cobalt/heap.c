@@ -26,6 +26,7 @@
 #include <cobalt/kernel/assert.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/vfile.h>
+#include <cobalt/uapi/kernel/vfile.h>
 
 /**
  * @ingroup cobalt_core
@@ -67,6 +68,8 @@ static struct xnvfile_snapshot vfile = {
 	.datasz = sizeof(struct vfile_data),
 	.tag = &vfile_tag,
 	.ops = &vfile_ops,
+	.recsz = sizeof(struct cobalt_vfile_heap),
+	.rectype = COBALT_VFILE_HEAP,
 };
 
 static int vfile_rewind(struct xnvfile_snapshot_iterator *it)
@@ -121,10 +124,24 @@ static int vfile_show(struct xnvfile_snapshot_iterator *it, void *data)
 	return 0;
 }
 
+static int vfile_encode(struct xnvfile_snapshot_iterator *it,
+			void *data, void *rec)
+{
+	struct cobalt_vfile_heap *h = rec;
+	struct vfile_data *p = data;
+
+	h->size = p->all_mem;
+	h->free = p->free_mem;
+	memcpy(h->name, p->name, sizeof(h->name));
+
+	return 0;
+}
+
 static struct xnvfile_snapshot_ops vfile_ops = {
 	.rewind = vfile_rewind,
 	.next = vfile_next,
 	.show = vfile_show,
+	.encode = vfile_encode,
 };
 
 void xnheap_init_proc(void)
@@ -382,10 +382,14 @@ static int __init xenomai_init(void)
 	if (ret)
 		goto cleanup_sys;
 
-	ret = cobalt_init();
+	ret = rtdm_ring_init();
 	if (ret)
 		goto cleanup_rtdm;
 
+	ret = cobalt_init();
+	if (ret)
+		goto cleanup_ring;
+
 	rtdm_fd_init();
 
 	printk(XENO_INFO "Cobalt v%s (%s) %s%s%s%s\n",
@@ -398,6 +402,8 @@ static int __init xenomai_init(void)
 
 	return 0;
 
+cleanup_ring:
+	rtdm_ring_cleanup();
 cleanup_rtdm:
 	rtdm_cleanup();
 cleanup_sys:
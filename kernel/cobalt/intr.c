@@ -19,10 +19,12 @@
  * 02111-1307, USA.
 */
 #include <linux/mutex.h>
+#include <linux/slab.h>
 #include <linux/ipipe.h>
 #include <linux/ipipe_tickdev.h>
 #include <cobalt/kernel/sched.h>
 #include <cobalt/kernel/intr.h>
+#include <cobalt/kernel/synch.h>
 #include <cobalt/kernel/stat.h>
 #include <cobalt/kernel/clock.h>
 #include <cobalt/kernel/assert.h>
@@ -143,6 +145,24 @@ static inline xnstat_exectime_t *switch_core_irqstats(struct xnsched *sched)
 	return prev;
 }
 
+/*
+ * Charge the CPU time consumed by a threaded handler to the IRQ, so
+ * that it shows up in the interrupt statistics. Interrupts off.
+ */
+static inline xnstat_exectime_t *enter_thread_irqstats(struct xnintr *intr)
+{
+	struct xnirqstat *statp;
+
+	statp = raw_cpu_ptr(intr->stats);
+
+	return xnstat_exectime_switch(xnsched_current(), &statp->account);
+}
+
+static inline void leave_thread_irqstats(xnstat_exectime_t *prev)
+{
+	xnstat_exectime_switch(xnsched_current(), prev);
+}
+
 #else  /* !CONFIG_XENO_OPT_STATS */
 
 static inline void stat_counter_inc(void) {}
@@ -169,6 +189,13 @@ static inline xnstat_exectime_t *switch_core_irqstats(struct xnsched *sched)
 	return NULL;
 }
 
+static inline xnstat_exectime_t *enter_thread_irqstats(struct xnintr *intr)
+{
+	return NULL;
+}
+
+static inline void leave_thread_irqstats(xnstat_exectime_t *prev) {}
+
 #endif /* !CONFIG_XENO_OPT_STATS */
 
 static void xnintr_irq_handler(unsigned int irq, void *cookie);
@@ -751,6 +778,7 @@ int xnintr_init(struct xnintr *intr, const char *name,
 	intr->status = _XN_IRQSTAT_DISABLED;
 	intr->unhandled = 0;
 	raw_spin_lock_init(&intr->lock);
+	intr->thread = NULL;
 #ifdef CONFIG_XENO_OPT_SHIRQ
 	intr->next = NULL;
 #endif
@@ -777,6 +805,7 @@ void xnintr_destroy(struct xnintr *intr)
 {
 	secondary_mode_only();
 	xnintr_detach(intr);
+	xnintr_destroy_thread(intr);
 	free_irqstats(intr);
 }
 EXPORT_SYMBOL_GPL(xnintr_destroy);
@@ -969,6 +998,251 @@ void xnintr_affinity(struct xnintr *intr, cpumask_t cpumask)
 }
 EXPORT_SYMBOL_GPL(xnintr_affinity);
 
+struct xnintr_thread {
+	struct xnthread thread;
+	struct xnintr *intr;
+	xnisr_t primary;
+	xnisr_t handler;
+	struct xnsynch synch;
+	struct xntimer timer;
+	unsigned int batch;
+	xnticks_t delay;
+	unsigned int pending;
+	int ready;
+};
+
+/* nklock held, interrupts off. */
+static void wakeup_irq_thread(struct xnintr_thread *it)
+{
+	it->ready = 1;
+	xnsynch_wakeup_one_sleeper(&it->synch);
+}
+
+static void irq_thread_timeout(struct xntimer *timer)
+{
+	struct xnintr_thread *it = container_of(timer, struct xnintr_thread, timer);
+
+	if (it->pending > 0)
+		wakeup_irq_thread(it);
+}
+
+/*
+ * Primary handler of a threaded descriptor, counts the events which
+ * require the handler thread, waking it up once the batch is full
+ * or the coalescing delay has elapsed.
+ */
+static int irq_thread_isr(struct xnintr *intr)
+{
+	struct xnintr_thread *it = intr->thread;
+	int ret;
+	spl_t s;
+
+	if (it->primary)
+		ret = it->primary(intr);
+	else
+		ret = XN_IRQ_HANDLED|XN_IRQ_WAKE_THREAD;
+
+	if (!(ret & XN_IRQ_WAKE_THREAD))
+		return ret;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (++it->pending >= it->batch) {
+		xntimer_stop(&it->timer);
+		wakeup_irq_thread(it);
+	} else if (it->pending == 1)
+		xntimer_start(&it->timer, it->delay, XN_INFINITE, XN_RELATIVE);
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	return ret & ~XN_IRQ_WAKE_THREAD;
+}
+
+static void irq_thread_body(void *arg)
+{
+	struct xnintr_thread *it = arg;
+	struct xnintr *intr = it->intr;
+	xnstat_exectime_t *prev;
+	spl_t s;
+
+	for (;;) {
+		xnlock_get_irqsave(&nklock, s);
+
+		while (!it->ready) {
+			if (xnthread_test_info(&it->thread, XNCANCELD)) {
+				xnlock_put_irqrestore(&nklock, s);
+				return;
+			}
+			xnsynch_sleep_on(&it->synch, XN_INFINITE, XN_RELATIVE);
+		}
+
+		it->ready = 0;
+		it->pending = 0;
+		xntimer_stop(&it->timer);
+		prev = enter_thread_irqstats(intr);
+
+		xnlock_put_irqrestore(&nklock, s);
+
+		it->handler(intr);
+
+		splhigh(s);
+		leave_thread_irqstats(prev);
+		splexit(s);
+	}
+}
+
+/**
+ * @fn int xnintr_init_thread(struct xnintr *intr, xnisr_t handler, const struct xnintr_thread_attr *attr)
+ * @brief Attach a handler thread to an interrupt descriptor.
+ *
+ * Creates a Cobalt kernel thread running @a handler each time the
+ * interrupt service routine of @a intr returns with the
+ * XN_IRQ_WAKE_THREAD bit set. Unlike the service routine, @a handler
+ * runs in primary mode over a regular thread context, so it may
+ * block. The service routine should only quiesce the interrupt
+ * source at device level; if none was passed to xnintr_init(), every
+ * event wakes up the thread, which is only safe with interrupt
+ * sources which need no acknowledge (e.g. edge-triggered or virtual
+ * IRQs).
+ *
+ * Events may be coalesced: the thread is woken up once @a
+ * attr->batch events are pending, or @a attr->delay nanoseconds after
+ * the first pending event, whichever comes first. The time spent in
+ * @a handler is charged to the interrupt statistics.
+ *
+ * This service must be called after xnintr_init() and before
+ * xnintr_attach(). The thread is deleted by xnintr_destroy() or
+ * xnintr_destroy_thread().
+ *
+ * @param intr The interrupt descriptor.
+ *
+ * @param handler The threaded handler, which is passed @a intr. Its
+ * return value is ignored.
+ *
+ * @param attr Thread priority in the RT class, CPU affinity and
+ * coalescing parameters. A zero batch is equivalent to one, a batch
+ * greater than one requires a non-zero delay.
+ *
+ * @return 0 is returned on success. Otherwise:
+ *
+ * - -EINVAL is returned if @a handler is NULL, the coalescing
+ * parameters are inconsistent, or the thread could not be created
+ * with the requested priority and affinity.
+ *
+ * - -EBUSY is returned if @a intr is already attached or threaded.
+ *
+ * - -ENOMEM is returned if the thread could not be allocated.
+ *
+ * @coretags{secondary-only}
+ */
+int xnintr_init_thread(struct xnintr *intr, xnisr_t handler,
+		       const struct xnintr_thread_attr *attr)
+{
+	union xnsched_policy_param param;
+	struct xnthread_start_attr sattr;
+	struct xnthread_init_attr iattr;
+	struct xnintr_thread *it;
+	int ret;
+
+	secondary_mode_only();
+
+	if (handler == NULL || (attr->batch > 1 && attr->delay == 0))
+		return -EINVAL;
+
+	if (intr->thread || test_bit(XN_IRQSTAT_ATTACHED, &intr->status))
+		return -EBUSY;
+
+	it = kzalloc(sizeof(*it), GFP_KERNEL);
+	if (it == NULL)
+		return -ENOMEM;
+
+	it->intr = intr;
+	it->primary = intr->isr;
+	it->handler = handler;
+	it->batch = attr->batch ?: 1;
+	it->delay = attr->delay;
+	xnsynch_init(&it->synch, XNSYNCH_FIFO, NULL);
+	xntimer_init(&it->timer, &nkclock, irq_thread_timeout,
+		     NULL, XNTIMER_IGRAVITY);
+
+	iattr.name = intr->name;
+	iattr.flags = 0;
+	iattr.personality = &xenomai_personality;
+	iattr.affinity = attr->affinity;
+	param.rt.prio = attr->prio;
+
+	ret = xnthread_init(&it->thread, &iattr, &xnsched_class_rt, &param);
+	if (ret)
+		goto fail_init;
+
+	/* Anonymous registry entry, for fast mutex locking. */
+	ret = xnthread_register(&it->thread, "");
+	if (ret)
+		goto fail_start;
+
+	sattr.mode = 0;
+	sattr.entry = irq_thread_body;
+	sattr.cookie = it;
+	ret = xnthread_start(&it->thread, &sattr);
+	if (ret)
+		goto fail_start;
+
+	intr->thread = it;
+	intr->isr = irq_thread_isr;
+
+	return 0;
+
+fail_start:
+	xnthread_cancel(&it->thread);
+	xnthread_join(&it->thread, true);
+fail_init:
+	xntimer_destroy(&it->timer);
+	xnsynch_destroy(&it->synch);
+	kfree(it);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(xnintr_init_thread);
+
+/**
+ * @fn void xnintr_destroy_thread(struct xnintr *intr)
+ * @brief Delete the handler thread of an interrupt descriptor.
+ *
+ * Detaches @a intr, then deletes the thread created by
+ * xnintr_init_thread(), waiting for any ongoing run of the threaded
+ * handler to complete. The descriptor gets its original interrupt
+ * service routine back. This call is a no-op for descriptors which
+ * are not threaded.
+ *
+ * @param intr The interrupt descriptor.
+ *
+ * @coretags{secondary-only}
+ */
+void xnintr_destroy_thread(struct xnintr *intr)
+{
+	struct xnintr_thread *it = intr->thread;
+	spl_t s;
+
+	secondary_mode_only();
+
+	if (it == NULL)
+		return;
+
+	xnintr_detach(intr);
+	xnthread_cancel(&it->thread);
+	xnthread_join(&it->thread, true);
+
+	xnlock_get_irqsave(&nklock, s);
+	xntimer_destroy(&it->timer);
+	xnlock_put_irqrestore(&nklock, s);
+	xnsynch_destroy(&it->synch);
+
+	intr->isr = it->primary;
+	intr->thread = NULL;
+	kfree(it);
+}
+EXPORT_SYMBOL_GPL(xnintr_destroy_thread);
+
 static inline int xnintr_is_timer_irq(int irq)
 {
 	int cpu;
@@ -0,0 +1,186 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <linux/eventfd.h>
+#include <linux/fcntl.h>
+#include <linux/err.h>
+#include <rtdm/driver.h>
+#include <rtdm/fd.h>
+#include "internal.h"
+#include "doorbell.h"
+
+/*
+ * A doorbell forwards counts written by real-time threads to a
+ * regular Linux eventfd, which any epoll loop may wait for. Counts
+ * accumulate in the doorbell until the root stage runs the pending
+ * signal handler, which posts them to the eventfd at once: a burst
+ * of rings costs a single APC and a single Linux wakeup.
+ *
+ * A signal is posted each time the pending count leaves zero. Since
+ * the handler clears the count before posting it to the eventfd,
+ * several handlers may be in flight at once; the doorbell is
+ * released by the last of them if it was closed meanwhile.
+ */
+struct cobalt_doorbell {
+	struct rtdm_fd fd;
+	struct eventfd_ctx *efd;
+	rtdm_nrtsig_t nrtsig;
+	__u64 pending;
+	int inflight;		/* signal handlers not done yet */
+	bool closed;
+};
+
+static void doorbell_destroy(struct cobalt_doorbell *db)
+{
+	eventfd_ctx_put(db->efd);
+	xnfree(db);
+}
+
+static void doorbell_signal(rtdm_nrtsig_t *nrt_sig, void *arg)
+{
+	struct cobalt_doorbell *db = arg;
+	bool destroy;
+	__u64 count;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	count = db->pending;
+	db->pending = 0;
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (count)
+		eventfd_signal(db->efd, count);
+
+	xnlock_get_irqsave(&nklock, s);
+	destroy = --db->inflight == 0 && db->closed;
+	xnlock_put_irqrestore(&nklock, s);
+
+	/* The doorbell was closed while we were in flight. */
+	if (destroy)
+		doorbell_destroy(db);
+}
+
+static ssize_t doorbell_write(struct rtdm_fd *fd,
+			      const void __user *buf, size_t size)
+{
+	struct cobalt_doorbell *db;
+	__u64 count;
+	bool kick;
+	spl_t s;
+
+	if (size < sizeof(count))
+		return -EINVAL;
+
+	if (cobalt_copy_from_user(&count, buf, sizeof(count)))
+		return -EFAULT;
+
+	/* Same as eventfd, the all-ones value is reserved. */
+	if (count == ULLONG_MAX)
+		return -EINVAL;
+
+	if (count == 0)
+		return sizeof(count);
+
+	db = container_of(fd, struct cobalt_doorbell, fd);
+
+	xnlock_get_irqsave(&nklock, s);
+	kick = db->pending == 0;
+	if (kick)
+		db->inflight++;
+	/* Saturate, eventfd_signal() caps the counter anyway. */
+	if (ULLONG_MAX - 1 - db->pending < count)
+		db->pending = ULLONG_MAX - 1;
+	else
+		db->pending += count;
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (kick)
+		rtdm_nrtsig_pend(&db->nrtsig);
+
+	return sizeof(count);
+}
+
+static void doorbell_close(struct rtdm_fd *fd)
+{
+	struct cobalt_doorbell *db;
+	bool destroy;
+	spl_t s;
+
+	db = container_of(fd, struct cobalt_doorbell, fd);
+
+	xnlock_get_irqsave(&nklock, s);
+	destroy = db->inflight == 0;
+	db->closed = true;
+	xnlock_put_irqrestore(&nklock, s);
+
+	/* Otherwise the last signal handler in flight will drop it. */
+	if (destroy)
+		doorbell_destroy(db);
+}
+
+static struct rtdm_fd_ops doorbell_ops = {
+	.write_rt = doorbell_write,
+	.write_nrt = doorbell_write,
+	.close = doorbell_close,
+};
+
+COBALT_SYSCALL(doorbell_create, lostage, (int efd, int flags))
+{
+	struct cobalt_doorbell *db;
+	struct eventfd_ctx *ctx;
+	int ret, ufd;
+
+	if (flags & ~O_CLOEXEC)
+		return -EINVAL;
+
+	ctx = eventfd_ctx_fdget(efd);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	db = xnmalloc(sizeof(*db));
+	if (db == NULL) {
+		ret = -ENOMEM;
+		goto fail_alloc;
+	}
+
+	ufd = __rtdm_anon_getfd("[cobalt-doorbell]", O_WRONLY | flags);
+	if (ufd < 0) {
+		ret = ufd;
+		goto fail_getfd;
+	}
+
+	db->efd = ctx;
+	db->pending = 0;
+	db->inflight = 0;
+	db->closed = false;
+	db->fd.oflags = 0;
+	rtdm_nrtsig_init(&db->nrtsig, doorbell_signal, db);
+
+	ret = rtdm_fd_enter(&db->fd, ufd, COBALT_DOORBELL_MAGIC, &doorbell_ops);
+	if (ret < 0)
+		goto fail;
+
+	return ufd;
+fail:
+	rtdm_nrtsig_destroy(&db->nrtsig);
+	__rtdm_anon_putfd(ufd);
+fail_getfd:
+	xnfree(db);
+fail_alloc:
+	eventfd_ctx_put(ctx);
+
+	return ret;
+}
@@ -397,18 +397,24 @@ get_tp_config(int cpu, union sched_config __user *u_config, size_t len,
 static inline
 int set_quota_config(int cpu, union sched_config *config, size_t len)
 {
+	struct xnsched_quota_group *tg, *parent = NULL;
 	struct __sched_config_quota *p = &config->quota;
 	struct __sched_quota_info *iq = &p->info;
 	struct cobalt_sched_group *group;
-	struct xnsched_quota_group *tg;
+	int ret, quota_sum, flags = 0;
 	struct xnsched *sched;
-	int ret, quota_sum;
 	spl_t s;
 
 	if (len < sizeof(*p))
 		return -EINVAL;
 
 	switch (p->op) {
+	case sched_quota_add_ex:
+		if (p->add.flags & ~SCHED_QUOTA_BORROW)
+			return -EINVAL;
+		if (p->add.flags & SCHED_QUOTA_BORROW)
+			flags |= XNSCHED_QUOTA_BORROW;
+		/* fall through */
 	case sched_quota_add:
 		group = xnmalloc(sizeof(*group));
 		if (group == NULL)
@@ -418,7 +424,18 @@ int set_quota_config(int cpu, union sched_config *config, size_t len)
 		group->scope = cobalt_current_resources(group->pshared);
 		xnlock_get_irqsave(&nklock, s);
 		sched = xnsched_struct(cpu);
-		ret = xnsched_quota_create_group(tg, sched, &quota_sum);
+		if (p->op == sched_quota_add_ex && p->add.parent >= 0) {
+			parent = xnsched_quota_find_group(sched, p->add.parent);
+			if (parent == NULL ||
+			    container_of(parent, struct cobalt_sched_group,
+					 quota)->scope != group->scope) {
+				xnlock_put_irqrestore(&nklock, s);
+				xnfree(group);
+				return -ESRCH;
+			}
+		}
+		ret = xnsched_quota_create_group(tg, sched, parent,
+						 flags, &quota_sum);
 		if (ret) {
 			xnlock_put_irqrestore(&nklock, s);
 			xnfree(group);
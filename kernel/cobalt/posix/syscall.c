@@ -41,6 +41,7 @@
 #include "timerfd.h"
 #include "io.h"
 #include "corectl.h"
+#include "doorbell.h"
 #include "../debug.h"
 #include <trace/events/cobalt-posix.h>
 
@@ -1445,6 +1445,104 @@ int rtdm_irq_request(rtdm_irq_t *irq_handle, unsigned int irq_no,
 
 EXPORT_SYMBOL_GPL(rtdm_irq_request);
 
+/**
+ * @brief Register a threaded interrupt handler
+ *
+ * This function registers a pair of handlers with an IRQ line, then
+ * enables the line. @a handler runs in interrupt context like with
+ * rtdm_irq_request(); it should only quiesce the interrupt source at
+ * device level, then return RTDM_IRQ_HANDLED | RTDM_IRQ_WAKE_THREAD
+ * to have @a thread_fn run over a dedicated real-time task. Unlike
+ * @a handler, @a thread_fn may block, which removes the need for
+ * signaling a driver task from the interrupt handler.
+ *
+ * If @a handler is NULL, each interrupt wakes up the thread. This is
+ * only safe with interrupt sources which do not need to be
+ * acknowledged at device level, such as edge-triggered or virtual
+ * IRQs.
+ *
+ * Events may be coalesced according to @a params, in which case @a
+ * thread_fn runs once for a batch of events, which it should process
+ * entirely. The time spent in @a thread_fn is accounted to the IRQ in
+ * the interrupt statistics.
+ *
+ * The line is released by rtdm_irq_free(), which also deletes the
+ * handler thread.
+ *
+ * @param[in,out] irq_handle IRQ handle
+ * @param[in] irq_no Line number of the addressed IRQ
+ * @param[in] handler Interrupt handler, or NULL
+ * @param[in] thread_fn Threaded handler, its return value is ignored
+ * @param[in] flags Registration flags, see @ref RTDM_IRQTYPE_xxx for details
+ * @param[in] device_name Device name to show up in real-time IRQ
+ * lists, also used for naming the handler thread
+ * @param[in] arg Pointer to be passed to both handlers on invocation
+ * @param[in] params Thread and coalescing parameters, or NULL for a
+ * thread running at the highest RTDM priority on any CPU, without
+ * coalescing
+ *
+ * @return 0 on success, otherwise:
+ *
+ * - -EINVAL is returned if an invalid parameter was passed.
+ *
+ * - -EBUSY is returned if the specified IRQ line is already in use.
+ *
+ * - -ENOMEM is returned if the handler thread could not be allocated.
+ *
+ * @coretags{secondary-only}
+ */
+int rtdm_irq_request_threaded(rtdm_irq_t *irq_handle, unsigned int irq_no,
+			      rtdm_irq_handler_t handler,
+			      rtdm_irq_handler_t thread_fn,
+			      unsigned long flags, const char *device_name,
+			      void *arg,
+			      const struct rtdm_irq_thread_params *params)
+{
+	struct xnintr_thread_attr attr;
+	int err;
+
+	if (!XENO_ASSERT(COBALT, xnsched_root_p()))
+		return -EPERM;
+
+	if (params) {
+		if (params->priority < RTDM_TASK_LOWEST_PRIORITY ||
+		    params->priority > RTDM_TASK_HIGHEST_PRIORITY ||
+		    params->delay < 0)
+			return -EINVAL;
+		attr.prio = params->priority;
+		attr.affinity = params->affinity;
+		attr.batch = params->batch;
+		attr.delay = params->delay;
+	} else {
+		attr.prio = RTDM_TASK_HIGHEST_PRIORITY;
+		attr.affinity = CPU_MASK_ALL;
+		attr.batch = 1;
+		attr.delay = 0;
+	}
+
+	err = xnintr_init(irq_handle, device_name, irq_no, handler, NULL, flags);
+	if (err)
+		return err;
+
+	err = xnintr_init_thread(irq_handle, thread_fn, &attr);
+	if (err)
+		goto fail;
+
+	err = xnintr_attach(irq_handle, arg);
+	if (err)
+		goto fail;
+
+	xnintr_enable(irq_handle);
+
+	return 0;
+fail:
+	xnintr_destroy(irq_handle);
+
+	return err;
+}
+
+EXPORT_SYMBOL_GPL(rtdm_irq_request_threaded);
+
 #ifdef DOXYGEN_CPP /* Only used for doxygen doc generation */
 /**
  * @brief Release an interrupt handler
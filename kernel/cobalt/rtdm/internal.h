@@ -53,6 +53,23 @@ int rtdm_init(void);
 
 void rtdm_cleanup(void);
 
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+
+int rtdm_ring_init(void);
+
+void rtdm_ring_cleanup(void);
+
+#else /* !CONFIG_XENO_OPT_RTDM_RING */
+
+static inline int rtdm_ring_init(void)
+{
+	return 0;
+}
+
+static inline void rtdm_ring_cleanup(void) { }
+
+#endif /* !CONFIG_XENO_OPT_RTDM_RING */
+
 extern const struct file_operations rtdm_dumb_fops;
 
 #endif /* _RTDM_INTERNAL_H */
@@ -0,0 +1,834 @@
+/*
+ * Real-Time Driver Model for Xenomai, asynchronous I/O rings
+ *
+ * Xenomai is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/poll.h>
+#include <linux/socket.h>
+#include <linux/cache.h>
+#include <cobalt/kernel/select.h>
+#include <cobalt/kernel/clock.h>
+#include <cobalt/kernel/compat.h>
+#include <rtdm/driver.h>
+#include <rtdm/ring.h>
+#include "internal.h"
+
+/**
+ * @ingroup rtdm_driver_interface
+ * @defgroup rtdm_ring Asynchronous I/O Rings
+ *
+ * A ring is a pair of submission and completion queues shared
+ * between an application and the RTDM core, through which I/O
+ * requests to any RTDM file descriptor may be issued in batches,
+ * with a single system call. Completions are posted to memory the
+ * application reads directly.
+ *
+ * Drivers may take over the requests aimed at their file descriptors
+ * by implementing the ->submit() handler, then complete them from
+ * any context, typically an interrupt handler, with
+ * rtdm_ring_complete(). All other requests are served by the core on
+ * behalf of the ring owner: requests which cannot progress
+ * immediately are parked, and retried each time the owner enters
+ * the ring, or waits for completions.
+ *
+ * @{
+ */
+
+#define RTDM_RING_MAX_ENTRIES	4096
+#define RTDM_RING_MAX_BUFSZ	(1024 * 1024)
+
+/* Selector bit reserved to the completion events of the ring. */
+#define RTDM_RING_SELF		(__FD_SETSIZE - 1)
+
+struct rtdm_ring {
+	atomic_t refs;
+	size_t size;
+	struct rtdm_ring_header *hdr;
+	struct rtdm_ring_sqe *sq;
+	struct rtdm_ring_cqe *cq;
+	void *buf;
+	unsigned int buf_off;
+	unsigned int buf_size;
+	/* User address of the mapping, for fixed buffers. */
+	unsigned long ubase;
+	/* Kernel copies of the indexes we own. */
+	unsigned int sq_mask;
+	unsigned int sq_head;
+	unsigned int cq_mask;
+	unsigned int cq_tail;
+	/* Requests submitted but not completed yet (nklock). */
+	unsigned int inflight;
+	struct rtdm_ring_req *reqs;
+	struct list_head freeq;
+	/* Requests waiting for their fd to be ready (owner only). */
+	struct list_head parked;
+	struct xnthread *owner;
+	struct xnselector *selector;
+	struct xnselect cq_block;
+	fd_set in_fds[XNSELECT_EXCEPT];
+	fd_set out_fds[XNSELECT_EXCEPT];
+};
+
+struct ring_context {
+	struct rtdm_ring *ring;
+};
+
+struct lostage_free_ring {
+	struct ipipe_work_header work; /* Must be first */
+	struct rtdm_ring *ring;
+};
+
+static void free_ring(struct rtdm_ring *ring)
+{
+	xnselect_destroy(&ring->cq_block);
+	free_pages_exact(ring->hdr, ring->size);
+	kfree(ring->reqs);
+	kfree(ring);
+}
+
+static void lostage_free_ring(struct ipipe_work_header *work)
+{
+	struct lostage_free_ring *rq;
+
+	rq = container_of(work, struct lostage_free_ring, work);
+	free_ring(rq->ring);
+}
+
+static inline void get_ring(struct rtdm_ring *ring)
+{
+	atomic_inc(&ring->refs);
+}
+
+static void put_ring(struct rtdm_ring *ring)
+{
+	struct lostage_free_ring freework = {
+		.work = {
+			.size = sizeof(freework),
+			.handler = lostage_free_ring,
+		},
+		.ring = ring,
+	};
+
+	if (!atomic_dec_and_test(&ring->refs))
+		return;
+
+	/*
+	 * The last request in flight may be completed from primary
+	 * mode, after the ring was closed and unmapped.
+	 */
+	if (ipipe_root_p)
+		free_ring(ring);
+	else
+		ipipe_post_work_root(&freework, work);
+}
+
+/* nklock held, irqs off. */
+static inline unsigned int cq_pending(struct rtdm_ring *ring)
+{
+	unsigned int pending;
+
+	/*
+	 * The consumer index is user-writable, clamp the result so
+	 * that a bogus value only makes the CQ look full.
+	 */
+	pending = ring->cq_tail - READ_ONCE(ring->hdr->cq_head);
+
+	return pending > ring->cq_mask ? ring->cq_mask + 1 : pending;
+}
+
+/* nklock held, irqs off. */
+static int post_cqe(struct rtdm_ring *ring, __u64 user_data, int res)
+{
+	struct rtdm_ring_header *hdr = ring->hdr;
+	struct rtdm_ring_cqe *cqe;
+
+	if (cq_pending(ring) > ring->cq_mask) {
+		hdr->cq_overflow++;
+		goto signal;
+	}
+
+	cqe = ring->cq + (ring->cq_tail & ring->cq_mask);
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = 0;
+	/* Publish the entry before the index. */
+	smp_wmb();
+	ring->cq_tail++;
+	WRITE_ONCE(hdr->cq_tail, ring->cq_tail);
+signal:
+	return xnselect_signal(&ring->cq_block, POLLIN);
+}
+
+/**
+ * @brief Complete a ring request
+ *
+ * Post the result of a request to the completion queue of the ring
+ * it was submitted to, waking up the ring owner if it waits for
+ * completions. Drivers call this service for the requests they
+ * accepted from their ->submit() handler.
+ *
+ * @param[in] req Request descriptor
+ * @param[in] result Result of the operation, which the application
+ * receives in the @a res field of the completion entry
+ *
+ * @note The request descriptor must not be referred to anymore upon
+ * return from this call.
+ *
+ * @coretags{unrestricted, might-switch}
+ */
+void rtdm_ring_complete(struct rtdm_ring_req *req, int result)
+{
+	struct rtdm_ring *ring = req->ring;
+	int resched;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	resched = post_cqe(ring, req->sqe.user_data, result);
+	list_add(&req->next, &ring->freeq);
+	ring->inflight--;
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (resched)
+		xnsched_run();
+
+	put_ring(ring);
+}
+EXPORT_SYMBOL_GPL(rtdm_ring_complete);
+
+static struct rtdm_ring_req *get_req(struct rtdm_ring *ring)
+{
+	struct rtdm_ring_req *req = NULL;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	/*
+	 * Never accept more requests than the CQ can receive
+	 * completions for, so that none may be dropped.
+	 */
+	if (ring->inflight + cq_pending(ring) <= ring->cq_mask &&
+	    !list_empty(&ring->freeq)) {
+		req = list_first_entry(&ring->freeq, struct rtdm_ring_req, next);
+		list_del(&req->next);
+		ring->inflight++;
+	}
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (req)
+		get_ring(ring);
+
+	return req;
+}
+
+static int prepare_req(struct rtdm_ring *ring, struct rtdm_ring_req *req)
+{
+	struct rtdm_ring_sqe *sqe = &req->sqe;
+	unsigned long ubase;
+
+	req->kbuf = NULL;
+	req->type = -1;
+
+	if (sqe->flags & ~RTDM_RING_F_FIXED)
+		return -EINVAL;
+
+	if ((sqe->flags & RTDM_RING_F_FIXED) == 0) {
+		req->ubuf = (void __user *)(unsigned long)sqe->addr;
+		return 0;
+	}
+
+	if (sqe->addr > ring->buf_size ||
+	    sqe->len > ring->buf_size - sqe->addr)
+		return -EFAULT;
+
+	ubase = READ_ONCE(ring->ubase);
+	if (ubase == 0)
+		return -ENXIO;
+
+	req->kbuf = ring->buf + sqe->addr;
+	req->ubuf = (void __user *)(ubase + ring->buf_off + sqe->addr);
+
+	return 0;
+}
+
+static int get_msghdr(struct rtdm_fd *rfd, struct user_msghdr *msg,
+		      const void __user *u_msg)
+{
+#ifdef CONFIG_XENO_ARCH_SYS3264
+	if (rtdm_fd_is_compat(rfd))
+		return sys32_get_msghdr(msg, u_msg);
+#endif
+	return rtdm_safe_copy_from_user(rfd, msg, u_msg, sizeof(*msg));
+}
+
+static int put_msghdr(struct rtdm_fd *rfd, void __user *u_msg,
+		      const struct user_msghdr *msg)
+{
+#ifdef CONFIG_XENO_ARCH_SYS3264
+	if (rtdm_fd_is_compat(rfd))
+		return sys32_put_msghdr(u_msg, msg);
+#endif
+	return rtdm_safe_copy_to_user(rfd, u_msg, msg, sizeof(*msg));
+}
+
+static int run_req(struct rtdm_fd *rfd, struct rtdm_ring_req *req,
+		   int nonblock)
+{
+	struct rtdm_ring_sqe *sqe = &req->sqe;
+	struct user_msghdr msg;
+	int flags, ret;
+
+	switch (sqe->opcode) {
+	case RTDM_RING_OP_READ:
+		return rtdm_fd_read(sqe->fd, req->ubuf, sqe->len);
+	case RTDM_RING_OP_WRITE:
+		return rtdm_fd_write(sqe->fd, req->ubuf, sqe->len);
+	case RTDM_RING_OP_IOCTL:
+		return rtdm_fd_ioctl(sqe->fd, sqe->op_flags, req->ubuf);
+	case RTDM_RING_OP_RECVMSG:
+	case RTDM_RING_OP_SENDMSG:
+		ret = get_msghdr(rfd, &msg, req->ubuf);
+		if (ret)
+			return ret;
+		flags = sqe->op_flags;
+		if (nonblock)
+			flags |= MSG_DONTWAIT;
+		if (sqe->opcode == RTDM_RING_OP_SENDMSG)
+			return rtdm_fd_sendmsg(sqe->fd, &msg, flags);
+		ret = rtdm_fd_recvmsg(sqe->fd, &msg, flags);
+		if (ret < 0)
+			return ret;
+		return put_msghdr(rfd, req->ubuf, &msg) ?: ret;
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Returns 1 if @ufd is ready for @type, 0 if not, or a negated error
+ * code if the descriptor cannot be monitored.
+ */
+static int fd_ready(struct rtdm_ring *ring, int ufd, int type)
+{
+	struct xnselector *selector = ring->selector;
+	int ret, bound, ready;
+	spl_t s;
+
+	if (ufd < 0 || ufd >= RTDM_RING_SELF)
+		return -EBADF;
+
+	xnlock_get_irqsave(&nklock, s);
+	bound = __FD_ISSET__(ufd, &selector->fds[type].expected);
+	ready = __FD_ISSET__(ufd, &selector->fds[type].pending);
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (bound)
+		return ready;
+
+	ret = rtdm_fd_select(ufd, selector, type);
+	if (ret)
+		return ret;
+
+	xnlock_get_irqsave(&nklock, s);
+	ready = __FD_ISSET__(ufd, &selector->fds[type].pending);
+	xnlock_put_irqrestore(&nklock, s);
+
+	return ready;
+}
+
+static int run_or_park(struct rtdm_fd *rfd, struct rtdm_ring *ring,
+		       struct rtdm_ring_req *req)
+{
+	int ret;
+
+	if (req->type < 0)
+		return run_req(rfd, req, 0);
+
+	ret = fd_ready(ring, req->sqe.fd, req->type);
+	if (ret < 0)
+		/* Cannot tell, run it as a plain blocking call. */
+		return run_req(rfd, req, 0);
+
+	if (ret > 0) {
+		ret = run_req(rfd, req, 1);
+		if (ret != -EAGAIN)
+			return ret;
+	}
+
+	list_add_tail(&req->next, &ring->parked);
+
+	return -EIOCBQUEUED;
+}
+
+static void submit_req(struct rtdm_fd *rfd, struct rtdm_ring *ring,
+		       struct rtdm_ring_req *req)
+{
+	struct rtdm_ring_sqe *sqe = &req->sqe;
+	struct rtdm_fd *fd;
+	int ret;
+
+	ret = prepare_req(ring, req);
+	if (ret)
+		goto done;
+
+	switch (sqe->opcode) {
+	case RTDM_RING_OP_NOP:
+		goto done;
+	case RTDM_RING_OP_READ:
+	case RTDM_RING_OP_RECVMSG:
+		req->type = XNSELECT_READ;
+		break;
+	case RTDM_RING_OP_WRITE:
+	case RTDM_RING_OP_SENDMSG:
+		req->type = XNSELECT_WRITE;
+		break;
+	case RTDM_RING_OP_IOCTL:
+		break;
+	default:
+		ret = -EINVAL;
+		goto done;
+	}
+
+	fd = rtdm_fd_get(sqe->fd, 0);
+	if (IS_ERR(fd)) {
+		ret = PTR_ERR(fd);
+		goto done;
+	}
+
+	if (fd->ops == rfd->ops)
+		ret = -EINVAL;	/* No ring nesting. */
+	else if (fd->ops->submit)
+		ret = fd->ops->submit(fd, req);
+	else
+		ret = -ENOSYS;
+
+	rtdm_fd_put(fd);
+
+	if (ret == -ENOSYS)
+		ret = run_or_park(rfd, ring, req);
+
+	if (ret == -EIOCBQUEUED)
+		return;
+done:
+	rtdm_ring_complete(req, ret);
+}
+
+static void reap_parked(struct rtdm_fd *rfd, struct rtdm_ring *ring)
+{
+	struct rtdm_ring_req *req, *tmp;
+	int ready, ret;
+
+	list_for_each_entry_safe(req, tmp, &ring->parked, next) {
+		ready = fd_ready(ring, req->sqe.fd, req->type);
+		if (ready == 0)
+			continue;
+		ret = run_req(rfd, req, ready > 0);
+		if (ret == -EAGAIN && ready > 0)
+			continue;
+		list_del(&req->next);
+		rtdm_ring_complete(req, ret);
+	}
+}
+
+static int submit_sqes(struct rtdm_fd *rfd, struct rtdm_ring *ring,
+		       unsigned int to_submit)
+{
+	struct rtdm_ring_header *hdr = ring->hdr;
+	struct rtdm_ring_req *req;
+	unsigned int avail, n;
+
+	avail = READ_ONCE(hdr->sq_tail) - ring->sq_head;
+	if (avail > ring->sq_mask + 1)
+		return -EINVAL;
+
+	/* Read the entries after the producer index. */
+	smp_rmb();
+
+	for (n = 0; n < to_submit && n < avail; n++) {
+		req = get_req(ring);
+		if (req == NULL)
+			break;
+		/* Work on a copy, the ring is user-writable. */
+		req->sqe = ring->sq[ring->sq_head & ring->sq_mask];
+		ring->sq_head++;
+		WRITE_ONCE(hdr->sq_head, ring->sq_head);
+		submit_req(rfd, ring, req);
+	}
+
+	if (n == 0 && to_submit > 0 && avail > 0)
+		return -EBUSY;
+
+	return n;
+}
+
+static int wait_cq(struct rtdm_fd *rfd, struct rtdm_ring *ring,
+		   unsigned int min_complete, nanosecs_rel_t timeout)
+{
+	fd_set *in_fds[XNSELECT_MAX_TYPES] = { NULL, };
+	fd_set *out_fds[XNSELECT_MAX_TYPES] = { NULL, };
+	xnticks_t expiry = XN_INFINITE;
+	xntmode_t tmode = XN_RELATIVE;
+	struct rtdm_ring_req *req;
+	unsigned int pending, ufd;
+	int type, ret;
+	spl_t s;
+
+	if (min_complete > ring->cq_mask + 1)
+		return -EINVAL;
+
+	if (timeout > 0) {
+		expiry = xnclock_read_monotonic(&nkclock) + timeout;
+		tmode = XN_ABSOLUTE;
+	}
+
+	for (type = XNSELECT_READ; type < XNSELECT_EXCEPT; type++) {
+		in_fds[type] = &ring->in_fds[type];
+		out_fds[type] = &ring->out_fds[type];
+	}
+
+	for (;;) {
+		reap_parked(rfd, ring);
+
+		/*
+		 * Clear the completion event before sampling the CQ,
+		 * so that we may not miss any completion posted in
+		 * the meantime.
+		 */
+		xnlock_get_irqsave(&nklock, s);
+		xnselect_signal(&ring->cq_block, 0);
+		pending = cq_pending(ring);
+		xnlock_put_irqrestore(&nklock, s);
+
+		if (pending >= min_complete)
+			return 0;
+
+		__FD_ZERO__(in_fds[XNSELECT_READ]);
+		__FD_ZERO__(in_fds[XNSELECT_WRITE]);
+		__FD_SET__(RTDM_RING_SELF, in_fds[XNSELECT_READ]);
+		list_for_each_entry(req, &ring->parked, next)
+			__FD_SET__(req->sqe.fd, in_fds[req->type]);
+
+		ret = xnselect(ring->selector, out_fds, in_fds,
+			       __FD_SETSIZE, expiry, tmode);
+		if (ret == -ECHRNG) {
+			/*
+			 * A parked descriptor was closed. Try binding
+			 * again, reaping will complete the request
+			 * with the proper error if this fails.
+			 */
+			for (type = XNSELECT_READ; type < XNSELECT_EXCEPT; type++)
+				for (ufd = 0; ufd < RTDM_RING_SELF; ufd++)
+					if (__FD_ISSET__(ufd, out_fds[type]))
+						rtdm_fd_select(ufd, ring->selector, type);
+			continue;
+		}
+
+		if (ret == 0)
+			return -ETIMEDOUT;
+		if (ret < 0)
+			return ret;
+	}
+}
+
+static int ring_enter(struct rtdm_fd *rfd, struct rtdm_ring *ring,
+		      const struct rtdm_ring_enter *e)
+{
+	int submitted, ret = 0;
+
+	if (xnthread_current() != ring->owner)
+		return -EPERM;
+
+	submitted = submit_sqes(rfd, ring, e->to_submit);
+	if (submitted < 0)
+		return submitted;
+
+	if (e->min_complete > 0 && e->timeout >= 0)
+		ret = wait_cq(rfd, ring, e->min_complete, e->timeout);
+	else
+		reap_parked(rfd, ring);
+
+	return submitted > 0 ? submitted : ret;
+}
+
+static int ring_setup(struct rtdm_fd *fd, struct rtdm_ring_params __user *u_p)
+{
+	struct ring_context *ctx = rtdm_fd_to_private(fd);
+	struct xnselect_binding *binding;
+	size_t sq_off, cq_off, buf_off;
+	struct rtdm_ring_header *hdr;
+	struct rtdm_ring_params p;
+	struct xnthread *curr;
+	struct rtdm_ring *ring;
+	unsigned int n;
+	int ret;
+	spl_t s;
+
+	curr = xnthread_current();
+	if (curr == NULL)
+		return -EPERM;
+
+	ret = rtdm_safe_copy_from_user(fd, &p, u_p, sizeof(p));
+	if (ret)
+		return ret;
+
+	if (p.cq_entries == 0)
+		p.cq_entries = p.sq_entries * 2;
+
+	if (!is_power_of_2(p.sq_entries) ||
+	    p.sq_entries > RTDM_RING_MAX_ENTRIES ||
+	    !is_power_of_2(p.cq_entries) ||
+	    p.cq_entries < p.sq_entries ||
+	    p.cq_entries > RTDM_RING_MAX_ENTRIES * 2 ||
+	    p.buf_size > RTDM_RING_MAX_BUFSZ)
+		return -EINVAL;
+
+	if (ctx->ring)
+		return -EBUSY;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	ring->reqs = kcalloc(p.cq_entries, sizeof(*ring->reqs), GFP_KERNEL);
+	if (ring->reqs == NULL) {
+		ret = -ENOMEM;
+		goto fail_reqs;
+	}
+
+	sq_off = L1_CACHE_ALIGN(sizeof(*hdr));
+	cq_off = sq_off + p.sq_entries * sizeof(struct rtdm_ring_sqe);
+	buf_off = PAGE_ALIGN(cq_off + p.cq_entries * sizeof(struct rtdm_ring_cqe));
+	ring->size = PAGE_ALIGN(buf_off + p.buf_size);
+
+	/* rtdm_mmap_kmem() wants page-aligned memory. */
+	hdr = alloc_pages_exact(ring->size, GFP_KERNEL | __GFP_ZERO);
+	if (hdr == NULL) {
+		ret = -ENOMEM;
+		goto fail_mem;
+	}
+
+	ring->selector = xnmalloc(sizeof(*ring->selector));
+	if (ring->selector == NULL) {
+		ret = -ENOMEM;
+		goto fail_selector;
+	}
+
+	binding = xnmalloc(sizeof(*binding));
+	if (binding == NULL) {
+		ret = -ENOMEM;
+		goto fail_binding;
+	}
+
+	hdr->sq_entries = p.sq_entries;
+	hdr->sq_off = sq_off;
+	hdr->cq_entries = p.cq_entries;
+	hdr->cq_off = cq_off;
+	hdr->buf_off = buf_off;
+	hdr->buf_size = p.buf_size;
+	hdr->map_size = ring->size;
+
+	atomic_set(&ring->refs, 1);
+	ring->hdr = hdr;
+	ring->sq = (void *)hdr + sq_off;
+	ring->cq = (void *)hdr + cq_off;
+	ring->buf = (void *)hdr + buf_off;
+	ring->buf_off = buf_off;
+	ring->buf_size = p.buf_size;
+	ring->sq_mask = p.sq_entries - 1;
+	ring->cq_mask = p.cq_entries - 1;
+	ring->owner = curr;
+	INIT_LIST_HEAD(&ring->freeq);
+	INIT_LIST_HEAD(&ring->parked);
+	for (n = 0; n < p.cq_entries; n++) {
+		ring->reqs[n].ring = ring;
+		list_add_tail(&ring->reqs[n].next, &ring->freeq);
+	}
+
+	xnselector_init(ring->selector);
+	xnselect_init(&ring->cq_block);
+	xnlock_get_irqsave(&nklock, s);
+	xnselect_bind(&ring->cq_block, binding, ring->selector,
+		      XNSELECT_READ, RTDM_RING_SELF, 0);
+	xnlock_put_irqrestore(&nklock, s);
+
+	p.map_size = ring->size;
+	ret = rtdm_safe_copy_to_user(fd, u_p, &p, sizeof(p));
+	if (ret == 0 && cmpxchg(&ctx->ring, NULL, ring) != NULL)
+		ret = -EBUSY;
+
+	if (ret) {
+		xnselector_destroy(ring->selector);
+		put_ring(ring);
+	}
+
+	return ret;
+
+fail_binding:
+	xnfree(ring->selector);
+fail_selector:
+	free_pages_exact(hdr, ring->size);
+fail_mem:
+	kfree(ring->reqs);
+fail_reqs:
+	kfree(ring);
+
+	return ret;
+}
+
+static int ring_open(struct rtdm_fd *fd, int oflags)
+{
+	struct ring_context *ctx = rtdm_fd_to_private(fd);
+
+	ctx->ring = NULL;
+
+	return 0;
+}
+
+static void ring_close(struct rtdm_fd *fd)
+{
+	struct ring_context *ctx = rtdm_fd_to_private(fd);
+	struct rtdm_ring *ring = ctx->ring;
+	struct rtdm_ring_req *req, *tmp;
+
+	if (ring == NULL)
+		return;
+
+	list_for_each_entry_safe(req, tmp, &ring->parked, next) {
+		list_del(&req->next);
+		rtdm_ring_complete(req, -ECANCELED);
+	}
+
+	/*
+	 * Requests owned by drivers keep the ring alive until they
+	 * are completed.
+	 */
+	xnselector_destroy(ring->selector);
+	put_ring(ring);
+}
+
+static int ring_ioctl_rt(struct rtdm_fd *fd,
+			 unsigned int request, void __user *arg)
+{
+	struct ring_context *ctx = rtdm_fd_to_private(fd);
+	struct rtdm_ring *ring = READ_ONCE(ctx->ring);
+	struct rtdm_ring_enter e;
+	int ret;
+
+	switch (request) {
+	case RTDM_RING_RTIOC_ENTER:
+		if (ring == NULL)
+			return -ENXIO;
+		ret = rtdm_safe_copy_from_user(fd, &e, arg, sizeof(e));
+		if (ret)
+			return ret;
+		return ring_enter(fd, ring, &e);
+	}
+
+	return -ENOSYS;
+}
+
+static int ring_ioctl_nrt(struct rtdm_fd *fd,
+			  unsigned int request, void __user *arg)
+{
+	switch (request) {
+	case RTDM_RING_RTIOC_SETUP:
+		return ring_setup(fd, arg);
+	}
+
+	return -ENOSYS;
+}
+
+static void ring_vm_open(struct vm_area_struct *vma)
+{
+	get_ring(vma->vm_private_data);
+}
+
+static void ring_vm_close(struct vm_area_struct *vma)
+{
+	struct rtdm_ring *ring = vma->vm_private_data;
+
+	/* Fixed buffers cannot be referred to anymore. */
+	cmpxchg(&ring->ubase, vma->vm_start, 0);
+	put_ring(ring);
+}
+
+static struct vm_operations_struct ring_vm_ops = {
+	.open = ring_vm_open,
+	.close = ring_vm_close,
+};
+
+static int ring_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	struct ring_context *ctx = rtdm_fd_to_private(fd);
+	struct rtdm_ring *ring = ctx->ring;
+	size_t len = vma->vm_end - vma->vm_start;
+	int ret;
+
+	if (ring == NULL)
+		return -ENXIO;
+
+	if (vma->vm_pgoff || len > ring->size)
+		return -EINVAL;
+
+	ret = rtdm_mmap_kmem(vma, ring->hdr);
+	if (ret)
+		return ret;
+
+	vma->vm_ops = &ring_vm_ops;
+	vma->vm_private_data = ring;
+	get_ring(ring);
+
+	if (len == ring->size)
+		WRITE_ONCE(ring->ubase, vma->vm_start);
+
+	return 0;
+}
+
+static struct rtdm_driver ring_driver = {
+	.profile_info		=	RTDM_PROFILE_INFO(ring,
+							  RTDM_CLASS_COBALT,
+							  RTDM_SUBCLASS_RING,
+							  0),
+	.device_flags		=	RTDM_NAMED_DEVICE,
+	.device_count		=	1,
+	.context_size		=	sizeof(struct ring_context),
+	.ops = {
+		.open		=	ring_open,
+		.close		=	ring_close,
+		.ioctl_rt	=	ring_ioctl_rt,
+		.ioctl_nrt	=	ring_ioctl_nrt,
+		.mmap		=	ring_mmap,
+	},
+};
+
+static struct rtdm_device ring_device = {
+	.driver = &ring_driver,
+	.label = "ring",
+};
+
+int __init rtdm_ring_init(void)
+{
+	return rtdm_dev_register(&ring_device);
+}
+
+void rtdm_ring_cleanup(void)
+{
+	rtdm_dev_unregister(&ring_device);
+}
+
+/** @} */
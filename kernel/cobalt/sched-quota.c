@@ -54,6 +54,25 @@
  * a result of this, the Cobalt core will ask for the next thread to
  * run, which means calling xnsched_quota_pick() eventually.
  *
+ * Groups may be nested, in which case the quota of a child group is
+ * a share of the quota of its parent. Time consumed by a thread is
+ * charged to its own group and to every ancestor of the latter, and
+ * a thread may only run if all of those have budget left. Since the
+ * nesting depth is bounded (XNSCHED_QUOTA_MAX_DEPTH), walking the
+ * ancestry does not change the O(1) nature of the pick path.
+ *
+ * Groups created with the XNSCHED_QUOTA_BORROW flag may run on
+ * budget other groups leave unused within the current period. The
+ * per-CPU lending pool (xnsched_quota->lend_ns) starts each period
+ * with the sum of the quotas of the top-level groups, and is drained
+ * by every runtime charged to a group. When no thread with budget is
+ * runnable, xnsched_quota_pick() hands the CPU to the first expired
+ * thread of the first borrowing group waiting on the per-CPU
+ * borrowers list, for at most the time left in the pool. Since the
+ * pool never exceeds the overall share given to the top-level
+ * groups, borrowing does not eat into the CPU time left for
+ * non-quota activities.
+ *
  * CAUTION: xnsched_quota_group->nr_active does count both the threads
  * from that group linked to the sched_rt runqueue, _and_ the threads
  * moved to the local expiry queue. As a matter of fact, the expired
@@ -84,6 +103,62 @@ static inline int group_is_active(struct xnsched_quota_group *tg)
 	return 0;
 }
 
+static inline xnticks_t group_budget(struct xnsched_quota_group *tg)
+{
+	xnticks_t budget_ns = tg->run_budget_ns;
+
+	/* A nested group may not run past the budget of its ancestors. */
+	while ((tg = tg->parent) != NULL) {
+		if (tg->run_budget_ns < budget_ns)
+			budget_ns = tg->run_budget_ns;
+	}
+
+	return budget_ns;
+}
+
+static inline void drain_pool(struct xnsched_quota *qs, xnticks_t elapsed)
+{
+	if (elapsed < qs->lend_ns)
+		qs->lend_ns -= elapsed;
+	else
+		qs->lend_ns = 0;
+}
+
+static inline void charge_budget(struct xnsched_quota *qs,
+				 struct xnsched_quota_group *tg,
+				 xnticks_t elapsed)
+{
+	drain_pool(qs, elapsed);
+
+	do {
+		if (elapsed < tg->run_budget_ns)
+			tg->run_budget_ns -= elapsed;
+		else
+			tg->run_budget_ns = 0;
+	} while ((tg = tg->parent) != NULL);
+}
+
+static inline void expire_thread(struct xnsched_quota_group *tg,
+				 struct xnthread *thread, int head)
+{
+	if (head)
+		list_add(&thread->quota_expired, &tg->expired);
+	else
+		list_add_tail(&thread->quota_expired, &tg->expired);
+
+	if ((tg->flags & XNSCHED_QUOTA_BORROW) && list_empty(&tg->borrow_next))
+		list_add_tail(&tg->borrow_next, &tg->sched->quota.borrowers);
+}
+
+static inline void unexpire_thread(struct xnsched_quota_group *tg,
+				   struct xnthread *thread)
+{
+	list_del_init(&thread->quota_expired);
+
+	if (list_empty(&tg->expired) && !list_empty(&tg->borrow_next))
+		list_del_init(&tg->borrow_next);
+}
+
 static inline void replenish_budget(struct xnsched_quota *qs,
 				    struct xnsched_quota_group *tg)
 {
@@ -155,11 +230,19 @@ static void quota_refill_handler(struct xntimer *timer)
 	XENO_BUG_ON(COBALT, list_empty(&qs->groups));
 	sched = container_of(qs, struct xnsched, quota);
 
+	qs->lend_ns = 0;
 	list_for_each_entry(tg, &qs->groups, next) {
 		/* Allot a new runtime budget for the group. */
 		replenish_budget(qs, tg);
+		if (tg->parent == NULL)
+			qs->lend_ns += tg->quota_ns;
+	}
 
-		if (tg->run_budget_ns == 0 || list_empty(&tg->expired))
+	if (qs->lend_ns > qs->period_ns)
+		qs->lend_ns = qs->period_ns;
+
+	list_for_each_entry(tg, &qs->groups, next) {
+		if (list_empty(&tg->expired) || group_budget(tg) == 0)
 			continue;
 		/*
 		 * For each group living on this CPU, move all expired
@@ -174,6 +257,8 @@ static void quota_refill_handler(struct xntimer *timer)
 			list_del_init(&thread->quota_expired);
 			xnsched_addq(&sched->rt.runnable, thread);
 		}
+		if (!list_empty(&tg->borrow_next))
+			list_del_init(&tg->borrow_next);
 	}
 
 	xnsched_set_self_resched(timer->sched);
@@ -200,9 +285,12 @@ static int quota_sum_all(struct xnsched_quota *qs)
 	if (list_empty(&qs->groups))
 		return 0;
 
+	/* Nested groups share the quota of their parent. */
 	sum = 0;
-	list_for_each_entry(tg, &qs->groups, next)
-		sum += tg->quota_percent;
+	list_for_each_entry(tg, &qs->groups, next) {
+		if (tg->parent == NULL)
+			sum += tg->quota_percent;
+	}
 
 	return sum;
 }
@@ -213,7 +301,10 @@ static void xnsched_quota_init(struct xnsched *sched)
 	struct xnsched_quota *qs = &sched->quota;
 
 	qs->period_ns = CONFIG_XENO_OPT_SCHED_QUOTA_PERIOD * 1000ULL;
+	qs->lend_ns = 0;
+	qs->borrower = NULL;
 	INIT_LIST_HEAD(&qs->groups);
+	INIT_LIST_HEAD(&qs->borrowers);
 
 #ifdef CONFIG_SMP
 	ksformat(refiller_name, sizeof(refiller_name),
@@ -337,15 +428,15 @@ static void xnsched_quota_kick(struct xnthread *thread)
 	 * relaxes, even if the group it belongs to lacks runtime
 	 * budget.
 	 */
-	if (tg->run_budget_ns == 0 && !list_empty(&thread->quota_expired)) {
-		list_del_init(&thread->quota_expired);
+	if (!list_empty(&thread->quota_expired) && group_budget(tg) == 0) {
+		unexpire_thread(tg, thread);
 		xnsched_addq_tail(&sched->rt.runnable, thread);
 	}
 }
 
 static inline int thread_is_runnable(struct xnthread *thread)
 {
-	return thread->quota->run_budget_ns > 0 ||
+	return group_budget(thread->quota) > 0 ||
 		xnthread_test_info(thread, XNKICKED);
 }
 
@@ -355,9 +446,13 @@ static void xnsched_quota_enqueue(struct xnthread *thread)
 	struct xnsched *sched = thread->sched;
 
 	if (!thread_is_runnable(thread))
-		list_add_tail(&thread->quota_expired, &tg->expired);
-	else
+		expire_thread(tg, thread, 0);
+	else {
 		xnsched_addq_tail(&sched->rt.runnable, thread);
+		/* Take the CPU back from a borrowing group. */
+		if (sched->quota.borrower)
+			xnsched_set_resched(sched);
+	}
 
 	tg->nr_active++;
 }
@@ -368,53 +463,135 @@ static void xnsched_quota_dequeue(struct xnthread *thread)
 	struct xnsched *sched = thread->sched;
 
 	if (!list_empty(&thread->quota_expired))
-		list_del_init(&thread->quota_expired);
+		unexpire_thread(tg, thread);
 	else
 		xnsched_delq(&sched->rt.runnable, thread);
 
 	tg->nr_active--;
 }
 
+/*
+ * A thread from a higher class (e.g. SCHED_FIFO) may preempt the
+ * current quota thread without xnsched_quota_pick() being called, so
+ * the time consumed so far has to be accounted for when the outgoing
+ * thread is pushed back to the runqueue. Borrowing ends there: the
+ * borrowed time drains the lending pool, and the group has to wait
+ * for its turn on the borrowers list again.
+ */
+static void settle_runtime(struct xnsched *sched,
+			   struct xnsched_quota_group *tg)
+{
+	struct xnsched_quota *qs = &sched->quota;
+	xnticks_t now, elapsed;
+
+	now = xnclock_read_monotonic(&nkclock);
+	elapsed = now - tg->run_start_ns;
+
+	if (qs->borrower == tg) {
+		drain_pool(qs, elapsed);
+		qs->borrower = NULL;
+		xntimer_stop(&qs->limit_timer);
+	} else
+		charge_budget(qs, tg, elapsed);
+
+	tg->run_start_ns = now;
+}
+
 static void xnsched_quota_requeue(struct xnthread *thread)
 {
 	struct xnsched_quota_group *tg = thread->quota;
 	struct xnsched *sched = thread->sched;
 
+	if (thread == sched->curr)
+		settle_runtime(sched, tg);
+
 	if (!thread_is_runnable(thread))
-		list_add(&thread->quota_expired, &tg->expired);
+		expire_thread(tg, thread, 1);
 	else
 		xnsched_addq(&sched->rt.runnable, thread);
 
 	tg->nr_active++;
 }
 
+static struct xnthread *borrow_budget(struct xnsched *sched, xnticks_t now)
+{
+	struct xnsched_quota *qs = &sched->quota;
+	struct xnsched_quota_group *tg;
+	struct xnthread *next;
+	int ret;
+
+	if (qs->lend_ns == 0 || list_empty(&qs->borrowers))
+		goto idle;
+
+	/*
+	 * Nothing with budget is runnable: lend the time left in
+	 * the pool to the first borrowing group, then move it to the
+	 * end of the line so that borrowers share the spare time
+	 * round-robin.
+	 */
+	tg = list_first_entry(&qs->borrowers, struct xnsched_quota_group,
+			      borrow_next);
+	next = list_first_entry(&tg->expired, struct xnthread, quota_expired);
+	ret = xntimer_start(&qs->limit_timer, now + qs->lend_ns,
+			    XN_INFINITE, XN_ABSOLUTE);
+	if (ret) {
+		qs->lend_ns = 0;
+		goto idle;
+	}
+
+	unexpire_thread(tg, next);
+	if (!list_empty(&tg->expired))
+		list_move_tail(&tg->borrow_next, &qs->borrowers);
+
+	tg->run_start_ns = now;
+	tg->nr_active--;
+	qs->borrower = tg;
+
+	return next;
+idle:
+	xntimer_stop(&qs->limit_timer);
+
+	return NULL;
+}
+
 static struct xnthread *xnsched_quota_pick(struct xnsched *sched)
 {
 	struct xnthread *next, *curr = sched->curr;
 	struct xnsched_quota *qs = &sched->quota;
 	struct xnsched_quota_group *otg, *tg;
-	xnticks_t now, elapsed;
-	int ret;
+	xnticks_t now, elapsed, budget_ns;
+	int ret, borrowed;
 
 	now = xnclock_read_monotonic(&nkclock);
 	otg = curr->quota;
+	borrowed = qs->borrower != NULL;
+	if (borrowed && qs->borrower != otg) {
+		/*
+		 * The borrower blocked while a thread from a higher
+		 * class was picked. We can't tell how long it ran,
+		 * so drain the pool by the time elapsed since it was
+		 * elected, which may only make us lend less.
+		 */
+		drain_pool(qs, now - qs->borrower->run_start_ns);
+		borrowed = 0;
+	}
+	qs->borrower = NULL;
 	if (otg == NULL)
 		goto pick;
 	/*
 	 * Charge the time consumed by the outgoing thread to the
-	 * group it belongs to.
+	 * group it belongs to and its ancestors, unless it ran on
+	 * borrowed time, which only drains the lending pool.
 	 */
 	elapsed = now - otg->run_start_ns;
-	if (elapsed < otg->run_budget_ns)
-		otg->run_budget_ns -= elapsed;
+	if (borrowed)
+		drain_pool(qs, elapsed);
 	else
-		otg->run_budget_ns = 0;
+		charge_budget(qs, otg, elapsed);
 pick:
 	next = xnsched_getq(&sched->rt.runnable);
-	if (next == NULL) {
-		xntimer_stop(&qs->limit_timer);
-		return NULL;
-	}
+	if (next == NULL)
+		return borrow_budget(sched, now);
 
 	/*
 	 * As we basically piggyback on the SCHED_FIFO runqueue, make
@@ -435,23 +612,24 @@ pick:
 		goto out;
 	}
 
-	if (tg->run_budget_ns == 0) {
+	budget_ns = group_budget(tg);
+	if (budget_ns == 0) {
 		/* Flush expired group members as we go. */
-		list_add_tail(&next->quota_expired, &tg->expired);
+		expire_thread(tg, next, 0);
 		goto pick;
 	}
 
-	if (otg == tg && xntimer_running_p(&qs->limit_timer))
+	if (otg == tg && !borrowed && xntimer_running_p(&qs->limit_timer))
 		/* Same group, leave the running timer untouched. */
 		goto out;
 
 	/* Arm limit timer for the new running group. */
-	ret = xntimer_start(&qs->limit_timer, now + tg->run_budget_ns,
+	ret = xntimer_start(&qs->limit_timer, now + budget_ns,
 			    XN_INFINITE, XN_ABSOLUTE);
 	if (ret) {
 		/* Budget exhausted: deactivate this group. */
 		tg->run_budget_ns = 0;
-		list_add_tail(&next->quota_expired, &tg->expired);
+		expire_thread(tg, next, 0);
 		goto pick;
 	}
 out:
@@ -487,17 +665,56 @@ static void xnsched_quota_migrate(struct xnthread *thread, struct xnsched *sched
  * quota interval starts. At this point, a new runtime budget is
  * given to each group, in accordance with its share.
  *
+ * Groups may be nested, a child group receiving a share of the quota
+ * allotted to its parent. Optionally, a group may borrow the budget
+ * other groups leave unused during the current period, instead of
+ * being suspended when its own budget is exhausted.
+ *
  *@{
  */
+static void update_limits(struct xnsched_quota *qs,
+			  struct xnsched_quota_group *tg)
+{
+	struct xnsched_quota_group *parent = tg->parent, *child;
+	xnticks_t base_ns, peak_base_ns;
+
+	if (parent) {
+		base_ns = parent->quota_ns;
+		peak_base_ns = parent->quota_peak_ns;
+	} else
+		base_ns = peak_base_ns = qs->period_ns;
+
+	tg->quota_ns = xnarch_div64(base_ns * tg->quota_percent, 100);
+	tg->quota_peak_ns = xnarch_div64(peak_base_ns * tg->quota_peak_percent, 100);
+	tg->run_budget_ns = tg->quota_ns;
+	tg->run_credit_ns = 0;	/* Drop accumulated credit. */
+
+	/* Children receive a share of the new quota. */
+	if (tg->nr_children == 0)
+		return;
+
+	list_for_each_entry(child, &qs->groups, next) {
+		if (child->parent == tg)
+			update_limits(qs, child);
+	}
+}
+
 int xnsched_quota_create_group(struct xnsched_quota_group *tg,
 			       struct xnsched *sched,
-			       int *quota_sum_r)
+			       struct xnsched_quota_group *parent,
+			       int flags, int *quota_sum_r)
 {
 	int tgid, nr_groups = CONFIG_XENO_OPT_SCHED_QUOTA_NR_GROUPS;
 	struct xnsched_quota *qs = &sched->quota;
 
 	atomic_only();
 
+	if (parent) {
+		if (parent->sched != sched ||
+		    parent->depth + 1 >= XNSCHED_QUOTA_MAX_DEPTH)
+			return -EINVAL;
+	}
+
 	tgid = find_first_zero_bit(group_map, nr_groups);
 	if (tgid >= nr_groups)
 		return -ENOSPC;
@@ -505,16 +722,21 @@ int xnsched_quota_create_group(struct xnsched_quota_group *tg,
 	__set_bit(tgid, group_map);
 	tg->tgid = tgid;
 	tg->sched = sched;
-	tg->run_budget_ns = qs->period_ns;
-	tg->run_credit_ns = 0;
+	tg->parent = parent;
+	tg->depth = parent ? parent->depth + 1 : 0;
+	tg->flags = flags & XNSCHED_QUOTA_BORROW;
 	tg->quota_percent = 100;
 	tg->quota_peak_percent = 100;
-	tg->quota_ns = qs->period_ns;
-	tg->quota_peak_ns = qs->period_ns;
 	tg->nr_active = 0;
 	tg->nr_threads = 0;
+	tg->nr_children = 0;
 	INIT_LIST_HEAD(&tg->members);
 	INIT_LIST_HEAD(&tg->expired);
+	INIT_LIST_HEAD(&tg->borrow_next);
+	update_limits(qs, tg);
+
+	if (parent)
+		parent->nr_children++;
 
 	if (list_empty(&qs->groups))
 		xntimer_start(&qs->refill_timer,
@@ -536,6 +758,9 @@ int xnsched_quota_destroy_group(struct xnsched_quota_group *tg,
 
 	atomic_only();
 
+	if (tg->nr_children > 0)
+		return -EBUSY;
+
 	if (!list_empty(&tg->members)) {
 		if (!force)
 			return -EBUSY;
@@ -549,6 +774,12 @@ int xnsched_quota_destroy_group(struct xnsched_quota_group *tg,
 	list_del(&tg->next);
 	__clear_bit(tg->tgid, group_map);
 
+	if (tg->parent)
+		tg->parent->nr_children--;
+
+	if (qs->borrower == tg)
+		qs->borrower = NULL;
+
 	if (list_empty(&qs->groups))
 		xntimer_stop(&qs->refill_timer);
 
@@ -566,25 +797,22 @@ void xnsched_quota_set_limit(struct xnsched_quota_group *tg,
 
 	atomic_only();
 
-	if (quota_percent < 0 || quota_percent > 100) { /* Quota off. */
+	if (quota_percent < 0 || quota_percent > 100) /* Quota off. */
 		quota_percent = 100;
-		tg->quota_ns = qs->period_ns;
-	} else
-		tg->quota_ns = xnarch_div64(qs->period_ns * quota_percent, 100);
 
 	if (quota_peak_percent < quota_percent)
 		quota_peak_percent = quota_percent;
 
-	if (quota_peak_percent < 0 || quota_peak_percent > 100) {
+	if (quota_peak_percent < 0 || quota_peak_percent > 100)
 		quota_peak_percent = 100;
-		tg->quota_peak_ns = qs->period_ns;
-	} else
-		tg->quota_peak_ns = xnarch_div64(qs->period_ns * quota_peak_percent, 100);
 
+	/*
+	 * The percentages of a nested group apply to the quota of
+	 * its parent, not to the quota interval.
+	 */
 	tg->quota_percent = quota_percent;
 	tg->quota_peak_percent = quota_peak_percent;
-	tg->run_budget_ns = tg->quota_ns;
-	tg->run_credit_ns = 0;	/* Drop accumulated credit. */
+	update_limits(qs, tg);
 
 	*quota_sum_r = quota_sum_all(qs);
 
@@ -26,6 +26,9 @@ static void tp_schedule_next(struct xnsched_tp *tp)
 	struct xnsched *sched;
 	int p_next, ret;
 	xnticks_t t;
+#ifdef CONFIG_XENO_OPT_SCHED_TP_MERGE
+	int n;
+#endif
 
 	for (;;) {
 		/*
@@ -44,6 +47,20 @@ static void tp_schedule_next(struct xnsched_tp *tp)
 		/* Schedule tick to advance to the next window. */
 		tp->wnext = (tp->wnext + 1) % tp->gps->pwin_nr;
 		w = &tp->gps->pwins[tp->wnext];
+#ifdef CONFIG_XENO_OPT_SCHED_TP_MERGE
+		/*
+		 * Skip the windows activating the same partition as
+		 * the current one, there is no point in taking a
+		 * tick to switch to them. Passing the last window
+		 * moves the target date to the next time frame.
+		 */
+		for (n = 1; n < tp->gps->pwin_nr && w->w_part == p_next; n++) {
+			if (tp->wnext + 1 == tp->gps->pwin_nr)
+				tp->tf_start += tp->gps->tf_duration;
+			tp->wnext = (tp->wnext + 1) % tp->gps->pwin_nr;
+			w = &tp->gps->pwins[tp->wnext];
+		}
+#endif
 		t = tp->tf_start + w->w_offset;
 
 		ret = xntimer_start(&tp->tf_timer, t, XN_INFINITE, XN_ABSOLUTE);
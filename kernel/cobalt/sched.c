@@ -27,9 +27,16 @@
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/arith.h>
 #include <cobalt/uapi/signal.h>
+#include <cobalt/uapi/kernel/vfile.h>
 #define CREATE_TRACE_POINTS
 #include <trace/events/cobalt-core.h>
 
+/* Drivers may probe the timer path, e.g. for latency breakdowns. */
+EXPORT_TRACEPOINT_SYMBOL_GPL(cobalt_clock_entry);
+EXPORT_TRACEPOINT_SYMBOL_GPL(cobalt_clock_exit);
+EXPORT_TRACEPOINT_SYMBOL_GPL(cobalt_schedule);
+EXPORT_TRACEPOINT_SYMBOL_GPL(cobalt_switch_context);
+
 /**
  * @ingroup cobalt_core
  * @defgroup cobalt_core_sched Thread scheduling control
@@ -1114,6 +1121,8 @@ static struct xnvfile_snapshot schedstat_vfile = {
 	.tag = &nkthreadlist_tag,
 	.ops = &vfile_schedstat_ops,
 	.entry = { .lockops = &vfile_schedstat_lockops },
+	.recsz = sizeof(struct cobalt_vfile_thread),
+	.rectype = COBALT_VFILE_THREAD,
 };
 
 static int vfile_schedstat_rewind(struct xnvfile_snapshot_iterator *it)
@@ -1273,10 +1282,39 @@ static int vfile_schedacct_show(struct xnvfile_snapshot_iterator *it,
 	return 0;
 }
 
+static int vfile_schedstat_encode(struct xnvfile_snapshot_iterator *it,
+				  void *data, void *rec)
+{
+	struct vfile_schedstat_data *p = data;
+	struct cobalt_vfile_thread *t = rec;
+
+	/*
+	 * The per-period figures are left out, since they change on
+	 * every read; readers compute them from the total execution
+	 * time and the snapshot date instead.
+	 */
+	t->exectime_total = xnclock_ticks_to_ns(&nkclock, p->exectime_total);
+	t->period = p->period;
+	t->ssw = p->ssw;
+	t->csw = p->csw;
+	t->xsc = p->xsc;
+	t->pf = p->pf;
+	t->cpu = p->cpu;
+	t->pid = p->pid;
+	t->state = p->state;
+	t->cprio = p->cprio;
+	memcpy(t->name, p->name, sizeof(t->name));
+	strncpy(t->sched_class, p->sched_class->name,
+		sizeof(t->sched_class) - 1);
+
+	return 0;
+}
+
 static struct xnvfile_snapshot_ops vfile_schedstat_ops = {
 	.rewind = vfile_schedstat_rewind,
 	.next = vfile_schedstat_next,
 	.show = vfile_schedstat_show,
+	.encode = vfile_schedstat_encode,
 };
 
 /*
@@ -1290,12 +1328,15 @@ static struct xnvfile_snapshot schedacct_vfile = {
 	.datasz = sizeof(struct vfile_schedstat_data),
 	.tag = &nkthreadlist_tag,
 	.ops = &vfile_schedacct_ops,
+	.recsz = sizeof(struct cobalt_vfile_thread),
+	.rectype = COBALT_VFILE_THREAD,
 };
 
 static struct xnvfile_snapshot_ops vfile_schedacct_ops = {
 	.rewind = vfile_schedstat_rewind,
 	.next = vfile_schedstat_next,
 	.show = vfile_schedacct_show,
+	.encode = vfile_schedstat_encode,
 };
 
 #endif /* CONFIG_XENO_OPT_STATS */
@@ -20,9 +20,13 @@
 #include <linux/uaccess.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
 #include <cobalt/kernel/lock.h>
+#include <cobalt/kernel/clock.h>
 #include <cobalt/kernel/assert.h>
 #include <cobalt/kernel/vfile.h>
+#include <cobalt/uapi/kernel/vfile.h>
 #include <asm/xenomai/wrappers.h>
 
 /**
@@ -144,40 +148,24 @@ static void vfile_snapshot_free(struct xnvfile_snapshot_iterator *it, void *buf)
 	kfree(buf);
 }
 
-static int vfile_snapshot_open(struct inode *inode, struct file *file)
+/*
+ * Collect a consistent snapshot of the vfile records into the
+ * iterator, redoing the collection from scratch whenever the
+ * revision tag of the scanned data set changes concurrently. On
+ * success, the revision the snapshot is consistent with is returned
+ * into *revp.
+ */
+static int vfile_snapshot_collect(struct xnvfile_snapshot_iterator *it,
+				  int *revp)
 {
-	struct xnvfile_snapshot *vfile = PDE_DATA(inode);
+	struct xnvfile_snapshot *vfile = it->vfile;
 	struct xnvfile_snapshot_ops *ops = vfile->ops;
-	struct xnvfile_snapshot_iterator *it;
 	int revtag, ret, nrdata;
-	struct seq_file *seq;
 	caddr_t data;
 
-	if ((file->f_mode & FMODE_WRITE) != 0 && ops->store == NULL)
-		return -EACCES;
-
-	/*
-	 * Make sure to create the seq_file backend only when reading
-	 * from the v-file is possible.
-	 */
-	if ((file->f_mode & FMODE_READ) == 0) {
-		file->private_data = NULL;
-		return 0;
-	}
-
-	if ((file->f_flags & O_EXCL) != 0 && xnvfile_nref(vfile) > 0)
-		return -EBUSY;
-
-	it = kzalloc(sizeof(*it) + vfile->privsz, GFP_KERNEL);
-	if (it == NULL)
-		return -ENOMEM;
-
-	it->vfile = vfile;
-	xnvfile_file(vfile) = file;
-
 	ret = vfile->entry.lockops->get(&vfile->entry);
 	if (ret)
-		goto fail;
+		return ret;
 redo:
 	/*
 	 * The ->rewind() method is optional; there may be cases where
@@ -200,9 +188,8 @@ redo:
 	if (ops->rewind) {
 		nrdata = ops->rewind(it);
 		if (nrdata < 0) {
-			ret = nrdata;
 			vfile->entry.lockops->put(&vfile->entry);
-			goto fail;
+			return nrdata;
 		}
 	}
 	revtag = vfile->tag->rev;
@@ -225,10 +212,8 @@ redo:
 	if (ops->begin) {
 		XENO_BUG_ON(COBALT, ops->end == NULL);
 		data = ops->begin(it);
-		if (data == NULL) {
-			kfree(it);
+		if (data == NULL)
 			return -ENOMEM;
-		}
 		if (data != VFILE_SEQ_EMPTY) {
 			it->databuf = data;
 			it->endfn = ops->end;
@@ -236,22 +221,17 @@ redo:
 	} else if (nrdata > 0 && vfile->datasz > 0) {
 		/* We have a hint for auto-allocation. */
 		data = kmalloc(vfile->datasz * nrdata, GFP_KERNEL);
-		if (data == NULL) {
-			kfree(it);
+		if (data == NULL)
 			return -ENOMEM;
-		}
 		it->databuf = data;
 		it->endfn = vfile_snapshot_free;
 	}
 
-	ret = seq_open(file, &vfile_snapshot_ops);
-	if (ret)
-		goto fail;
-
 	it->nrdata = 0;
+	*revp = revtag;
 	data = it->databuf;
 	if (data == NULL)
-		goto finish;
+		return 0;
 
 	/*
 	 * Take a snapshot of the vfile contents, redo if the revision
@@ -273,8 +253,45 @@ redo:
 		}
 	}
 
-	if (ret < 0) {
-		seq_release(inode, file);
+	return ret < 0 ? ret : 0;
+}
+
+static int vfile_snapshot_open(struct inode *inode, struct file *file)
+{
+	struct xnvfile_snapshot *vfile = PDE_DATA(inode);
+	struct xnvfile_snapshot_ops *ops = vfile->ops;
+	struct xnvfile_snapshot_iterator *it;
+	struct seq_file *seq;
+	int revtag, ret;
+
+	if ((file->f_mode & FMODE_WRITE) != 0 && ops->store == NULL)
+		return -EACCES;
+
+	/*
+	 * Make sure to create the seq_file backend only when reading
+	 * from the v-file is possible.
+	 */
+	if ((file->f_mode & FMODE_READ) == 0) {
+		file->private_data = NULL;
+		return 0;
+	}
+
+	if ((file->f_flags & O_EXCL) != 0 && xnvfile_nref(vfile) > 0)
+		return -EBUSY;
+
+	it = kzalloc(sizeof(*it) + vfile->privsz, GFP_KERNEL);
+	if (it == NULL)
+		return -ENOMEM;
+
+	it->vfile = vfile;
+	xnvfile_file(vfile) = file;
+
+	ret = vfile_snapshot_collect(it, &revtag);
+	if (ret)
+		goto fail;
+
+	ret = seq_open(file, &vfile_snapshot_ops);
+	if (ret) {
 	fail:
 		if (it->databuf)
 			it->endfn(it, it->databuf);
@@ -282,7 +299,6 @@ redo:
 		return ret;
 	}
 
-finish:
 	seq = file->private_data;
 	it->seq = seq;
 	seq->private = it;
@@ -346,6 +362,197 @@ static struct file_operations vfile_snapshot_fops = {
 	.release = vfile_snapshot_release,
 };
 
+/*
+ * Binary output: each read starting at offset zero collects a fresh
+ * snapshot, then encodes it as a struct cobalt_vfile_header followed
+ * by fixed-size records, each preceded by a struct
+ * cobalt_vfile_record telling its index into the snapshot. Reads at
+ * non-zero offsets continue streaming the output of the last
+ * snapshot.
+ *
+ * The encoded records of the last snapshot are kept with the open
+ * file. If the revision tag and record count did not change since
+ * then, only the records which differ from their former binary
+ * image are sent, and the header is flagged as a delta. Readers
+ * polling the same file descriptor therefore only get what changed
+ * since the generation they already know.
+ *
+ * The delta only trims what is copied out to the reader: every read
+ * still collects a full snapshot under the vfile lock (i.e. nklock
+ * for the scheduler files), then compares it to the former records
+ * once the lock is dropped. It does not shorten the time the lock is
+ * held.
+ */
+struct vfile_binary_state {
+	struct mutex lock;
+	struct xnvfile_snapshot_iterator *it;
+	void *recs;
+	int nrec;
+	int rev;
+	char *out;
+	size_t outlen;
+};
+
+static int vfile_binary_open(struct inode *inode, struct file *file)
+{
+	struct xnvfile_snapshot *vfile = PDE_DATA(inode);
+	struct xnvfile_snapshot_iterator *it;
+	struct vfile_binary_state *st;
+
+	if ((file->f_flags & O_EXCL) != 0 && xnvfile_nref(vfile) > 0)
+		return -EBUSY;
+
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (st == NULL)
+		return -ENOMEM;
+
+	it = kzalloc(sizeof(*it) + vfile->privsz, GFP_KERNEL);
+	if (it == NULL) {
+		kfree(st);
+		return -ENOMEM;
+	}
+
+	it->vfile = vfile;
+	xnvfile_file(vfile) = file;
+	mutex_init(&st->lock);
+	st->it = it;
+	file->private_data = st;
+	xnvfile_nref(vfile)++;
+
+	return 0;
+}
+
+static int vfile_binary_fill(struct vfile_binary_state *st)
+{
+	struct xnvfile_snapshot_iterator *it = st->it;
+	struct xnvfile_snapshot *vfile = it->vfile;
+	size_t recsz = vfile->recsz, cellsz, len;
+	struct cobalt_vfile_header *hdr;
+	struct cobalt_vfile_record *rec;
+	void *recs = NULL, *p;
+	int ret, rev, n, delta;
+	char *out;
+
+	ret = vfile_snapshot_collect(it, &rev);
+	if (ret)
+		goto out;
+
+	if (it->nrdata > 0) {
+		recs = vzalloc(it->nrdata * recsz);
+		if (recs == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		for (n = 0, p = recs; n < it->nrdata; n++, p += recsz) {
+			ret = vfile->ops->encode(it, it->databuf +
+						 n * vfile->datasz, p);
+			if (ret)
+				goto out;
+		}
+	}
+
+	cellsz = sizeof(*rec) + recsz;
+	len = sizeof(*hdr) + it->nrdata * cellsz;
+	out = vmalloc(len);
+	if (out == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	delta = st->recs && st->rev == rev && st->nrec == it->nrdata;
+	hdr = (struct cobalt_vfile_header *)out;
+	hdr->magic = COBALT_VFILE_MAGIC;
+	hdr->abi = COBALT_VFILE_ABI;
+	hdr->flags = delta ? COBALT_VFILE_DELTA : 0;
+	hdr->type = vfile->rectype;
+	hdr->recsz = recsz;
+	hdr->nrec = it->nrdata;
+	hdr->nemit = 0;
+	hdr->generation = rev;
+	hdr->__pad = 0;
+	hdr->date = xnclock_read_monotonic(&nkclock);
+
+	for (n = 0, p = recs, rec = (void *)(hdr + 1);
+	     n < it->nrdata; n++, p += recsz) {
+		if (delta && memcmp(st->recs + n * recsz, p, recsz) == 0)
+			continue;
+		rec->index = n;
+		rec->__pad = 0;
+		memcpy(rec + 1, p, recsz);
+		rec = (void *)(rec + 1) + recsz;
+		hdr->nemit++;
+	}
+
+	if (st->out)
+		vfree(st->out);
+	st->out = out;
+	st->outlen = sizeof(*hdr) + hdr->nemit * cellsz;
+
+	/* Make the encoded records the reference for the next delta. */
+	if (st->recs)
+		vfree(st->recs);
+	st->recs = recs;
+	st->nrec = it->nrdata;
+	st->rev = rev;
+	recs = NULL;
+out:
+	if (recs)
+		vfree(recs);
+
+	if (it->databuf) {
+		it->endfn(it, it->databuf);
+		it->databuf = NULL;
+	}
+
+	return ret;
+}
+
+static ssize_t vfile_binary_read(struct file *file, char __user *buf,
+				 size_t size, loff_t *ppos)
+{
+	struct vfile_binary_state *st = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&st->lock);
+
+	if (*ppos == 0) {
+		ret = vfile_binary_fill(st);
+		if (ret)
+			goto out;
+	}
+
+	ret = simple_read_from_buffer(buf, size, ppos, st->out, st->outlen);
+out:
+	mutex_unlock(&st->lock);
+
+	return ret;
+}
+
+static int vfile_binary_release(struct inode *inode, struct file *file)
+{
+	struct vfile_binary_state *st = file->private_data;
+	struct xnvfile_snapshot_iterator *it = st->it;
+
+	--xnvfile_nref(it->vfile);
+	XENO_BUG_ON(COBALT, it->vfile->entry.refcnt < 0);
+
+	if (st->recs)
+		vfree(st->recs);
+	if (st->out)
+		vfree(st->out);
+	kfree(it);
+	kfree(st);
+
+	return 0;
+}
+
+static struct file_operations vfile_binary_fops = {
+	.open = vfile_binary_open,
+	.read = vfile_binary_read,
+	.llseek = default_llseek,
+	.release = vfile_binary_release,
+};
+
 /**
  * @fn int xnvfile_init_snapshot(const char *name, struct xnvfile_snapshot *vfile, struct xnvfile_directory *parent)
  * @brief Initialize a snapshot-driven vfile.
@@ -381,6 +588,13 @@ static struct file_operations vfile_snapshot_fops = {
  *
  * - .ops is a pointer to an @ref snapshot_ops "operation descriptor".
  *
+ * - .recsz and .rectype give the size and type code of the binary
+ * records produced by the @ref snapshot_encode "encode() handler",
+ * if the latter is present in the operation descriptor. In such a
+ * case, a read-only companion entry named after the vfile with a
+ * ".bin" suffix is created, which outputs the snapshot in the
+ * binary format defined by <cobalt/uapi/kernel/vfile.h>.
+ *
  * @param parent A pointer to a virtual directory descriptor; the
  * vfile entry will be created into this directory. If NULL, the /proc
  * root directory will be used. /proc/xenomai is mapped on the
@@ -398,6 +612,7 @@ int xnvfile_init_snapshot(const char *name,
 			  struct xnvfile_directory *parent)
 {
 	struct proc_dir_entry *ppde, *pde;
+	char *binname;
 	int mode;
 
 	XENO_BUG_ON(COBALT, vfile->tag == NULL);
@@ -416,8 +631,29 @@ int xnvfile_init_snapshot(const char *name,
 		return -ENOMEM;
 
 	vfile->entry.pde = pde;
+	vfile->binpde = NULL;
+
+	if (vfile->ops->encode == NULL)
+		return 0;
+
+	XENO_BUG_ON(COBALT, vfile->recsz == 0);
+
+	binname = kasprintf(GFP_KERNEL, "%s.bin", name);
+	if (binname == NULL)
+		goto fail;
+
+	pde = proc_create_data(binname, 0444, ppde, &vfile_binary_fops, vfile);
+	kfree(binname);
+	if (pde == NULL)
+		goto fail;
+
+	vfile->binpde = pde;
 
 	return 0;
+fail:
+	proc_remove(vfile->entry.pde);
+
+	return -ENOMEM;
 }
 EXPORT_SYMBOL_GPL(xnvfile_init_snapshot);
 
@@ -661,6 +661,7 @@ int a4l_ioctl_bufcfg2(struct a4l_device_context * cxt, void *arg)
 	}
 
 	buf->wake_count = buf_cfg.wake_count;
+	buf->wake_timeout = buf_cfg.wake_timeout;
 
 	return 0;
 }
@@ -710,15 +711,23 @@ int a4l_ioctl_bufinfo(struct a4l_device_context * cxt, void *arg)
 			buf->cns_count += info.rw_count;
 
 		/* Retrieves the data amount to read */
-		tmp_cnt = info.rw_count = __count_to_get(buf);
+		info.rw_count = __count_to_get(buf);
 
-		__a4l_dbg(1, core_dbg, "count to read=%lu\n", tmp_cnt);
+		__a4l_dbg(1, core_dbg, "count to read=%lu\n", info.rw_count);
 
 		if ((ret < 0 && ret != -ENOENT) ||
-		    (ret == -ENOENT && tmp_cnt == 0)) {
+		    (ret == -ENOENT && info.rw_count == 0)) {
 			a4l_cancel_buffer(cxt);
 			return ret;
 		}
+
+		/* Only munge the data which were not already handed
+		   over to the user by a previous call; the consumer
+		   may poll the buffer state without consuming
+		   anything */
+		tmp_cnt = buf->cns_count + info.rw_count - buf->mng_count;
+		if ((long)tmp_cnt < 0)
+			tmp_cnt = 0;
 	} else if (a4l_subd_is_output(subd)) {
 
 		if (ret < 0) {
@@ -790,7 +799,9 @@ int a4l_ioctl_bufinfo2(struct a4l_device_context * cxt, void *arg)
 		return -EINVAL;
 	}
 
+	memset(&buf_cfg, 0, sizeof(buf_cfg));
 	buf_cfg.wake_count = buf->wake_count;
+	buf_cfg.wake_timeout = buf->wake_timeout;
 
 	if (rtdm_safe_copy_to_user(fd,
 				   arg, &buf_cfg, sizeof(a4l_bufcfg2_t)) != 0)
@@ -1052,6 +1063,77 @@ int a4l_select(struct a4l_device_context *cxt,
 	return a4l_select_sync(&(buf->sync), selector, type, fd_index);
 }
 
+/* The amount of data which should be available before a poller
+   is awakened: the wake-up threshold, unless the acquisition ends
+   before it can be reached */
+static inline unsigned long __wake_threshold(struct a4l_buffer *buf)
+{
+	unsigned long wake = __count_to_end(buf);
+
+	if (wake > buf->wake_count)
+		wake = buf->wake_count;
+
+	return wake ?: 1;
+}
+
+static inline unsigned long __count_to_poll(struct a4l_buffer *buf,
+					    struct a4l_subdevice *subd)
+{
+	return a4l_subd_is_input(subd) ?
+		__count_to_get(buf) : __count_to_put(buf);
+}
+
+/* Waits until the wake-up threshold is reached. If a wake-up timeout
+   was configured, the poller is also released once this delay has
+   elapsed with some (less than threshold) data pending, which bounds
+   the latency of a streaming consumer on slow acquisitions */
+static int __wait_watermark(struct a4l_buffer *buf,
+			    struct a4l_subdevice *subd,
+			    unsigned long ms_timeout, unsigned long *count)
+{
+	nanosecs_abs_t now, deadline, poll_end = 0, wake_end = 0;
+	int rt = rtdm_in_rt_context(), ret;
+
+	now = rtdm_clock_read_monotonic();
+	if (ms_timeout != A4L_INFINITE)
+		poll_end = now + (nanosecs_abs_t)ms_timeout * NSEC_PER_MSEC;
+	if (buf->wake_timeout)
+		wake_end = now + (nanosecs_abs_t)buf->wake_timeout * NSEC_PER_USEC;
+
+	for (;;) {
+		deadline = poll_end;
+		if (*count > 0 && wake_end &&
+		    (deadline == 0 || wake_end < deadline))
+			deadline = wake_end;
+
+		if (deadline == 0)
+			ret = a4l_wait_sync(&buf->sync, rt);
+		else if (deadline > now)
+			ret = a4l_timedwait_sync(&buf->sync, rt,
+						 deadline - now);
+		else
+			ret = -ETIMEDOUT;
+
+		if (ret < 0 && ret != -ETIMEDOUT)
+			return ret == -ERESTARTSYS ? -EINTR : ret;
+
+		*count = __count_to_poll(buf, subd);
+
+		/* Let the next call report the end of acquisition or
+		   the failure, once the pending data are consumed */
+		if (__handle_event(buf) < 0 ||
+		    *count >= __wake_threshold(buf))
+			return 0;
+
+		now = rtdm_clock_read_monotonic();
+		if (*count > 0 && wake_end && now >= wake_end)
+			return 0;
+
+		if (poll_end && now >= poll_end)
+			return *count > 0 ? 0 : -ETIMEDOUT;
+	}
+}
+
 int a4l_ioctl_poll(struct a4l_device_context * cxt, void *arg)
 {
 	struct rtdm_fd *fd = rtdm_private_to_fd(cxt);
@@ -1113,25 +1195,14 @@ int a4l_ioctl_poll(struct a4l_device_context * cxt, void *arg)
 		tmp_cnt = __count_to_put(buf);
 	}
 
-	if (poll.arg == A4L_NONBLOCK || tmp_cnt != 0)
+	/* The wake-up threshold does not hold anymore once the
+	   acquisition is over */
+	if (poll.arg == A4L_NONBLOCK || ret < 0 ||
+	    tmp_cnt >= __wake_threshold(buf))
 		goto out_poll;
 
-	if (poll.arg == A4L_INFINITE)
-		ret = a4l_wait_sync(&(buf->sync), rtdm_in_rt_context());
-	else {
-		unsigned long long ns = ((unsigned long long)poll.arg) *
-			((unsigned long long)NSEC_PER_MSEC);
-		ret = a4l_timedwait_sync(&(buf->sync), rtdm_in_rt_context(), ns);
-	}
-
-	if (ret == 0) {
-		/* Retrieves the count once more */
-		if (a4l_subd_is_input(dev->transfer.subds[poll.idx_subd]))
-			tmp_cnt = __count_to_get(buf);
-		else
-			tmp_cnt = __count_to_put(buf);
-	}
-	else
+	ret = __wait_watermark(buf, subd, poll.arg, &tmp_cnt);
+	if (ret < 0)
 		return ret;
 
 out_poll:
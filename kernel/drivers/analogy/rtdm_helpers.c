@@ -158,7 +158,8 @@ int a4l_timedwait_sync(struct a4l_sync * snc,
 		/* ... else if the process is NRT,
 		   the Linux wait queue system is used */
 
-		timeout = do_div(ns_timeout, 1000);
+		do_div(ns_timeout, 1000);
+		timeout = ns_timeout;
 
 		/* We consider the Linux kernel cannot tick at a frequency
 		   higher than 1 MHz
@@ -171,6 +172,11 @@ int a4l_timedwait_sync(struct a4l_sync * snc,
 						       test_bit(__EVT_PDING,
 								&snc->status),
 						       timeout);
+		/* Stick with the RTDM return values */
+		if (ret > 0)
+			ret = 0;
+		else if (ret == 0)
+			ret = -ETIMEDOUT;
 	}
 
 out_wait:
@@ -178,6 +178,7 @@ struct rtcan_device *rtcan_dev_alloc(int sizeof_priv, int sizeof_board_priv)
     /* Init TX Semaphore, will be destroyed forthwith
      * when setting stop mode */
     rtdm_sem_init(&dev->tx_sem, 0);
+    INIT_LIST_HEAD(&dev->tx_queue);
 #ifdef RTCAN_USE_REFCOUNT
     atomic_set(&dev->refcount, 0);
 #endif
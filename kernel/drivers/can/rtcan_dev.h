@@ -99,6 +99,10 @@ struct rtcan_device {
      * destroyed if it goes into reset mode. */
     rtdm_sem_t          tx_sem;
 
+    /* Frames waiting for a transmit slot, ordered by priority (see
+     * struct rtcan_tx_entry). Protected by device_lock. */
+    struct list_head    tx_queue;
+
     /* Baudrate of this device. Protected by device_lock in all device
      * structures. */
     unsigned int        can_sys_clock;
@@ -60,6 +60,32 @@ struct tx_wait_queue {
 };
 
 
+/*
+ *  Frame waiting in the TX queue of a CAN controller.
+ *
+ *  The queue is ordered by priority. Any sender obtaining a transmit
+ *  slot of the controller sends the frame at the head of the queue,
+ *  regardless of which sender queued it. Every sender holds its own
+ *  elements and removes those still queued before leaving.
+ */
+struct rtcan_tx_req {
+    struct rtcan_socket     *sock;          /* socket frames are sent via */
+    int                     pending;        /* frames not sent yet */
+};
+
+#define RTCAN_TX_QUEUED     1
+
+struct rtcan_tx_entry {
+    struct list_head        next;           /* List pointers */
+    uint64_t                key;            /* queueing order, lowest first */
+    can_frame_t             frame;
+    nanosecs_abs_t          timestamp;      /* time handed to the controller */
+    int                     status;         /* RTCAN_TX_QUEUED, 0 when sent,
+					     * or the transmit error */
+    struct rtcan_tx_req     *req;
+};
+
+
 /* Spinlock for all reception lists and also for some members in
  * struct rtcan_socket */
 extern rtdm_lock_t rtcan_recv_list_lock;
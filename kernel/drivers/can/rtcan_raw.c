@@ -55,6 +55,12 @@
  */
 #define RTCAN_GET_TIMESTAMP         0
 
+/*
+ * Set if socket wants the TX timestamps of sent frames back, see
+ * CAN_RAW_TX_TIMESTAMP
+ */
+#define RTCAN_GET_TX_TIMESTAMP      1
+
 
 MODULE_AUTHOR("RT-Socket-CAN Development Team");
 MODULE_DESCRIPTION("RTDM CAN raw socket device driver");
@@ -89,6 +95,12 @@ static void rtcan_rcv_deliver(struct rtcan_recv *recv_listener,
 
     sock = recv_listener->sock;
 
+    if (sock->ring) {
+	rtcan_raw_ring_deliver(sock, skb);
+	rtdm_fd_unlock(fd);
+	return;
+    }
+
     cpy_size = skb->rb_frame_size;
     /* Check if socket wants to receive a timestamp */
     if (test_bit(RTCAN_GET_TIMESTAMP, &sock->flags)) {
@@ -252,6 +264,7 @@ static void rtcan_raw_close(struct rtdm_fd *fd)
 
     rtdm_lock_put_irqrestore(&rtcan_recv_list_lock, lock_ctx);
 
+    rtcan_raw_ring_release(sock);
 
     rtcan_socket_cleanup(fd);
 }
@@ -397,6 +410,42 @@ static int rtcan_raw_setsockopt(struct rtdm_fd *fd,
 #endif
 	break;
 
+    case CAN_RAW_TX_PRIORITY:
+
+	if (so->optlen != sizeof(int))
+	    return -EINVAL;
+
+	if (rtdm_fd_is_user(fd)) {
+	    if (!rtdm_read_user_ok(fd, so->optval, so->optlen) ||
+		rtdm_copy_from_user(fd, &val, so->optval, so->optlen))
+		return -EFAULT;
+	} else
+	    memcpy(&val, so->optval, so->optlen);
+
+	if (val < 0 || val > CAN_RAW_TX_PRIO_MAX)
+	    return -EINVAL;
+
+	sock->tx_prio = val;
+	break;
+
+    case CAN_RAW_TX_TIMESTAMP:
+
+	if (so->optlen != sizeof(int))
+	    return -EINVAL;
+
+	if (rtdm_fd_is_user(fd)) {
+	    if (!rtdm_read_user_ok(fd, so->optval, so->optlen) ||
+		rtdm_copy_from_user(fd, &val, so->optval, so->optlen))
+		return -EFAULT;
+	} else
+	    memcpy(&val, so->optval, so->optlen);
+
+	if (val)
+	    set_bit(RTCAN_GET_TX_TIMESTAMP, &sock->flags);
+	else
+	    clear_bit(RTCAN_GET_TX_TIMESTAMP, &sock->flags);
+	break;
+
     default:
 	ret = -ENOPROTOOPT;
     }
@@ -504,6 +553,15 @@ int rtcan_raw_ioctl(struct rtdm_fd *fd,
 	break;
     }
 
+    case RTCAN_RTIOC_RING_SETUP:
+	ret = rtcan_raw_ring_setup(fd, (unsigned long)arg);
+	break;
+
+    case RTCAN_RTIOC_RING_WAIT:
+	/* Have the caller switch to primary mode. */
+	ret = -ENOSYS;
+	break;
+
     default:
 	ret = rtcan_raw_ioctl_dev(fd, request, arg);
 	break;
@@ -513,6 +571,16 @@ int rtcan_raw_ioctl(struct rtdm_fd *fd,
 }
 
 
+static int rtcan_raw_ioctl_rt(struct rtdm_fd *fd,
+			      unsigned int request, void *arg)
+{
+    if (request == RTCAN_RTIOC_RING_WAIT)
+	return rtcan_raw_ring_wait(fd, (unsigned long)arg);
+
+    return -ENOSYS;
+}
+
+
 #define MEMCPY_FROM_RING_BUF(to, len)					\
 do {									\
 	if (unlikely((recv_buf_index + len) > RTCAN_RXBUF_SIZE)) { 	\
@@ -762,6 +830,156 @@ ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd,
 }
 
 
+/*
+ * Queueing order of a frame: socket priority first, then the order in
+ * which the bus arbitration would let frames through, i.e. 11 base ID
+ * bits, RTR/SRR, IDE, 18 extended ID bits and RTR, lowest wins.
+ */
+static inline uint64_t rtcan_tx_key(struct rtcan_socket *sock,
+				    can_id_t can_id)
+{
+    uint32_t arb;
+
+    if (can_id & CAN_EFF_FLAG) {
+	arb = ((can_id & CAN_EFF_MASK) >> 18) << 21 | 1 << 20 | 1 << 19 |
+	    (can_id & 0x3ffff) << 1;
+	if (can_id & CAN_RTR_FLAG)
+	    arb |= 1;
+    } else {
+	arb = (can_id & CAN_SFF_MASK) << 21;
+	if (can_id & CAN_RTR_FLAG)
+	    arb |= 1 << 20;
+    }
+
+    return (uint64_t)(CAN_RAW_TX_PRIO_MAX - sock->tx_prio) << 32 | arb;
+}
+
+
+static int rtcan_raw_xmit_queued(struct rtcan_device *dev,
+				 struct rtcan_socket *sock,
+				 struct rtcan_tx_entry *entries, int nr,
+				 nanosecs_rel_t timeout)
+{
+    struct rtcan_tx_req req = { .sock = sock, .pending = nr };
+    struct rtcan_tx_entry *e, *pos;
+    struct tx_wait_queue tx_wait;
+    rtdm_toseq_t timeout_seq;
+    rtdm_lockctx_t lock_ctx;
+    int n, ret = 0, pending;
+    spl_t s;
+
+    rtdm_toseq_init(&timeout_seq, timeout);
+
+    rtdm_lock_get_irqsave(&dev->device_lock, lock_ctx);
+
+    for (n = 0; n < nr; n++) {
+	e = &entries[n];
+	e->req = &req;
+	e->key = rtcan_tx_key(sock, e->frame.can_id);
+	e->timestamp = 0;
+	e->status = RTCAN_TX_QUEUED;
+	/* Keep the queue sorted, FIFO among equal keys. */
+	list_for_each_entry_reverse(pos, &dev->tx_queue, next)
+	    if (pos->key <= e->key)
+		break;
+	list_add(&e->next, &pos->next);
+    }
+
+    rtdm_lock_put_irqrestore(&dev->device_lock, lock_ctx);
+
+    tx_wait.rt_task = rtdm_task_current();
+
+    for (pending = nr; pending > 0; ) {
+	/* Register the task at the socket's TX wait queue and decrement
+	 * the TX semaphore. This must be atomic. Finally, the task must
+	 * be deregistered again (also atomic). */
+	cobalt_atomic_enter(s);
+
+	list_add(&tx_wait.tx_wait_list, &sock->tx_wait_head);
+
+	/* Try to pass the guard in order to access the controller */
+	ret = rtdm_sem_timeddown(&dev->tx_sem, timeout, &timeout_seq);
+
+	/* Only dequeue task again if socket isn't being closed i.e. if
+	 * this task was not unblocked within the close() function. */
+	if (likely(!list_empty(&tx_wait.tx_wait_list)))
+	    /* Dequeue this task from the TX wait queue */
+	    list_del_init(&tx_wait.tx_wait_list);
+	else
+	    /* The socket was closed. */
+	    ret = -EBADF;
+
+	cobalt_atomic_leave(s);
+
+	/* Error code returned? */
+	if (ret != 0) {
+	    if (ret == -EIDRM)
+		/* Controller is stopped or bus-off */
+		ret = -ENETDOWN;
+	    else if (ret == -EWOULDBLOCK)
+		/* We would block but don't want to */
+		ret = -EAGAIN;
+	    break;
+	}
+
+	/* We got access */
+
+	rtdm_lock_get_irqsave(&dev->device_lock, lock_ctx);
+
+	/* Controller should be operating */
+	if (!CAN_STATE_OPERATING(dev->state)) {
+	    if (dev->state == CAN_STATE_SLEEPING) {
+		ret = -ECOMM;
+		rtdm_lock_put_irqrestore(&dev->device_lock, lock_ctx);
+		rtdm_sem_up(&dev->tx_sem);
+		break;
+	    }
+	    ret = -ENETDOWN;
+	    rtdm_lock_put_irqrestore(&dev->device_lock, lock_ctx);
+	    break;
+	}
+
+	if (list_empty(&dev->tx_queue)) {
+	    /* Other senders got our frames out meanwhile. */
+	    pending = req.pending;
+	    rtdm_lock_put_irqrestore(&dev->device_lock, lock_ctx);
+	    rtdm_sem_up(&dev->tx_sem);
+	    continue;
+	}
+
+	/* Send the most urgent frame, whoever queued it. */
+	e = list_first_entry(&dev->tx_queue, struct rtcan_tx_entry, next);
+	list_del(&e->next);
+
+	/* Push message onto stack for loopback when TX done */
+	if (rtcan_loopback_enabled(e->req->sock))
+	    rtcan_tx_push(dev, e->req->sock, &e->frame);
+
+	dev->tx_count++;
+	e->status = dev->hard_start_xmit(dev, &e->frame);
+	e->timestamp = rtdm_clock_read();
+	e->req->pending--;
+	pending = req.pending;
+
+	rtdm_lock_put_irqrestore(&dev->device_lock, lock_ctx);
+    }
+
+    if (pending > 0) {
+	/* Withdraw the frames nobody sent. */
+	rtdm_lock_get_irqsave(&dev->device_lock, lock_ctx);
+	for (n = 0; n < nr; n++) {
+	    if (entries[n].status == RTCAN_TX_QUEUED) {
+		list_del(&entries[n].next);
+		entries[n].status = ret;
+	    }
+	}
+	rtdm_lock_put_irqrestore(&dev->device_lock, lock_ctx);
+    }
+
+    return ret;
+}
+
+
 ssize_t rtcan_raw_sendmsg(struct rtdm_fd *fd,
 			  const struct user_msghdr *msg, int flags)
 {
@@ -770,15 +988,15 @@ ssize_t rtcan_raw_sendmsg(struct rtdm_fd *fd,
     struct sockaddr_can scan_buf;
     struct iovec *iov = (struct iovec *)msg->msg_iov;
     struct iovec iov_buf;
+    struct rtcan_tx_entry *entries;
+    struct rtcan_tx_entry entry_buf;
     can_frame_t *frame;
-    can_frame_t frame_buf;
-    rtdm_lockctx_t lock_ctx;
     nanosecs_rel_t timeout = 0;
-    struct tx_wait_queue tx_wait;
     struct rtcan_device *dev;
+    nanosecs_abs_t *stamps = NULL;
     int ifindex = 0;
     int ret  = 0;
-    spl_t s;
+    int nr, n, sent;
 
 
     if (flags & MSG_OOB)   /* Mirror BSD error message compatibility */
@@ -841,126 +1059,121 @@ ssize_t rtcan_raw_sendmsg(struct rtdm_fd *fd,
 	iov = &iov_buf;
     }
 
-    /* Check size of buffer */
-    if (iov->iov_len != sizeof(can_frame_t))
+    /* Check size of buffer, which may hold a batch of frames */
+    if (iov->iov_len == 0 || iov->iov_len % sizeof(can_frame_t) ||
+	iov->iov_len > RTCAN_TX_BATCH_MAX * sizeof(can_frame_t))
 	return -EMSGSIZE;
 
-    frame = (can_frame_t *)iov->iov_base;
+    nr = iov->iov_len / sizeof(can_frame_t);
 
-    if (rtdm_fd_is_user(fd)) {
-	/* Copy CAN frame from userspace */
-	if (!rtdm_read_user_ok(fd, iov->iov_base,
-			       sizeof(can_frame_t)) ||
-	    rtdm_copy_from_user(fd, &frame_buf, iov->iov_base,
-				sizeof(can_frame_t)))
-	    return -EFAULT;
-
-	frame = &frame_buf;
-    }
+    /* Check the buffer receiving the TX timestamps, if wanted */
+    if (test_bit(RTCAN_GET_TX_TIMESTAMP, &sock->flags)) {
+	stamps = msg->msg_control;
+	if (stamps == NULL ||
+	    msg->msg_controllen < nr * sizeof(nanosecs_abs_t))
+	    return -EINVAL;
 
-    /* Adjust iovec in the common way */
-    iov->iov_base += sizeof(can_frame_t);
-    iov->iov_len -= sizeof(can_frame_t);
-    /* ... and copy it back to userspace if necessary */
-    if (rtdm_fd_is_user(fd)) {
-	if (rtdm_copy_to_user(fd, msg->msg_iov, iov,
-			      sizeof(struct iovec)))
-	    return -EFAULT;
+	if (rtdm_fd_is_user(fd)) {
+	    if (!rtdm_rw_user_ok(fd, stamps, nr * sizeof(nanosecs_abs_t)))
+		return -EFAULT;
+	}
     }
 
-    /* At last, we've got the frame ... */
-
-    /* Check if DLC between 0 and 15 */
-    if (frame->can_dlc > 15)
-	return -EINVAL;
-
-    /* Check if it is a standard frame and the ID between 0 and 2031 */
-    if (!(frame->can_id & CAN_EFF_FLAG)) {
-	u32 id = frame->can_id & CAN_EFF_MASK;
-	if (id > (CAN_SFF_MASK - 16))
-	    return -EINVAL;
+    if (nr == 1)
+	entries = &entry_buf;
+    else {
+	entries = rtdm_malloc(nr * sizeof(*entries));
+	if (entries == NULL)
+	    return -ENOMEM;
     }
 
-    if ((dev = rtcan_dev_get_by_index(ifindex)) == NULL)
-	return -ENXIO;
-
-    timeout = (flags & MSG_DONTWAIT) ? RTDM_TIMEOUT_NONE : sock->tx_timeout;
-
-    tx_wait.rt_task = rtdm_task_current();
-
-    /* Register the task at the socket's TX wait queue and decrement
-     * the TX semaphore. This must be atomic. Finally, the task must
-     * be deregistered again (also atomic). */
-    cobalt_atomic_enter(s);
+    for (n = 0; n < nr; n++) {
+	frame = &entries[n].frame;
 
-    list_add(&tx_wait.tx_wait_list, &sock->tx_wait_head);
+	if (rtdm_fd_is_user(fd)) {
+	    /* Copy CAN frame from userspace */
+	    if (!rtdm_read_user_ok(fd, iov->iov_base,
+				   sizeof(can_frame_t)) ||
+		rtdm_copy_from_user(fd, frame, iov->iov_base,
+				    sizeof(can_frame_t))) {
+		ret = -EFAULT;
+		goto out_free;
+	    }
+	} else
+	    memcpy(frame, iov->iov_base, sizeof(can_frame_t));
 
-    /* Try to pass the guard in order to access the controller */
-    ret = rtdm_sem_timeddown(&dev->tx_sem, timeout, NULL);
+	/* Adjust iovec in the common way */
+	iov->iov_base += sizeof(can_frame_t);
+	iov->iov_len -= sizeof(can_frame_t);
 
-    /* Only dequeue task again if socket isn't being closed i.e. if
-     * this task was not unblocked within the close() function. */
-    if (likely(!list_empty(&tx_wait.tx_wait_list)))
-	/* Dequeue this task from the TX wait queue */
-	list_del_init(&tx_wait.tx_wait_list);
-    else
-	/* The socket was closed. */
-	ret = -EBADF;
+	/* Check if DLC between 0 and 15 */
+	if (frame->can_dlc > 15) {
+	    ret = -EINVAL;
+	    goto out_free;
+	}
 
-    cobalt_atomic_leave(s);
+	/* Check if it is a standard frame and the ID between 0 and 2031 */
+	if (!(frame->can_id & CAN_EFF_FLAG)) {
+	    u32 id = frame->can_id & CAN_EFF_MASK;
+	    if (id > (CAN_SFF_MASK - 16)) {
+		ret = -EINVAL;
+		goto out_free;
+	    }
+	}
+    }
 
-    /* Error code returned? */
-    if (ret != 0) {
-	/* Which error code? */
-	switch (ret) {
-	case -EIDRM:
-	    /* Controller is stopped or bus-off */
-	    ret = -ENETDOWN;
-	    goto send_out1;
+    /* ... and copy the iovec back to userspace if necessary */
+    if (rtdm_fd_is_user(fd)) {
+	if (rtdm_copy_to_user(fd, msg->msg_iov, iov,
+			      sizeof(struct iovec))) {
+	    ret = -EFAULT;
+	    goto out_free;
+	}
+    }
 
-	case -EWOULDBLOCK:
-	    /* We would block but don't want to */
-	    ret = -EAGAIN;
-	    goto send_out1;
+    /* At last, we've got the frames ... */
 
-	default:
-	    /* Return all other error codes unmodified. */
-	    goto send_out1;
-	}
+    if ((dev = rtcan_dev_get_by_index(ifindex)) == NULL) {
+	ret = -ENXIO;
+	goto out_free;
     }
 
-    /* We got access */
+    timeout = (flags & MSG_DONTWAIT) ? RTDM_TIMEOUT_NONE : sock->tx_timeout;
 
+    ret = rtcan_raw_xmit_queued(dev, sock, entries, nr, timeout);
 
-    /* Push message onto stack for loopback when TX done */
-    if (rtcan_loopback_enabled(sock))
-	rtcan_tx_push(dev, sock, frame);
+    rtcan_dev_dereference(dev);
 
-    rtdm_lock_get_irqsave(&dev->device_lock, lock_ctx);
+    for (n = 0, sent = 0; n < nr; n++) {
+	if (entries[n].status == 0)
+	    sent++;
+	else if (ret == 0)
+	    /* Report the first transmit error */
+	    ret = entries[n].status;
+    }
 
-    /* Controller should be operating */
-    if (!CAN_STATE_OPERATING(dev->state)) {
-	if (dev->state == CAN_STATE_SLEEPING) {
-	    ret = -ECOMM;
-	    rtdm_lock_put_irqrestore(&dev->device_lock, lock_ctx);
-	    rtdm_sem_up(&dev->tx_sem);
-	    goto send_out1;
+    /* Copy the TX timestamps back if requested */
+    if (stamps != NULL) {
+	for (n = 0; n < nr; n++) {
+	    if (rtdm_fd_is_user(fd)) {
+		if (rtdm_copy_to_user(fd, stamps + n, &entries[n].timestamp,
+				      sizeof(nanosecs_abs_t))) {
+		    ret = -EFAULT;
+		    goto out_free;
+		}
+	    } else
+		stamps[n] = entries[n].timestamp;
 	}
-	ret = -ENETDOWN;
-	goto send_out2;
     }
 
-    dev->tx_count++;
-    ret = dev->hard_start_xmit(dev, frame);
+    /* Return number of bytes sent upon (partial) completion */
+    if (sent > 0)
+	ret = sent * sizeof(can_frame_t);
 
-    /* Return number of bytes sent upon successful completion */
-    if (ret == 0)
-	ret = sizeof(can_frame_t);
+ out_free:
+    if (entries != &entry_buf)
+	rtdm_free(entries);
 
- send_out2:
-    rtdm_lock_put_irqrestore(&dev->device_lock, lock_ctx);
- send_out1:
-    rtcan_dev_dereference(dev);
     return ret;
 }
 
@@ -978,9 +1191,11 @@ static struct rtdm_driver rtcan_driver = {
 	.ops = {
 		.socket		= rtcan_raw_socket,
 		.close		= rtcan_raw_close,
+		.ioctl_rt	= rtcan_raw_ioctl_rt,
 		.ioctl_nrt	= rtcan_raw_ioctl,
 		.recvmsg_rt	= rtcan_raw_recvmsg,
 		.sendmsg_rt	= rtcan_raw_sendmsg,
+		.mmap		= rtcan_raw_ring_mmap,
 	},
 };
 
@@ -31,6 +31,12 @@ void rtcan_raw_remove_filter(struct rtcan_socket *sock);
 
 void rtcan_rcv(struct rtcan_device *rtcandev, struct rtcan_skb *skb);
 
+int rtcan_raw_ring_setup(struct rtdm_fd *fd, unsigned int nr_slots);
+int rtcan_raw_ring_wait(struct rtdm_fd *fd, unsigned int nr);
+int rtcan_raw_ring_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma);
+void rtcan_raw_ring_deliver(struct rtcan_socket *sock, struct rtcan_skb *skb);
+void rtcan_raw_ring_release(struct rtcan_socket *sock);
+
 void rtcan_loopback(struct rtcan_device *rtcandev);
 #ifdef CONFIG_XENO_DRIVERS_CAN_LOOPBACK
 #define rtcan_loopback_enabled(sock) (sock->loopback)
@@ -0,0 +1,269 @@
+/*
+ * Receive ring shared between a CAN raw socket and user space.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/cache.h>
+#include <linux/slab.h>
+#include <linux/gfp.h>
+#include <linux/log2.h>
+
+#include <rtdm/driver.h>
+
+#include <rtdm/can.h>
+#include "rtcan_internal.h"
+#include "rtcan_socket.h"
+#include "rtcan_list.h"
+#include "rtcan_dev.h"
+#include "rtcan_raw.h"
+
+#define RTCAN_RING_MIN_SLOTS	16
+#define RTCAN_RING_MAX_SLOTS	65536
+
+
+static void rtcan_ring_put(struct rtcan_ring *ring)
+{
+    if (atomic_dec_and_test(&ring->refs)) {
+	free_pages_exact(ring->hdr, ring->size);
+	kfree(ring);
+    }
+}
+
+
+int rtcan_raw_ring_setup(struct rtdm_fd *fd, unsigned int nr_slots)
+{
+    struct rtcan_socket *sock = rtdm_fd_to_private(fd);
+    struct can_ring_hdr *hdr;
+    struct rtcan_ring *ring;
+    rtdm_lockctx_t lock_ctx;
+    size_t slot_off;
+
+    if (nr_slots < RTCAN_RING_MIN_SLOTS || nr_slots > RTCAN_RING_MAX_SLOTS ||
+	!is_power_of_2(nr_slots))
+	return -EINVAL;
+
+    if (sock->ring)
+	return -EBUSY;
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (ring == NULL)
+	return -ENOMEM;
+
+    slot_off = L1_CACHE_ALIGN(sizeof(*hdr));
+    ring->size = PAGE_ALIGN(slot_off + nr_slots * sizeof(struct can_ring_slot));
+
+    /* rtdm_mmap_kmem() wants page-aligned memory. */
+    hdr = alloc_pages_exact(ring->size, GFP_KERNEL | __GFP_ZERO);
+    if (hdr == NULL) {
+	kfree(ring);
+	return -ENOMEM;
+    }
+
+    hdr->nr_slots = nr_slots;
+    hdr->slot_off = slot_off;
+    hdr->map_size = ring->size;
+
+    ring->hdr = hdr;
+    ring->slots = (void *)hdr + slot_off;
+    ring->mask = nr_slots - 1;
+    atomic_set(&ring->refs, 1);
+
+    rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+
+    if (sock->ring) {
+	rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+	rtcan_ring_put(ring);
+	return -EBUSY;
+    }
+
+    sock->ring = ring;
+
+    rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+
+    return 0;
+}
+
+
+/* Called with rtcan_socket_lock held. */
+void rtcan_raw_ring_deliver(struct rtcan_socket *sock, struct rtcan_skb *skb)
+{
+    struct rtcan_ring *ring = sock->ring;
+    struct can_ring_hdr *hdr = ring->hdr;
+    struct rtcan_rb_frame *frame = &skb->rb_frame;
+    struct can_ring_slot *slot;
+    uint32_t head = ring->head, fill;
+    size_t payload_size;
+
+    /*
+     * The consumer index is written by user space: a bogus value
+     * only makes the ring look full, it never lets us write outside
+     * of it.
+     */
+    fill = head - hdr->tail;
+    if (fill >= ring->mask + 1) {
+	hdr->overruns++;
+	sock->rx_buf_full++;
+	RTCAN_RTDM_DBG("rtcan: socket ring overflow, message discarded\n");
+	return;
+    }
+
+    slot = &ring->slots[head & ring->mask];
+    memset(&slot->frame, 0, sizeof(slot->frame));
+    slot->frame.can_id = frame->can_id;
+    slot->frame.can_dlc = frame->can_dlc & RTCAN_HAS_NO_TIMESTAMP;
+    payload_size = min_t(size_t, skb->rb_frame_size - (EMPTY_RB_FRAME_SIZE),
+			 sizeof(slot->frame.data));
+    if (payload_size)
+	memcpy(slot->frame.data, frame->data, payload_size);
+    memcpy(&slot->timestamp, (void *)frame + skb->rb_frame_size,
+	   RTCAN_TIMESTAMP_SIZE);
+    slot->ifindex = frame->can_ifindex;
+
+    /* Publish the slot before the index. */
+    smp_wmb();
+    ring->head = ++head;
+    hdr->head = head;
+
+    /* Wake up the receiver only when the level it waits for is reached. */
+    if (sock->ring_wait && fill + 1 == sock->ring_wait) {
+	sock->ring_wait = 0;
+	rtdm_event_signal(&sock->ring_event);
+    }
+}
+
+
+int rtcan_raw_ring_wait(struct rtdm_fd *fd, unsigned int nr)
+{
+    struct rtcan_socket *sock = rtdm_fd_to_private(fd);
+    struct rtcan_ring *ring;
+    rtdm_toseq_t timeout_seq;
+    rtdm_lockctx_t lock_ctx;
+    uint32_t fill;
+    int ret;
+
+    rtcan_raw_enable_bus_err(sock);
+
+    rtdm_toseq_init(&timeout_seq, sock->rx_timeout);
+
+    rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+
+    ring = sock->ring;
+    if (ring == NULL) {
+	ret = -ENXIO;
+	goto out;
+    }
+
+    if (nr == 0 || nr > ring->mask + 1) {
+	ret = -EINVAL;
+	goto out;
+    }
+
+    for (;;) {
+	fill = ring->head - ring->hdr->tail;
+	if (fill >= nr) {
+	    ret = min(fill, ring->mask + 1);
+	    break;
+	}
+
+	sock->ring_wait = nr;
+
+	rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+
+	ret = rtdm_event_timedwait(&sock->ring_event, sock->rx_timeout,
+				   &timeout_seq);
+
+	rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+
+	if (ret) {
+	    sock->ring_wait = 0;
+	    if (ret == -EIDRM)
+		/* Socket was closed */
+		ret = -EBADF;
+	    else if (ret == -EWOULDBLOCK)
+		/* We would block but don't want to */
+		ret = -EAGAIN;
+	    break;
+	}
+    }
+
+ out:
+    rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+
+    return ret;
+}
+
+
+static void rtcan_ring_vm_open(struct vm_area_struct *vma)
+{
+    struct rtcan_ring *ring = vma->vm_private_data;
+
+    atomic_inc(&ring->refs);
+}
+
+
+static void rtcan_ring_vm_close(struct vm_area_struct *vma)
+{
+    rtcan_ring_put(vma->vm_private_data);
+}
+
+
+static struct vm_operations_struct rtcan_ring_vm_ops = {
+    .open = rtcan_ring_vm_open,
+    .close = rtcan_ring_vm_close,
+};
+
+
+int rtcan_raw_ring_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+    struct rtcan_socket *sock = rtdm_fd_to_private(fd);
+    struct rtcan_ring *ring = sock->ring;
+    size_t len = vma->vm_end - vma->vm_start;
+    int ret;
+
+    if (ring == NULL)
+	return -ENXIO;
+
+    if (vma->vm_pgoff || len > ring->size)
+	return -EINVAL;
+
+    ret = rtdm_mmap_kmem(vma, ring->hdr);
+    if (ret)
+	return ret;
+
+    vma->vm_ops = &rtcan_ring_vm_ops;
+    vma->vm_private_data = ring;
+    atomic_inc(&ring->refs);
+
+    return 0;
+}
+
+
+/* Called once the socket was unbound, no more frames may come in. */
+void rtcan_raw_ring_release(struct rtcan_socket *sock)
+{
+    struct rtcan_ring *ring;
+    rtdm_lockctx_t lock_ctx;
+
+    rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+    ring = sock->ring;
+    sock->ring = NULL;
+    rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+
+    if (ring)
+	rtcan_ring_put(ring);
+}
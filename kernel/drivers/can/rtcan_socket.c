@@ -41,6 +41,7 @@ void rtcan_socket_init(struct rtdm_fd *fd)
 
 
     rtdm_sem_init(&sock->recv_sem, 0);
+    rtdm_event_init(&sock->ring_event, 0);
 
     sock->recv_head = 0;
     sock->recv_tail = 0;
@@ -48,8 +49,11 @@ void rtcan_socket_init(struct rtdm_fd *fd)
     sock->flistlen = RTCAN_SOCK_UNBOUND;
     sock->flist = NULL;
     sock->err_mask = 0;
+    sock->tx_prio = 0;
     sock->rx_buf_full = 0;
     sock->flags = 0;
+    sock->ring = NULL;
+    sock->ring_wait = 0;
 #ifdef CONFIG_XENO_DRIVERS_CAN_LOOPBACK
     sock->loopback = 1;
 #endif
@@ -95,6 +99,7 @@ void rtcan_socket_cleanup(struct rtdm_fd *fd)
     } while (!tx_list_empty);
 
     rtdm_sem_destroy(&sock->recv_sem);
+    rtdm_event_destroy(&sock->ring_event);
 
     rtdm_lock_get_irqsave(&rtcan_recv_list_lock, lock_ctx);
     if (sock->socket_list.next) {
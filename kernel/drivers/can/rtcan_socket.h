@@ -109,6 +109,24 @@ struct rtcan_skb {
     struct rtcan_rb_frame rb_frame;
 };
 
+/*
+ * Receive ring shared with user space, see RTCAN_RTIOC_RING_SETUP.
+ * The memory stays around as long as the socket or a mapping
+ * references it.
+ */
+struct rtcan_ring {
+    struct can_ring_hdr  *hdr;
+    struct can_ring_slot *slots;
+    size_t               size;
+
+    /* Private copy of the producer index, user space may scribble
+     * over the shared one. */
+    uint32_t             head;
+    uint32_t             mask;
+
+    atomic_t             refs;
+};
+
 struct rtcan_filter_list {
     int flistlen;
     struct can_filter flist[1];
@@ -170,10 +188,24 @@ struct rtcan_socket {
 
     uint32_t            err_mask;
 
+    /* Priority of the frames sent, see CAN_RAW_TX_PRIORITY */
+    int                 tx_prio;
+
     uint32_t            rx_buf_full;
 
     struct rtcan_filter_list *flist;
 
+    /* Receive ring replacing recv_buf if set up. Protected by
+     * rtcan_socket_lock in all socket structures. */
+    struct rtcan_ring   *ring;
+
+    /* Ring fill level the receiver waits for, 0 if nobody waits.
+     * Protected by rtcan_socket_lock in all socket structures. */
+    uint32_t            ring_wait;
+
+    /* Event signaled when the ring fill level reaches ring_wait */
+    rtdm_event_t        ring_event;
+
 #ifdef CONFIG_XENO_DRIVERS_CAN_LOOPBACK
     int loopback;
 #endif
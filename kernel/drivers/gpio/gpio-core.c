@@ -22,8 +22,21 @@
 #include <linux/irq.h>
 #include <linux/slab.h>
 #include <linux/err.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/delay.h>
 #include "gpio-core.h"
 
+#define GPIO_EVQ_MAX_EVENTS  65536
+
+struct rtdm_gpio_evq {
+	atomic_t refs;
+	size_t size;
+	unsigned int mask;
+	struct rtdm_gpio_evq_header *hdr;
+	struct rtdm_gpio_event *ring;
+};
+
 struct rtdm_gpio_pin {
 	struct rtdm_device dev;
 	struct list_head next;
@@ -31,25 +44,138 @@ struct rtdm_gpio_pin {
 	rtdm_event_t event;
 	char *name;
 	struct gpio_desc *desc;
+	struct rtdm_gpio_evq *evq;
+	unsigned int sequence;
+	int trigger;
 };
 
 struct rtdm_gpio_chan {
 	int requested : 1,
 	    has_direction : 1,
 	    is_output : 1 ;
+	struct rtdm_gpio_evq *evq;
+	/* Readers in read_events(), under the chip lock. */
+	int nreaders;
 };
 
+static struct rtdm_gpio_evq *alloc_evq(unsigned int nr_events)
+{
+	struct rtdm_gpio_evq *evq;
+	size_t size;
+
+	evq = kzalloc(sizeof(*evq), GFP_KERNEL);
+	if (evq == NULL)
+		return NULL;
+
+	size = PAGE_ALIGN(sizeof(struct rtdm_gpio_evq_header) +
+			  nr_events * sizeof(struct rtdm_gpio_event));
+	evq->hdr = alloc_pages_exact(size, GFP_KERNEL|__GFP_ZERO);
+	if (evq->hdr == NULL) {
+		kfree(evq);
+		return NULL;
+	}
+
+	evq->size = size;
+	evq->mask = nr_events - 1;
+	evq->ring = rtdm_gpio_evq_ring(evq->hdr);
+	evq->hdr->nr_events = nr_events;
+	atomic_set(&evq->refs, 1);
+
+	return evq;
+}
+
+static inline void get_evq(struct rtdm_gpio_evq *evq)
+{
+	atomic_inc(&evq->refs);
+}
+
+static void put_evq(struct rtdm_gpio_evq *evq)
+{
+	if (atomic_dec_and_test(&evq->refs)) {
+		free_pages_exact(evq->hdr, evq->size);
+		kfree(evq);
+	}
+}
+
+static void evq_vm_open(struct vm_area_struct *vma)
+{
+	get_evq(vma->vm_private_data);
+}
+
+static void evq_vm_close(struct vm_area_struct *vma)
+{
+	put_evq(vma->vm_private_data);
+}
+
+static struct vm_operations_struct evq_vm_ops = {
+	.open = evq_vm_open,
+	.close = evq_vm_close,
+};
+
+static void gpio_pin_post_event(struct rtdm_gpio_pin *pin)
+{
+	struct rtdm_gpio_evq *evq = pin->evq;
+	struct rtdm_gpio_evq_header *hdr;
+	struct rtdm_gpio_event *ev;
+	nanosecs_abs_t now;
+	unsigned int head;
+
+	now = rtdm_clock_read_monotonic();
+
+	if (evq) {
+		/*
+		 * Single producer ring: we are the only writer of
+		 * ->head, the consumer only moves ->tail. Never trust
+		 * the latter for indexing since it may be updated
+		 * from user-space.
+		 */
+		hdr = evq->hdr;
+		head = hdr->head;
+		if (head - READ_ONCE(hdr->tail) > evq->mask)
+			hdr->overflows++;
+		else {
+			ev = evq->ring + (head & evq->mask);
+			ev->timestamp = now;
+			ev->sequence = pin->sequence;
+			ev->value = gpiod_get_raw_value(pin->desc);
+			smp_wmb();
+			hdr->head = head + 1;
+		}
+	}
+
+	pin->sequence++;
+	rtdm_event_signal(&pin->event);
+}
+
 static int gpio_pin_interrupt(rtdm_irq_t *irqh)
 {
 	struct rtdm_gpio_pin *pin;
 
 	pin = rtdm_irq_get_arg(irqh, struct rtdm_gpio_pin);
 
-	rtdm_event_signal(&pin->event);
+	gpio_pin_post_event(pin);
 
 	return RTDM_IRQ_HANDLED;
 }
 
+static inline struct rtdm_gpio_chip *pin_to_chip(struct rtdm_gpio_pin *pin)
+{
+	return pin->dev.device_data;
+}
+
+static void set_pin_events(struct rtdm_gpio_pin *pin,
+			   struct rtdm_gpio_evq *evq, int trigger)
+{
+	struct rtdm_gpio_chip *rgc = pin_to_chip(pin);
+	rtdm_lockctx_t s;
+
+	rtdm_lock_get_irqsave(&rgc->lock, s);
+	pin->evq = evq;
+	pin->trigger = trigger;
+	pin->sequence = 0;
+	rtdm_lock_put_irqrestore(&rgc->lock, s);
+}
+
 static int request_gpio_irq(unsigned int gpio, struct rtdm_gpio_pin *pin,
 			    struct rtdm_gpio_chan *chan,
 			    int trigger)
@@ -60,6 +186,14 @@ static int request_gpio_irq(unsigned int gpio, struct rtdm_gpio_pin *pin,
 	if (trigger & ~GPIO_TRIGGER_MASK)
 		return -EINVAL;
 
+	if (pin_to_chip(pin)->soft_irq) {
+		/* Software-driven pins only know about edges. */
+		if (trigger & (GPIO_TRIGGER_LEVEL_HIGH|GPIO_TRIGGER_LEVEL_LOW))
+			return -EINVAL;
+		if (trigger == GPIO_TRIGGER_NONE)
+			trigger = GPIO_TRIGGER_EDGE_RISING|GPIO_TRIGGER_EDGE_FALLING;
+	}
+
 	ret = gpio_request(gpio, pin->name);
 	if (ret) {
 		if (ret != -EPROBE_DEFER)
@@ -77,6 +211,13 @@ static int request_gpio_irq(unsigned int gpio, struct rtdm_gpio_pin *pin,
 	gpio_export(gpio, true);
 
 	rtdm_event_clear(&pin->event);
+	set_pin_events(pin, chan->evq, trigger);
+
+	if (pin_to_chip(pin)->soft_irq) {
+		chan->requested = true;
+		return 0;
+	}
+
 	irq = gpio_to_irq(gpio);
 
 	irq_trigger = 0;
@@ -105,6 +246,7 @@ static int request_gpio_irq(unsigned int gpio, struct rtdm_gpio_pin *pin,
 
 	return 0;
 fail:
+	set_pin_events(pin, NULL, GPIO_TRIGGER_NONE);
 	gpio_free(gpio);
 
 	return ret;
@@ -113,9 +255,62 @@ fail:
 static void release_gpio_irq(unsigned int gpio, struct rtdm_gpio_pin *pin,
 			     struct rtdm_gpio_chan *chan)
 {
-	rtdm_irq_free(&pin->irqh);
-	gpio_free(gpio);
+	struct rtdm_gpio_chip *rgc = pin_to_chip(pin);
+	rtdm_lockctx_t s;
+	int nreaders;
+
+	if (!rgc->soft_irq)
+		rtdm_irq_free(&pin->irqh);
+
+	rtdm_lock_get_irqsave(&rgc->lock, s);
 	chan->requested = false;
+	pin->evq = NULL;
+	pin->trigger = GPIO_TRIGGER_NONE;
+	rtdm_lock_put_irqrestore(&rgc->lock, s);
+
+	/*
+	 * Kick the readers sleeping on the event queue, then wait for
+	 * all of them to leave it, so that the ring may be freed once
+	 * we return. No new reader may enter since we cleared
+	 * ->requested.
+	 */
+	rtdm_event_signal(&pin->event);
+
+	for (;;) {
+		rtdm_lock_get_irqsave(&rgc->lock, s);
+		nreaders = chan->nreaders;
+		rtdm_lock_put_irqrestore(&rgc->lock, s);
+		if (nreaders == 0)
+			break;
+		msleep(1);
+	}
+
+	gpio_free(gpio);
+}
+
+static int setup_evq(struct rtdm_gpio_chan *chan, int nr_events)
+{
+	struct rtdm_gpio_evq *evq = NULL;
+
+	/* The ring may not change under the feet of the handler. */
+	if (chan->requested)
+		return -EBUSY;
+
+	if (nr_events) {
+		if (nr_events < 2 || nr_events > GPIO_EVQ_MAX_EVENTS ||
+		    !is_power_of_2(nr_events))
+			return -EINVAL;
+		evq = alloc_evq(nr_events);
+		if (evq == NULL)
+			return -ENOMEM;
+	}
+
+	if (chan->evq)
+		put_evq(chan->evq);
+
+	chan->evq = evq;
+
+	return 0;
 }
 
 static int gpio_pin_ioctl_nrt(struct rtdm_fd *fd,
@@ -124,7 +319,8 @@ static int gpio_pin_ioctl_nrt(struct rtdm_fd *fd,
 	struct rtdm_gpio_chan *chan = rtdm_fd_to_private(fd);
 	struct rtdm_device *dev = rtdm_fd_device(fd);
 	unsigned int gpio = rtdm_fd_minor(fd);
-	int ret = 0, val, trigger;
+	int ret = 0, val, trigger, nr_events;
+	struct rtdm_gpio_evq_header stat;
 	struct rtdm_gpio_pin *pin;
 	
 	pin = container_of(dev, struct rtdm_gpio_pin, dev);
@@ -158,6 +354,19 @@ static int gpio_pin_ioctl_nrt(struct rtdm_fd *fd,
 		release_gpio_irq(gpio, pin, chan);
 		chan->requested = false;
 		break;
+	case GPIO_RTIOC_EVQ_SETUP:
+		ret = rtdm_safe_copy_from_user(fd, &nr_events,
+				       arg, sizeof(nr_events));
+		if (ret)
+			return ret;
+		ret = setup_evq(chan, nr_events);
+		break;
+	case GPIO_RTIOC_EVQ_STAT:
+		if (chan->evq == NULL)
+			return -ENXIO;
+		stat = *chan->evq->hdr;
+		ret = rtdm_safe_copy_to_user(fd, arg, &stat, sizeof(stat));
+		break;
 	default:
 		return -EINVAL;
 	}
@@ -165,11 +374,104 @@ static int gpio_pin_ioctl_nrt(struct rtdm_fd *fd,
 	return ret;
 }
 
+static struct rtdm_gpio_evq *enter_evq(struct rtdm_gpio_pin *pin,
+				       struct rtdm_gpio_chan *chan)
+{
+	struct rtdm_gpio_chip *rgc = pin_to_chip(pin);
+	struct rtdm_gpio_evq *evq = NULL;
+	rtdm_lockctx_t s;
+
+	rtdm_lock_get_irqsave(&rgc->lock, s);
+
+	if (chan->requested && chan->evq) {
+		evq = chan->evq;
+		chan->nreaders++;
+	}
+
+	rtdm_lock_put_irqrestore(&rgc->lock, s);
+
+	return evq;
+}
+
+static void leave_evq(struct rtdm_gpio_pin *pin,
+		      struct rtdm_gpio_chan *chan)
+{
+	struct rtdm_gpio_chip *rgc = pin_to_chip(pin);
+	rtdm_lockctx_t s;
+
+	rtdm_lock_get_irqsave(&rgc->lock, s);
+	chan->nreaders--;
+	rtdm_lock_put_irqrestore(&rgc->lock, s);
+}
+
+static ssize_t read_events(struct rtdm_fd *fd, struct rtdm_gpio_pin *pin,
+			   struct rtdm_gpio_chan *chan,
+			   struct rtdm_gpio_evq *evq,
+			   void __user *buf, size_t len)
+{
+	struct rtdm_gpio_evq_header *hdr = evq->hdr;
+	unsigned int head, tail, avail, count, idx, chunk;
+	int ret;
+
+	count = len / sizeof(struct rtdm_gpio_event);
+	if (count == 0)
+		return -EINVAL;
+
+	for (;;) {
+		head = READ_ONCE(hdr->head);
+		tail = READ_ONCE(hdr->tail);
+		avail = head - tail;
+		if (avail)
+			break;
+		/* Interrupts were disabled under our feet. */
+		if (!chan->requested)
+			return -EIDRM;
+		if (fd->oflags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = rtdm_event_wait(&pin->event);
+		if (ret)
+			return ret;
+	}
+
+	/* Resync over a consumer index trashed from user-space. */
+	if (avail > evq->mask + 1) {
+		avail = evq->mask + 1;
+		tail = head - avail;
+	}
+
+	smp_rmb();
+
+	/* Copy out the whole batch, at most two chunks on wrap. */
+	if (count > avail)
+		count = avail;
+	idx = tail & evq->mask;
+	chunk = min(count, evq->mask + 1 - idx);
+	ret = rtdm_safe_copy_to_user(fd, buf, evq->ring + idx,
+				     chunk * sizeof(struct rtdm_gpio_event));
+	if (ret)
+		return ret;
+
+	if (count > chunk) {
+		ret = rtdm_safe_copy_to_user(fd,
+			     buf + chunk * sizeof(struct rtdm_gpio_event),
+			     evq->ring,
+			     (count - chunk) * sizeof(struct rtdm_gpio_event));
+		if (ret)
+			return ret;
+	}
+
+	smp_mb();
+	hdr->tail = tail + count;
+
+	return count * sizeof(struct rtdm_gpio_event);
+}
+
 static ssize_t gpio_pin_read_rt(struct rtdm_fd *fd,
 				void __user *buf, size_t len)
 {
 	struct rtdm_gpio_chan *chan = rtdm_fd_to_private(fd);
 	struct rtdm_device *dev = rtdm_fd_device(fd);
+	struct rtdm_gpio_evq *evq;
 	struct rtdm_gpio_pin *pin;
 	int value, ret;
 
@@ -184,6 +486,13 @@ static ssize_t gpio_pin_read_rt(struct rtdm_fd *fd,
 
 	pin = container_of(dev, struct rtdm_gpio_pin, dev);
 
+	evq = enter_evq(pin, chan);
+	if (evq) {
+		ret = read_events(fd, pin, chan, evq, buf, len);
+		leave_evq(pin, chan);
+		return ret;
+	}
+
 	if (!(fd->oflags & O_NONBLOCK)) {
 		ret = rtdm_event_wait(&pin->event);
 		if (ret)
@@ -241,6 +550,32 @@ static int gpio_pin_select(struct rtdm_fd *fd, struct xnselector *selector,
 	return rtdm_event_select(&pin->event, selector, type, index);
 }
 
+static int gpio_pin_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	struct rtdm_gpio_chan *chan = rtdm_fd_to_private(fd);
+	struct rtdm_gpio_evq *evq = chan->evq;
+	size_t len;
+	int ret;
+
+	if (evq == NULL)
+		return -ENXIO;
+
+	len = vma->vm_end - vma->vm_start;
+	if (vma->vm_pgoff || len > evq->size)
+		return -EINVAL;
+
+	ret = rtdm_mmap_kmem(vma, evq->hdr);
+	if (ret)
+		return ret;
+
+	/* The mapping holds a reference on the ring. */
+	vma->vm_ops = &evq_vm_ops;
+	vma->vm_private_data = evq;
+	get_evq(evq);
+
+	return 0;
+}
+
 static void gpio_pin_close(struct rtdm_fd *fd)
 {
 	struct rtdm_gpio_chan *chan = rtdm_fd_to_private(fd);
@@ -252,6 +587,9 @@ static void gpio_pin_close(struct rtdm_fd *fd)
 		pin = container_of(dev, struct rtdm_gpio_pin, dev);
 		release_gpio_irq(gpio, pin, chan);
 	}
+
+	if (chan->evq)
+		put_evq(chan->evq);
 }
 
 static void delete_pin_devices(struct rtdm_gpio_chip *rgc)
@@ -366,6 +704,7 @@ int rtdm_gpiochip_add(struct rtdm_gpio_chip *rgc,
 		.read_rt	=	gpio_pin_read_rt,
 		.write_rt	=	gpio_pin_write_rt,
 		.select		=	gpio_pin_select,
+		.mmap		=	gpio_pin_mmap,
 	};
 	
 	rtdm_drv_set_sysclass(&rgc->driver, rgc->devclass);
@@ -416,6 +755,40 @@ int rtdm_gpiochip_add_by_name(struct rtdm_gpio_chip *rgc,
 }
 EXPORT_SYMBOL_GPL(rtdm_gpiochip_add_by_name);
 
+/**
+ * Post an edge event on a pin of a software-driven chip.
+ *
+ * Chips registered with rgc->soft_irq set have no interrupt line
+ * backing their pins; their driver should call this routine each
+ * time the level of @a offset changes instead. The event is queued
+ * only if it matches the trigger enabled on that pin.
+ *
+ * @coretags{unrestricted}
+ */
+void rtdm_gpiochip_post_event(struct rtdm_gpio_chip *rgc,
+			      unsigned int offset)
+{
+	unsigned int gpio = rgc->gc->base + offset;
+	struct rtdm_gpio_pin *pin;
+	rtdm_lockctx_t s;
+	int value, edge;
+
+	rtdm_lock_get_irqsave(&rgc->lock, s);
+
+	list_for_each_entry(pin, &rgc->pins, next) {
+		if (pin->dev.minor != gpio)
+			continue;
+		value = gpiod_get_raw_value(pin->desc);
+		edge = value ? GPIO_TRIGGER_EDGE_RISING : GPIO_TRIGGER_EDGE_FALLING;
+		if (pin->trigger & edge)
+			gpio_pin_post_event(pin);
+		break;
+	}
+
+	rtdm_lock_put_irqrestore(&rgc->lock, s);
+}
+EXPORT_SYMBOL_GPL(rtdm_gpiochip_post_event);
+
 #ifdef CONFIG_OF
 
 #include <linux/of_platform.h>
@@ -32,6 +32,8 @@ struct rtdm_gpio_chip {
 	struct list_head pins;
 	struct list_head next;
 	rtdm_lock_t lock;
+	/* Pins have no IRQ line, see rtdm_gpiochip_post_event(). */
+	bool soft_irq;
 };
 
 int rtdm_gpiochip_add(struct rtdm_gpio_chip *rgc,
@@ -43,6 +45,9 @@ void rtdm_gpiochip_remove(struct rtdm_gpio_chip *rgc);
 int rtdm_gpiochip_add_by_name(struct rtdm_gpio_chip *rgc,
 			      const char *label, int gpio_subclass);
 
+void rtdm_gpiochip_post_event(struct rtdm_gpio_chip *rgc,
+			      unsigned int offset);
+
 #ifdef CONFIG_OF
 
 int rtdm_gpiochip_scan_of(struct device_node *from,
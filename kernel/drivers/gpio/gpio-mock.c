@@ -0,0 +1,117 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/module.h>
+#include <linux/gpio.h>
+#include <linux/bitops.h>
+#include "gpio-core.h"
+
+#define RTDM_SUBCLASS_MOCK  3
+
+#define MOCK_NGPIO  32
+
+/*
+ * Software-only GPIO chip, pins are wired by pairs: driving the
+ * even pin of a pair as an output changes the level of its odd
+ * neighbour, which posts an edge event to the RTDM GPIO core as a
+ * hardware interrupt would. This allows to exercise the timestamped
+ * event queue without any GPIO hardware.
+ */
+static struct gpio_mock {
+	struct gpio_chip gc;
+	struct rtdm_gpio_chip rgc;
+	unsigned long levels;
+} mock;
+
+static int mock_get(struct gpio_chip *gc, unsigned int offset)
+{
+	return test_bit(offset, &mock.levels);
+}
+
+static void mock_set_level(unsigned int offset, int value)
+{
+	int old;
+
+	if (value)
+		old = test_and_set_bit(offset, &mock.levels);
+	else
+		old = test_and_clear_bit(offset, &mock.levels);
+
+	if (!old != !value)
+		rtdm_gpiochip_post_event(&mock.rgc, offset);
+}
+
+static void mock_set(struct gpio_chip *gc, unsigned int offset, int value)
+{
+	mock_set_level(offset, value);
+	if ((offset & 1) == 0)
+		mock_set_level(offset + 1, value);
+}
+
+static int mock_direction_input(struct gpio_chip *gc, unsigned int offset)
+{
+	return 0;
+}
+
+static int mock_direction_output(struct gpio_chip *gc,
+				 unsigned int offset, int value)
+{
+	mock_set(gc, offset, value);
+
+	return 0;
+}
+
+static int __init mock_gpio_init(void)
+{
+	int ret;
+
+	if (!realtime_core_enabled())
+		return 0;
+
+	mock.gc = (struct gpio_chip){
+		.label = "gpio-mock",
+		.owner = THIS_MODULE,
+		.base = -1,
+		.ngpio = MOCK_NGPIO,
+		.get = mock_get,
+		.set = mock_set,
+		.direction_input = mock_direction_input,
+		.direction_output = mock_direction_output,
+	};
+
+	ret = gpiochip_add(&mock.gc);
+	if (ret)
+		return ret;
+
+	mock.rgc.soft_irq = true;
+	ret = rtdm_gpiochip_add(&mock.rgc, &mock.gc, RTDM_SUBCLASS_MOCK);
+	if (ret)
+		gpiochip_remove(&mock.gc);
+
+	return ret;
+}
+module_init(mock_gpio_init);
+
+static void __exit mock_gpio_exit(void)
+{
+	if (!realtime_core_enabled())
+		return;
+
+	rtdm_gpiochip_remove(&mock.rgc);
+	gpiochip_remove(&mock.gc);
+}
+module_exit(mock_gpio_exit);
+
+MODULE_LICENSE("GPL");
@@ -22,6 +22,8 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/map.h>
 #include <cobalt/kernel/bufd.h>
@@ -30,6 +32,15 @@
 
 #define BUFP_SOCKET_MAGIC 0xa61a61a6
 
+/* Largest mapped ring, so that 32bit indices can't wrap over it. */
+#define BUFP_RING_MAXSZ   (1UL << 30)
+
+struct bufp_ring {
+	struct bufp_ring_hdr *hdr;
+	size_t size;
+	atomic_t refs;
+};
+
 struct bufp_socket {
 	int magic;
 	struct sockaddr_ipc name;
@@ -52,6 +63,9 @@ struct bufp_socket {
 	nanosecs_rel_t rx_timeout;
 	nanosecs_rel_t tx_timeout;
 
+	int mapped;
+	struct bufp_ring *ring;
+
 	struct rtipc_private *priv;
 };
 
@@ -102,6 +116,155 @@ static struct xnpnode_link __bufp_pnode = {
 
 #endif /* !CONFIG_XENO_OPT_VFILE */
 
+/*
+ * In mapped mode, the ring indices live in the shared header and may
+ * be moved from user space at any time. Clamp the fill level to the
+ * buffer size: a bogus index may only garble the data, offsets are
+ * always masked.
+ */
+static inline size_t bufp_fillsz(struct bufp_socket *sk)
+{
+	struct bufp_ring_hdr *hdr;
+	u32 fillsz;
+
+	if (sk->ring == NULL)
+		return sk->fillsz;
+
+	hdr = sk->ring->hdr;
+	fillsz = READ_ONCE(hdr->head) - READ_ONCE(hdr->tail);
+
+	return min_t(size_t, fillsz, sk->bufsz);
+}
+
+static inline off_t bufp_rdoff(struct bufp_socket *sk)
+{
+	if (sk->ring == NULL)
+		return sk->rdoff;
+
+	/* Read the data only after the index which published it. */
+	smp_rmb();
+
+	return READ_ONCE(sk->ring->hdr->tail) & (sk->bufsz - 1);
+}
+
+static inline off_t bufp_wroff(struct bufp_socket *sk)
+{
+	if (sk->ring == NULL)
+		return sk->wroff;
+
+	/* Do not overwrite the space before it was released. */
+	smp_mb();
+
+	return READ_ONCE(sk->ring->hdr->head) & (sk->bufsz - 1);
+}
+
+static inline void bufp_consume(struct bufp_socket *sk,
+				off_t rdoff, size_t len)
+{
+	struct bufp_ring_hdr *hdr;
+
+	if (sk->ring == NULL) {
+		sk->fillsz -= len;
+		sk->rdoff = rdoff;
+		return;
+	}
+
+	hdr = sk->ring->hdr;
+	/* Done with the data before the space is handed back. */
+	smp_mb();
+	WRITE_ONCE(hdr->tail, hdr->tail + len);
+}
+
+static inline void bufp_produce(struct bufp_socket *sk,
+				off_t wroff, size_t len)
+{
+	struct bufp_ring_hdr *hdr;
+
+	if (sk->ring == NULL) {
+		sk->fillsz += len;
+		sk->wroff = wroff;
+		return;
+	}
+
+	hdr = sk->ring->hdr;
+	/* Publish the data before the index. */
+	smp_wmb();
+	WRITE_ONCE(hdr->head, hdr->head + len);
+}
+
+/*
+ * Ask the user-space side of a mapped ring to kick us via
+ * BUFP_RTIOC_NOTIFY once it moved its index. The caller must check
+ * the ring state again afterwards, so that no update is missed.
+ */
+static inline void bufp_set_waiters(struct bufp_socket *sk, u32 flag)
+{
+	if (sk->ring) {
+		sk->ring->hdr->waiters |= flag;
+		smp_mb();
+	}
+}
+
+static inline void bufp_clear_waiters(struct bufp_socket *sk, u32 flag)
+{
+	if (sk->ring)
+		sk->ring->hdr->waiters &= ~flag;
+}
+
+static void bufp_ring_put(struct bufp_ring *ring)
+{
+	if (atomic_dec_and_test(&ring->refs)) {
+		xnheap_vfree(ring->hdr);
+		kfree(ring);
+	}
+}
+
+static int bufp_ring_alloc(struct bufp_socket *sk)
+{
+	struct bufp_ring_hdr *hdr;
+	struct bufp_ring *ring;
+	size_t bufsz;
+
+	if (sk->bufsz > BUFP_RING_MAXSZ)
+		return -ENOMEM;
+
+	/* Power of two so that the indices may run freely. */
+	bufsz = roundup_pow_of_two(max_t(size_t, sk->bufsz, PAGE_SIZE));
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	/* The header takes a page of its own, data follows. */
+	ring->size = PAGE_SIZE + bufsz;
+	hdr = xnheap_vmalloc(ring->size);
+	if (hdr == NULL) {
+		kfree(ring);
+		return -ENOMEM;
+	}
+
+	memset(hdr, 0, PAGE_SIZE);
+	hdr->size = bufsz;
+	hdr->data_off = PAGE_SIZE;
+	hdr->map_size = ring->size;
+	ring->hdr = hdr;
+	atomic_set(&ring->refs, 1);
+
+	sk->ring = ring;
+	sk->bufsz = bufsz;
+	sk->bufmem = (void *)hdr + PAGE_SIZE;
+
+	return 0;
+}
+
+static void bufp_free_buffer(struct bufp_socket *sk)
+{
+	if (sk->ring)
+		bufp_ring_put(sk->ring);
+	else
+		xnheap_vfree(sk->bufmem);
+}
+
 static int bufp_socket(struct rtdm_fd *fd)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
@@ -121,6 +284,8 @@ static int bufp_socket(struct rtdm_fd *fd)
 	sk->handle = 0;
 	sk->rx_timeout = RTDM_TIMEOUT_INFINITE;
 	sk->tx_timeout = RTDM_TIMEOUT_INFINITE;
+	sk->mapped = 0;
+	sk->ring = NULL;
 	*sk->label = 0;
 	rtdm_event_init(&sk->i_event, 0);
 	rtdm_event_init(&sk->o_event, 0);
@@ -149,7 +314,7 @@ static void bufp_close(struct rtdm_fd *fd)
 			xnregistry_remove(sk->handle);
 
 		if (sk->bufmem)
-			xnheap_vfree(sk->bufmem);
+			bufp_free_buffer(sk);
 	}
 
 	kfree(sk);
@@ -163,8 +328,8 @@ static ssize_t __bufp_readbuf(struct bufp_socket *sk,
 	struct rtipc_wait_context *wc;
 	struct xnthread *waiter;
 	rtdm_toseq_t toseq;
+	size_t rbytes, n, fillsz;
 	ssize_t len, ret;
-	size_t rbytes, n;
 	rtdm_lockctx_t s;
 	u_long rdtoken;
 	off_t rdoff;
@@ -181,7 +346,7 @@ redo:
 		 * We should be able to read a complete message of the
 		 * requested length, or block.
 		 */
-		if (sk->fillsz < len)
+		if (bufp_fillsz(sk) < len)
 			goto wait;
 
 		/*
@@ -191,7 +356,7 @@ redo:
 		rdtoken = ++sk->rdtoken;
 
 		/* Read from the buffer in a circular way. */
-		rdoff = sk->rdoff;
+		rdoff = bufp_rdoff(sk);
 		rbytes = len;
 
 		do {
@@ -223,15 +388,15 @@ redo:
 			rbytes -= n;
 		} while (rbytes > 0);
 
-		sk->fillsz -= len;
-		sk->rdoff = rdoff;
+		bufp_consume(sk, rdoff, len);
+		fillsz = bufp_fillsz(sk);
 		ret = len;
 
 		resched = 0;
-		if (sk->fillsz + len == sk->bufsz) /* -> writable */
+		if (fillsz + len == sk->bufsz) /* -> writable */
 			resched |= xnselect_signal(&sk->priv->send_block, POLLOUT);
 
-		if (sk->fillsz == 0) /* -> non-readable */
+		if (fillsz == 0) /* -> non-readable */
 			resched |= xnselect_signal(&sk->priv->recv_block, 0);
 
 		/*
@@ -246,10 +411,11 @@ redo:
 		wc = rtipc_get_wait_context(waiter);
 		XENO_BUG_ON(COBALT, wc == NULL);
 		bufwc = container_of(wc, struct bufp_wait_context, wc);
-		if (bufwc->len + sk->fillsz <= sk->bufsz)
+		if (bufwc->len + fillsz <= sk->bufsz) {
+			bufp_clear_waiters(sk, BUFP_RING_WRWAIT);
 			/* This call rescheds internally. */
 			rtdm_event_pulse(&sk->o_event);
-		else if (resched)
+		} else if (resched)
 			xnsched_run();
 		/*
 		 * We cannot fail anymore once some data has been
@@ -271,11 +437,16 @@ redo:
 		 * pathological use of the buffer. We must allow for a
 		 * short read to prevent a deadlock.
 		 */
-		if (sk->fillsz > 0 && rtipc_peek_wait_head(&sk->o_event)) {
-			len = sk->fillsz;
+		fillsz = bufp_fillsz(sk);
+		if (fillsz > 0 && rtipc_peek_wait_head(&sk->o_event)) {
+			len = fillsz;
 			goto redo;
 		}
 
+		bufp_set_waiters(sk, BUFP_RING_RDWAIT);
+		if (bufp_fillsz(sk) >= len)
+			continue;
+
 		wait.len = len;
 		wait.sk = sk;
 		rtipc_prepare_wait(&wait.wc);
@@ -417,9 +588,9 @@ static ssize_t __bufp_writebuf(struct bufp_socket *rsk,
 	struct rtipc_wait_context *wc;
 	struct xnthread *waiter;
 	rtdm_toseq_t toseq;
+	size_t wbytes, n, fillsz;
 	rtdm_lockctx_t s;
 	ssize_t len, ret;
-	size_t wbytes, n;
 	u_long wrtoken;
 	off_t wroff;
 	int resched;
@@ -435,7 +606,7 @@ redo:
 		 * We should be able to write the entire message at
 		 * once or block.
 		 */
-		if (rsk->fillsz + len > rsk->bufsz)
+		if (bufp_fillsz(rsk) + len > rsk->bufsz)
 			goto wait;
 
 		/*
@@ -445,7 +616,7 @@ redo:
 		wrtoken = ++rsk->wrtoken;
 
 		/* Write to the buffer in a circular way. */
-		wroff = rsk->wroff;
+		wroff = bufp_wroff(rsk);
 		wbytes = len;
 
 		do {
@@ -476,15 +647,15 @@ redo:
 			wbytes -= n;
 		} while (wbytes > 0);
 
-		rsk->fillsz += len;
-		rsk->wroff = wroff;
+		bufp_produce(rsk, wroff, len);
+		fillsz = bufp_fillsz(rsk);
 		ret = len;
 		resched = 0;
 
-		if (rsk->fillsz == len) /* -> readable */
+		if (fillsz == len) /* -> readable */
 			resched |= xnselect_signal(&rsk->priv->recv_block, POLLIN);
 
-		if (rsk->fillsz == rsk->bufsz) /* non-writable */
+		if (fillsz == rsk->bufsz) /* non-writable */
 			resched |= xnselect_signal(&rsk->priv->send_block, 0);
 		/*
 		 * Wake up all threads pending on the input wait
@@ -498,9 +669,10 @@ redo:
 		wc = rtipc_get_wait_context(waiter);
 		XENO_BUG_ON(COBALT, wc == NULL);
 		bufwc = container_of(wc, struct bufp_wait_context, wc);
-		if (bufwc->len <= rsk->fillsz)
+		if (bufwc->len <= fillsz) {
+			bufp_clear_waiters(rsk, BUFP_RING_RDWAIT);
 			rtdm_event_pulse(&rsk->i_event);
-		else if (resched)
+		} else if (resched)
 			xnsched_run();
 		/*
 		 * We cannot fail anymore once some data has been
@@ -514,6 +686,10 @@ redo:
 			break;
 		}
 
+		bufp_set_waiters(rsk, BUFP_RING_WRWAIT);
+		if (bufp_fillsz(rsk) + len <= rsk->bufsz)
+			continue;
+
 		wait.len = len;
 		wait.sk = rsk;
 		rtipc_prepare_wait(&wait.wc);
@@ -709,10 +885,16 @@ static int __bufp_bind_socket(struct rtipc_private *priv,
 	if (sk->bufsz == 0)
 		return -ENOBUFS;
 
-	sk->bufmem = xnheap_vmalloc(sk->bufsz);
-	if (sk->bufmem == NULL) {
-		ret = -ENOMEM;
-		goto fail;
+	if (sk->mapped) {
+		ret = bufp_ring_alloc(sk);
+		if (ret)
+			goto fail;
+	} else {
+		sk->bufmem = xnheap_vmalloc(sk->bufsz);
+		if (sk->bufmem == NULL) {
+			ret = -ENOMEM;
+			goto fail;
+		}
 	}
 
 	sk->name = *sa;
@@ -724,7 +906,8 @@ static int __bufp_bind_socket(struct rtipc_private *priv,
 		ret = xnregistry_enter(sk->label, sk,
 				       &sk->handle, &__bufp_pnode.node);
 		if (ret) {
-			xnheap_vfree(sk->bufmem);
+			bufp_free_buffer(sk);
+			sk->ring = NULL;
 			goto fail;
 		}
 	}
@@ -828,8 +1011,8 @@ static int __bufp_setsockopt(struct bufp_socket *sk,
 	struct rtipc_port_label plabel;
 	struct timeval tv;
 	rtdm_lockctx_t s;
+	int ret, mapped;
 	size_t len;
-	int ret;
 
 	ret = rtipc_get_sockoptin(fd, &sopt, arg);
 	if (ret)
@@ -902,6 +1085,21 @@ static int __bufp_setsockopt(struct bufp_socket *sk,
 		cobalt_atomic_leave(s);
 		break;
 
+	case BUFP_MAPPED:
+		if (sopt.optlen != sizeof(mapped))
+			return -EINVAL;
+		if (rtipc_get_arg(fd, &mapped, sopt.optval, sizeof(mapped)))
+			return -EFAULT;
+		cobalt_atomic_enter(s);
+		/* The buffer layout is fixed at binding time. */
+		if (test_bit(_BUFP_BOUND, &sk->status) ||
+		    test_bit(_BUFP_BINDING, &sk->status))
+			ret = -EALREADY;
+		else
+			sk->mapped = !!mapped;
+		cobalt_atomic_leave(s);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -973,6 +1171,218 @@ static int __bufp_getsockopt(struct bufp_socket *sk,
 	return ret;
 }
 
+/*
+ * Return the socket owning the ring a BUFP socket gives access to:
+ * its own ring if it was bound in mapped mode, otherwise the ring of
+ * its connected peer, in which case the peer descriptor is locked
+ * and returned in *rfdp.
+ */
+static struct bufp_socket *bufp_get_ring_owner(struct bufp_socket *sk,
+					       struct rtdm_fd **rfdp)
+{
+	struct bufp_socket *rsk;
+	struct rtdm_fd *rfd;
+	rtdm_lockctx_t s;
+
+	*rfdp = NULL;
+
+	if (test_bit(_BUFP_BOUND, &sk->status) && sk->ring)
+		return sk;
+
+	if (!test_bit(_BUFP_CONNECTED, &sk->status))
+		return NULL;
+
+	cobalt_atomic_enter(s);
+	rfd = xnmap_fetch_nocheck(portmap, sk->peer.sipc_port);
+	if (rfd && rtdm_fd_lock(rfd) < 0)
+		rfd = NULL;
+	cobalt_atomic_leave(s);
+	if (rfd == NULL)
+		return NULL;
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_BUFP_BOUND, &rsk->status) || rsk->ring == NULL) {
+		rtdm_fd_unlock(rfd);
+		return NULL;
+	}
+
+	*rfdp = rfd;
+
+	return rsk;
+}
+
+static inline void bufp_put_ring_owner(struct rtdm_fd *rfd)
+{
+	if (rfd)
+		rtdm_fd_unlock(rfd);
+}
+
+static inline size_t bufp_ring_avail(struct bufp_socket *rsk, u32 what)
+{
+	size_t fillsz = bufp_fillsz(rsk);
+
+	return what == BUFP_RING_RDWAIT ? fillsz : rsk->bufsz - fillsz;
+}
+
+/*
+ * Wait for @len bytes of data (BUFP_RING_RDWAIT) or free space
+ * (BUFP_RING_WRWAIT) in a mapped ring. Waiters are queued with a
+ * regular wait context, so that the kernel-based read and write
+ * paths wake them up as well.
+ */
+static int bufp_wait_ring(struct bufp_socket *rsk, u32 what,
+			  size_t len, nanosecs_rel_t timeout)
+{
+	struct bufp_wait_context wait;
+	rtdm_toseq_t toseq;
+	rtdm_event_t *event;
+	rtdm_lockctx_t s;
+	size_t avail;
+	int ret;
+
+	if (len == 0 || len > rsk->bufsz)
+		return -EINVAL;
+
+	event = what == BUFP_RING_RDWAIT ? &rsk->i_event : &rsk->o_event;
+
+	rtdm_toseq_init(&toseq, timeout);
+
+	cobalt_atomic_enter(s);
+
+	for (;;) {
+		avail = bufp_ring_avail(rsk, what);
+		if (avail >= len)
+			break;
+
+		bufp_set_waiters(rsk, what);
+		avail = bufp_ring_avail(rsk, what);
+		if (avail >= len)
+			break;
+
+		wait.len = len;
+		wait.sk = rsk;
+		rtipc_prepare_wait(&wait.wc);
+		ret = rtdm_event_timedwait(event, timeout, &toseq);
+		if (unlikely(ret))
+			goto out;
+	}
+
+	ret = avail;
+out:
+	cobalt_atomic_leave(s);
+
+	return ret;
+}
+
+static int bufp_notify_ring(struct bufp_socket *rsk)
+{
+	rtdm_lockctx_t s;
+	size_t fillsz;
+	int resched;
+
+	cobalt_atomic_enter(s);
+
+	fillsz = bufp_fillsz(rsk);
+	resched = xnselect_signal(&rsk->priv->recv_block,
+				  fillsz > 0 ? POLLIN : 0);
+	resched |= xnselect_signal(&rsk->priv->send_block,
+				   fillsz < rsk->bufsz ? POLLOUT : 0);
+
+	/*
+	 * Sleepers check the ring again on wakeup, raising their flag
+	 * anew if they still have to wait. These calls resched
+	 * internally.
+	 */
+	rsk->ring->hdr->waiters = 0;
+	rtdm_event_pulse(&rsk->i_event);
+	rtdm_event_pulse(&rsk->o_event);
+
+	if (resched)
+		xnsched_run();
+
+	cobalt_atomic_leave(s);
+
+	return 0;
+}
+
+static int bufp_ring_ioctl(struct bufp_socket *sk,
+			   unsigned int request, void *arg)
+{
+	struct bufp_socket *rsk;
+	struct rtdm_fd *rfd;
+	int ret;
+
+	rsk = bufp_get_ring_owner(sk, &rfd);
+	if (rsk == NULL)
+		return -ENXIO;
+
+	switch (request) {
+	case BUFP_RTIOC_WAIT_DATA:
+		ret = bufp_wait_ring(rsk, BUFP_RING_RDWAIT,
+				     (unsigned long)arg, sk->rx_timeout);
+		break;
+	case BUFP_RTIOC_WAIT_SPACE:
+		ret = bufp_wait_ring(rsk, BUFP_RING_WRWAIT,
+				     (unsigned long)arg, sk->tx_timeout);
+		break;
+	default:
+		ret = bufp_notify_ring(rsk);
+	}
+
+	bufp_put_ring_owner(rfd);
+
+	return ret;
+}
+
+static void bufp_ring_vm_open(struct vm_area_struct *vma)
+{
+	struct bufp_ring *ring = vma->vm_private_data;
+
+	atomic_inc(&ring->refs);
+}
+
+static void bufp_ring_vm_close(struct vm_area_struct *vma)
+{
+	bufp_ring_put(vma->vm_private_data);
+}
+
+static struct vm_operations_struct bufp_ring_vm_ops = {
+	.open = bufp_ring_vm_open,
+	.close = bufp_ring_vm_close,
+};
+
+static int bufp_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	struct bufp_socket *sk = rtipc_fd_to_state(fd), *rsk;
+	size_t len = vma->vm_end - vma->vm_start;
+	struct bufp_ring *ring;
+	struct rtdm_fd *rfd;
+	int ret;
+
+	rsk = bufp_get_ring_owner(sk, &rfd);
+	if (rsk == NULL)
+		return -ENXIO;
+
+	ring = rsk->ring;
+	if (vma->vm_pgoff || len > ring->size) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = rtdm_mmap_vmem(vma, ring->hdr);
+	if (ret)
+		goto out;
+
+	/* The mapping may outlive both endpoints. */
+	vma->vm_ops = &bufp_ring_vm_ops;
+	vma->vm_private_data = ring;
+	atomic_inc(&ring->refs);
+out:
+	bufp_put_ring_owner(rfd);
+
+	return ret;
+}
+
 static int __bufp_ioctl(struct rtdm_fd *fd,
 			unsigned int request, void *arg)
 {
@@ -1024,6 +1434,12 @@ static int __bufp_ioctl(struct rtdm_fd *fd,
 		ret = -ENOTCONN;
 		break;
 
+	case BUFP_RTIOC_WAIT_DATA:
+	case BUFP_RTIOC_WAIT_SPACE:
+	case BUFP_RTIOC_NOTIFY:
+		ret = bufp_ring_ioctl(sk, request, arg);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -1040,6 +1456,12 @@ static int bufp_ioctl(struct rtdm_fd *fd,
 	COMPAT_CASE(_RTIOC_BIND):
 		if (rtdm_in_rt_context())
 			return -ENOSYS;	/* Try downgrading to NRT */
+		ret = __bufp_ioctl(fd, request, arg);
+		break;
+	case BUFP_RTIOC_WAIT_DATA:
+	case BUFP_RTIOC_WAIT_SPACE:
+		if (!rtdm_in_rt_context())
+			return -ENOSYS;	/* Try upgrading to RT */
 	default:
 		ret = __bufp_ioctl(fd, request, arg);
 	}
@@ -1054,7 +1476,7 @@ static unsigned int bufp_pollstate(struct rtdm_fd *fd) /* atomic */
 	unsigned int mask = 0;
 	struct rtdm_fd *rfd;
 
-	if (test_bit(_BUFP_BOUND, &sk->status) && sk->fillsz > 0)
+	if (test_bit(_BUFP_BOUND, &sk->status) && bufp_fillsz(sk) > 0)
 		mask |= POLLIN;
 
 	/*
@@ -1067,7 +1489,7 @@ static unsigned int bufp_pollstate(struct rtdm_fd *fd) /* atomic */
 		rfd = xnmap_fetch_nocheck(portmap, sk->peer.sipc_port);
 		if (rfd) {
 			rsk = rtipc_fd_to_state(rfd);
-			if (rsk->fillsz < rsk->bufsz)
+			if (bufp_fillsz(rsk) < rsk->bufsz)
 				mask |= POLLOUT;
 		}
 	} else
@@ -1103,6 +1525,7 @@ struct rtipc_protocol bufp_proto_driver = {
 		.read = bufp_read,
 		.write = bufp_write,
 		.ioctl = bufp_ioctl,
+		.mmap = bufp_mmap,
 		.pollstate = bufp_pollstate,
 	}
 };
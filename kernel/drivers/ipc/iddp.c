@@ -22,14 +22,35 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/poll.h>
+#include <linux/cache.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/bufd.h>
 #include <cobalt/kernel/map.h>
 #include <rtdm/ipc.h>
+#include <rtdm/ring.h>
 #include "internal.h"
 
 #define IDDP_SOCKET_MAGIC 0xa37a37a8
 
+#define IDDP_SLAB_MAXMSGSZ 65536
+#define IDDP_SLAB_MAXCOUNT 65536
+#define IDDP_SLAB_MAXSIZE  (16 * 1024 * 1024)
+
+#ifdef CONFIG_XENO_ARCH_SYS3264
+
+struct compat_iddp_mmsg_req {
+	compat_uptr_t msgvec;
+	unsigned int vlen;
+	int flags;
+};
+
+#define IDDP_RTIOC_SENDMMSG_COMPAT	_IOW(RTIOC_TYPE_RTIPC, 0x10,	\
+					     struct compat_iddp_mmsg_req)
+#define IDDP_RTIOC_RECVMMSG_COMPAT	_IOW(RTIOC_TYPE_RTIPC, 0x11,	\
+					     struct compat_iddp_mmsg_req)
+
+#endif /* CONFIG_XENO_ARCH_SYS3264 */
+
 struct iddp_message {
 	struct list_head next;
 	int from;
@@ -47,6 +68,10 @@ struct iddp_socket {
 	rtdm_waitqueue_t *poolwaitq;
 	rtdm_waitqueue_t privwaitq;
 	size_t poolsz;
+	struct iddp_slab_config slabcf;
+	void *slabmem;
+	size_t slabsz;
+	struct list_head slabq;	/* Free slab slots. */
 	rtdm_sem_t insem;
 	struct list_head inq;
 	u_long status;
@@ -56,6 +81,9 @@ struct iddp_socket {
 	nanosecs_rel_t tx_timeout;
 	unsigned long stalls;	/* Buffer stall counter. */
 	struct rtipc_private *priv;
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+	struct list_head ringq;	/* Pending ring reads. */
+#endif
 };
 
 static struct sockaddr_ipc nullsa = {
@@ -108,6 +136,59 @@ static inline void __iddp_init_mbuf(struct iddp_message *mbuf, size_t len)
 	INIT_LIST_HEAD(&mbuf->next);
 }
 
+static inline size_t __iddp_slab_slotsz(u32 msgsz)
+{
+	return L1_CACHE_ALIGN(sizeof(struct iddp_message) + msgsz);
+}
+
+static int __iddp_init_slab(struct iddp_socket *sk)
+{
+	struct iddp_message *mbuf;
+	size_t slotsz;
+	u32 n;
+
+	slotsz = __iddp_slab_slotsz(sk->slabcf.msgsz);
+	sk->slabsz = slotsz * sk->slabcf.count;
+	sk->slabmem = xnheap_vmalloc(sk->slabsz);
+	if (sk->slabmem == NULL)
+		return -ENOMEM;
+
+	for (n = 0; n < sk->slabcf.count; n++) {
+		mbuf = sk->slabmem + n * slotsz;
+		list_add_tail(&mbuf->next, &sk->slabq);
+	}
+
+	return 0;
+}
+
+static inline int __iddp_slab_mbuf(struct iddp_socket *sk,
+				   struct iddp_message *mbuf)
+{
+	return (void *)mbuf >= sk->slabmem &&
+		(void *)mbuf < sk->slabmem + sk->slabsz;
+}
+
+static struct iddp_message *
+__iddp_slab_alloc(struct iddp_socket *sk, size_t len)
+{
+	struct iddp_message *mbuf = NULL;
+	rtdm_lockctx_t s;
+
+	if (sk->slabmem == NULL || len > sk->slabcf.msgsz)
+		return NULL;
+
+	cobalt_atomic_enter(s);
+
+	if (!list_empty(&sk->slabq)) {
+		mbuf = list_first_entry(&sk->slabq, struct iddp_message, next);
+		list_del(&mbuf->next);
+	}
+
+	cobalt_atomic_leave(s);
+
+	return mbuf;
+}
+
 static struct iddp_message *
 __iddp_alloc_mbuf(struct iddp_socket *sk, size_t len,
 		  nanosecs_rel_t timeout, int flags, int *pret)
@@ -120,7 +201,10 @@ __iddp_alloc_mbuf(struct iddp_socket *sk, size_t len,
 	rtdm_toseq_init(&timeout_seq, timeout);
 
 	for (;;) {
-		mbuf = xnheap_alloc(sk->bufpool, len + sizeof(*mbuf));
+		/* Oversized or slab exhausted? Fall back to the pool. */
+		mbuf = __iddp_slab_alloc(sk, len);
+		if (mbuf == NULL)
+			mbuf = xnheap_alloc(sk->bufpool, len + sizeof(*mbuf));
 		if (mbuf) {
 			__iddp_init_mbuf(mbuf, len);
 			break;
@@ -154,10 +238,156 @@ __iddp_alloc_mbuf(struct iddp_socket *sk, size_t len,
 static void __iddp_free_mbuf(struct iddp_socket *sk,
 			     struct iddp_message *mbuf)
 {
-	xnheap_free(sk->bufpool, mbuf);
+	rtdm_lockctx_t s;
+
+	if (__iddp_slab_mbuf(sk, mbuf)) {
+		/* LIFO, so that the next sender gets a cache-hot slot. */
+		cobalt_atomic_enter(s);
+		list_add(&mbuf->next, &sk->slabq);
+		cobalt_atomic_leave(s);
+	} else
+		xnheap_free(sk->bufpool, mbuf);
+
 	rtdm_waitqueue_broadcast(sk->poolwaitq);
 }
 
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+
+static void __iddp_flush_ring(struct iddp_socket *sk)
+{
+	struct rtdm_ring_req *req;
+	rtdm_lockctx_t s;
+
+	cobalt_atomic_enter(s);
+
+	while (!list_empty(&sk->ringq)) {
+		req = list_first_entry(&sk->ringq, struct rtdm_ring_req, next);
+		list_del(&req->next);
+		cobalt_atomic_leave(s);
+		rtdm_ring_complete(req, -ECONNRESET);
+		cobalt_atomic_enter(s);
+	}
+
+	cobalt_atomic_leave(s);
+}
+
+/*
+ * Copy a datagram straight to the buffer of a pending ring read,
+ * bypassing the input queue. Returns -ENOENT if no read is pending,
+ * in which case the message should be queued normally.
+ */
+static ssize_t __iddp_ring_deliver(struct rtdm_fd *fd,
+				   struct iddp_socket *rsk,
+				   struct iovec *iov, int iovlen,
+				   ssize_t len)
+{
+	struct rtdm_ring_req *req;
+	ssize_t rdlen, vlen;
+	struct xnbufd bufd;
+	int nvec, wroff;
+	rtdm_lockctx_t s;
+	int ret = 0;
+
+	cobalt_atomic_enter(s);
+
+	if (list_empty(&rsk->ringq)) {
+		cobalt_atomic_leave(s);
+		return -ENOENT;
+	}
+
+	req = list_first_entry(&rsk->ringq, struct rtdm_ring_req, next);
+	list_del(&req->next);
+
+	cobalt_atomic_leave(s);
+
+	/*
+	 * Unlike a plain read, a ring read cannot consume a datagram
+	 * partially: fail it, and queue the message for the next
+	 * reader.
+	 */
+	if (len > req->sqe.len) {
+		rtdm_ring_complete(req, -EMSGSIZE);
+		return -ENOENT;
+	}
+
+	for (nvec = 0, rdlen = len, wroff = 0;
+	     nvec < iovlen && rdlen > 0; nvec++) {
+		if (iov[nvec].iov_len == 0)
+			continue;
+		vlen = rdlen >= iov[nvec].iov_len ? iov[nvec].iov_len : rdlen;
+		if (rtdm_fd_is_user(fd)) {
+			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_to_kmem(req->kbuf + wroff, &bufd, vlen);
+			xnbufd_unmap_uread(&bufd);
+		} else {
+			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_to_kmem(req->kbuf + wroff, &bufd, vlen);
+			xnbufd_unmap_kread(&bufd);
+		}
+		if (ret < 0)
+			goto fail;
+		iov[nvec].iov_base += vlen;
+		iov[nvec].iov_len -= vlen;
+		rdlen -= vlen;
+		wroff += vlen;
+	}
+
+	rtdm_ring_complete(req, len);
+
+	return len;
+fail:
+	/* The sender is at fault, keep the read pending. */
+	cobalt_atomic_enter(s);
+	list_add(&req->next, &rsk->ringq);
+	cobalt_atomic_leave(s);
+
+	return ret;
+}
+
+static int iddp_submit(struct rtdm_fd *fd, struct rtdm_ring_req *req)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iddp_socket *sk = priv->state;
+	rtdm_lockctx_t s;
+	int ret = -ENOSYS;
+
+	/*
+	 * Only reads to fixed buffers are taken over, since those may
+	 * be filled in from the sender context. Reads are queued only
+	 * when no message is pending, which preserves ordering.
+	 */
+	if (req->sqe.opcode != RTDM_RING_OP_READ || req->kbuf == NULL)
+		return -ENOSYS;
+
+	if (!test_bit(_IDDP_BOUND, &sk->status))
+		return -EAGAIN;
+
+	cobalt_atomic_enter(s);
+
+	if (list_empty(&sk->inq)) {
+		list_add_tail(&req->next, &sk->ringq);
+		ret = -EIOCBQUEUED;
+	}
+
+	cobalt_atomic_leave(s);
+
+	return ret;
+}
+
+#else /* !CONFIG_XENO_OPT_RTDM_RING */
+
+static inline void __iddp_flush_ring(struct iddp_socket *sk) { }
+
+static inline ssize_t __iddp_ring_deliver(struct rtdm_fd *fd,
+					  struct iddp_socket *rsk,
+					  struct iovec *iov, int iovlen,
+					  ssize_t len)
+{
+	return -ENOENT;
+}
+
+#endif /* !CONFIG_XENO_OPT_RTDM_RING */
+
 static int iddp_socket(struct rtdm_fd *fd)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
@@ -169,6 +399,11 @@ static int iddp_socket(struct rtdm_fd *fd)
 	sk->bufpool = &cobalt_heap;
 	sk->poolwaitq = &poolwaitq;
 	sk->poolsz = 0;
+	sk->slabcf.msgsz = 0;
+	sk->slabcf.count = 0;
+	sk->slabmem = NULL;
+	sk->slabsz = 0;
+	INIT_LIST_HEAD(&sk->slabq);
 	sk->status = 0;
 	sk->handle = 0;
 	sk->rx_timeout = RTDM_TIMEOUT_INFINITE;
@@ -176,6 +411,9 @@ static int iddp_socket(struct rtdm_fd *fd)
 	sk->stalls = 0;
 	*sk->label = 0;
 	INIT_LIST_HEAD(&sk->inq);
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+	INIT_LIST_HEAD(&sk->ringq);
+#endif
 	rtdm_sem_init(&sk->insem, 0);
 	rtdm_waitqueue_init(&sk->privwaitq);
 	sk->priv = priv;
@@ -192,6 +430,7 @@ static void iddp_close(struct rtdm_fd *fd)
 	void *poolmem;
 	u32 poolsz;
 
+	__iddp_flush_ring(sk);
 	rtdm_sem_destroy(&sk->insem);
 	rtdm_waitqueue_destroy(&sk->privwaitq);
 
@@ -208,6 +447,8 @@ static void iddp_close(struct rtdm_fd *fd)
 			poolsz = xnheap_get_size(&sk->privpool);
 			xnheap_destroy(&sk->privpool);
 			xnheap_vfree(poolmem);
+			if (sk->slabmem)
+				xnheap_vfree(sk->slabmem);
 			return;
 		}
 	}
@@ -216,9 +457,13 @@ static void iddp_close(struct rtdm_fd *fd)
 	while (!list_empty(&sk->inq)) {
 		mbuf = list_entry(sk->inq.next, struct iddp_message, next);
 		list_del(&mbuf->next);
-		xnheap_free(&cobalt_heap, mbuf);
+		if (!__iddp_slab_mbuf(sk, mbuf))
+			xnheap_free(&cobalt_heap, mbuf);
 	}
 
+	if (sk->slabmem)
+		xnheap_vfree(sk->slabmem);
+
 	kfree(sk);
 
 	return;
@@ -405,6 +650,12 @@ static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
 		return -ECONNREFUSED;
 	}
 
+	ret = __iddp_ring_deliver(fd, rsk, iov, iovlen, len);
+	if (ret != -ENOENT) {
+		rtdm_fd_unlock(rfd);
+		return ret;
+	}
+
 	mbuf = __iddp_alloc_mbuf(rsk, len, sk->tx_timeout, flags, &ret);
 	if (unlikely(ret)) {
 		rtdm_fd_unlock(rfd);
@@ -528,6 +779,104 @@ static ssize_t iddp_write(struct rtdm_fd *fd,
 	return __iddp_sendmsg(fd, &iov, 1, 0, &sk->peer);
 }
 
+static int __iddp_get_mmsg_req(struct rtdm_fd *fd,
+			       struct iddp_mmsg_req *req, const void *arg)
+{
+#ifdef CONFIG_XENO_ARCH_SYS3264
+	struct compat_iddp_mmsg_req creq;
+
+	if (rtdm_fd_is_compat(fd)) {
+		if (rtdm_safe_copy_from_user(fd, &creq, arg, sizeof(creq)))
+			return -EFAULT;
+		req->msgvec = compat_ptr(creq.msgvec);
+		req->vlen = creq.vlen;
+		req->flags = creq.flags;
+		return 0;
+	}
+#endif
+
+	return rtipc_get_arg(fd, req, arg, sizeof(*req));
+}
+
+static int __iddp_get_mmsghdr(struct rtdm_fd *fd, struct user_msghdr *msg,
+			      struct mmsghdr *msgvec, unsigned int n)
+{
+#ifdef CONFIG_XENO_ARCH_SYS3264
+	struct compat_mmsghdr __user *cmsgvec = (void __user *)msgvec;
+
+	if (rtdm_fd_is_compat(fd))
+		return sys32_get_msghdr(msg, &cmsgvec[n].msg_hdr);
+#endif
+
+	return rtipc_get_arg(fd, msg, &msgvec[n].msg_hdr, sizeof(*msg));
+}
+
+/* The message header is written back on receipt only. */
+static int __iddp_put_mmsghdr(struct rtdm_fd *fd, struct mmsghdr *msgvec,
+			      unsigned int n, const struct user_msghdr *msg,
+			      unsigned int len)
+{
+#ifdef CONFIG_XENO_ARCH_SYS3264
+	struct compat_mmsghdr __user *cmsgvec = (void __user *)msgvec;
+	compat_uint_t clen = len;
+
+	if (rtdm_fd_is_compat(fd)) {
+		if (msg && sys32_put_msghdr(&cmsgvec[n].msg_hdr, msg))
+			return -EFAULT;
+		return rtdm_safe_copy_to_user(fd, &cmsgvec[n].msg_len,
+					      &clen, sizeof(clen));
+	}
+#endif
+
+	if (msg && rtipc_put_arg(fd, &msgvec[n].msg_hdr, msg, sizeof(*msg)))
+		return -EFAULT;
+
+	return rtipc_put_arg(fd, &msgvec[n].msg_len, &len, sizeof(len));
+}
+
+/*
+ * Batched counterpart of sendmsg()/recvmsg(), processing datagrams
+ * in order until the vector is exhausted or an error occurs. Only
+ * the first receipt may block.
+ */
+static int __iddp_mmsg(struct rtdm_fd *fd, void *arg, int send)
+{
+	struct iddp_mmsg_req req;
+	struct user_msghdr msg;
+	unsigned int n;
+	ssize_t ret;
+	int flags;
+
+	ret = __iddp_get_mmsg_req(fd, &req, arg);
+	if (ret)
+		return ret;
+
+	if (req.vlen > UIO_MAXIOV)
+		req.vlen = UIO_MAXIOV;
+
+	flags = req.flags;
+
+	for (n = 0, ret = 0; n < req.vlen; n++) {
+		ret = __iddp_get_mmsghdr(fd, &msg, req.msgvec, n);
+		if (ret)
+			break;
+		if (send)
+			ret = iddp_sendmsg(fd, &msg, flags);
+		else
+			ret = iddp_recvmsg(fd, &msg, flags);
+		if (ret < 0)
+			break;
+		ret = __iddp_put_mmsghdr(fd, req.msgvec, n,
+					 send ? NULL : &msg, ret);
+		if (ret)
+			break;
+		if (!send)
+			flags |= MSG_DONTWAIT;
+	}
+
+	return n > 0 ? n : ret;
+}
+
 static int __iddp_bind_socket(struct rtdm_fd *fd,
 			      struct sockaddr_ipc *sa)
 {
@@ -586,6 +935,13 @@ static int __iddp_bind_socket(struct rtdm_fd *fd,
 		sk->bufpool = &sk->privpool;
 	}
 
+	/* Likewise for the message slab. */
+	if (sk->slabcf.count > 0) {
+		ret = __iddp_init_slab(sk);
+		if (ret)
+			goto fail_slab;
+	}
+
 	sk->name = *sa;
 	/* Set default destination if unset at binding time. */
 	if (sk->peer.sipc_port < 0)
@@ -595,11 +951,12 @@ static int __iddp_bind_socket(struct rtdm_fd *fd,
 		ret = xnregistry_enter(sk->label, sk,
 				       &sk->handle, &__iddp_pnode.node);
 		if (ret) {
-			if (poolsz > 0) {
-				xnheap_destroy(&sk->privpool);
-				xnheap_vfree(poolmem);
+			if (sk->slabmem) {
+				xnheap_vfree(sk->slabmem);
+				sk->slabmem = NULL;
+				INIT_LIST_HEAD(&sk->slabq);
 			}
-			goto fail;
+			goto fail_slab;
 		}
 	}
 
@@ -611,6 +968,11 @@ static int __iddp_bind_socket(struct rtdm_fd *fd,
 	cobalt_atomic_leave(s);
 
 	return 0;
+fail_slab:
+	if (poolsz > 0) {
+		xnheap_destroy(&sk->privpool);
+		xnheap_vfree(poolmem);
+	}
 fail:
 	xnmap_remove(portmap, port);
 	clear_bit(_IDDP_BINDING, &sk->status);
@@ -699,6 +1061,7 @@ static int __iddp_setsockopt(struct iddp_socket *sk,
 			     void *arg)
 {
 	struct _rtdm_setsockopt_args sopt;
+	struct iddp_slab_config slabcf;
 	struct rtipc_port_label plabel;
 	struct timeval tv;
 	rtdm_lockctx_t s;
@@ -776,6 +1139,26 @@ static int __iddp_setsockopt(struct iddp_socket *sk,
 		cobalt_atomic_leave(s);
 		break;
 
+	case IDDP_SLAB:
+		if (sopt.optlen != sizeof(slabcf))
+			return -EINVAL;
+		if (rtipc_get_arg(fd, &slabcf, sopt.optval, sizeof(slabcf)))
+			return -EFAULT;
+		if (slabcf.msgsz == 0 || slabcf.msgsz > IDDP_SLAB_MAXMSGSZ ||
+		    slabcf.count == 0 || slabcf.count > IDDP_SLAB_MAXCOUNT ||
+		    slabcf.count > IDDP_SLAB_MAXSIZE /
+		    __iddp_slab_slotsz(slabcf.msgsz))
+			return -EINVAL;
+		cobalt_atomic_enter(s);
+		/* Same as IDDP_POOLSZ, the slab is set up when binding. */
+		if (test_bit(_IDDP_BOUND, &sk->status) ||
+		    test_bit(_IDDP_BINDING, &sk->status))
+			ret = -EALREADY;
+		else
+			sk->slabcf = slabcf;
+		cobalt_atomic_leave(s);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -899,6 +1282,14 @@ static int __iddp_ioctl(struct rtdm_fd *fd,
 		ret = -ENOTCONN;
 		break;
 
+	COMPAT_CASE(IDDP_RTIOC_SENDMMSG):
+		ret = __iddp_mmsg(fd, arg, 1);
+		break;
+
+	COMPAT_CASE(IDDP_RTIOC_RECVMMSG):
+		ret = __iddp_mmsg(fd, arg, 0);
+		break;
+
 	default:
 		ret = -EINVAL;
 	}
@@ -915,6 +1306,12 @@ static int iddp_ioctl(struct rtdm_fd *fd,
 	COMPAT_CASE(_RTIOC_BIND):
 		if (rtdm_in_rt_context())
 			return -ENOSYS;	/* Try downgrading to NRT */
+		ret = __iddp_ioctl(fd, request, arg);
+		break;
+	COMPAT_CASE(IDDP_RTIOC_SENDMMSG):
+	COMPAT_CASE(IDDP_RTIOC_RECVMMSG):
+		if (!rtdm_in_rt_context())
+			return -ENOSYS;	/* Try upgrading to RT */
 	default:
 		ret = __iddp_ioctl(fd, request, arg);
 	}
@@ -984,5 +1381,8 @@ struct rtipc_protocol iddp_proto_driver = {
 		.write = iddp_write,
 		.ioctl = iddp_ioctl,
 		.pollstate = iddp_pollstate,
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+		.submit = iddp_submit,
+#endif
 	}
 };
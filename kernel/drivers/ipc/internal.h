@@ -58,6 +58,10 @@ struct rtipc_protocol {
 		int (*ioctl)(struct rtdm_fd *fd,
 			     unsigned int request, void *arg);
 		unsigned int (*pollstate)(struct rtdm_fd *fd);
+		int (*submit)(struct rtdm_fd *fd,
+			      struct rtdm_ring_req *req);
+		int (*mmap)(struct rtdm_fd *fd,
+			    struct vm_area_struct *vma);
 	} proto_ops;
 };
 
@@ -490,6 +490,30 @@ static int rtipc_ioctl(struct rtdm_fd *fd,
 	return priv->proto->proto_ops.ioctl(fd, request, arg);
 }
 
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+
+static int rtipc_submit(struct rtdm_fd *fd, struct rtdm_ring_req *req)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+
+	if (priv->proto->proto_ops.submit == NULL)
+		return -ENOSYS;
+
+	return priv->proto->proto_ops.submit(fd, req);
+}
+
+#endif /* CONFIG_XENO_OPT_RTDM_RING */
+
+static int rtipc_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+
+	if (priv->proto->proto_ops.mmap == NULL)
+		return -ENODEV;
+
+	return priv->proto->proto_ops.mmap(fd, vma);
+}
+
 static int rtipc_select(struct rtdm_fd *fd, struct xnselector *selector,
 			unsigned int type, unsigned int index)
 {
@@ -553,6 +577,10 @@ static struct rtdm_driver rtipc_driver = {
 		.write_rt	=	rtipc_write,
 		.write_nrt	=	NULL,
 		.select		=	rtipc_select,
+		.mmap		=	rtipc_mmap,
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+		.submit		=	rtipc_submit,
+#endif
 	},
 };
 
@@ -0,0 +1,627 @@
+/* veth.c
+ *
+ * Virtual Ethernet pair driver for RTnet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Each pair of devices behaves like two NICs connected by a cable.
+ * Unlike the loopback driver, frames go through the same path as
+ * with real hardware: the sender queues them to a TX ring, then an
+ * emulated receive interrupt on the peer copies them to buffers
+ * pre-allocated from its RX ring, hands them over to the stack with
+ * rtnetif_rx(), refills the ring from the device pool and completes
+ * transmission on the sender side.
+ *
+ * The receive interrupt is either emulated by a Cobalt timer, which
+ * allows for injecting latency and jitter, or by an I-pipe virtual
+ * IRQ raised by the sender, which goes through the regular RTDM IRQ
+ * layer including its statistics.
+ *
+ * Frames are spread over the queues according to their transmit
+ * priority, so that traffic classes (e.g. RTmac) may be mapped to
+ * distinct queues.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/netdevice.h>
+#include <linux/if_ether.h>
+
+#include <rtnet_port.h>
+#include <stack_mgr.h>
+
+MODULE_DESCRIPTION("RTnet virtual Ethernet pair driver");
+MODULE_LICENSE("GPL");
+
+#define RT_VETH_MAX_PAIRS	8
+#define RT_VETH_MAX_QUEUES	8
+#define RT_VETH_MAX_RING	1024
+#define RT_VETH_BATCH		16
+#define RT_VETH_BUFSZ		(ETH_FRAME_LEN + 2)
+
+#define RT_VETH_IRQ_TIMER	0
+#define RT_VETH_IRQ_VIRQ	1
+
+static unsigned int pairs = 1;
+module_param(pairs, uint, 0444);
+MODULE_PARM_DESC(pairs, "Number of device pairs (default 1)");
+
+static unsigned int queues = 1;
+module_param(queues, uint, 0444);
+MODULE_PARM_DESC(queues, "Number of queues per device, up to 8 (default 1)");
+
+static unsigned int rx_ring_size = 64;
+module_param(rx_ring_size, uint, 0444);
+MODULE_PARM_DESC(rx_ring_size, "Receive buffers per queue (default 64)");
+
+static unsigned int tx_ring_size = 64;
+module_param(tx_ring_size, uint, 0444);
+MODULE_PARM_DESC(tx_ring_size, "Transmit slots per queue (default 64)");
+
+static unsigned int irq_mode = RT_VETH_IRQ_TIMER;
+module_param(irq_mode, uint, 0444);
+MODULE_PARM_DESC(irq_mode, "Receive interrupt emulation, 0: timer (default), "
+		 "1: virtual IRQ");
+
+static unsigned int irq_delay = 1000;
+module_param(irq_delay, uint, 0444);
+MODULE_PARM_DESC(irq_delay, "Timer mode: delay between transmission and "
+		 "receive interrupt in ns (default 1000)");
+
+static unsigned int irq_jitter;
+module_param(irq_jitter, uint, 0444);
+MODULE_PARM_DESC(irq_jitter, "Timer mode: maximum random delay added to "
+		 "irq_delay in ns (default 0)");
+
+struct rt_veth_priv;
+
+struct rt_veth_queue {
+	struct rt_veth_priv *priv;
+	rtdm_lock_t lock;
+	/* Outgoing frames, picked up by the peer. */
+	struct rtskb **tx_ring;
+	unsigned int tx_head;
+	unsigned int tx_tail;
+	/* Receive buffers, refilled from the device pool. */
+	struct rtskb **rx_ring;
+	unsigned int rx_next;
+	int running;
+	int irq_pending;
+	rtdm_timer_t timer;
+	/* Per-queue counters, summed up by rt_veth_get_stats(). */
+	unsigned long rx_packets;
+	unsigned long rx_bytes;
+	unsigned long rx_dropped;
+	unsigned long tx_packets;
+	unsigned long tx_bytes;
+	unsigned long tx_dropped;
+};
+
+struct rt_veth_priv {
+	struct rtnet_device *rtdev;
+	struct rt_veth_priv *peer;
+	unsigned int virq;
+	rtdm_irq_t irq_handle;
+	u32 seed;
+	struct net_device_stats stats;
+	struct rt_veth_queue q[RT_VETH_MAX_QUEUES];
+};
+
+static struct rtnet_device *rt_veth_devs[RT_VETH_MAX_PAIRS * 2];
+
+static inline unsigned int tx_ring_count(struct rt_veth_queue *q)
+{
+	return q->tx_head - q->tx_tail;
+}
+
+static void rt_veth_refill(struct rt_veth_priv *priv, struct rt_veth_queue *q,
+			   unsigned int entry)
+{
+	struct rtskb *skb;
+
+	skb = rtnetdev_alloc_rtskb(priv->rtdev, RT_VETH_BUFSZ);
+	if (skb)
+		rtskb_reserve(skb, 2);	/* Align IP header. */
+
+	q->rx_ring[entry] = skb;
+}
+
+/*
+ * Deliver a frame from the peer to the next receive buffer of @q,
+ * returns non-zero if the frame was dropped. Called with q->lock
+ * held.
+ */
+static int rt_veth_receive(struct rt_veth_priv *priv, struct rt_veth_queue *q,
+			   struct rtskb *txskb, nanosecs_abs_t time_stamp)
+{
+	struct rtnet_device *rtdev = priv->rtdev;
+	unsigned int entry = q->rx_next;
+	struct rtskb *skb;
+
+	if (!q->running || txskb->len > RT_VETH_BUFSZ - 2)
+		return -EINVAL;
+
+	skb = q->rx_ring[entry];
+	if (skb == NULL) {
+		/* Retry a refill which failed previously. */
+		rt_veth_refill(priv, q, entry);
+		skb = q->rx_ring[entry];
+		if (skb == NULL)
+			return -ENOBUFS;
+	}
+
+	memcpy(rtskb_put(skb, txskb->len), txskb->data, txskb->len);
+	skb->time_stamp = time_stamp;
+	skb->protocol = rt_eth_type_trans(skb, rtdev);
+	rtnetif_rx(skb);
+
+	rt_veth_refill(priv, q, entry);
+	q->rx_next = (entry + 1) % rx_ring_size;
+
+	return 0;
+}
+
+/*
+ * Receive interrupt of queue @q: pick up frames from the TX ring of
+ * the same queue on the peer side, then complete their transmission.
+ */
+static int rt_veth_rx_queue(struct rt_veth_priv *priv, struct rt_veth_queue *q,
+			    nanosecs_abs_t time_stamp)
+{
+	struct rt_veth_queue *pq = &priv->peer->q[q - priv->q];
+	struct rtnet_device *peer_dev = priv->peer->rtdev;
+	struct rtskb *batch[RT_VETH_BATCH];
+	int n, count, received = 0;
+	rtdm_lockctx_t context;
+
+	rtdm_lock_get_irqsave(&q->lock, context);
+	q->irq_pending = 0;
+	rtdm_lock_put_irqrestore(&q->lock, context);
+
+	/*
+	 * Both queues are never locked at the same time, since the
+	 * peer may be processing the opposite direction.
+	 */
+	do {
+		rtdm_lock_get_irqsave(&pq->lock, context);
+		for (count = 0; count < RT_VETH_BATCH &&
+			     tx_ring_count(pq) > 0; count++) {
+			batch[count] = pq->tx_ring[pq->tx_tail % tx_ring_size];
+			pq->tx_tail++;
+		}
+		rtdm_lock_put_irqrestore(&pq->lock, context);
+
+		rtdm_lock_get_irqsave(&q->lock, context);
+		for (n = 0; n < count; n++) {
+			if (rt_veth_receive(priv, q, batch[n], time_stamp)) {
+				q->rx_dropped++;
+				continue;
+			}
+			q->rx_packets++;
+			q->rx_bytes += batch[n]->len;
+			received++;
+		}
+		rtdm_lock_put_irqrestore(&q->lock, context);
+
+		rtdm_lock_get_irqsave(&pq->lock, context);
+		for (n = 0; n < count; n++) {
+			pq->tx_packets++;
+			pq->tx_bytes += batch[n]->len;
+		}
+		rtdm_lock_put_irqrestore(&pq->lock, context);
+
+		for (n = 0; n < count; n++)
+			dev_kfree_rtskb(batch[n]);
+	} while (count == RT_VETH_BATCH);
+
+	if (rtnetif_queue_stopped(peer_dev))
+		rtnetif_wake_queue(peer_dev);
+
+	return received;
+}
+
+static void rt_veth_timer(rtdm_timer_t *timer)
+{
+	struct rt_veth_queue *q = container_of(timer, struct rt_veth_queue, timer);
+	struct rt_veth_priv *priv = q->priv;
+
+	/* The queue may have been stopped before the timer was armed. */
+	if (!q->irq_pending)
+		return;
+
+	if (rt_veth_rx_queue(priv, q, rtdm_clock_read()))
+		rt_mark_stack_mgr(priv->rtdev);
+}
+
+static int rt_veth_interrupt(rtdm_irq_t *irq_handle)
+{
+	struct rt_veth_priv *priv = rtdm_irq_get_arg(irq_handle, struct rt_veth_priv);
+	nanosecs_abs_t time_stamp = rtdm_clock_read();
+	struct rt_veth_queue *q;
+	int received = 0;
+
+	for (q = priv->q; q < priv->q + queues; q++)
+		if (q->irq_pending)
+			received += rt_veth_rx_queue(priv, q, time_stamp);
+
+	if (received)
+		rt_mark_stack_mgr(priv->rtdev);
+
+	return RTDM_IRQ_HANDLED;
+}
+
+static nanosecs_rel_t rt_veth_irq_delay(struct rt_veth_priv *priv)
+{
+	nanosecs_rel_t delay = irq_delay;
+
+	if (irq_jitter) {
+		/* xorshift32, we only need some spread. */
+		priv->seed ^= priv->seed << 13;
+		priv->seed ^= priv->seed >> 17;
+		priv->seed ^= priv->seed << 5;
+		delay += priv->seed % (irq_jitter + 1);
+	}
+
+	/* A zero delay would not start the timer. */
+	return delay ?: 1;
+}
+
+/* Raise the receive interrupt of queue @q. */
+static void rt_veth_kick(struct rt_veth_priv *priv, struct rt_veth_queue *q)
+{
+	nanosecs_rel_t delay = 0;
+	rtdm_lockctx_t context;
+	int raise;
+
+	rtdm_lock_get_irqsave(&q->lock, context);
+
+	raise = q->running && !q->irq_pending;
+	if (raise) {
+		q->irq_pending = 1;
+		if (irq_mode == RT_VETH_IRQ_TIMER)
+			delay = rt_veth_irq_delay(priv);
+	}
+
+	rtdm_lock_put_irqrestore(&q->lock, context);
+
+	if (!raise)
+		return;
+
+	/*
+	 * Out of q->lock, which the timer handler grabs with nklock
+	 * held.
+	 */
+	if (irq_mode == RT_VETH_IRQ_TIMER)
+		rtdm_timer_start(&q->timer, delay, 0, RTDM_TIMERMODE_RELATIVE);
+	else
+		ipipe_raise_irq(priv->virq);
+}
+
+static int rt_veth_xmit(struct rtskb *skb, struct rtnet_device *rtdev)
+{
+	struct rt_veth_priv *priv = rtdev->priv;
+	unsigned int index = (skb->priority & RTSKB_PRIO_MASK) % queues;
+	struct rt_veth_queue *q = &priv->q[index];
+	rtdm_lockctx_t context;
+
+	rtdm_lock_get_irqsave(&q->lock, context);
+
+	if (!q->running || tx_ring_count(q) >= tx_ring_size) {
+		q->tx_dropped++;
+		rtdm_lock_put_irqrestore(&q->lock, context);
+		dev_kfree_rtskb(skb);
+		return 0;
+	}
+
+	rtskb_tx_timestamp(skb);
+	q->tx_ring[q->tx_head % tx_ring_size] = skb;
+	q->tx_head++;
+	if (tx_ring_count(q) == tx_ring_size)
+		rtnetif_stop_queue(rtdev);
+
+	rtdm_lock_put_irqrestore(&q->lock, context);
+
+	rt_veth_kick(priv->peer, &priv->peer->q[index]);
+
+	return 0;
+}
+
+static void rt_veth_stop_queue(struct rt_veth_priv *priv,
+			       struct rt_veth_queue *q)
+{
+	rtdm_lockctx_t context;
+	unsigned int n;
+
+	if (irq_mode == RT_VETH_IRQ_TIMER)
+		rtdm_timer_stop(&q->timer);
+
+	rtdm_lock_get_irqsave(&q->lock, context);
+
+	q->running = 0;
+	q->irq_pending = 0;
+
+	while (tx_ring_count(q) > 0) {
+		dev_kfree_rtskb(q->tx_ring[q->tx_tail % tx_ring_size]);
+		q->tx_tail++;
+		q->tx_dropped++;
+	}
+
+	for (n = 0; n < rx_ring_size; n++) {
+		if (q->rx_ring[n]) {
+			kfree_rtskb(q->rx_ring[n]);
+			q->rx_ring[n] = NULL;
+		}
+	}
+
+	rtdm_lock_put_irqrestore(&q->lock, context);
+}
+
+static int rt_veth_open(struct rtnet_device *rtdev)
+{
+	struct rt_veth_priv *priv = rtdev->priv;
+	struct rt_veth_queue *q;
+	rtdm_lockctx_t context;
+	unsigned int n;
+
+	for (q = priv->q; q < priv->q + queues; q++) {
+		for (n = 0; n < rx_ring_size; n++)
+			rt_veth_refill(priv, q, n);
+		rtdm_lock_get_irqsave(&q->lock, context);
+		q->rx_next = 0;
+		q->tx_head = q->tx_tail = 0;
+		q->running = 1;
+		rtdm_lock_put_irqrestore(&q->lock, context);
+	}
+
+	rt_stack_connect(rtdev, &STACK_manager);
+	rtnetif_start_queue(rtdev);
+
+	/* The link is up when both ends are. */
+	if (rtnetif_running(priv->peer->rtdev)) {
+		rtnetif_carrier_on(rtdev);
+		rtnetif_carrier_on(priv->peer->rtdev);
+	}
+
+	return 0;
+}
+
+static int rt_veth_close(struct rtnet_device *rtdev)
+{
+	struct rt_veth_priv *priv = rtdev->priv;
+	struct rt_veth_queue *q;
+
+	rtnetif_carrier_off(rtdev);
+	rtnetif_carrier_off(priv->peer->rtdev);
+	rtnetif_stop_queue(rtdev);
+
+	for (q = priv->q; q < priv->q + queues; q++)
+		rt_veth_stop_queue(priv, q);
+
+	rt_stack_disconnect(rtdev);
+
+	return 0;
+}
+
+static struct net_device_stats *rt_veth_get_stats(struct rtnet_device *rtdev)
+{
+	struct rt_veth_priv *priv = rtdev->priv;
+	struct net_device_stats *stats = &priv->stats;
+	struct rt_veth_queue *q;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (q = priv->q; q < priv->q + queues; q++) {
+		stats->rx_packets += q->rx_packets;
+		stats->rx_bytes += q->rx_bytes;
+		stats->rx_dropped += q->rx_dropped;
+		stats->tx_packets += q->tx_packets;
+		stats->tx_bytes += q->tx_bytes;
+		stats->tx_dropped += q->tx_dropped;
+	}
+
+	return stats;
+}
+
+static void rt_veth_free(struct rtnet_device *rtdev)
+{
+	struct rt_veth_priv *priv = rtdev->priv;
+	struct rt_veth_queue *q;
+
+	if (irq_mode == RT_VETH_IRQ_VIRQ && priv->virq) {
+		rtdm_irq_free(&priv->irq_handle);
+		ipipe_free_virq(priv->virq);
+	}
+
+	for (q = priv->q; q < priv->q + queues; q++) {
+		if (irq_mode == RT_VETH_IRQ_TIMER)
+			rtdm_timer_destroy(&q->timer);
+		kfree(q->tx_ring);
+		kfree(q->rx_ring);
+	}
+
+	rtdev_free(rtdev);
+}
+
+static void rt_veth_drop(struct rtnet_device *rtdev)
+{
+	rt_rtdev_disconnect(rtdev);
+	rt_veth_free(rtdev);
+}
+
+static struct rtnet_device *rt_veth_alloc(int index)
+{
+	struct rtnet_device *rtdev;
+	struct rt_veth_priv *priv;
+	struct rt_veth_queue *q;
+	int ret;
+
+	/* RX rings, plus frames held by the stack and the TX rings. */
+	rtdev = rt_alloc_etherdev(sizeof(*priv),
+				  queues * (rx_ring_size * 2 + tx_ring_size));
+	if (rtdev == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	rtdev_alloc_name(rtdev, "rtveth%d");
+	rt_rtdev_connect(rtdev, &RTDEV_manager);
+
+	priv = rtdev->priv;
+	priv->rtdev = rtdev;
+	priv->seed = 0x9e3779b9 ^ index;
+
+	for (q = priv->q; q < priv->q + queues; q++) {
+		q->priv = priv;
+		rtdm_lock_init(&q->lock);
+		if (irq_mode == RT_VETH_IRQ_TIMER)
+			rtdm_timer_init(&q->timer, rt_veth_timer, rtdev->name);
+	}
+
+	for (q = priv->q; q < priv->q + queues; q++) {
+		q->tx_ring = kcalloc(tx_ring_size, sizeof(*q->tx_ring),
+				     GFP_KERNEL);
+		q->rx_ring = kcalloc(rx_ring_size, sizeof(*q->rx_ring),
+				     GFP_KERNEL);
+		if (q->tx_ring == NULL || q->rx_ring == NULL) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+	}
+
+	if (irq_mode == RT_VETH_IRQ_VIRQ) {
+		priv->virq = ipipe_alloc_virq();
+		if (priv->virq == 0) {
+			ret = -EBUSY;
+			goto fail;
+		}
+		ret = rtdm_irq_request(&priv->irq_handle, priv->virq,
+				       rt_veth_interrupt, 0, rtdev->name, priv);
+		if (ret) {
+			ipipe_free_virq(priv->virq);
+			priv->virq = 0;
+			goto fail;
+		}
+	}
+
+	/* Locally administered address. */
+	rtdev->dev_addr[0] = 0x02;
+	rtdev->dev_addr[1] = 'v';
+	rtdev->dev_addr[2] = 'e';
+	rtdev->dev_addr[3] = 't';
+	rtdev->dev_addr[4] = 'h';
+	rtdev->dev_addr[5] = index;
+
+	rtdev->vers = RTDEV_VERS_2_0;
+	rtdev->open = rt_veth_open;
+	rtdev->stop = rt_veth_close;
+	rtdev->hard_start_xmit = rt_veth_xmit;
+	rtdev->get_stats = rt_veth_get_stats;
+
+	return rtdev;
+fail:
+	rt_veth_drop(rtdev);
+
+	return ERR_PTR(ret);
+}
+
+/* Unregister both ends of each pair before freeing either. */
+static void rt_veth_remove(int count)
+{
+	struct rtnet_device *rtdev;
+	int n;
+
+	for (n = count - 1; n >= 0; n--)
+		rt_unregister_rtnetdev(rt_veth_devs[n]);
+
+	for (n = count - 1; n >= 0; n--) {
+		rtdev = rt_veth_devs[n];
+		rt_veth_devs[n] = NULL;
+		rt_veth_drop(rtdev);
+	}
+}
+
+static int __init rt_veth_init(void)
+{
+	struct rtnet_device *a, *b;
+	struct rt_veth_priv *pa, *pb;
+	int n, ret;
+
+	if (pairs == 0 || pairs > RT_VETH_MAX_PAIRS ||
+	    queues == 0 || queues > RT_VETH_MAX_QUEUES ||
+	    rx_ring_size == 0 || rx_ring_size > RT_VETH_MAX_RING ||
+	    tx_ring_size == 0 || tx_ring_size > RT_VETH_MAX_RING ||
+	    irq_mode > RT_VETH_IRQ_VIRQ)
+		return -EINVAL;
+
+	for (n = 0; n < pairs; n++) {
+		a = rt_veth_alloc(n * 2);
+		if (IS_ERR(a)) {
+			ret = PTR_ERR(a);
+			goto fail;
+		}
+
+		b = rt_veth_alloc(n * 2 + 1);
+		if (IS_ERR(b)) {
+			ret = PTR_ERR(b);
+			rt_veth_drop(a);
+			goto fail;
+		}
+
+		/*
+		 * Either end may be brought up as soon as it is
+		 * registered, link them first.
+		 */
+		pa = a->priv;
+		pb = b->priv;
+		pa->peer = pb;
+		pb->peer = pa;
+
+		/* No carrier until both ends are up. */
+		rtnetif_carrier_off(a);
+		rtnetif_carrier_off(b);
+
+		ret = rt_register_rtnetdev(a);
+		if (ret)
+			goto fail_pair;
+
+		ret = rt_register_rtnetdev(b);
+		if (ret) {
+			rt_unregister_rtnetdev(a);
+			goto fail_pair;
+		}
+
+		rt_veth_devs[n * 2] = a;
+		rt_veth_devs[n * 2 + 1] = b;
+	}
+
+	return 0;
+fail_pair:
+	rt_veth_drop(b);
+	rt_veth_drop(a);
+fail:
+	rt_veth_remove(n * 2);
+
+	return ret;
+}
+
+static void __exit rt_veth_cleanup(void)
+{
+	rt_veth_remove(pairs * 2);
+}
+
+module_init(rt_veth_init);
+module_exit(rt_veth_cleanup);
@@ -34,8 +34,9 @@ MODULE_LICENSE("GPL");
 
 #define MAX_DEVICES		8
 
-#define IN_BUFFER_SIZE		4096
-#define OUT_BUFFER_SIZE		4096
+#define DEFAULT_BUFFER_SIZE	4096
+#define MIN_BUFFER_SIZE		64
+#define MAX_BUFFER_SIZE		(1 << 20)
 
 #define DEFAULT_BAUD_BASE	115200
 #define DEFAULT_TX_FIFO		16
@@ -44,6 +45,7 @@ MODULE_LICENSE("GPL");
 #define DATA_BITS_MASK		0x03
 #define STOP_BITS_MASK		0x01
 #define FIFO_MASK		0xC0
+#define FIFO_CONFIG_MASK	(FIFO_MASK | RTSER_FIFO_DEPTH_ADAPTIVE)
 #define EVENT_MASK		0x0F
 
 #define LCR_DLAB		0x80
@@ -62,7 +64,9 @@ MODULE_LICENSE("GPL");
 #define IIR_TX			0x02
 #define IIR_RX			0x04
 #define IIR_STAT		0x06
+#define IIR_RX_TIMEOUT		0x0C
 #define IIR_MASK		0x07
+#define IIR_ID_MASK		0x0F
 
 #define RHR			0	/* Receive Holding Buffer */
 #define THR			0	/* Transmit Holding Buffer */
@@ -75,6 +79,14 @@ MODULE_LICENSE("GPL");
 #define MCR			4	/* Modem Control Register */
 #define LSR			5	/* Line Status Register */
 #define MSR			6	/* Modem Status Register */
+#define SCR			7	/* Scratch Register */
+
+#define RX_ERRORS		(RTSER_LSR_OVERRUN_ERR | RTSER_LSR_PARITY_ERR | \
+				 RTSER_LSR_FRAMING_ERR | RTSER_LSR_BREAK_IND)
+
+/* Consecutive interrupts of the same kind before adapting the FIFO
+   threshold. */
+#define ADAPT_STEPS		16
 
 struct rt_16550_context {
 	struct rtser_config config;	/* current device configuration */
@@ -93,7 +105,8 @@ struct rt_16550_context {
 	size_t in_npend;		/* pending bytes in RX ring */
 	int in_nwait;			/* bytes the user waits for */
 	rtdm_event_t in_event;		/* raised to unblock reader */
-	char in_buf[IN_BUFFER_SIZE];	/* RX ring buffer */
+	char *in_buf;			/* RX ring buffer */
+	int in_size;			/* RX ring buffer size */
 	volatile unsigned long in_lock;	/* single-reader lock */
 	uint64_t *in_history;		/* RX timestamp buffer */
 
@@ -101,8 +114,13 @@ struct rt_16550_context {
 	int out_tail;			/* TX ring buffer, tail pointer */
 	size_t out_npend;		/* pending bytes in TX ring */
 	rtdm_event_t out_event;		/* raised to unblock writer */
-	char out_buf[OUT_BUFFER_SIZE];	/* TX ring buffer */
+	char *out_buf;			/* TX ring buffer */
+	int out_size;			/* TX ring buffer size */
 	rtdm_mutex_t out_lock;		/* single-writer mutex */
+	volatile unsigned long out_busy;	/* writer vs. resizing lock */
+
+	int rx_trigger;			/* RX FIFO threshold in bytes */
+	int rx_adapt;			/* adaptive threshold score */
 
 	uint64_t last_timestamp;	/* timestamp of last event */
 	int ioc_events;			/* recorded events */
@@ -130,49 +148,131 @@ static unsigned long irqtype[MAX_DEVICES] = {
 };
 static unsigned int baud_base[MAX_DEVICES];
 static int tx_fifo[MAX_DEVICES];
+static int rx_buffer[MAX_DEVICES];
+static int tx_buffer[MAX_DEVICES];
 
 module_param_array(irq, uint, NULL, 0400);
 module_param_array(baud_base, uint, NULL, 0400);
 module_param_array(tx_fifo, int, NULL, 0400);
+module_param_array(rx_buffer, int, NULL, 0400);
+module_param_array(tx_buffer, int, NULL, 0400);
 
 MODULE_PARM_DESC(irq, "IRQ numbers of the serial devices");
 MODULE_PARM_DESC(baud_base, "Maximum baud rate of the serial device "
 		 "(internal clock rate / 16)");
 MODULE_PARM_DESC(tx_fifo, "Transmitter FIFO size");
+MODULE_PARM_DESC(rx_buffer, "Initial size of the reception buffers "
+		 "(power of two)");
+MODULE_PARM_DESC(tx_buffer, "Initial size of the transmission buffers "
+		 "(power of two)");
+
+static inline int rt_16550_fifo_trigger(int fifo_depth)
+{
+	static const int trigger[] = { 1, 4, 8, 14 };
+
+	return trigger[(fifo_depth & FIFO_MASK) >> 6];
+}
 
+#include "16550A_emu.h"
 #include "16550A_io.h"
 #include "16550A_pnp.h"
 #include "16550A_pci.h"
 
+static inline int rt_16550_valid_buffer_size(int size)
+{
+	return size >= MIN_BUFFER_SIZE && size <= MAX_BUFFER_SIZE &&
+		(size & (size - 1)) == 0;
+}
+
+/*
+ * Move the RX FIFO threshold one step up after a series of trigger
+ * level interrupts, i.e. sustained input, in order to lower the
+ * interrupt rate. Move it one step down after a series of character
+ * timeouts, i.e. input bursts shorter than the threshold which are
+ * delayed by the timeout, or immediately on overrun.
+ */
+static void rt_16550_adapt_fifo(struct rt_16550_context *ctx, int delta)
+{
+	int depth = ctx->config.fifo_depth & FIFO_MASK;
+
+	ctx->rx_adapt += delta;
+
+	if (ctx->rx_adapt >= ADAPT_STEPS && depth < RTSER_FIFO_DEPTH_14)
+		depth += RTSER_FIFO_DEPTH_4;
+	else if (ctx->rx_adapt <= -ADAPT_STEPS && depth > RTSER_FIFO_DEPTH_1)
+		depth -= RTSER_FIFO_DEPTH_4;
+	else {
+		if (ctx->rx_adapt > ADAPT_STEPS)
+			ctx->rx_adapt = ADAPT_STEPS;
+		else if (ctx->rx_adapt < -ADAPT_STEPS)
+			ctx->rx_adapt = -ADAPT_STEPS;
+		return;
+	}
+
+	ctx->rx_adapt = 0;
+	ctx->config.fifo_depth = RTSER_FIFO_DEPTH_ADAPTIVE | depth;
+	ctx->rx_trigger = rt_16550_fifo_trigger(depth);
+	rt_16550_reg_out(rt_16550_io_mode_from_ctx(ctx), ctx->base_addr,
+			 FCR, FCR_FIFO | depth);
+}
+
+static inline void rt_16550_rx_put(struct rt_16550_context *ctx, int c,
+				   uint64_t timestamp, int *lsr)
+{
+	ctx->in_buf[ctx->in_tail] = c;
+	if (ctx->in_history)
+		ctx->in_history[ctx->in_tail] = timestamp;
+	ctx->in_tail = (ctx->in_tail + 1) & (ctx->in_size - 1);
+
+	if (++ctx->in_npend > ctx->in_size) {
+		*lsr |= RTSER_SOFT_OVERRUN_ERR;
+		ctx->in_npend--;
+	}
+}
+
 static inline int rt_16550_rx_interrupt(struct rt_16550_context *ctx,
-					uint64_t * timestamp)
+					uint64_t * timestamp, int iir)
 {
 	unsigned long base = ctx->base_addr;
 	int mode = rt_16550_io_mode_from_ctx(ctx);
 	int rbytes = 0;
 	int lsr = 0;
+	int status;
 	int c;
 
-	do {
-		c = rt_16550_reg_in(mode, base, RHR);	/* read input char */
-
-		ctx->in_buf[ctx->in_tail] = c;
-		if (ctx->in_history)
-			ctx->in_history[ctx->in_tail] = *timestamp;
-		ctx->in_tail = (ctx->in_tail + 1) & (IN_BUFFER_SIZE - 1);
-
-		if (++ctx->in_npend > IN_BUFFER_SIZE) {
-			lsr |= RTSER_SOFT_OVERRUN_ERR;
-			ctx->in_npend--;
+	status = rt_16550_reg_in(mode, base, LSR);
+
+	/*
+	 * A trigger level interrupt guarantees that many characters
+	 * to be available from the FIFO. Unless any of them came with
+	 * an error, drain them without polling LSR for each of them.
+	 */
+	if (iir == IIR_RX && !(status & RTSER_LSR_FIFO_ERR)) {
+		/* Reading LSR clears OE, keep it. */
+		lsr |= status & RX_ERRORS;
+		for (; rbytes < ctx->rx_trigger; rbytes++) {
+			c = rt_16550_reg_in(mode, base, RHR);
+			rt_16550_rx_put(ctx, c, *timestamp, &lsr);
 		}
+		status = rt_16550_reg_in(mode, base, LSR);
+	}
 
+	while (status & RTSER_LSR_DATA) {
+		lsr |= status & RX_ERRORS;
+		c = rt_16550_reg_in(mode, base, RHR);
+		rt_16550_rx_put(ctx, c, *timestamp, &lsr);
 		rbytes++;
-		lsr &= ~RTSER_LSR_DATA;
-		lsr |= (rt_16550_reg_in(mode, base, LSR) &
-			(RTSER_LSR_DATA | RTSER_LSR_OVERRUN_ERR |
-			 RTSER_LSR_PARITY_ERR | RTSER_LSR_FRAMING_ERR |
-			 RTSER_LSR_BREAK_IND));
-	} while (lsr & RTSER_LSR_DATA);
+		status = rt_16550_reg_in(mode, base, LSR);
+	}
+
+	lsr |= status & RX_ERRORS;
+
+	if (ctx->config.fifo_depth & RTSER_FIFO_DEPTH_ADAPTIVE) {
+		if (lsr & RTSER_LSR_OVERRUN_ERR)
+			rt_16550_adapt_fifo(ctx, -ADAPT_STEPS);
+		else
+			rt_16550_adapt_fifo(ctx, iir == IIR_RX ? 1 : -1);
+	}
 
 	/* save new errors */
 	ctx->status |= lsr;
@@ -204,7 +304,7 @@ static inline void rt_16550_tx_interrupt(struct rt_16550_context *ctx)
 		     count--, ctx->out_npend--) {
 			c = ctx->out_buf[ctx->out_head++];
 			rt_16550_reg_out(mode, base, THR, c);
-			ctx->out_head &= (OUT_BUFFER_SIZE - 1);
+			ctx->out_head &= (ctx->out_size - 1);
 		}
 	}
 }
@@ -238,12 +338,12 @@ static int rt_16550_interrupt(rtdm_irq_t * irq_context)
 	rtdm_lock_get(&ctx->lock);
 
 	while (1) {
-		iir = rt_16550_reg_in(mode, base, IIR) & IIR_MASK;
+		iir = rt_16550_reg_in(mode, base, IIR) & IIR_ID_MASK;
 		if (iir & IIR_PIRQ)
 			break;
 
-		if (iir == IIR_RX) {
-			rbytes += rt_16550_rx_interrupt(ctx, &timestamp);
+		if ((iir & IIR_MASK) == IIR_RX) {
+			rbytes += rt_16550_rx_interrupt(ctx, &timestamp, iir);
 			events |= RTSER_EVENT_RXPEND;
 		} else if (iir == IIR_STAT)
 			rt_16550_stat_interrupt(ctx);
@@ -300,7 +400,7 @@ static int rt_16550_interrupt(rtdm_irq_t * irq_context)
 
 static int rt_16550_set_config(struct rt_16550_context *ctx,
 			       const struct rtser_config *config,
-			       uint64_t **in_history_ptr)
+			       uint64_t **in_history_ptr, int in_history_size)
 {
 	rtdm_lockctx_t lock_ctx;
 	unsigned long base = ctx->base_addr;
@@ -342,11 +442,13 @@ static int rt_16550_set_config(struct rt_16550_context *ctx,
 	}
 
 	if (config->config_mask & RTSER_SET_FIFO_DEPTH) {
-		ctx->config.fifo_depth = config->fifo_depth & FIFO_MASK;
+		ctx->config.fifo_depth = config->fifo_depth & FIFO_CONFIG_MASK;
+		ctx->rx_trigger = rt_16550_fifo_trigger(ctx->config.fifo_depth);
+		ctx->rx_adapt = 0;
 		rt_16550_reg_out(mode, base, FCR,
 				 FCR_FIFO | FCR_RESET_RX | FCR_RESET_TX);
 		rt_16550_reg_out(mode, base, FCR,
-				 FCR_FIFO | ctx->config.fifo_depth);
+				 FCR_FIFO | (ctx->config.fifo_depth & FIFO_MASK));
 	}
 
 	rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
@@ -366,10 +468,15 @@ static int rt_16550_set_config(struct rt_16550_context *ctx,
 
 		if (config->timestamp_history & RTSER_RX_TIMESTAMP_HISTORY) {
 			if (!ctx->in_history) {
-				ctx->in_history = *in_history_ptr;
-				*in_history_ptr = NULL;
-				if (!ctx->in_history)
+				if (*in_history_ptr == NULL)
 					err = -ENOMEM;
+				else if (in_history_size != ctx->in_size)
+					/* RX buffer resized meanwhile */
+					err = -EBUSY;
+				else {
+					ctx->in_history = *in_history_ptr;
+					*in_history_ptr = NULL;
+				}
 			}
 		} else {
 			*in_history_ptr = ctx->in_history;
@@ -434,6 +541,95 @@ void rt_16550_cleanup_ctx(struct rt_16550_context *ctx)
 	rtdm_event_destroy(&ctx->out_event);
 	rtdm_event_destroy(&ctx->ioc_event);
 	rtdm_mutex_destroy(&ctx->out_lock);
+	kfree(ctx->in_buf);
+	kfree(ctx->out_buf);
+}
+
+static int rt_16550_set_buffers(struct rt_16550_context *ctx,
+				const struct rtser_buffers *bufs)
+{
+	char *in_buf = NULL, *out_buf = NULL;
+	uint64_t *in_history = NULL;
+	rtdm_lockctx_t lock_ctx;
+	int err = 0;
+
+	if ((bufs->rx_size && !rt_16550_valid_buffer_size(bufs->rx_size)) ||
+	    (bufs->tx_size && !rt_16550_valid_buffer_size(bufs->tx_size)))
+		return -EINVAL;
+
+	/* Keep readers and writers away while we swap the buffers. */
+	if (test_and_set_bit(0, &ctx->in_lock))
+		return -EBUSY;
+
+	if (test_and_set_bit(0, &ctx->out_busy)) {
+		err = -EBUSY;
+		goto unlock_in;
+	}
+
+	if (bufs->rx_size) {
+		in_buf = kmalloc(bufs->rx_size, GFP_KERNEL);
+		if (ctx->in_history)
+			in_history = kmalloc(bufs->rx_size *
+					     sizeof(nanosecs_abs_t),
+					     GFP_KERNEL);
+		if (!in_buf || (ctx->in_history && !in_history)) {
+			err = -ENOMEM;
+			goto free_out;
+		}
+	}
+
+	if (bufs->tx_size) {
+		out_buf = kmalloc(bufs->tx_size, GFP_KERNEL);
+		if (!out_buf) {
+			err = -ENOMEM;
+			goto free_out;
+		}
+	}
+
+	rtdm_lock_get_irqsave(&ctx->lock, lock_ctx);
+
+	/*
+	 * The timestamp history may have been switched on or off
+	 * meanwhile, it must always match the size of the RX buffer.
+	 */
+	if (in_buf && ctx->in_history && !in_history) {
+		rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
+		err = -EBUSY;
+		goto free_out;
+	}
+
+	if (in_buf) {
+		swap(ctx->in_buf, in_buf);
+		if (ctx->in_history)
+			swap(ctx->in_history, in_history);
+		ctx->in_size = bufs->rx_size;
+		ctx->in_head = 0;
+		ctx->in_tail = 0;
+		ctx->in_npend = 0;
+		ctx->ioc_events &= ~RTSER_EVENT_RXPEND;
+	}
+
+	if (out_buf) {
+		swap(ctx->out_buf, out_buf);
+		ctx->out_size = bufs->tx_size;
+		ctx->out_head = 0;
+		ctx->out_tail = 0;
+		ctx->out_npend = 0;
+	}
+
+	rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
+
+	/* Release the former buffers. */
+free_out:
+	kfree(in_buf);
+	kfree(in_history);
+	kfree(out_buf);
+
+	clear_bit(0, &ctx->out_busy);
+unlock_in:
+	clear_bit(0, &ctx->in_lock);
+
+	return err;
 }
 
 int rt_16550_open(struct rtdm_fd *fd, int oflags)
@@ -457,6 +653,15 @@ int rt_16550_open(struct rtdm_fd *fd, int oflags)
 
 	ctx->tx_fifo = tx_fifo[dev_id];
 
+	ctx->in_size = rx_buffer[dev_id];
+	ctx->in_buf = kmalloc(ctx->in_size, GFP_KERNEL);
+	ctx->out_size = tx_buffer[dev_id];
+	ctx->out_buf = kmalloc(ctx->out_size, GFP_KERNEL);
+	if (!ctx->in_buf || !ctx->out_buf) {
+		rt_16550_cleanup_ctx(ctx);
+		return -ENOMEM;
+	}
+
 	ctx->in_head = 0;
 	ctx->in_tail = 0;
 	ctx->in_npend = 0;
@@ -467,13 +672,14 @@ int rt_16550_open(struct rtdm_fd *fd, int oflags)
 	ctx->out_head = 0;
 	ctx->out_tail = 0;
 	ctx->out_npend = 0;
+	ctx->out_busy = 0;
 
 	ctx->ioc_events = 0;
 	ctx->ioc_event_lock = 0;
 	ctx->status = 0;
 	ctx->saved_errors = 0;
 
-	rt_16550_set_config(ctx, &default_config, &dummy);
+	rt_16550_set_config(ctx, &default_config, &dummy, 0);
 
 	err = rtdm_irq_request(&ctx->irq_handle, irq[dev_id],
 			rt_16550_interrupt, irqtype[dev_id],
@@ -536,6 +742,167 @@ void rt_16550_close(struct rtdm_fd *fd)
 	kfree(in_history);
 }
 
+static int rt_16550_copy_in(struct rtdm_fd *fd, struct rt_16550_context *ctx,
+			    char *out_pos, int in_pos, int block)
+{
+	int subblock;
+
+	/* Wrap around the buffer end if needed. */
+	while (block > 0) {
+		subblock = min(block, ctx->in_size - in_pos);
+
+		if (rtdm_fd_is_user(fd)) {
+			if (rtdm_copy_to_user(fd, out_pos,
+					      &ctx->in_buf[in_pos], subblock))
+				return -EFAULT;
+		} else
+			memcpy(out_pos, &ctx->in_buf[in_pos], subblock);
+
+		out_pos += subblock;
+		block -= subblock;
+		in_pos = 0;
+	}
+
+	return 0;
+}
+
+static ssize_t rt_16550_read_chunks(struct rtdm_fd *fd,
+				    struct rt_16550_context *ctx,
+				    struct rtser_read_chunks *req)
+{
+	struct rtser_chunk chunk = { .reserved = 0 };
+	char *out_pos = (char *)req->buf;
+	rtdm_toseq_t timeout_seq;
+	rtdm_lockctx_t lock_ctx;
+	int pending, in_pos, block;
+	int read = 0, nr_chunks = 0;
+	ssize_t ret;
+
+	if (req->size == 0 || req->nr_chunks <= 0)
+		return -EINVAL;
+
+	if (rtdm_fd_is_user(fd) &&
+	    (!rtdm_rw_user_ok(fd, req->buf, req->size) ||
+	     !rtdm_rw_user_ok(fd, req->chunks,
+			      req->nr_chunks * sizeof(struct rtser_chunk))))
+		return -EFAULT;
+
+	/* only one reader allowed, stop any further attempts here */
+	if (test_and_set_bit(0, &ctx->in_lock))
+		return -EBUSY;
+
+	rtdm_toseq_init(&timeout_seq, ctx->config.rx_timeout);
+
+	rtdm_lock_get_irqsave(&ctx->lock, lock_ctx);
+
+	for (;;) {
+		if (ctx->in_history == NULL) {
+			ret = -EINVAL;
+			goto unlock_out;
+		}
+
+		if (ctx->status) {
+			if (ctx->status & RTSER_LSR_BREAK_IND)
+				ret = -EPIPE;
+			else
+				ret = -EIO;
+			ctx->saved_errors = ctx->status &
+			    (RTSER_LSR_OVERRUN_ERR | RTSER_LSR_PARITY_ERR |
+			     RTSER_LSR_FRAMING_ERR | RTSER_SOFT_OVERRUN_ERR);
+			ctx->status = 0;
+			goto unlock_out;
+		}
+
+		if (ctx->in_npend > 0)
+			break;
+
+		if (ctx->config.rx_timeout < 0) {
+			ret = -EAGAIN;
+			goto unlock_out;
+		}
+
+		ctx->in_nwait = 1;
+
+		rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
+
+		ret = rtdm_event_timedwait(&ctx->in_event,
+					   ctx->config.rx_timeout,
+					   &timeout_seq);
+		if (ret == -EIDRM)
+			/* Device has been closed - return immediately. */
+			return -EBADF;
+
+		rtdm_lock_get_irqsave(&ctx->lock, lock_ctx);
+
+		if (ret < 0) {
+			ctx->in_nwait = 0;
+			if (ctx->in_npend == 0)
+				goto unlock_out;
+		}
+	}
+
+	pending = min_t(size_t, ctx->in_npend, req->size);
+	in_pos = ctx->in_head;
+
+	rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
+
+	/*
+	 * Characters received by the same interrupt share the same
+	 * timestamp, which delimits the chunks.
+	 */
+	while (read < pending && nr_chunks < req->nr_chunks) {
+		/* The history may be switched off meanwhile. */
+		rtdm_lock_get_irqsave(&ctx->lock, lock_ctx);
+		if (ctx->in_history == NULL) {
+			rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
+			break;
+		}
+		chunk.timestamp = ctx->in_history[in_pos];
+		block = 1;
+		while (read + block < pending &&
+		       ctx->in_history[(in_pos + block) & (ctx->in_size - 1)] ==
+		       chunk.timestamp)
+			block++;
+		rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
+
+		ret = rt_16550_copy_in(fd, ctx, out_pos, in_pos, block);
+		if (ret)
+			goto out;
+
+		chunk.length = block;
+		if (rtdm_fd_is_user(fd)) {
+			if (rtdm_copy_to_user(fd, &req->chunks[nr_chunks],
+					      &chunk, sizeof(chunk))) {
+				ret = -EFAULT;
+				goto out;
+			}
+		} else
+			req->chunks[nr_chunks] = chunk;
+
+		nr_chunks++;
+		read += block;
+		out_pos += block;
+		in_pos = (in_pos + block) & (ctx->in_size - 1);
+	}
+
+	rtdm_lock_get_irqsave(&ctx->lock, lock_ctx);
+
+	ctx->in_head = (ctx->in_head + read) & (ctx->in_size - 1);
+	if ((ctx->in_npend -= read) == 0)
+		ctx->ioc_events &= ~RTSER_EVENT_RXPEND;
+
+	req->nr_chunks = nr_chunks;
+	ret = read ?: -EINVAL;
+
+unlock_out:
+	rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
+out:
+	/* Release the simple reader lock. */
+	clear_bit(0, &ctx->in_lock);
+
+	return ret;
+}
+
 int rt_16550_ioctl(struct rtdm_fd *fd, unsigned int request, void *arg)
 {
 	rtdm_lockctx_t lock_ctx;
@@ -565,6 +932,7 @@ int rt_16550_ioctl(struct rtdm_fd *fd, unsigned int request, void *arg)
 		struct rtser_config *config;
 		struct rtser_config config_buf;
 		uint64_t *hist_buf = NULL;
+		int hist_size = 0;
 
 		config = (struct rtser_config *)arg;
 
@@ -596,13 +964,15 @@ int rt_16550_ioctl(struct rtdm_fd *fd, unsigned int request, void *arg)
 				return -ENOSYS;
 
 			if (config->timestamp_history &
-			    RTSER_RX_TIMESTAMP_HISTORY)
-				hist_buf = kmalloc(IN_BUFFER_SIZE *
+			    RTSER_RX_TIMESTAMP_HISTORY) {
+				hist_size = ctx->in_size;
+				hist_buf = kmalloc(hist_size *
 						   sizeof(nanosecs_abs_t),
 						   GFP_KERNEL);
+			}
 		}
 
-		rt_16550_set_config(ctx, config, &hist_buf);
+		err = rt_16550_set_config(ctx, config, &hist_buf, hist_size);
 
 		if (hist_buf)
 			kfree(hist_buf);
@@ -766,12 +1136,69 @@ int rt_16550_ioctl(struct rtdm_fd *fd, unsigned int request, void *arg)
 		if (fcr) {
 			rt_16550_reg_out(mode, base, FCR, fcr);
 			rt_16550_reg_out(mode, base, FCR,
-					 FCR_FIFO | ctx->config.fifo_depth);
+					 FCR_FIFO |
+					 (ctx->config.fifo_depth & FIFO_MASK));
 		}
 		rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
 		break;
 	}
 
+	case RTSER_RTIOC_READ_CHUNKS: {
+		struct rtser_read_chunks *req;
+		struct rtser_read_chunks req_buf;
+		ssize_t ret;
+
+		if (!rtdm_in_rt_context())
+			return -ENOSYS;
+
+		req = (struct rtser_read_chunks *)arg;
+
+		if (rtdm_fd_is_user(fd)) {
+			err =
+			    rtdm_safe_copy_from_user(fd, &req_buf, arg,
+						     sizeof(struct
+							    rtser_read_chunks));
+			if (err)
+				return err;
+
+			req = &req_buf;
+		}
+
+		ret = rt_16550_read_chunks(fd, ctx, req);
+		if (ret < 0)
+			return ret;
+
+		if (rtdm_fd_is_user(fd)) {
+			err = rtdm_safe_copy_to_user(fd,
+				&((struct rtser_read_chunks *)arg)->nr_chunks,
+				&req->nr_chunks, sizeof(int));
+			if (err)
+				return err;
+		}
+
+		err = ret;
+		break;
+	}
+
+	case RTSER_RTIOC_SET_BUFFERS: {
+		struct rtser_buffers bufs;
+
+		/* Reflect the call to non-RT as we allocate buffers. */
+		if (rtdm_in_rt_context())
+			return -ENOSYS;
+
+		if (rtdm_fd_is_user(fd)) {
+			err = rtdm_safe_copy_from_user(fd, &bufs, arg,
+						       sizeof(bufs));
+			if (err)
+				return err;
+		} else
+			bufs = *(struct rtser_buffers *)arg;
+
+		err = rt_16550_set_buffers(ctx, &bufs);
+		break;
+	}
+
 	default:
 		err = -ENOTTY;
 	}
@@ -842,10 +1269,10 @@ ssize_t rt_16550_read(struct rtdm_fd *fd, void *buf, size_t nbyte)
 			rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
 
 			/* Do we have to wrap around the buffer end? */
-			if (in_pos + subblock > IN_BUFFER_SIZE) {
+			if (in_pos + subblock > ctx->in_size) {
 				/* Treat the block between head and buffer end
 				   separately. */
-				subblock = IN_BUFFER_SIZE - in_pos;
+				subblock = ctx->in_size - in_pos;
 
 				if (rtdm_fd_is_user(fd)) {
 					if (rtdm_copy_to_user
@@ -883,7 +1310,7 @@ ssize_t rt_16550_read(struct rtdm_fd *fd, void *buf, size_t nbyte)
 			rtdm_lock_get_irqsave(&ctx->lock, lock_ctx);
 
 			ctx->in_head =
-			    (ctx->in_head + block) & (IN_BUFFER_SIZE - 1);
+			    (ctx->in_head + block) & (ctx->in_size - 1);
 			if ((ctx->in_npend -= block) == 0)
 				ctx->ioc_events &= ~RTSER_EVENT_RXPEND;
 
@@ -971,10 +1398,16 @@ ssize_t rt_16550_write(struct rtdm_fd *fd, const void *buf, size_t nbyte)
 	if (ret)
 		return ret;
 
+	/* Buffers are being resized? */
+	if (test_and_set_bit(0, &ctx->out_busy)) {
+		rtdm_mutex_unlock(&ctx->out_lock);
+		return -EBUSY;
+	}
+
 	while (nbyte > 0) {
 		rtdm_lock_get_irqsave(&ctx->lock, lock_ctx);
 
-		free = OUT_BUFFER_SIZE - ctx->out_npend;
+		free = ctx->out_size - ctx->out_npend;
 
 		if (free > 0) {
 			block = subblock = (nbyte <= free) ? nbyte : free;
@@ -983,10 +1416,10 @@ ssize_t rt_16550_write(struct rtdm_fd *fd, const void *buf, size_t nbyte)
 			rtdm_lock_put_irqrestore(&ctx->lock, lock_ctx);
 
 			/* Do we have to wrap around the buffer end? */
-			if (out_pos + subblock > OUT_BUFFER_SIZE) {
+			if (out_pos + subblock > ctx->out_size) {
 				/* Treat the block between head and buffer
 				   end separately. */
-				subblock = OUT_BUFFER_SIZE - out_pos;
+				subblock = ctx->out_size - out_pos;
 
 				if (rtdm_fd_is_user(fd)) {
 					if (rtdm_copy_from_user
@@ -1024,7 +1457,7 @@ ssize_t rt_16550_write(struct rtdm_fd *fd, const void *buf, size_t nbyte)
 			rtdm_lock_get_irqsave(&ctx->lock, lock_ctx);
 
 			ctx->out_tail =
-			    (ctx->out_tail + block) & (OUT_BUFFER_SIZE - 1);
+			    (ctx->out_tail + block) & (ctx->out_size - 1);
 			ctx->out_npend += block;
 
 			/* unmask tx interrupt */
@@ -1057,6 +1490,7 @@ ssize_t rt_16550_write(struct rtdm_fd *fd, const void *buf, size_t nbyte)
 		}
 	}
 
+	clear_bit(0, &ctx->out_busy);
 	rtdm_mutex_unlock(&ctx->out_lock);
 
 	if ((written > 0) && ((ret == 0) || (ret == -EAGAIN) ||
@@ -1105,8 +1539,18 @@ int __init rt_16550_init(void)
 		if (!rt_16550_addr_param(i))
 			continue;
 
+		if (rx_buffer[i] == 0)
+			rx_buffer[i] = DEFAULT_BUFFER_SIZE;
+
+		if (tx_buffer[i] == 0)
+			tx_buffer[i] = DEFAULT_BUFFER_SIZE;
+
 		err = -EINVAL;
-		if (!irq[i] || !rt_16550_addr_param_valid(i))
+		/* Emulated devices get a virtual IRQ assigned. */
+		if ((!irq[i] && rt_16550_io_mode(i) != MODE_EMU) ||
+		    !rt_16550_addr_param_valid(i) ||
+		    !rt_16550_valid_buffer_size(rx_buffer[i]) ||
+		    !rt_16550_valid_buffer_size(tx_buffer[i]))
 			goto cleanup_out;
 
 		dev = kmalloc(sizeof(struct rtdm_device) +
@@ -0,0 +1,385 @@
+/*
+ * Xenomai is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Software model of a 16550A register file, for testing the driver
+ * without hardware. Transmitted characters are looped back to the
+ * receiver at the configured line speed, FIFO trigger levels and
+ * character timeouts are modelled, and interrupts are delivered
+ * through a virtual IRQ.
+ */
+
+#ifdef CONFIG_XENO_DRIVERS_16550A_EMU
+
+#include <linux/ipipe.h>
+
+#define EMU_FIFO_SIZE		16
+#define EMU_MIN_TICK		10000	/* ns */
+#define EMU_TIMEOUT_CHARS	4
+
+struct rt_16550_emu {
+	rtdm_lock_t lock;
+	rtdm_timer_t timer;
+	unsigned int virq;
+	int dev_id;
+	u8 ier, lcr, mcr, fcr, lsr, scr, dll, dlm;
+	u8 rx_fifo[EMU_FIFO_SIZE];
+	int rx_head, rx_count;
+	u8 tx_fifo[EMU_FIFO_SIZE];
+	int tx_head, tx_count;
+	int trigger;
+	int chars_per_tick;
+	int idle;		/* character times without reception */
+	int timeout;		/* character timeout pending */
+	int thre;		/* THR empty interrupt pending */
+	int irq_line;		/* interrupt line asserted */
+	int running;		/* line timer running */
+};
+
+static int emu[MAX_DEVICES];
+module_param_array(emu, int, NULL, 0400);
+MODULE_PARM_DESC(emu, "Emulated serial devices (non-zero: software UART "
+		 "looping transmitted characters back)");
+
+static struct rt_16550_emu *emu_state[MAX_DEVICES];
+
+static inline unsigned long rt_16550_emu_param(int dev_id)
+{
+	return emu[dev_id];
+}
+
+static inline unsigned long rt_16550_emu_base(int dev_id)
+{
+	return (unsigned long)emu_state[dev_id];
+}
+
+static int rt_16550_emu_fifo_size(struct rt_16550_emu *emu)
+{
+	return (emu->fcr & FCR_FIFO) ? EMU_FIFO_SIZE : 1;
+}
+
+static u8 rt_16550_emu_iir(struct rt_16550_emu *emu)
+{
+	if ((emu->ier & IER_STAT) && (emu->lsr & RX_ERRORS))
+		return IIR_STAT;
+
+	if (emu->ier & IER_RX) {
+		if (emu->rx_count >= emu->trigger)
+			return IIR_RX;
+		if (emu->timeout)
+			return IIR_RX_TIMEOUT;
+	}
+
+	if ((emu->ier & IER_TX) && emu->thre)
+		return IIR_TX;
+
+	return IIR_PIRQ;
+}
+
+/* Raise the virtual IRQ on rising edges of the interrupt line. */
+static void rt_16550_emu_update(struct rt_16550_emu *emu)
+{
+	int line = rt_16550_emu_iir(emu) != IIR_PIRQ;
+
+	if (line && !emu->irq_line)
+		ipipe_raise_irq(emu->virq);
+
+	emu->irq_line = line;
+}
+
+static nanosecs_rel_t rt_16550_emu_period(struct rt_16550_emu *emu)
+{
+	unsigned int divisor = (emu->dlm << 8) | emu->dll;
+	unsigned int baud, char_ns;
+	nanosecs_rel_t period;
+
+	baud = (baud_base[emu->dev_id] ? : DEFAULT_BAUD_BASE) /
+		(divisor ? : 1);
+	/* Start, stop and 8 data bits. */
+	char_ns = 10 * 1000000000U / (baud ? : 1);
+
+	period = max_t(unsigned int, char_ns, EMU_MIN_TICK);
+	emu->chars_per_tick = period / char_ns;
+
+	return period;
+}
+
+/* Called with emu->lock held, returns non-zero to start the timer. */
+static int rt_16550_emu_kick(struct rt_16550_emu *emu)
+{
+	if (emu->running)
+		return 0;
+
+	if (emu->tx_count == 0 && (emu->rx_count == 0 || emu->timeout))
+		return 0;
+
+	emu->running = 1;
+
+	return 1;
+}
+
+static void rt_16550_emu_start(struct rt_16550_emu *emu)
+{
+	nanosecs_rel_t period = rt_16550_emu_period(emu);
+
+	rtdm_timer_start(&emu->timer, period, period,
+			 RTDM_TIMERMODE_RELATIVE);
+}
+
+/* Move characters from the TX FIFO over the wire to the RX FIFO. */
+static void rt_16550_emu_tick(rtdm_timer_t *timer)
+{
+	struct rt_16550_emu *emu = container_of(timer, struct rt_16550_emu,
+						timer);
+	int n, c;
+
+	rtdm_lock_get(&emu->lock);
+
+	for (n = 0; n < emu->chars_per_tick && emu->tx_count > 0; n++) {
+		c = emu->tx_fifo[emu->tx_head];
+		emu->tx_head = (emu->tx_head + 1) % EMU_FIFO_SIZE;
+		if (--emu->tx_count == 0)
+			emu->thre = 1;
+
+		if (emu->rx_count < rt_16550_emu_fifo_size(emu)) {
+			emu->rx_fifo[(emu->rx_head + emu->rx_count) %
+				     EMU_FIFO_SIZE] = c;
+			emu->rx_count++;
+		} else
+			emu->lsr |= RTSER_LSR_OVERRUN_ERR;
+
+		emu->idle = 0;
+		emu->timeout = 0;
+	}
+
+	emu->idle += emu->chars_per_tick - n;
+	if (emu->rx_count > 0 && (emu->fcr & FCR_FIFO) &&
+	    emu->idle >= EMU_TIMEOUT_CHARS)
+		emu->timeout = 1;
+
+	if (emu->tx_count == 0 && (emu->rx_count == 0 || emu->timeout)) {
+		rtdm_timer_stop_in_handler(&emu->timer);
+		emu->running = 0;
+	}
+
+	rt_16550_emu_update(emu);
+
+	rtdm_lock_put(&emu->lock);
+}
+
+static u8 rt_16550_emu_in(unsigned long base, int off)
+{
+	struct rt_16550_emu *emu = (struct rt_16550_emu *)base;
+	rtdm_lockctx_t lock_ctx;
+	int start;
+	u8 val = 0;
+
+	rtdm_lock_get_irqsave(&emu->lock, lock_ctx);
+
+	switch (off) {
+	case RHR:
+		if (emu->lcr & LCR_DLAB) {
+			val = emu->dll;
+			break;
+		}
+		if (emu->rx_count > 0) {
+			val = emu->rx_fifo[emu->rx_head];
+			emu->rx_head = (emu->rx_head + 1) % EMU_FIFO_SIZE;
+			emu->rx_count--;
+		}
+		emu->idle = 0;
+		emu->timeout = 0;
+		break;
+	case IER:
+		val = (emu->lcr & LCR_DLAB) ? emu->dlm : emu->ier;
+		break;
+	case IIR:
+		val = rt_16550_emu_iir(emu);
+		if (val == IIR_TX)
+			emu->thre = 0;
+		if (emu->fcr & FCR_FIFO)
+			val |= FIFO_MASK;
+		break;
+	case LCR:
+		val = emu->lcr;
+		break;
+	case MCR:
+		val = emu->mcr;
+		break;
+	case LSR:
+		val = emu->lsr;
+		if (emu->rx_count > 0)
+			val |= RTSER_LSR_DATA;
+		if (emu->tx_count == 0)
+			val |= RTSER_LSR_THR_EMTPY | RTSER_LSR_TRANSM_EMPTY;
+		/* Errors are cleared on read. */
+		emu->lsr = 0;
+		break;
+	case MSR:
+		val = RTSER_MSR_CTS | RTSER_MSR_DSR | RTSER_MSR_DCD;
+		break;
+	case SCR:
+		val = emu->scr;
+		break;
+	}
+
+	rt_16550_emu_update(emu);
+	start = rt_16550_emu_kick(emu);
+
+	rtdm_lock_put_irqrestore(&emu->lock, lock_ctx);
+
+	/* Out of our lock, the tick handler nests it the other way
+	   around. */
+	if (start)
+		rt_16550_emu_start(emu);
+
+	return val;
+}
+
+static void rt_16550_emu_out(unsigned long base, int off, u8 val)
+{
+	struct rt_16550_emu *emu = (struct rt_16550_emu *)base;
+	rtdm_lockctx_t lock_ctx;
+	int start;
+
+	rtdm_lock_get_irqsave(&emu->lock, lock_ctx);
+
+	switch (off) {
+	case THR:
+		if (emu->lcr & LCR_DLAB) {
+			emu->dll = val;
+			break;
+		}
+		if (emu->tx_count < rt_16550_emu_fifo_size(emu)) {
+			emu->tx_fifo[(emu->tx_head + emu->tx_count) %
+				     EMU_FIFO_SIZE] = val;
+			emu->tx_count++;
+		}
+		emu->thre = 0;
+		break;
+	case IER:
+		if (emu->lcr & LCR_DLAB) {
+			emu->dlm = val;
+			break;
+		}
+		/* Enabling THRE interrupts with an empty FIFO fires one. */
+		if (!(emu->ier & IER_TX) && (val & IER_TX) &&
+		    emu->tx_count == 0)
+			emu->thre = 1;
+		emu->ier = val & (IER_RX | IER_TX | IER_STAT | IER_MODEM);
+		break;
+	case FCR:
+		if ((val & FCR_FIFO) != (emu->fcr & FCR_FIFO))
+			val |= FCR_RESET_RX | FCR_RESET_TX;
+		if (val & FCR_RESET_RX) {
+			emu->rx_count = 0;
+			emu->timeout = 0;
+		}
+		if (val & FCR_RESET_TX)
+			emu->tx_count = 0;
+		emu->fcr = val & (FCR_FIFO | FIFO_MASK);
+		emu->trigger = (emu->fcr & FCR_FIFO) ?
+			rt_16550_fifo_trigger(emu->fcr) : 1;
+		break;
+	case LCR:
+		emu->lcr = val;
+		break;
+	case MCR:
+		emu->mcr = val;
+		break;
+	case SCR:
+		emu->scr = val;
+		break;
+	}
+
+	rt_16550_emu_update(emu);
+	start = rt_16550_emu_kick(emu);
+
+	rtdm_lock_put_irqrestore(&emu->lock, lock_ctx);
+
+	if (start)
+		rt_16550_emu_start(emu);
+}
+
+static int rt_16550_emu_init(int dev_id)
+{
+	struct rt_16550_emu *emu;
+
+	emu = kzalloc(sizeof(*emu), GFP_KERNEL);
+	if (emu == NULL)
+		return -ENOMEM;
+
+	emu->virq = ipipe_alloc_virq();
+	if (emu->virq == 0) {
+		kfree(emu);
+		return -EBUSY;
+	}
+
+	rtdm_lock_init(&emu->lock);
+	rtdm_timer_init(&emu->timer, rt_16550_emu_tick, "16550A-emu");
+	emu->dev_id = dev_id;
+	emu->trigger = 1;
+	emu->chars_per_tick = 1;
+
+	emu_state[dev_id] = emu;
+	irq[dev_id] = emu->virq;
+
+	return 0;
+}
+
+static void rt_16550_emu_cleanup(int dev_id)
+{
+	struct rt_16550_emu *emu = emu_state[dev_id];
+
+	rtdm_timer_destroy(&emu->timer);
+	ipipe_free_virq(emu->virq);
+	kfree(emu);
+
+	emu_state[dev_id] = NULL;
+	irq[dev_id] = 0;
+}
+
+#else /* !CONFIG_XENO_DRIVERS_16550A_EMU */
+
+static inline unsigned long rt_16550_emu_param(int dev_id)
+{
+	return 0;
+}
+
+static inline unsigned long rt_16550_emu_base(int dev_id)
+{
+	return 0;
+}
+
+static inline u8 rt_16550_emu_in(unsigned long base, int off)
+{
+	return 0;
+}
+
+static inline void rt_16550_emu_out(unsigned long base, int off, u8 val)
+{
+}
+
+static inline int rt_16550_emu_init(int dev_id)
+{
+	return -ENODEV;
+}
+
+static inline void rt_16550_emu_cleanup(int dev_id)
+{
+}
+
+#endif /* !CONFIG_XENO_DRIVERS_16550A_EMU */
@@ -18,7 +18,7 @@
 
 /* Manages the I/O access method of the driver. */
 
-typedef enum { MODE_PIO, MODE_MMIO } io_mode_t;
+typedef enum { MODE_PIO, MODE_MMIO, MODE_EMU } io_mode_t;
 
 #if defined(CONFIG_XENO_DRIVERS_16550A_PIO) || \
     defined(CONFIG_XENO_DRIVERS_16550A_ANY)
@@ -117,22 +117,33 @@ rt_16550_init_io_ctx(int dev_id, struct rt_16550_context *ctx)
 
 static inline unsigned long rt_16550_addr_param(int dev_id)
 {
-	return (io[dev_id]) ? io[dev_id] : mem[dev_id];
+	if (io[dev_id])
+		return io[dev_id];
+
+	return (mem[dev_id]) ? mem[dev_id] : rt_16550_emu_param(dev_id);
 }
 
 static inline int rt_16550_addr_param_valid(int dev_id)
 {
-	return !(io[dev_id] && mem[dev_id]);
+	return !(io[dev_id] && mem[dev_id]) &&
+		!((io[dev_id] || mem[dev_id]) && rt_16550_emu_param(dev_id));
 }
 
 static inline unsigned long rt_16550_base_addr(int dev_id)
 {
-	return (io[dev_id]) ? io[dev_id] : (unsigned long)mapped_io[dev_id];
+	if (io[dev_id])
+		return io[dev_id];
+
+	return (mem[dev_id]) ? (unsigned long)mapped_io[dev_id] :
+		rt_16550_emu_base(dev_id);
 }
 
 static inline io_mode_t rt_16550_io_mode(int dev_id)
 {
-	return (io[dev_id]) ? MODE_PIO : MODE_MMIO;
+	if (io[dev_id])
+		return MODE_PIO;
+
+	return (mem[dev_id]) ? MODE_MMIO : MODE_EMU;
 }
 
 static inline io_mode_t
@@ -144,13 +155,8 @@ rt_16550_io_mode_from_ctx(struct rt_16550_context *ctx)
 static inline void
 rt_16550_init_io_ctx(int dev_id, struct rt_16550_context *ctx)
 {
-	if (io[dev_id]) {
-		ctx->base_addr = io[dev_id];
-		ctx->io_mode   = MODE_PIO;
-	} else {
-		ctx->base_addr = (unsigned long)mapped_io[dev_id];
-		ctx->io_mode   = MODE_MMIO;
-	}
+	ctx->base_addr = rt_16550_base_addr(dev_id);
+	ctx->io_mode   = rt_16550_io_mode(dev_id);
 }
 
 #else
@@ -163,6 +169,8 @@ rt_16550_reg_in(io_mode_t io_mode, unsigned long base, int off)
 	switch (io_mode) {
 	case MODE_PIO:
 		return inb(base + off);
+	case MODE_EMU:
+		return rt_16550_emu_in(base, off);
 	default: /* MODE_MMIO */
 		return readb((void *)base + off);
 	}
@@ -178,6 +186,9 @@ rt_16550_reg_out(io_mode_t io_mode, unsigned long base, int off, u8 val)
 	case MODE_MMIO:
 		writeb(val, (void *)base + off);
 		break;
+	case MODE_EMU:
+		rt_16550_emu_out(base, off, val);
+		break;
 	}
 }
 
@@ -193,6 +204,8 @@ static int rt_16550_init_io(int dev_id, char* name)
 		if (!mapped_io[dev_id])
 			return -EBUSY;
 		break;
+	case MODE_EMU:
+		return rt_16550_emu_init(dev_id);
 	}
 	return 0;
 }
@@ -206,5 +219,8 @@ static void rt_16550_release_io(int dev_id)
 	case MODE_MMIO:
 		iounmap(mapped_io[dev_id]);
 		break;
+	case MODE_EMU:
+		rt_16550_emu_cleanup(dev_id);
+		break;
 	}
 }
@@ -344,6 +344,19 @@ static ssize_t bcm2835_write(struct rtdm_spi_remote_slave *slave,
 	return do_transfer_irq(slave) ?: len;
 }
 
+static int bcm2835_transfer(struct rtdm_spi_remote_slave *slave,
+			    const void *tx, void *rx, size_t len)
+{
+	struct spi_master_bcm2835 *spim = to_master_bcm2835(slave);
+
+	spim->tx_len = len;
+	spim->rx_len = len;
+	spim->tx_buf = tx;
+	spim->rx_buf = rx;
+
+	return do_transfer_irq(slave);
+}
+
 static int set_iobufs(struct spi_slave_bcm2835 *bcm, size_t len)
 {
 	dma_addr_t dma;
@@ -551,6 +564,7 @@ static struct rtdm_spi_master_ops bcm2835_master_ops = {
 	.transfer_iobufs = bcm2835_transfer_iobufs,
 	.write = bcm2835_write,
 	.read = bcm2835_read,
+	.transfer = bcm2835_transfer,
 	.attach_slave = bcm2835_attach_slave,
 	.detach_slave = bcm2835_detach_slave,
 };
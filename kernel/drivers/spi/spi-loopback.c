@@ -0,0 +1,291 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/mm.h>
+#include <linux/platform_device.h>
+#include <linux/spi/spi.h>
+#include "spi-master.h"
+
+#define RTDM_SUBCLASS_LOOPBACK  2
+
+/*
+ * Virtual SPI master with MOSI wired to MISO: every byte clocked
+ * out is received back. No hardware is involved, which makes this
+ * driver suitable for exercising the RTDM SPI core and its batch
+ * transfer queue from the testsuite.
+ */
+
+static unsigned int nr_slaves = 4;
+module_param(nr_slaves, uint, 0444);
+MODULE_PARM_DESC(nr_slaves, "Number of slaves attached to the loopback master");
+
+struct spi_master_loopback {
+	struct rtdm_spi_master master;
+};
+
+struct spi_slave_loopback {
+	struct rtdm_spi_remote_slave slave;
+	void *io_virt;
+	size_t io_len;
+	size_t map_len;
+};
+
+static struct platform_device *loopback_pdev;
+
+static inline struct spi_slave_loopback *
+to_slave_loopback(struct rtdm_spi_remote_slave *slave)
+{
+	return container_of(slave, struct spi_slave_loopback, slave);
+}
+
+static int loopback_configure(struct rtdm_spi_remote_slave *slave)
+{
+	return 0;
+}
+
+static void loopback_chip_select(struct rtdm_spi_remote_slave *slave,
+				 bool active)
+{
+}
+
+static int loopback_transfer(struct rtdm_spi_remote_slave *slave,
+			     const void *tx, void *rx, size_t len)
+{
+	if (rx == NULL)
+		return 0;
+
+	if (tx)
+		memcpy(rx, tx, len);
+	else
+		memset(rx, 0, len);
+
+	return 0;
+}
+
+static int loopback_transfer_iobufs(struct rtdm_spi_remote_slave *slave)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+
+	if (lb->io_len == 0)
+		return -EINVAL;	/* No I/O buffers set. */
+
+	return loopback_transfer(slave, lb->io_virt + lb->io_len / 2,
+				 lb->io_virt, lb->io_len / 2);
+}
+
+static ssize_t loopback_read(struct rtdm_spi_remote_slave *slave,
+			     void *rx, size_t len)
+{
+	return loopback_transfer(slave, NULL, rx, len) ?: len;
+}
+
+static ssize_t loopback_write(struct rtdm_spi_remote_slave *slave,
+			      const void *tx, size_t len)
+{
+	return len;
+}
+
+static int loopback_set_iobufs(struct rtdm_spi_remote_slave *slave,
+			       struct rtdm_spi_iobufs *p)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+	size_t len;
+	void *io;
+
+	if (p->io_len == 0)
+		return -EINVAL;
+
+	len = L1_CACHE_ALIGN(p->io_len) * 2;
+	if (len != lb->io_len) {
+		if (lb->io_len)
+			return -EINVAL;	/* I/O buffers may not be resized. */
+		io = alloc_pages_exact(PAGE_ALIGN(len), GFP_KERNEL|__GFP_ZERO);
+		if (io == NULL)
+			return -ENOMEM;
+		lb->io_virt = io;
+		lb->map_len = PAGE_ALIGN(len);
+		smp_mb();
+		lb->io_len = len;
+	}
+
+	p->i_offset = 0;
+	p->o_offset = lb->io_len / 2;
+	p->map_len = lb->map_len;
+
+	return 0;
+}
+
+static int loopback_mmap_iobufs(struct rtdm_spi_remote_slave *slave,
+				struct vm_area_struct *vma)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+
+	return rtdm_mmap_kmem(vma, lb->io_virt);
+}
+
+static void loopback_mmap_release(struct rtdm_spi_remote_slave *slave)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+
+	free_pages_exact(lb->io_virt, lb->map_len);
+	lb->io_len = 0;
+}
+
+static struct rtdm_spi_remote_slave *
+loopback_attach_slave(struct rtdm_spi_master *master, struct spi_device *spi)
+{
+	struct spi_slave_loopback *lb;
+	int ret;
+
+	lb = kzalloc(sizeof(*lb), GFP_KERNEL);
+	if (lb == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	ret = rtdm_spi_add_remote_slave(&lb->slave, master, spi);
+	if (ret) {
+		dev_err(&spi->dev,
+			"%s: failed to attach slave\n", __func__);
+		kfree(lb);
+		return ERR_PTR(ret);
+	}
+
+	return &lb->slave;
+}
+
+static void loopback_detach_slave(struct rtdm_spi_remote_slave *slave)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+
+	rtdm_spi_remove_remote_slave(slave);
+	if (lb->io_len && atomic_read(&slave->mmap_refs) == 0)
+		free_pages_exact(lb->io_virt, lb->map_len);
+	kfree(lb);
+}
+
+static struct rtdm_spi_master_ops loopback_master_ops = {
+	.configure = loopback_configure,
+	.chip_select = loopback_chip_select,
+	.set_iobufs = loopback_set_iobufs,
+	.mmap_iobufs = loopback_mmap_iobufs,
+	.mmap_release = loopback_mmap_release,
+	.transfer_iobufs = loopback_transfer_iobufs,
+	.write = loopback_write,
+	.read = loopback_read,
+	.transfer = loopback_transfer,
+	.attach_slave = loopback_attach_slave,
+	.detach_slave = loopback_detach_slave,
+};
+
+static int loopback_spi_probe(struct platform_device *pdev)
+{
+	struct spi_board_info info;
+	struct rtdm_spi_master *master;
+	struct spi_master *kmaster;
+	struct spi_device *spi;
+	unsigned int cs;
+	int ret;
+
+	master = rtdm_spi_alloc_master(&pdev->dev,
+		   struct spi_master_loopback, master);
+	if (master == NULL)
+		return -ENOMEM;
+
+	master->subclass = RTDM_SUBCLASS_LOOPBACK;
+	master->ops = &loopback_master_ops;
+	platform_set_drvdata(pdev, master);
+
+	kmaster = master->kmaster;
+	kmaster->mode_bits = SPI_CPOL | SPI_CPHA | SPI_CS_HIGH | SPI_LOOP;
+	kmaster->bits_per_word_mask = SPI_BPW_MASK(8);
+	kmaster->num_chipselect = nr_slaves;
+	kmaster->bus_num = -1;
+
+	ret = rtdm_spi_add_master(master);
+	if (ret) {
+		dev_err(&pdev->dev, "%s: failed to add master\n",
+			__func__);
+		spi_master_put(kmaster);
+		return ret;
+	}
+
+	/* No device tree here, advertise our slaves manually. */
+	for (cs = 0; cs < nr_slaves; cs++) {
+		memset(&info, 0, sizeof(info));
+		strlcpy(info.modalias, "rtdm_spi_device", sizeof(info.modalias));
+		info.max_speed_hz = 10000000;
+		info.chip_select = cs;
+		info.mode = SPI_MODE_0;
+		spi = spi_new_device(kmaster, &info);
+		if (spi == NULL)
+			dev_warn(&pdev->dev, "%s: cannot add slave %u\n",
+				 __func__, cs);
+	}
+
+	return 0;
+}
+
+static int loopback_spi_remove(struct platform_device *pdev)
+{
+	struct rtdm_spi_master *master = platform_get_drvdata(pdev);
+
+	rtdm_spi_remove_master(master);
+
+	return 0;
+}
+
+static struct platform_driver loopback_spi_driver = {
+	.driver		= {
+		.name		= "spi-loopback",
+	},
+	.probe		= loopback_spi_probe,
+	.remove		= loopback_spi_remove,
+};
+
+static int __init loopback_spi_init(void)
+{
+	int ret;
+
+	if (!realtime_core_enabled())
+		return 0;
+
+	ret = platform_driver_register(&loopback_spi_driver);
+	if (ret)
+		return ret;
+
+	loopback_pdev = platform_device_register_simple("spi-loopback",
+							-1, NULL, 0);
+	if (IS_ERR(loopback_pdev)) {
+		platform_driver_unregister(&loopback_spi_driver);
+		return PTR_ERR(loopback_pdev);
+	}
+
+	return 0;
+}
+module_init(loopback_spi_init);
+
+static void __exit loopback_spi_exit(void)
+{
+	if (!realtime_core_enabled())
+		return;
+
+	platform_device_unregister(loopback_pdev);
+	platform_driver_unregister(&loopback_spi_driver);
+}
+module_exit(loopback_spi_exit);
+
+MODULE_LICENSE("GPL");
@@ -25,6 +25,39 @@
 #include <linux/gpio.h>
 #include "spi-master.h"
 
+static int queue_prio = RTDM_TASK_HIGHEST_PRIORITY;
+module_param(queue_prio, int, 0444);
+MODULE_PARM_DESC(queue_prio, "Priority of the batch transfer queue tasks");
+
+struct spi_master_chan {
+	struct list_head done;
+	rtdm_event_t done_event;
+	unsigned int seq;
+	int nr_batches;		/* Queued or awaiting collection */
+};
+
+struct spi_batch_xfer {
+	struct rtdm_spi_remote_slave *slave;
+	struct rtdm_fd *fd;	/* Held on target, NULL if submitter. */
+	const void *tx;
+	void *rx;
+	void __user *u_rx;
+	u32 len;
+	u16 delay_us;
+	u16 flags;
+	int status;
+};
+
+struct spi_batch {
+	struct list_head next;
+	struct rtdm_fd *fd;	/* Submitter */
+	struct rtdm_spi_xfer __user *u_xfers;
+	unsigned int seq;
+	int nr_xfers;
+	int status;
+	struct spi_batch_xfer xfers[0];
+};
+
 static inline
 struct device *to_kdev(struct rtdm_spi_remote_slave *slave)
 {
@@ -73,19 +106,39 @@ static int update_slave_config(struct rtdm_spi_remote_slave *slave,
 
 static int spi_master_open(struct rtdm_fd *fd, int oflags)
 {
+	struct spi_master_chan *chan = rtdm_fd_to_private(fd);
 	struct rtdm_spi_remote_slave *slave = fd_to_slave(fd);
 	struct rtdm_spi_master *master = slave->master;
 
+	INIT_LIST_HEAD(&chan->done);
+	rtdm_event_init(&chan->done_event, 0);
+	chan->seq = 0;
+	chan->nr_batches = 0;
+
 	if (master->ops->open)
 		return master->ops->open(slave);
 		
 	return 0;
 }
 
+static void free_batch(struct spi_batch *batch)
+{
+	int n;
+
+	for (n = 0; n < batch->nr_xfers; n++) {
+		if (batch->xfers[n].fd)
+			rtdm_fd_put(batch->xfers[n].fd);
+	}
+
+	xnfree(batch);
+}
+
 static void spi_master_close(struct rtdm_fd *fd)
 {
+	struct spi_master_chan *chan = rtdm_fd_to_private(fd);
 	struct rtdm_spi_remote_slave *slave = fd_to_slave(fd);
 	struct rtdm_spi_master *master = slave->master;
+	struct spi_batch *batch, *tmp;
 	rtdm_lockctx_t c;
 
 	rtdm_lock_get_irqsave(&master->lock, c);
@@ -95,6 +148,17 @@ static void spi_master_close(struct rtdm_fd *fd)
 
 	rtdm_lock_put_irqrestore(&master->lock, c);
 
+	/*
+	 * Pending batches hold a reference on the submitter, so only
+	 * completed ones which were never collected may remain.
+	 */
+	list_for_each_entry_safe(batch, tmp, &chan->done, next) {
+		list_del(&batch->next);
+		free_batch(batch);
+	}
+
+	rtdm_event_destroy(&chan->done_event);
+
 	if (master->ops->close)
 		master->ops->close(slave);
 }
@@ -144,13 +208,297 @@ static void do_chip_deselect(struct rtdm_spi_remote_slave *slave)
 	rtdm_lock_put_irqrestore(&master->lock, c);
 }
 
+static int do_transfer(struct rtdm_spi_remote_slave *slave,
+		       struct spi_batch_xfer *x)
+{				/* master->bus_lock held */
+	struct rtdm_spi_master *master = slave->master;
+	ssize_t ret;
+
+	if (master->ops->transfer)
+		return master->ops->transfer(slave, x->tx, x->rx, x->len);
+
+	/* Half-duplex fallback for masters with no transfer handler. */
+	if (x->rx == NULL)
+		ret = master->ops->write(slave, x->tx, x->len);
+	else if (x->tx == NULL)
+		ret = master->ops->read(slave, x->rx, x->len);
+	else
+		return -EOPNOTSUPP;
+
+	return ret < 0 ? ret : 0;
+}
+
+static void run_batch(struct rtdm_spi_master *master,
+		      struct spi_batch *batch)
+{
+	struct spi_batch_xfer *x, *next;
+	int n, ret = 0;
+
+	rtdm_mutex_lock(&master->bus_lock);
+
+	for (n = 0; n < batch->nr_xfers; n++) {
+		x = batch->xfers + n;
+		if (ret) {
+			x->status = -ECANCELED;
+			continue;
+		}
+		ret = do_chip_select(x->slave);
+		if (ret == 0)
+			ret = do_transfer(x->slave, x);
+		x->status = ret;
+		if (x->delay_us)
+			rtdm_task_sleep((nanosecs_rel_t)x->delay_us * 1000);
+		next = n + 1 < batch->nr_xfers ? x + 1 : NULL;
+		if (master->cs == x->slave &&
+		    (ret || next == NULL || next->slave != x->slave ||
+		     !(x->flags & SPI_XFER_CS_KEEP)))
+			do_chip_deselect(x->slave);
+	}
+
+	batch->status = ret;
+
+	rtdm_mutex_unlock(&master->bus_lock);
+}
+
+static void complete_batch(struct spi_batch *batch)
+{
+	struct rtdm_fd *fd = batch->fd;
+	struct spi_master_chan *chan = rtdm_fd_to_private(fd);
+	struct rtdm_spi_master *master = fd_to_slave(fd)->master;
+	rtdm_lockctx_t c;
+
+	rtdm_lock_get_irqsave(&master->lock, c);
+	list_add_tail(&batch->next, &chan->done);
+	rtdm_lock_put_irqrestore(&master->lock, c);
+
+	/* A single wakeup per batch. */
+	rtdm_event_signal(&chan->done_event);
+	rtdm_fd_unlock(fd);
+}
+
+static void queue_handler(void *arg)
+{
+	struct rtdm_spi_master *master = arg;
+	struct spi_batch *batch;
+	rtdm_lockctx_t c;
+
+	while (!rtdm_task_should_stop()) {
+		if (rtdm_event_wait(&master->queue_event))
+			break;
+		for (;;) {
+			rtdm_lock_get_irqsave(&master->lock, c);
+			if (list_empty(&master->queue)) {
+				rtdm_lock_put_irqrestore(&master->lock, c);
+				break;
+			}
+			batch = list_first_entry(&master->queue,
+						 struct spi_batch, next);
+			list_del(&batch->next);
+			rtdm_lock_put_irqrestore(&master->lock, c);
+			run_batch(master, batch);
+			complete_batch(batch);
+		}
+	}
+}
+
+static int get_target_slave(struct rtdm_fd *fd, int ufd,
+			    struct spi_batch_xfer *x)
+{
+	struct rtdm_spi_master *master = fd_to_slave(fd)->master;
+	struct rtdm_fd *tfd;
+
+	if (ufd < 0) {
+		x->slave = fd_to_slave(fd);
+		return 0;
+	}
+
+	tfd = rtdm_fd_get(ufd, RTDM_FD_MAGIC);
+	if (IS_ERR(tfd))
+		return PTR_ERR(tfd);
+
+	if (rtdm_fd_device(tfd)->driver != &master->driver) {
+		rtdm_fd_put(tfd);
+		return -EXDEV;
+	}
+
+	x->fd = tfd;
+	x->slave = fd_to_slave(tfd);
+
+	return 0;
+}
+
+static int submit_batch(struct rtdm_fd *fd, struct rtdm_spi_batch *req)
+{
+	struct spi_master_chan *chan = rtdm_fd_to_private(fd);
+	struct rtdm_spi_master *master = fd_to_slave(fd)->master;
+	struct rtdm_spi_xfer *u_xfers;
+	struct spi_batch_xfer *x;
+	struct spi_batch *batch;
+	size_t size, data_len;
+	rtdm_lockctx_t c;
+	int n, ret;
+	void *data;
+
+	if (req->nr_xfers == 0 || req->nr_xfers > SPI_BATCH_MAX_XFERS)
+		return -EINVAL;
+
+	size = req->nr_xfers * sizeof(*u_xfers);
+	u_xfers = xnmalloc(size);
+	if (u_xfers == NULL)
+		return -ENOMEM;
+
+	ret = rtdm_safe_copy_from_user(fd, u_xfers,
+			       (void __user *)(unsigned long)req->xfers, size);
+	if (ret)
+		goto out;
+
+	for (n = 0, data_len = 0; n < req->nr_xfers; n++) {
+		if (u_xfers[n].len == 0 ||
+		    u_xfers[n].len > SPI_BATCH_MAX_DATA) {
+			ret = -EINVAL;
+			goto out;
+		}
+		if (u_xfers[n].tx_buf)
+			data_len += ALIGN(u_xfers[n].len, sizeof(long));
+		if (u_xfers[n].rx_buf)
+			data_len += ALIGN(u_xfers[n].len, sizeof(long));
+	}
+
+	if (data_len > SPI_BATCH_MAX_DATA * 2) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/*
+	 * Transfer descriptors and I/O data are staged in a single
+	 * block, output data is pulled from user-space now, input
+	 * data is pushed back upon completion.
+	 */
+	size = sizeof(*batch) + req->nr_xfers * sizeof(*x);
+	batch = xnmalloc(size + data_len);
+	if (batch == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	memset(batch, 0, size);
+	batch->u_xfers = (void __user *)(unsigned long)req->xfers;
+	batch->fd = fd;
+	data = (void *)batch + size;
+
+	for (n = 0; n < req->nr_xfers; n++) {
+		x = batch->xfers + n;
+		batch->nr_xfers = n + 1;
+		ret = get_target_slave(fd, u_xfers[n].fd, x);
+		if (ret)
+			goto fail;
+		x->len = u_xfers[n].len;
+		x->delay_us = u_xfers[n].delay_us;
+		x->flags = u_xfers[n].flags;
+		if (u_xfers[n].tx_buf) {
+			ret = rtdm_safe_copy_from_user(fd, data,
+			       (void __user *)(unsigned long)u_xfers[n].tx_buf,
+			       x->len);
+			if (ret)
+				goto fail;
+			x->tx = data;
+			data += ALIGN(x->len, sizeof(long));
+		}
+		if (u_xfers[n].rx_buf) {
+			x->u_rx = (void __user *)(unsigned long)u_xfers[n].rx_buf;
+			x->rx = data;
+			data += ALIGN(x->len, sizeof(long));
+		}
+	}
+
+	/* The submitter may not go away until completion. */
+	ret = rtdm_fd_lock(fd);
+	if (ret)
+		goto fail;
+
+	rtdm_lock_get_irqsave(&master->lock, c);
+	if (chan->nr_batches >= SPI_BATCH_MAX_QUEUED) {
+		rtdm_lock_put_irqrestore(&master->lock, c);
+		rtdm_fd_unlock(fd);
+		ret = -EAGAIN;
+		goto fail;
+	}
+	chan->nr_batches++;
+	batch->seq = req->seq = chan->seq++;
+	list_add_tail(&batch->next, &master->queue);
+	rtdm_lock_put_irqrestore(&master->lock, c);
+
+	rtdm_event_signal(&master->queue_event);
+
+	xnfree(u_xfers);
+
+	return 0;
+fail:
+	free_batch(batch);
+out:
+	xnfree(u_xfers);
+
+	return ret;
+}
+
+static int collect_batch(struct rtdm_fd *fd, struct rtdm_spi_batch *req)
+{
+	struct spi_master_chan *chan = rtdm_fd_to_private(fd);
+	struct rtdm_spi_master *master = fd_to_slave(fd)->master;
+	struct spi_batch_xfer *x;
+	struct spi_batch *batch;
+	rtdm_lockctx_t c;
+	int n, ret;
+
+	for (;;) {
+		rtdm_lock_get_irqsave(&master->lock, c);
+		if (!list_empty(&chan->done)) {
+			batch = list_first_entry(&chan->done,
+						 struct spi_batch, next);
+			list_del(&batch->next);
+			chan->nr_batches--;
+			rtdm_lock_put_irqrestore(&master->lock, c);
+			break;
+		}
+		rtdm_lock_put_irqrestore(&master->lock, c);
+		if (rtdm_fd_flags(fd) & O_NONBLOCK)
+			return -EAGAIN;
+		ret = rtdm_event_wait(&chan->done_event);
+		if (ret)
+			return ret;
+	}
+
+	for (n = 0; n < batch->nr_xfers; n++) {
+		x = batch->xfers + n;
+		if (x->u_rx && x->status == 0) {
+			ret = rtdm_safe_copy_to_user(fd, x->u_rx, x->rx, x->len);
+			if (ret)
+				goto out;
+		}
+		ret = rtdm_safe_copy_to_user(fd, &batch->u_xfers[n].status,
+					     &x->status, sizeof(x->status));
+		if (ret)
+			goto out;
+	}
+
+	req->seq = batch->seq;
+	req->nr_xfers = batch->nr_xfers;
+	req->xfers = (unsigned long)batch->u_xfers;
+	ret = batch->status;
+out:
+	free_batch(batch);
+
+	return ret;
+}
+
 static int spi_master_ioctl_rt(struct rtdm_fd *fd,
 			       unsigned int request, void *arg)
 {
 	struct rtdm_spi_remote_slave *slave = fd_to_slave(fd);
 	struct rtdm_spi_master *master = slave->master;
 	struct rtdm_spi_config config;
-	int ret;
+	struct rtdm_spi_batch batch;
+	int ret, err;
 
 	switch (request) {
 	case SPI_RTIOC_SET_CONFIG:
@@ -178,6 +526,24 @@ static int spi_master_ioctl_rt(struct rtdm_fd *fd,
 			rtdm_mutex_unlock(&master->bus_lock);
 		}
 		break;
+	case SPI_RTIOC_SUBMIT:
+		ret = rtdm_safe_copy_from_user(fd, &batch, arg, sizeof(batch));
+		if (ret)
+			break;
+		ret = submit_batch(fd, &batch);
+		if (ret == 0)
+			ret = rtdm_safe_copy_to_user(fd, arg,
+					     &batch, sizeof(batch));
+		break;
+	case SPI_RTIOC_COMPLETE:
+		ret = collect_batch(fd, &batch);
+		if (ret == -EAGAIN || ret == -EINTR || ret == -EIDRM)
+			break;
+		/* Report the batch even if some transfer failed. */
+		err = rtdm_safe_copy_to_user(fd, arg, &batch, sizeof(batch));
+		if (ret == 0)
+			ret = err;
+		break;
 	default:
 		ret = -ENOSYS;
 	}
@@ -279,6 +645,18 @@ static ssize_t spi_master_write_rt(struct rtdm_fd *fd,
 	return ret;
 }
 
+static int spi_master_select(struct rtdm_fd *fd, struct xnselector *selector,
+			     unsigned int type, unsigned int index)
+{
+	struct spi_master_chan *chan = rtdm_fd_to_private(fd);
+
+	if (type != XNSELECT_READ)
+		return -EINVAL;
+
+	/* Readable means some batch is ready for collection. */
+	return rtdm_event_select(&chan->done_event, selector, type, index);
+}
+
 static void iobufs_vmopen(struct vm_area_struct *vma)
 {
 	struct rtdm_spi_remote_slave *slave = vma->vm_private_data;
@@ -352,6 +730,8 @@ EXPORT_SYMBOL_GPL(__rtdm_spi_alloc_master);
 
 int __rtdm_spi_setup_driver(struct rtdm_spi_master *master)
 {
+	int ret;
+
 	master->classname = kstrdup(
 		dev_name(&master->kmaster->dev), GFP_KERNEL);
 	master->devclass = class_create(THIS_MODULE,
@@ -373,7 +753,7 @@ int __rtdm_spi_setup_driver(struct rtdm_spi_master *master)
 	master->driver.device_flags = RTDM_NAMED_DEVICE;
 	master->driver.base_minor = 0;
 	master->driver.device_count = 256;
-	master->driver.context_size = 0;
+	master->driver.context_size = sizeof(struct spi_master_chan);
 	master->driver.ops = (struct rtdm_fd_ops){
 		.open		=	spi_master_open,
 		.close		=	spi_master_close,
@@ -382,13 +762,28 @@ int __rtdm_spi_setup_driver(struct rtdm_spi_master *master)
 		.ioctl_rt	=	spi_master_ioctl_rt,
 		.ioctl_nrt	=	spi_master_ioctl_nrt,
 		.mmap		=	spi_master_mmap,
+		.select		=	spi_master_select,
 	};
 	
 	rtdm_drv_set_sysclass(&master->driver, master->devclass);
 
 	INIT_LIST_HEAD(&master->slaves);
+	INIT_LIST_HEAD(&master->queue);
 	rtdm_lock_init(&master->lock);
 	rtdm_mutex_init(&master->bus_lock);
+	rtdm_event_init(&master->queue_event, 0);
+
+	ret = rtdm_task_init(&master->queue_task, master->classname,
+			     queue_handler, master, queue_prio, 0);
+	if (ret) {
+		rtdm_event_destroy(&master->queue_event);
+		rtdm_mutex_destroy(&master->bus_lock);
+		rtdm_drv_set_sysclass(&master->driver, NULL);
+		class_destroy(master->devclass);
+		master->devclass = NULL;
+		kfree(master->classname);
+		return ret;
+	}
 
 	return 0;
 }
@@ -424,8 +819,17 @@ void rtdm_spi_remove_master(struct rtdm_spi_master *master)
 	struct class *class = master->devclass;
 	char *classname = master->classname;
 	
-	rtdm_mutex_destroy(&master->bus_lock);
 	spi_unregister_master(master->kmaster);
+	if (class) {
+		/*
+		 * Slaves are gone, so is any pending batch. The queue
+		 * task may still hold the bus lock though, stop it
+		 * before dropping the latter.
+		 */
+		rtdm_task_destroy(&master->queue_task);
+		rtdm_event_destroy(&master->queue_event);
+	}
+	rtdm_mutex_destroy(&master->bus_lock);
 	rtdm_drv_set_sysclass(&master->driver, NULL);
 	class_destroy(class);
 	kfree(classname);
@@ -43,6 +43,8 @@ struct rtdm_spi_master_ops {
 			 const void *tx, size_t len);
 	ssize_t (*read)(struct rtdm_spi_remote_slave *slave,
 			 void *rx, size_t len);
+	int (*transfer)(struct rtdm_spi_remote_slave *slave,
+			const void *tx, void *rx, size_t len);
 	struct rtdm_spi_remote_slave *(*attach_slave)
 		(struct rtdm_spi_master *master,
 			struct spi_device *spi);
@@ -62,6 +64,9 @@ struct rtdm_spi_master {
 		rtdm_lock_t lock;
 		rtdm_mutex_t bus_lock;
 		struct rtdm_spi_remote_slave *cs;
+		struct list_head queue;
+		rtdm_event_t queue_event;
+		rtdm_task_t queue_task;
 	};
 };
 
@@ -17,6 +17,8 @@
  */
 
 #include <linux/module.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
 #include <rtdm/driver.h>
 #include <rtdm/testing.h>
 
@@ -41,6 +43,14 @@ struct rtdm_actor_context {
 	} args;
 };
 
+struct rtdm_irq_test {
+	rtdm_irq_t irq_handle;
+	unsigned int virq;
+	unsigned int count;
+	atomic_t nhandled;
+	atomic_t nruns;
+};
+
 static void close_timer_proc(rtdm_timer_t *timer)
 {
 	struct rtdm_basic_context *ctx =
@@ -104,6 +114,109 @@ static int rtdm_basic_ioctl_rt(struct rtdm_fd *fd,
 	return ret;
 }
 
+static int irq_test_handler(rtdm_irq_t *irq_handle)
+{
+	struct rtdm_irq_test *t =
+		rtdm_irq_get_arg(irq_handle, struct rtdm_irq_test);
+
+	atomic_inc(&t->nhandled);
+
+	return RTDM_IRQ_HANDLED | RTDM_IRQ_WAKE_THREAD;
+}
+
+static int irq_test_thread(rtdm_irq_t *irq_handle)
+{
+	struct rtdm_irq_test *t =
+		rtdm_irq_get_arg(irq_handle, struct rtdm_irq_test);
+
+	atomic_inc(&t->nruns);
+
+	return RTDM_IRQ_HANDLED;
+}
+
+static void raise_irq_events(void *arg)
+{
+	struct rtdm_irq_test *t = arg;
+	unsigned int n;
+
+	for (n = 0; n < t->count; n++)
+		ipipe_raise_irq(t->virq);
+}
+
+static int test_irq_thread(struct rtdm_fd *fd, void __user *arg)
+{
+	struct rtdm_irq_thread_params params;
+	struct rttst_rtdm_irq_thread args;
+	struct rtdm_irq_test *t;
+	unsigned int wait_ms;
+	int cpu, ret;
+
+	ret = rtdm_safe_copy_from_user(fd, &args, arg, sizeof(args));
+	if (ret)
+		return ret;
+
+	if (args.nevents == 0 || args.delay > 1000000000ULL)
+		return -EINVAL;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (t == NULL)
+		return -ENOMEM;
+
+	t->virq = ipipe_alloc_virq();
+	if (t->virq == 0) {
+		ret = -EBUSY;
+		goto out_free;
+	}
+
+	/*
+	 * Events are raised from the CPU the handler thread is bound
+	 * to, so that the thread preempts the raiser each time a batch
+	 * fills up, and the run counts are exact.
+	 */
+	cpu = cpumask_first(&cobalt_cpu_affinity);
+	params.priority = RTDM_TASK_HIGHEST_PRIORITY;
+	cpumask_copy(&params.affinity, cpumask_of(cpu));
+	params.batch = args.batch;
+	params.delay = args.delay;
+
+	ret = rtdm_irq_request_threaded(&t->irq_handle, t->virq,
+					irq_test_handler, irq_test_thread, 0,
+					"rtdm_irq_test", t, &params);
+	if (ret)
+		goto out_virq;
+
+	wait_ms = div_u64(args.delay, 1000000) + 10;
+
+	/* Full batches run right away, the remainder once delayed. */
+	t->count = args.nevents;
+	smp_call_function_single(cpu, raise_irq_events, t, 1);
+	args.nruns_batch = atomic_read(&t->nruns);
+	msleep(wait_ms);
+	args.nruns_delay = atomic_read(&t->nruns);
+
+	/*
+	 * Release the IRQ with a partial batch pending and the delay
+	 * timer armed: the handler may not run past rtdm_irq_free().
+	 */
+	if (args.batch > 1) {
+		t->count = args.batch - 1;
+		smp_call_function_single(cpu, raise_irq_events, t, 1);
+	}
+	rtdm_irq_free(&t->irq_handle);
+	args.nruns_free = atomic_read(&t->nruns);
+	msleep(wait_ms);
+	args.nruns_late = atomic_read(&t->nruns);
+	args.nhandled = atomic_read(&t->nhandled);
+
+	ret = rtdm_safe_copy_to_user(fd, arg, &args, sizeof(args));
+out_virq:
+	ipipe_free_virq(t->virq);
+out_free:
+	kfree(t);
+
+	return ret;
+}
+
 static int rtdm_basic_ioctl_nrt(struct rtdm_fd *fd,
 			    unsigned int request, void __user *arg)
 {
@@ -124,6 +237,9 @@ static int rtdm_basic_ioctl_nrt(struct rtdm_fd *fd,
 		ret = rtdm_safe_copy_to_user(fd, arg, &magic,
 					     sizeof(magic));
 		break;
+	case RTTST_RTIOC_RTDM_IRQ_THREAD:
+		ret = test_irq_thread(fd, arg);
+		break;
 	default:
 		ret = -ENOTTY;
 	}
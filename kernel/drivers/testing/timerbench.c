@@ -21,9 +21,12 @@
 #include <linux/semaphore.h>
 #include <linux/ipipe_trace.h>
 #include <cobalt/kernel/arith.h>
+#include <cobalt/kernel/sched.h>
 #include <rtdm/testing.h>
 #include <rtdm/driver.h>
 #include <rtdm/compat.h>
+#include <rtdm/ring.h>
+#include <trace/events/cobalt-core.h>
 
 MODULE_DESCRIPTION("Timer latency test helper");
 MODULE_AUTHOR("Jan Kiszka <jan.kiszka@web.de>");
@@ -41,6 +44,20 @@ struct rt_tmbench_context {
 	int32_t *histogram_avg;
 	int histogram_size;
 	int bucketsize;
+	int32_t *histogram_hdr;
+
+	struct rttst_bench_sample *worst;
+	int worst_count;
+	int nr_worst;
+	int traced;
+	/* Latest core events observed on the sampling CPU. */
+	struct {
+		int cpu;
+		uint64_t irq;
+		uint64_t tick;
+		uint64_t sched;
+		uint64_t switched;
+	} stamps;
 
 	rtdm_task_t timer_task;
 
@@ -52,6 +69,12 @@ struct rt_tmbench_context {
 
 	rtdm_event_t result_event;
 	struct rttst_interm_bench_res result;
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+	/* Pending ring requests for intermediate results. */
+	rtdm_lock_t ring_lock;
+	struct list_head ringq;
+	int ring_active;
+#endif
 
 	struct semaphore nrt_mutex;
 };
@@ -70,6 +93,111 @@ static inline long long slldiv(long long s, unsigned d)
 	return s >= 0 ? xnarch_ulldiv(s, d, NULL) : -xnarch_ulldiv(-s, d, NULL);
 }
 
+/*
+ * The probes below attach to the core tracepoints, recording the
+ * dates of the events leading to the wake up of the sampling code,
+ * so that the worst samples can be broken down into stages. They
+ * run with hard irqs off, on behalf of the CPU which triggered the
+ * event.
+ */
+static void probe_clock_entry(void *data, unsigned int irq)
+{
+	struct rt_tmbench_context *ctx = data;
+
+	if (ipipe_processor_id() != ctx->stamps.cpu)
+		return;
+
+	ctx->stamps.irq = rtdm_clock_read_monotonic();
+	ctx->stamps.tick = 0;
+	ctx->stamps.sched = 0;
+	ctx->stamps.switched = 0;
+}
+
+static void probe_clock_exit(void *data, unsigned int irq)
+{
+	struct rt_tmbench_context *ctx = data;
+
+	if (ipipe_processor_id() == ctx->stamps.cpu)
+		ctx->stamps.tick = rtdm_clock_read_monotonic();
+}
+
+static void probe_schedule(void *data, struct xnsched *sched)
+{
+	struct rt_tmbench_context *ctx = data;
+
+	/* Only the first rescheduling after the tick matters. */
+	if (ipipe_processor_id() == ctx->stamps.cpu &&
+	    ctx->stamps.tick && ctx->stamps.sched == 0)
+		ctx->stamps.sched = rtdm_clock_read_monotonic();
+}
+
+static void probe_switch_context(void *data, struct xnthread *prev,
+				 struct xnthread *next)
+{
+	struct rt_tmbench_context *ctx = data;
+
+	if (next == &ctx->timer_task && ctx->stamps.irq)
+		ctx->stamps.switched = rtdm_clock_read_monotonic();
+}
+
+static void register_probes(struct rt_tmbench_context *ctx)
+{
+	ctx->stamps.cpu = -1;
+
+	/* Tracepoints may not be available, this is not an error. */
+	if (register_trace_cobalt_clock_entry(probe_clock_entry, ctx))
+		return;
+
+	register_trace_cobalt_clock_exit(probe_clock_exit, ctx);
+	register_trace_cobalt_schedule(probe_schedule, ctx);
+	register_trace_cobalt_switch_context(probe_switch_context, ctx);
+	ctx->traced = 1;
+}
+
+static void unregister_probes(struct rt_tmbench_context *ctx)
+{
+	if (!ctx->traced)
+		return;
+
+	unregister_trace_cobalt_switch_context(probe_switch_context, ctx);
+	unregister_trace_cobalt_schedule(probe_schedule, ctx);
+	unregister_trace_cobalt_clock_exit(probe_clock_exit, ctx);
+	unregister_trace_cobalt_clock_entry(probe_clock_entry, ctx);
+	tracepoint_synchronize_unregister();
+	ctx->traced = 0;
+}
+
+static inline __s32 stamp_offset(struct rt_tmbench_context *ctx,
+				 uint64_t stamp)
+{
+	return stamp ? (__s32)(stamp - ctx->date) : RTTST_BENCH_NOSTAMP;
+}
+
+static void record_worst(struct rt_tmbench_context *ctx, __s32 dt)
+{
+	struct rttst_bench_sample *p;
+	int n;
+
+	if (ctx->nr_worst == ctx->worst_count) {
+		if (dt <= ctx->worst[ctx->nr_worst - 1].latency)
+			return;
+		ctx->nr_worst--;
+	}
+
+	/* Keep the samples sorted by decreasing latency. */
+	for (n = ctx->nr_worst; n > 0 && ctx->worst[n - 1].latency < dt; n--)
+		ctx->worst[n] = ctx->worst[n - 1];
+
+	p = ctx->worst + n;
+	p->date = ctx->date;
+	p->latency = dt;
+	p->irq = stamp_offset(ctx, ctx->stamps.irq);
+	p->tick = stamp_offset(ctx, ctx->stamps.tick);
+	p->sched = stamp_offset(ctx, ctx->stamps.sched);
+	p->switched = stamp_offset(ctx, ctx->stamps.switched);
+	ctx->nr_worst++;
+}
+
 static void eval_inner_loop(struct rt_tmbench_context *ctx, __s32 dt)
 {
 	if (dt > ctx->curr.max)
@@ -86,6 +214,20 @@ static void eval_inner_loop(struct rt_tmbench_context *ctx, __s32 dt)
 	}
 #endif /* CONFIG_IPIPE_TRACE */
 
+	if (!ctx->warmup) {
+		if (ctx->worst_count)
+			record_worst(ctx, dt);
+		if (ctx->histogram_size)
+			ctx->histogram_hdr[rttst_hdr_index(dt >= 0 ? dt : -dt)]++;
+	}
+
+	/* Stamps are per-sample, the next one starts from scratch. */
+	ctx->stamps.cpu = ipipe_processor_id();
+	ctx->stamps.irq = 0;
+	ctx->stamps.tick = 0;
+	ctx->stamps.sched = 0;
+	ctx->stamps.switched = 0;
+
 	ctx->date += ctx->period;
 
 	if (!ctx->warmup && ctx->histogram_size)
@@ -100,6 +242,81 @@ static void eval_inner_loop(struct rt_tmbench_context *ctx, __s32 dt)
 	}
 }
 
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+
+static void ring_complete_all(struct rt_tmbench_context *ctx,
+			      int result, int active)
+{
+	struct rtdm_ring_req *req, *tmp;
+	rtdm_lockctx_t s;
+	LIST_HEAD(q);
+
+	rtdm_lock_get_irqsave(&ctx->ring_lock, s);
+	list_splice_init(&ctx->ringq, &q);
+	ctx->ring_active = active;
+	rtdm_lock_put_irqrestore(&ctx->ring_lock, s);
+
+	list_for_each_entry_safe(req, tmp, &q, next) {
+		if (result == 0)
+			memcpy(req->kbuf, &ctx->result, sizeof(ctx->result));
+		rtdm_ring_complete(req, result);
+	}
+}
+
+static inline void ring_post_results(struct rt_tmbench_context *ctx)
+{
+	ring_complete_all(ctx, 0, 1);
+}
+
+static inline void ring_enable(struct rt_tmbench_context *ctx)
+{
+	ring_complete_all(ctx, -EIDRM, 1);
+}
+
+static inline void ring_disable(struct rt_tmbench_context *ctx)
+{
+	ring_complete_all(ctx, -EIDRM, 0);
+}
+
+/*
+ * Waiting for intermediate results through a ring does not need a
+ * thread: fixed buffers are filled in directly from the sampling
+ * loop, which may run over an interrupt handler.
+ */
+static int rt_tmbench_submit(struct rtdm_fd *fd, struct rtdm_ring_req *req)
+{
+	struct rt_tmbench_context *ctx = rtdm_fd_to_private(fd);
+	rtdm_lockctx_t s;
+	int ret;
+
+	if (req->sqe.opcode != RTDM_RING_OP_IOCTL ||
+	    req->sqe.op_flags != RTTST_RTIOC_INTERM_BENCH_RES ||
+	    req->kbuf == NULL || req->sqe.len < sizeof(ctx->result))
+		return -ENOSYS;
+
+	rtdm_lock_get_irqsave(&ctx->ring_lock, s);
+
+	if (ctx->ring_active) {
+		list_add_tail(&req->next, &ctx->ringq);
+		ret = -EIOCBQUEUED;
+	} else
+		ret = -EIDRM;
+
+	rtdm_lock_put_irqrestore(&ctx->ring_lock, s);
+
+	return ret;
+}
+
+#else /* !CONFIG_XENO_OPT_RTDM_RING */
+
+static inline void ring_post_results(struct rt_tmbench_context *ctx) { }
+
+static inline void ring_enable(struct rt_tmbench_context *ctx) { }
+
+static inline void ring_disable(struct rt_tmbench_context *ctx) { }
+
+#endif /* !CONFIG_XENO_OPT_RTDM_RING */
+
 static void eval_outer_loop(struct rt_tmbench_context *ctx)
 {
 	if (!ctx->warmup) {
@@ -121,6 +338,7 @@ static void eval_outer_loop(struct rt_tmbench_context *ctx)
 		ctx->result.overall.avg += ctx->result.last.avg;
 		ctx->result.overall.overruns += ctx->curr.overruns;
 		rtdm_event_pulse(&ctx->result_event);
+		ring_post_results(ctx);
 	}
 
 	if (ctx->warmup &&
@@ -192,7 +410,14 @@ static int rt_tmbench_open(struct rtdm_fd *fd, int oflags)
 	ctx = rtdm_fd_to_private(fd);
 
 	ctx->mode = RTTST_TMBENCH_INVALID;
+	ctx->worst = NULL;
+	ctx->traced = 0;
 	sema_init(&ctx->nrt_mutex, 1);
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+	rtdm_lock_init(&ctx->ring_lock);
+	INIT_LIST_HEAD(&ctx->ringq);
+	ctx->ring_active = 0;
+#endif
 
 	return 0;
 }
@@ -211,11 +436,15 @@ static void rt_tmbench_close(struct rtdm_fd *fd)
 		else if (ctx->mode == RTTST_TMBENCH_HANDLER)
 			rtdm_timer_destroy(&ctx->timer);
 
+		unregister_probes(ctx);
+		ring_disable(ctx);
 		rtdm_event_destroy(&ctx->result_event);
 
 		if (ctx->histogram_size)
 			kfree(ctx->histogram_min);
 
+		kfree(ctx->worst);
+		ctx->worst = NULL;
 		ctx->mode = RTTST_TMBENCH_INVALID;
 		ctx->histogram_size = 0;
 	}
@@ -250,15 +479,26 @@ static int rt_tmbench_start(struct rtdm_fd *fd,
 	ctx->samples_per_sec = 1000000000 / ctx->period;
 	ctx->histogram_size = config->histogram_size;
 	ctx->freeze_max = config->freeze_max;
+	ctx->worst_count = config->worst_count;
+	ctx->nr_worst = 0;
+	ctx->worst = NULL;
+
+	if (ctx->worst_count < 0 ||
+	    ctx->worst_count > RTTST_BENCH_MAX_WORST) {
+		up(&ctx->nrt_mutex);
+		return -EINVAL;
+	}
 
 	if (ctx->histogram_size > 0) {
 		ctx->histogram_min =
-		    kmalloc(3 * ctx->histogram_size * sizeof(int32_t),
-			    GFP_KERNEL);
+		    kmalloc((3 * ctx->histogram_size + RTTST_HDR_CELLS) *
+			    sizeof(int32_t), GFP_KERNEL);
 		ctx->histogram_max =
 		    ctx->histogram_min + config->histogram_size;
 		ctx->histogram_avg =
 		    ctx->histogram_max + config->histogram_size;
+		ctx->histogram_hdr =
+		    ctx->histogram_avg + config->histogram_size;
 
 		if (!ctx->histogram_min) {
 			up(&ctx->nrt_mutex);
@@ -266,10 +506,23 @@ static int rt_tmbench_start(struct rtdm_fd *fd,
 		}
 
 		memset(ctx->histogram_min, 0,
-		       3 * ctx->histogram_size * sizeof(int32_t));
+		       (3 * ctx->histogram_size + RTTST_HDR_CELLS) *
+		       sizeof(int32_t));
 		ctx->bucketsize = config->histogram_bucketsize;
 	}
 
+	if (ctx->worst_count > 0) {
+		ctx->worst = kcalloc(ctx->worst_count, sizeof(*ctx->worst),
+				     GFP_KERNEL);
+		if (ctx->worst == NULL) {
+			if (ctx->histogram_size > 0)
+				kfree(ctx->histogram_min);
+			up(&ctx->nrt_mutex);
+			return -ENOMEM;
+		}
+		register_probes(ctx);
+	}
+
 	ctx->result.overall.min = 10000000;
 	ctx->result.overall.max = -10000000;
 	ctx->result.overall.avg = 0;
@@ -285,6 +538,7 @@ static int rt_tmbench_start(struct rtdm_fd *fd,
 	ctx->mode = RTTST_TMBENCH_INVALID;
 
 	rtdm_event_init(&ctx->result_event, 0);
+	ring_enable(ctx);
 
 	if (config->mode == RTTST_TMBENCH_TASK) {
 		err = rtdm_task_init(&ctx->timer_task, "timerbench",
@@ -311,6 +565,13 @@ static int rt_tmbench_start(struct rtdm_fd *fd,
 		cobalt_atomic_leave(s);
 	}
 
+	if (ctx->mode == RTTST_TMBENCH_INVALID) {
+		ring_disable(ctx);
+		unregister_probes(ctx);
+		kfree(ctx->worst);
+		ctx->worst = NULL;
+	}
+
 	up(&ctx->nrt_mutex);
 
 	return err;
@@ -328,9 +589,16 @@ static int kernel_copy_results(struct rt_tmbench_context *ctx,
 		memcpy(res->histogram_min, ctx->histogram_min, size);
 		memcpy(res->histogram_max, ctx->histogram_max, size);
 		memcpy(res->histogram_avg, ctx->histogram_avg, size);
-		kfree(ctx->histogram_min);
+		if (res->histogram_hdr)
+			memcpy(res->histogram_hdr, ctx->histogram_hdr,
+			       RTTST_HDR_CELLS * sizeof(int32_t));
 	}
 
+	res->nr_worst = ctx->nr_worst;
+	if (ctx->nr_worst > 0)
+		memcpy(res->worst, ctx->worst,
+		       ctx->nr_worst * sizeof(*ctx->worst));
+
 	return 0;
 }
 
@@ -344,21 +612,35 @@ static int user_copy_results(struct rt_tmbench_context *ctx,
 	ret = rtdm_safe_copy_to_user(fd, &u_res->result,
 				     &ctx->result.overall,
 				     sizeof(u_res->result));
-	if (ret || ctx->histogram_size == 0)
+	if (ret)
 		return ret;
 
-	size = ctx->histogram_size * sizeof(int32_t);
+	if (rtdm_safe_copy_from_user(fd, &res_buf, u_res, sizeof(res_buf)) < 0)
+		return -EFAULT;
 
-	if (rtdm_safe_copy_from_user(fd, &res_buf, u_res, sizeof(res_buf)) < 0 ||
-	    rtdm_safe_copy_to_user(fd, res_buf.histogram_min,
-				   ctx->histogram_min, size) < 0 ||
-	    rtdm_safe_copy_to_user(fd, res_buf.histogram_max,
-				   ctx->histogram_max, size) < 0 ||
-	    rtdm_safe_copy_to_user(fd, res_buf.histogram_avg,
-				   ctx->histogram_avg, size) < 0)
+	if (ctx->histogram_size > 0) {
+		size = ctx->histogram_size * sizeof(int32_t);
+		if (rtdm_safe_copy_to_user(fd, res_buf.histogram_min,
+					   ctx->histogram_min, size) < 0 ||
+		    rtdm_safe_copy_to_user(fd, res_buf.histogram_max,
+					   ctx->histogram_max, size) < 0 ||
+		    rtdm_safe_copy_to_user(fd, res_buf.histogram_avg,
+					   ctx->histogram_avg, size) < 0)
+			return -EFAULT;
+		if (res_buf.histogram_hdr &&
+		    rtdm_safe_copy_to_user(fd, res_buf.histogram_hdr,
+					   ctx->histogram_hdr,
+					   RTTST_HDR_CELLS * sizeof(int32_t)) < 0)
+			return -EFAULT;
+	}
+
+	if (ctx->nr_worst > 0 &&
+	    rtdm_safe_copy_to_user(fd, res_buf.worst, ctx->worst,
+				   ctx->nr_worst * sizeof(*ctx->worst)) < 0)
 		return -EFAULT;
 
-	return 0;
+	return rtdm_safe_copy_to_user(fd, &u_res->nr_worst, &ctx->nr_worst,
+				      sizeof(u_res->nr_worst));
 }
 
 #ifdef CONFIG_XENO_ARCH_SYS3264
@@ -373,21 +655,35 @@ static int compat_user_copy_results(struct rt_tmbench_context *ctx,
 	ret = rtdm_safe_copy_to_user(fd, &u_res->result,
 				     &ctx->result.overall,
 				     sizeof(u_res->result));
-	if (ret || ctx->histogram_size == 0)
+	if (ret)
 		return ret;
 
-	size = ctx->histogram_size * sizeof(int32_t);
+	if (rtdm_safe_copy_from_user(fd, &res_buf, u_res, sizeof(res_buf)) < 0)
+		return -EFAULT;
 
-	if (rtdm_safe_copy_from_user(fd, &res_buf, u_res, sizeof(res_buf)) < 0 ||
-	    rtdm_safe_copy_to_user(fd, compat_ptr(res_buf.histogram_min),
-				   ctx->histogram_min, size) < 0 ||
-	    rtdm_safe_copy_to_user(fd, compat_ptr(res_buf.histogram_max),
-				   ctx->histogram_max, size) < 0 ||
-	    rtdm_safe_copy_to_user(fd, compat_ptr(res_buf.histogram_avg),
-				   ctx->histogram_avg, size) < 0)
+	if (ctx->histogram_size > 0) {
+		size = ctx->histogram_size * sizeof(int32_t);
+		if (rtdm_safe_copy_to_user(fd, compat_ptr(res_buf.histogram_min),
+					   ctx->histogram_min, size) < 0 ||
+		    rtdm_safe_copy_to_user(fd, compat_ptr(res_buf.histogram_max),
+					   ctx->histogram_max, size) < 0 ||
+		    rtdm_safe_copy_to_user(fd, compat_ptr(res_buf.histogram_avg),
+					   ctx->histogram_avg, size) < 0)
+			return -EFAULT;
+		if (res_buf.histogram_hdr &&
+		    rtdm_safe_copy_to_user(fd, compat_ptr(res_buf.histogram_hdr),
+					   ctx->histogram_hdr,
+					   RTTST_HDR_CELLS * sizeof(int32_t)) < 0)
+			return -EFAULT;
+	}
+
+	if (ctx->nr_worst > 0 &&
+	    rtdm_safe_copy_to_user(fd, compat_ptr(res_buf.worst), ctx->worst,
+				   ctx->nr_worst * sizeof(*ctx->worst)) < 0)
 		return -EFAULT;
 
-	return 0;
+	return rtdm_safe_copy_to_user(fd, &u_res->nr_worst, &ctx->nr_worst,
+				      sizeof(u_res->nr_worst));
 }
 
 #endif /* CONFIG_XENO_ARCH_SYS3264 */
@@ -409,6 +705,8 @@ static int rt_tmbench_stop(struct rt_tmbench_context *ctx, void *u_res)
 	else if (ctx->mode == RTTST_TMBENCH_HANDLER)
 		rtdm_timer_destroy(&ctx->timer);
 
+	unregister_probes(ctx);
+	ring_disable(ctx);
 	rtdm_event_destroy(&ctx->result_event);
 
 	ctx->mode = RTTST_TMBENCH_INVALID;
@@ -431,6 +729,9 @@ static int rt_tmbench_stop(struct rt_tmbench_context *ctx, void *u_res)
 	if (ctx->histogram_size > 0)
 		kfree(ctx->histogram_min);
 
+	kfree(ctx->worst);
+	ctx->worst = NULL;
+
 	up(&ctx->nrt_mutex);
 
 	return ret;
@@ -507,6 +808,9 @@ static struct rtdm_driver timerbench_driver = {
 		.close		= rt_tmbench_close,
 		.ioctl_rt	= rt_tmbench_ioctl_rt,
 		.ioctl_nrt	= rt_tmbench_ioctl_nrt,
+#ifdef CONFIG_XENO_OPT_RTDM_RING
+		.submit		= rt_tmbench_submit,
+#endif
 	},
 };
 
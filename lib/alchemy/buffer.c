@@ -41,6 +41,13 @@
  * under a well-defined situation (see note in rt_buffer_read()),
  * albeit they can be fully avoided by proper use of the buffer.
  *
+ * Large messages may be built and processed in place within the
+ * buffer memory, instead of being copied in and out: a writer
+ * obtains space from rt_buffer_reserve() then posts the message with
+ * rt_buffer_commit(), a reader obtains the message from
+ * rt_buffer_peek() then releases it with rt_buffer_consume(). The
+ * buffer lock is not held while the data is accessed.
+ *
  * @{
  */
 struct syncluster alchemy_buffer_table;
@@ -129,6 +136,7 @@ static int buffer_registry_open(struct fsobj *fsobj, void *priv)
 
 	fsobstack_grow_syncobj_grant(o, &bcb->sobj, &fill_grant_ops);
 	fsobstack_grow_syncobj_drain(o, &bcb->sobj, &fill_drain_ops);
+	fsobstack_grow_syncobj_stats(o, &bcb->sobj);
 
 	fsobstack_finish(o);
 
@@ -246,6 +254,8 @@ int rt_buffer_create(RT_BUFFER *bf, const char *name,
 	bcb->rdoff = 0;
 	bcb->wroff = 0;
 	bcb->fillsz = 0;
+	bcb->resvsz = 0;
+	bcb->peeksz = 0;
 	if (mode & B_PRIO)
 		sobj_flags = SYNCOBJ_PRIO;
 
@@ -254,6 +264,8 @@ int rt_buffer_create(RT_BUFFER *bf, const char *name,
 	if (ret)
 		goto fail_syncinit;
 
+	syncobj_set_name(&bcb->sobj, bcb->name);
+
 	bcb->magic = buffer_magic;
 
 	registry_init_file_obstack(&bcb->fsobj, &registry_ops);
@@ -487,9 +499,10 @@ redo:
 	for (;;) {
 		/*
 		 * We should be able to read a complete message of the
-		 * requested length, or block.
+		 * requested length, or block. Data being peeked at
+		 * may not be read until consumed.
 		 */
-		if (bcb->fillsz < len)
+		if (bcb->peeksz || bcb->fillsz < len)
 			goto wait;
 
 		/* Read from the buffer in a circular way. */
@@ -539,7 +552,8 @@ redo:
 		 * pathological use of the buffer. We must allow for a
 		 * short read to prevent a deadlock.
 		 */
-		if (bcb->fillsz > 0 && syncobj_count_drain(&bcb->sobj)) {
+		if (bcb->peeksz == 0 && bcb->fillsz > 0 &&
+		    syncobj_count_drain(&bcb->sobj)) {
 			len = bcb->fillsz;
 			goto redo;
 		}
@@ -702,9 +716,10 @@ ssize_t rt_buffer_write_timed(RT_BUFFER *bf,
 	for (;;) {
 		/*
 		 * We should be able to write the entire message at
-		 * once, or block.
+		 * once, or block. Nothing may be written past a
+		 * pending reservation until it is committed.
 		 */
-		if (bcb->fillsz + len > bcb->bufsz)
+		if (bcb->resvsz || bcb->fillsz + len > bcb->bufsz)
 			goto wait;
 
 		/* Write to the buffer in a circular way. */
@@ -788,6 +803,488 @@ out:
 	return ret;
 }
 
+static void get_buffer_span(struct alchemy_buffer *bcb, size_t off,
+			    size_t len, RT_BUFFER_SPAN *span)
+{
+	void *buf = __mptr(bcb->buf);
+
+	span->ptr[0] = buf + off;
+	span->len[0] = off + len > bcb->bufsz ? bcb->bufsz - off : len;
+	span->ptr[1] = buf;
+	span->len[1] = len - span->len[0];
+}
+
+/**
+ * @fn ssize_t rt_buffer_reserve(RT_BUFFER *bf, RT_BUFFER_SPAN *span, size_t len, RTIME timeout)
+ * @brief Reserve space in an IPC buffer (with relative scalar timeout).
+ *
+ * This routine is a variant of rt_buffer_reserve_timed() accepting a
+ * relative timeout specification expressed as a scalar value.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param span The address of a span descriptor receiving the location
+ * of the reserved space.
+ *
+ * @param len The length in bytes of the space to reserve.
+ *
+ * @param timeout A delay expressed in clock ticks.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+
+/**
+ * @fn ssize_t rt_buffer_reserve_until(RT_BUFFER *bf, RT_BUFFER_SPAN *span, size_t len, RTIME abs_timeout)
+ * @brief Reserve space in an IPC buffer (with absolute scalar timeout).
+ *
+ * This routine is a variant of rt_buffer_reserve_timed() accepting an
+ * absolute timeout specification expressed as a scalar value.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param span The address of a span descriptor receiving the location
+ * of the reserved space.
+ *
+ * @param len The length in bytes of the space to reserve.
+ *
+ * @param abs_timeout An absolute date expressed in clock ticks.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+
+/**
+ * @fn ssize_t rt_buffer_reserve_timed(RT_BUFFER *bf, RT_BUFFER_SPAN *span, size_t len, const struct timespec *abs_timeout)
+ * @brief Reserve space in an IPC buffer.
+ *
+ * This routine reserves room for a message in the specified buffer,
+ * returning the location of that space within the buffer memory, so
+ * that the caller may build the message in place. If not enough
+ * buffer space is available on entry, the caller is allowed to block
+ * until enough room is freed, or a timeout elapses, whichever comes
+ * first.
+ *
+ * The message becomes visible to readers once rt_buffer_commit() is
+ * called. A single reservation may be pending at any point in time
+ * on a buffer; until it is committed, other writers and reservers
+ * wait for buffer space as if the buffer was full.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param span The address of a @ref RT_BUFFER_SPAN "span descriptor"
+ * receiving the location of the reserved space, which may wrap at
+ * the end of the buffer memory.
+ *
+ * @param len The length in bytes of the space to reserve.
+ *
+ * @param abs_timeout An absolute date expressed in clock ticks,
+ * specifying a time limit to wait for enough buffer space to be
+ * available (see note). Passing NULL causes the caller to block
+ * indefinitely until enough buffer space is available. Passing {
+ * .tv_sec = 0, .tv_nsec = 0 } causes the service to return
+ * immediately without blocking in case of buffer space shortage.
+ *
+ * @return The number of bytes reserved is returned upon
+ * success. Otherwise:
+ *
+ * - -ETIMEDOUT is returned if the absolute @a abs_timeout date is
+ * reached before enough buffer space is available.
+ *
+ * - -EWOULDBLOCK is returned if @a abs_timeout is { .tv_sec = 0,
+ * .tv_nsec = 0 } and not enough buffer space is immediately
+ * available on entry.
+ *
+ * - -EINTR is returned if rt_task_unblock() was called for the
+ * current task before enough buffer space became available.
+ *
+ * - -EINVAL is returned if @a bf is not a valid buffer descriptor, or
+ * @a len is zero or greater than the actual buffer length.
+ *
+ * - -EIDRM is returned if @a bf is deleted while the caller was
+ * waiting for buffer space. In such event, @a bf is no more valid
+ * upon return of this service.
+ *
+ * - -EPERM is returned if this service should block, but was not
+ * called from a Xenomai thread.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ *
+ * @note @a abs_timeout is interpreted as a multiple of the Alchemy
+ * clock resolution (see --alchemy-clock-resolution option, defaults
+ * to 1 nanosecond).
+ */
+ssize_t rt_buffer_reserve_timed(RT_BUFFER *bf,
+				RT_BUFFER_SPAN *span, size_t size,
+				const struct timespec *abs_timeout)
+{
+	struct alchemy_buffer_wait *wait = NULL;
+	struct alchemy_buffer *bcb;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+
+	if (size == 0)
+		return -EINVAL;
+
+	if (!threadobj_current_p() && !alchemy_poll_mode(abs_timeout))
+		return -EPERM;
+
+	CANCEL_DEFER(svc);
+
+	bcb = get_alchemy_buffer(bf, &syns, &ret);
+	if (bcb == NULL)
+		goto out;
+
+	if (size > bcb->bufsz) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	for (;;) {
+		if (bcb->resvsz == 0 && bcb->fillsz + size <= bcb->bufsz) {
+			get_buffer_span(bcb, bcb->wroff, size, span);
+			bcb->resvsz = size;
+			ret = (ssize_t)size;
+			break;
+		}
+
+		if (alchemy_poll_mode(abs_timeout)) {
+			ret = -EWOULDBLOCK;
+			break;
+		}
+
+		if (wait == NULL)
+			wait = threadobj_prepare_wait(struct alchemy_buffer_wait);
+
+		wait->size = size;
+
+		/*
+		 * Same as rt_buffer_write_timed(): kick readers
+		 * waiting for more data than available while we
+		 * wait for space, so that they get a short read.
+		 */
+		if (bcb->fillsz > 0 && syncobj_count_grant(&bcb->sobj))
+			syncobj_grant_all(&bcb->sobj);
+
+		ret = syncobj_wait_drain(&bcb->sobj, abs_timeout, &syns);
+		if (ret) {
+			if (ret == -EIDRM)
+				goto out;
+			break;
+		}
+	}
+done:
+	put_alchemy_buffer(bcb, &syns);
+out:
+	if (wait)
+		threadobj_finish_wait();
+
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
+/**
+ * @fn int rt_buffer_commit(RT_BUFFER *bf, size_t len)
+ * @brief Commit a message built into reserved buffer space.
+ *
+ * This routine posts the message built into the space obtained from
+ * rt_buffer_reserve(), then ends the reservation. Tasks waiting for
+ * enough data to read are awakened as with rt_buffer_write().
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param len The length in bytes of the message, which may be
+ * shorter than the reserved space. Passing zero cancels the
+ * reservation.
+ *
+ * @return Zero is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a bf is not a valid buffer descriptor,
+ * no reservation is pending, or @a len is greater than the reserved
+ * space.
+ *
+ * @apitags{unrestricted, switch-primary}
+ */
+int rt_buffer_commit(RT_BUFFER *bf, size_t size)
+{
+	struct alchemy_buffer_wait *wait;
+	struct alchemy_buffer *bcb;
+	struct threadobj *thobj;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+
+	CANCEL_DEFER(svc);
+
+	bcb = get_alchemy_buffer(bf, &syns, &ret);
+	if (bcb == NULL)
+		goto out;
+
+	if (bcb->resvsz == 0 || size > bcb->resvsz) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	bcb->wroff = (bcb->wroff + size) % bcb->bufsz;
+	bcb->fillsz += size;
+	bcb->resvsz = 0;
+
+	/* Writers may post again, let them recheck for space. */
+	syncobj_drain(&bcb->sobj);
+
+	thobj = syncobj_peek_grant(&bcb->sobj);
+	if (thobj) {
+		wait = threadobj_get_wait(thobj);
+		if (wait->size <= bcb->fillsz)
+			syncobj_grant_all(&bcb->sobj);
+	}
+done:
+	put_alchemy_buffer(bcb, &syns);
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
+/**
+ * @fn ssize_t rt_buffer_peek(RT_BUFFER *bf, RT_BUFFER_SPAN *span, size_t len, RTIME timeout)
+ * @brief Get access to data in an IPC buffer (with relative scalar timeout).
+ *
+ * This routine is a variant of rt_buffer_peek_timed() accepting a
+ * relative timeout specification expressed as a scalar value.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param span The address of a span descriptor receiving the location
+ * of the data.
+ *
+ * @param len The length in bytes of the message to get.
+ *
+ * @param timeout A delay expressed in clock ticks.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+
+/**
+ * @fn ssize_t rt_buffer_peek_until(RT_BUFFER *bf, RT_BUFFER_SPAN *span, size_t len, RTIME abs_timeout)
+ * @brief Get access to data in an IPC buffer (with absolute scalar timeout).
+ *
+ * This routine is a variant of rt_buffer_peek_timed() accepting an
+ * absolute timeout specification expressed as a scalar value.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param span The address of a span descriptor receiving the location
+ * of the data.
+ *
+ * @param len The length in bytes of the message to get.
+ *
+ * @param abs_timeout An absolute date expressed in clock ticks.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+
+/**
+ * @fn ssize_t rt_buffer_peek_timed(RT_BUFFER *bf, RT_BUFFER_SPAN *span, size_t len, const struct timespec *abs_timeout)
+ * @brief Get access to data in an IPC buffer.
+ *
+ * This routine returns the location of the next message within the
+ * buffer memory, so that the caller may process it in place. If no
+ * message is available on entry, the caller is allowed to block until
+ * enough data is written to the buffer, or a timeout elapses.
+ *
+ * The data remain in the buffer until rt_buffer_consume() is
+ * called. A single peek operation may be pending at any point in time
+ * on a buffer; until it is ended by rt_buffer_consume(), other
+ * readers wait for data as if the buffer was empty.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param span The address of a @ref RT_BUFFER_SPAN "span descriptor"
+ * receiving the location of the data, which may wrap at the end of
+ * the buffer memory.
+ *
+ * @param len The length in bytes of the message to get. Like with
+ * rt_buffer_read_timed(), a shorter message may be returned to
+ * prevent a deadlock with writers.
+ *
+ * @param abs_timeout An absolute date expressed in clock ticks,
+ * specifying a time limit to wait for a message to be available from
+ * the buffer (see note). Passing NULL causes the caller to block
+ * indefinitely until enough data is available. Passing { .tv_sec = 0,
+ * .tv_nsec = 0 } causes the service to return immediately without
+ * blocking in case not enough data is available.
+ *
+ * @return The number of bytes available from @a span is returned upon
+ * success. Otherwise:
+ *
+ * - -ETIMEDOUT is returned if @a abs_timeout is reached before a
+ * complete message arrives.
+ *
+ * - -EWOULDBLOCK is returned if @a abs_timeout is { .tv_sec = 0,
+ * .tv_nsec = 0 } and not enough data is immediately available on
+ * entry to form a complete message.
+ *
+ * - -EINTR is returned if rt_task_unblock() was called for the
+ * current task before enough data became available to form a complete
+ * message.
+ *
+ * - -EINVAL is returned if @a bf is not a valid buffer descriptor, or
+ * @a len is zero or greater than the actual buffer length.
+ *
+ * - -EIDRM is returned if @a bf is deleted while the caller was
+ * waiting for data. In such event, @a bf is no more valid upon return
+ * of this service.
+ *
+ * - -EPERM is returned if this service should block, but was not
+ * called from a Xenomai thread.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ *
+ * @note @a abs_timeout is interpreted as a multiple of the Alchemy
+ * clock resolution (see --alchemy-clock-resolution option, defaults
+ * to 1 nanosecond).
+ */
+ssize_t rt_buffer_peek_timed(RT_BUFFER *bf,
+			     RT_BUFFER_SPAN *span, size_t size,
+			     const struct timespec *abs_timeout)
+{
+	struct alchemy_buffer_wait *wait = NULL;
+	struct alchemy_buffer *bcb;
+	struct syncstate syns;
+	struct service svc;
+	size_t len = size;
+	int ret = 0;
+
+	if (len == 0)
+		return -EINVAL;
+
+	if (!threadobj_current_p() && !alchemy_poll_mode(abs_timeout))
+		return -EPERM;
+
+	CANCEL_DEFER(svc);
+
+	bcb = get_alchemy_buffer(bf, &syns, &ret);
+	if (bcb == NULL)
+		goto out;
+
+	if (len > bcb->bufsz) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	for (;;) {
+		if (bcb->peeksz == 0 && bcb->fillsz >= len) {
+			get_buffer_span(bcb, bcb->rdoff, len, span);
+			bcb->peeksz = len;
+			ret = (ssize_t)len;
+			break;
+		}
+
+		if (alchemy_poll_mode(abs_timeout)) {
+			ret = -EWOULDBLOCK;
+			break;
+		}
+
+		/*
+		 * Same as rt_buffer_read_timed(): allow for a short
+		 * message if writers are waiting for space, while we
+		 * are about to wait for data.
+		 */
+		if (bcb->peeksz == 0 && bcb->fillsz > 0 &&
+		    syncobj_count_drain(&bcb->sobj)) {
+			len = bcb->fillsz;
+			continue;
+		}
+
+		if (wait == NULL)
+			wait = threadobj_prepare_wait(struct alchemy_buffer_wait);
+
+		wait->size = len;
+
+		ret = syncobj_wait_grant(&bcb->sobj, abs_timeout, &syns);
+		if (ret) {
+			if (ret == -EIDRM)
+				goto out;
+			break;
+		}
+	}
+done:
+	put_alchemy_buffer(bcb, &syns);
+out:
+	if (wait)
+		threadobj_finish_wait();
+
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
+/**
+ * @fn int rt_buffer_consume(RT_BUFFER *bf, size_t len)
+ * @brief Release data obtained from an IPC buffer.
+ *
+ * This routine removes data returned by rt_buffer_peek() from the
+ * buffer, then ends the peek operation. Tasks waiting for buffer
+ * space are awakened as with rt_buffer_read().
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param len The length in bytes of the data to remove, which may be
+ * shorter than the length returned by rt_buffer_peek(). The
+ * remaining data are left in the buffer for the next read. Passing
+ * zero ends the peek operation without removing any data.
+ *
+ * @return Zero is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a bf is not a valid buffer descriptor, no
+ * peek operation is pending, or @a len is greater than the data
+ * length returned by rt_buffer_peek().
+ *
+ * @apitags{unrestricted, switch-primary}
+ */
+int rt_buffer_consume(RT_BUFFER *bf, size_t size)
+{
+	struct alchemy_buffer_wait *wait;
+	struct alchemy_buffer *bcb;
+	struct threadobj *thobj;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+
+	CANCEL_DEFER(svc);
+
+	bcb = get_alchemy_buffer(bf, &syns, &ret);
+	if (bcb == NULL)
+		goto out;
+
+	if (bcb->peeksz == 0 || size > bcb->peeksz) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	bcb->rdoff = (bcb->rdoff + size) % bcb->bufsz;
+	bcb->fillsz -= size;
+	bcb->peeksz = 0;
+
+	/* Readers may get data again, let them recheck. */
+	if (bcb->fillsz > 0)
+		syncobj_grant_all(&bcb->sobj);
+
+	thobj = syncobj_peek_drain(&bcb->sobj);
+	if (thobj) {
+		wait = threadobj_get_wait(thobj);
+		if (wait->size + bcb->fillsz <= bcb->bufsz)
+			syncobj_drain(&bcb->sobj);
+	}
+done:
+	put_alchemy_buffer(bcb, &syns);
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
 /**
  * @fn int rt_buffer_clear(RT_BUFFER *bf)
  * @brief Clear an IPC buffer.
@@ -800,6 +1297,9 @@ out:
  *
  * - -EINVAL is returned if @a bf is not a valid buffer descriptor.
  *
+ * - -EBUSY is returned if a reservation or a peek operation is
+ * pending on the buffer.
+ *
  * @apitags{unrestricted, switch-primary}
  */
 int rt_buffer_clear(RT_BUFFER *bf)
@@ -815,11 +1315,16 @@ int rt_buffer_clear(RT_BUFFER *bf)
 	if (bcb == NULL)
 		goto out;
 
+	if (bcb->resvsz || bcb->peeksz) {
+		ret = -EBUSY;
+		goto done;
+	}
+
 	bcb->wroff = 0;
 	bcb->rdoff = 0;
 	bcb->fillsz = 0;
 	syncobj_drain(&bcb->sobj);
-
+done:
 	put_alchemy_buffer(bcb, &syns);
 out:
 	CANCEL_RESTORE(svc);
@@ -35,6 +35,8 @@ struct alchemy_buffer {
 	size_t rdoff;
 	size_t wroff;
 	size_t fillsz;
+	size_t resvsz;
+	size_t peeksz;
 	struct fsobj fsobj;
 };
 
@@ -122,6 +122,7 @@ static int heap_registry_open(struct fsobj *fsobj, void *priv)
 			      used_mem);
 
 	fsobstack_grow_syncobj_grant(o, &hcb->sobj, &fill_ops);
+	fsobstack_grow_syncobj_stats(o, &hcb->sobj);
 
 	fsobstack_finish(o);
 
@@ -255,6 +256,8 @@ int rt_heap_create(RT_HEAP *heap,
 	if (ret)
 		goto fail_syncinit;
 
+	syncobj_set_name(&hcb->sobj, hcb->name);
+
 	hcb->magic = heap_magic;
 
 	registry_init_file_obstack(&hcb->fsobj, &registry_ops);
@@ -37,6 +37,13 @@
  * message queue can be created by one task and used by multiple tasks
  * that send and/or receive messages to the queue.
  *
+ * Messages sent in normal mode are passed through a lock-free ring
+ * living in shared memory, so that senders and receivers exchange
+ * them without serializing on the queue lock, as long as the queue is
+ * neither empty with receivers waiting for messages, nor full. Urgent
+ * and broadcast messages, and messages which overflow the ring are
+ * handled under lock.
+ *
  * @{
  */
 struct syncluster alchemy_queue_table;
@@ -46,6 +53,12 @@ static DEFINE_NAME_GENERATOR(queue_namegen, "queue",
 
 DEFINE_SYNC_LOOKUP(queue, RT_QUEUE);
 
+DEFINE_LOOKUP_PRIVATE(queue, RT_QUEUE);
+
+/* Default/max number of slots in the lock-free ring. */
+#define QUEUE_RING_SLOTS	256
+#define QUEUE_RING_MAXSLOTS	4096
+
 #ifdef CONFIG_XENO_REGISTRY
 
 static int prepare_waiter_cache(struct fsobstack *o,
@@ -93,7 +106,7 @@ static int queue_registry_open(struct fsobj *fsobj, void *priv)
 	usable_mem = heapobj_size(&qcb->hobj);
 	used_mem = heapobj_inquire(&qcb->hobj);
 	limit = qcb->limit;
-	mcount = qcb->mcount;
+	mcount = atomic_read(&qcb->mcount);
 	mode = qcb->mode;
 
 	syncobj_unlock(&qcb->sobj, &syns);
@@ -110,6 +123,7 @@ static int queue_registry_open(struct fsobj *fsobj, void *priv)
 			      mcount);
 
 	fsobstack_grow_syncobj_grant(o, &qcb->sobj, &fill_ops);
+	fsobstack_grow_syncobj_stats(o, &qcb->sobj);
 
 	fsobstack_finish(o);
 
@@ -128,17 +142,296 @@ static struct registry_operations registry_ops;
 
 #endif /* CONFIG_XENO_REGISTRY */
 
+/*
+ * Lockless senders and receivers do not hold the queue lock, they
+ * pin the queue memory by raising nbusy instead, then check the
+ * magic tag. rt_queue_delete() invalidates the tag before the queue
+ * is finalized, so that the finalizer only has to wait for the
+ * callers already in flight to leave. Callers in flight must not
+ * grab the queue lock, since the finalizer may run with that lock
+ * held.
+ */
+static inline int queue_enter(struct alchemy_queue *qcb)
+{
+	atomic_add_fetch(&qcb->nbusy, 1); /* Implies a full barrier. */
+	if (ACCESS_ONCE(qcb->magic) == queue_magic)
+		return 1;
+
+	atomic_sub_fetch(&qcb->nbusy, 1);
+
+	return 0;
+}
+
+static inline void queue_leave(struct alchemy_queue *qcb)
+{
+	atomic_sub_fetch(&qcb->nbusy, 1);
+}
+
 static void queue_finalize(struct syncobj *sobj)
 {
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = 100000 };
 	struct alchemy_queue *qcb;
 
 	qcb = container_of(sobj, struct alchemy_queue, sobj);
+
+	/*
+	 * Callers in flight never block, but may have been preempted
+	 * by us: sleep, do not spin.
+	 */
+	smp_mb();
+	while (atomic_read(&qcb->nbusy) > 0)
+		__RT(clock_nanosleep(CLOCK_COPPERPLATE, 0, &delay, NULL));
+
 	registry_destroy_file(&qcb->fsobj);
 	heapobj_destroy(&qcb->hobj);
+	xnfree(__mptr(qcb->ring.cells));
 	xnfree(qcb);
 }
 fnref_register(libalchemy, queue_finalize);
 
+static int init_ring(struct alchemy_queue *qcb, size_t qlimit)
+{
+	struct alchemy_queue_cell *cells;
+	unsigned long n, nr = QUEUE_RING_SLOTS;
+
+	/*
+	 * A limited queue gets enough slots for holding all the
+	 * messages it accepts, up to a reasonable amount.
+	 */
+	if (qlimit != Q_UNLIMITED) {
+		for (nr = 2; nr < qlimit && nr < QUEUE_RING_MAXSLOTS; nr <<= 1)
+			;
+	}
+
+	cells = xnmalloc(nr * sizeof(*cells));
+	if (cells == NULL)
+		return -ENOMEM;
+
+	for (n = 0; n < nr; n++)
+		cells[n].seq = n;
+
+	qcb->ring.head = 0;
+	qcb->ring.tail = 0;
+	qcb->ring.mask = nr - 1;
+	qcb->ring.cells = __moff(cells);
+
+	return 0;
+}
+
+/*
+ * The ring is a bounded multi-producer/multi-consumer FIFO: each slot
+ * carries a sequence number telling whether it may be filled or
+ * emptied at the current position, which senders and receivers
+ * advance by compare-and-swap.
+ */
+static int push_ring(struct alchemy_queue *qcb,
+		     struct alchemy_queue_msg *msg)
+{
+	struct alchemy_queue_cell *cells, *cell;
+	unsigned long pos, seq;
+	long dif;
+
+	cells = __mptr(qcb->ring.cells);
+	pos = ACCESS_ONCE(qcb->ring.tail);
+
+	for (;;) {
+		cell = cells + (pos & qcb->ring.mask);
+		seq = ACCESS_ONCE(cell->seq);
+		smp_rmb();
+		dif = (long)(seq - pos);
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&qcb->ring.tail,
+							 pos, pos + 1))
+				break;
+		} else if (dif < 0)
+			return -EAGAIN;	/* Full. */
+
+		pos = ACCESS_ONCE(qcb->ring.tail);
+	}
+
+	ACCESS_ONCE(cell->msg) = __moff(msg);
+	smp_wmb();
+	ACCESS_ONCE(cell->seq) = pos + 1;
+
+	return 0;
+}
+
+static struct alchemy_queue_msg *pop_ring(struct alchemy_queue *qcb)
+{
+	struct alchemy_queue_cell *cells, *cell;
+	struct alchemy_queue_msg *msg;
+	unsigned long pos, seq;
+	long dif;
+
+	cells = __mptr(qcb->ring.cells);
+	pos = ACCESS_ONCE(qcb->ring.head);
+
+	for (;;) {
+		cell = cells + (pos & qcb->ring.mask);
+		seq = ACCESS_ONCE(cell->seq);
+		smp_rmb();
+		dif = (long)(seq - (pos + 1));
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&qcb->ring.head,
+							 pos, pos + 1))
+				break;
+		} else if (dif < 0)
+			return NULL;	/* Empty. */
+
+		pos = ACCESS_ONCE(qcb->ring.head);
+	}
+
+	msg = __mptr(ACCESS_ONCE(cell->msg));
+	smp_mb();
+	ACCESS_ONCE(cell->seq) = pos + qcb->ring.mask + 1;
+
+	return msg;
+}
+
+static inline int reserve_slot(struct alchemy_queue *qcb)
+{
+	if (qcb->limit &&
+	    atomic_add_fetch(&qcb->mcount, 1) > (int)qcb->limit) {
+		atomic_sub_fetch(&qcb->mcount, 1);
+		return -ENOMEM;
+	}
+
+	if (qcb->limit == 0)
+		atomic_add_fetch(&qcb->mcount, 1);
+
+	return 0;
+}
+
+/* qcb->sobj locked, slot reserved. */
+static void queue_message(struct alchemy_queue *qcb,
+			  struct alchemy_queue_msg *msg, int mode)
+{
+	if (mode & Q_URGENT) {
+		list_prepend(&msg->next, &qcb->mq);
+		atomic_add_fetch(&qcb->nurgent, 1);
+		return;
+	}
+
+	/*
+	 * Once the ring overflows, normal messages keep going to the
+	 * overflow list until it is drained, which preserves FIFO
+	 * order.
+	 */
+	if (atomic_read(&qcb->noverflow) == 0 && push_ring(qcb, msg) == 0)
+		return;
+
+	list_append(&msg->next, &qcb->oq);
+	atomic_add_fetch(&qcb->noverflow, 1);
+}
+
+/* qcb->sobj locked. */
+static struct alchemy_queue_msg *dequeue_message(struct alchemy_queue *qcb)
+{
+	struct alchemy_queue_msg *msg;
+
+	if (!list_empty(&qcb->mq)) {
+		msg = list_pop_entry(&qcb->mq, struct alchemy_queue_msg, next);
+		atomic_sub_fetch(&qcb->nurgent, 1);
+	} else {
+		msg = pop_ring(qcb);
+		if (msg == NULL) {
+			if (list_empty(&qcb->oq))
+				return NULL;
+			msg = list_pop_entry(&qcb->oq,
+					     struct alchemy_queue_msg, next);
+			atomic_sub_fetch(&qcb->noverflow, 1);
+		}
+	}
+
+	atomic_sub_fetch(&qcb->mcount, 1);
+
+	return msg;
+}
+
+static struct alchemy_queue_msg *fast_dequeue(struct alchemy_queue *qcb)
+{
+	struct alchemy_queue_msg *msg;
+
+	/* Urgent messages must be picked first, under lock. */
+	if (atomic_read(&qcb->nurgent))
+		return NULL;
+
+	msg = pop_ring(qcb);
+	if (msg)
+		atomic_sub_fetch(&qcb->mcount, 1);
+
+	return msg;
+}
+
+/* qcb->sobj locked. */
+static int grant_waiters(struct alchemy_queue *qcb)
+{
+	struct alchemy_queue_wait *wait;
+	struct alchemy_queue_msg *msg;
+	struct threadobj *waiter;
+	int ret = 0;
+
+	/*
+	 * Hand queued messages over to the receivers which went
+	 * sleeping while we were sending through the ring.
+	 */
+	while ((waiter = syncobj_peek_grant(&qcb->sobj)) != NULL) {
+		msg = dequeue_message(qcb);
+		if (msg == NULL)
+			break;
+		wait = threadobj_get_wait(waiter);
+		wait->msg = __moff(msg);
+		msg->refcount++;
+		syncobj_grant_to(&qcb->sobj, waiter);
+		ret++;
+	}
+
+	return ret;
+}
+
+/*
+ * In flight. Returns non-zero if receivers may be waiting for the
+ * message just pushed, in which case wake_receivers() should be
+ * called after leaving.
+ */
+static int fast_send(struct alchemy_queue *qcb,
+		     struct alchemy_queue_msg *msg)
+{
+	if (reserve_slot(qcb))
+		return -ENOMEM;
+
+	if (push_ring(qcb, msg)) {
+		atomic_sub_fetch(&qcb->mcount, 1);
+		return -EAGAIN;
+	}
+
+	/*
+	 * A receiver may have started waiting for a message after
+	 * we checked for sleepers: it pairs the update of nwaiters
+	 * with a final check of the ring, we pair our push with
+	 * checking nwaiters, so that either side notices the other.
+	 */
+	smp_mb();
+
+	return atomic_read(&qcb->nwaiters) != 0;
+}
+
+static int wake_receivers(RT_QUEUE *queue)
+{
+	struct alchemy_queue *qcb;
+	struct syncstate syns;
+	int ret = 0;
+
+	qcb = get_alchemy_queue(queue, &syns, &ret);
+	if (qcb == NULL)
+		return 0;
+
+	ret = grant_waiters(qcb);
+	put_alchemy_queue(qcb, &syns);
+
+	return ret;
+}
+
 /**
  * @fn int rt_queue_create(RT_QUEUE *q, const char *name, size_t poolsize, size_t qlimit, int mode)
  * @brief Create a message queue.
@@ -241,10 +534,19 @@ int rt_queue_create(RT_QUEUE *queue, const char *name,
 	if (ret)
 		goto fail_bufalloc;
 
+	ret = init_ring(qcb, qlimit);
+	if (ret)
+		goto fail_ringalloc;
+
 	qcb->mode = mode;
 	qcb->limit = qlimit;
 	list_init(&qcb->mq);
-	qcb->mcount = 0;
+	list_init(&qcb->oq);
+	atomic_set(&qcb->mcount, 0);
+	atomic_set(&qcb->nurgent, 0);
+	atomic_set(&qcb->noverflow, 0);
+	atomic_set(&qcb->nwaiters, 0);
+	atomic_set(&qcb->nbusy, 0);
 
 	if (mode & Q_PRIO)
 		sobj_flags = SYNCOBJ_PRIO;
@@ -254,6 +556,8 @@ int rt_queue_create(RT_QUEUE *queue, const char *name,
 	if (ret)
 		goto fail_syncinit;
 
+	syncobj_set_name(&qcb->sobj, qcb->name);
+
 	qcb->magic = queue_magic;
 
 	registry_init_file_obstack(&qcb->fsobj, &registry_ops);
@@ -278,6 +582,8 @@ fail_register:
 	registry_destroy_file(&qcb->fsobj);
 	syncobj_uninit(&qcb->sobj);
 fail_syncinit:
+	xnfree(__mptr(qcb->ring.cells));
+fail_ringalloc:
 	heapobj_destroy(&qcb->hobj);
 fail_bufalloc:
 	xnfree(qcb);
@@ -517,17 +823,45 @@ int rt_queue_send(RT_QUEUE *queue,
 
 	CANCEL_DEFER(svc);
 
+	/*
+	 * Fast path: normal message, nobody waiting and no overflow,
+	 * the sender owns the message until it is pushed to the ring.
+	 */
+	if (mode == 0) {
+		qcb = find_alchemy_queue(queue, &ret);
+		if (qcb == NULL)
+			goto out;
+		if (queue_enter(qcb)) {
+			if (msg->refcount == 1 &&
+			    atomic_read(&qcb->nwaiters) == 0 &&
+			    atomic_read(&qcb->noverflow) == 0) {
+				msg->refcount = 0;
+				msg->size = size;
+				ret = fast_send(qcb, msg);
+				if (ret < 0)
+					msg->refcount = 1;
+			} else
+				ret = -EAGAIN;
+			queue_leave(qcb);
+			if (ret > 0)
+				ret = wake_receivers(queue);
+			if (ret != -EAGAIN)
+				goto out;
+			ret = 0;
+		}
+	}
+
 	qcb = get_alchemy_queue(queue, &syns, &ret);
 	if (qcb == NULL)
 		goto out;
 
-	if (qcb->limit && qcb->mcount >= qcb->limit) {
-		ret = -ENOMEM;
+	if (msg->refcount == 0) {
+		ret = -EINVAL;
 		goto done;
 	}
 
-	if (msg->refcount == 0) {
-		ret = -EINVAL;
+	if ((mode & Q_BROADCAST) == 0 && reserve_slot(qcb)) {
+		ret = -ENOMEM;
 		goto done;
 	}
 
@@ -545,8 +879,11 @@ int rt_queue_send(RT_QUEUE *queue,
 		ret++;
 	} while (mode & Q_BROADCAST);
 
-	if (ret)
+	if (ret) {
+		if ((mode & Q_BROADCAST) == 0)
+			atomic_sub_fetch(&qcb->mcount, 1);
 		goto done;
+	}
 	/*
 	 * We need to queue the message if no task was waiting for it,
 	 * except in broadcast mode, in which case we only fix up the
@@ -554,13 +891,8 @@ int rt_queue_send(RT_QUEUE *queue,
 	 */
 	if (mode & Q_BROADCAST)
 		msg->refcount++;
-	else {
-		qcb->mcount++;
-		if (mode & Q_URGENT)
-			list_prepend(&msg->next, &qcb->mq);
-		else
-			list_append(&msg->next, &qcb->mq);
-	}
+	else
+		queue_message(qcb, msg, mode);
 done:
 	put_alchemy_queue(qcb, &syns);
 out:
@@ -635,6 +967,36 @@ int rt_queue_write(RT_QUEUE *queue,
 
 	CANCEL_DEFER(svc);
 
+	if (mode == 0) {
+		qcb = find_alchemy_queue(queue, &ret);
+		if (qcb == NULL)
+			goto out;
+		if (queue_enter(qcb)) {
+			ret = -EAGAIN;
+			if (atomic_read(&qcb->nwaiters) == 0 &&
+			    atomic_read(&qcb->noverflow) == 0) {
+				msg = heapobj_alloc(&qcb->hobj,
+						    size + sizeof(*msg));
+				if (msg) {
+					msg->size = size;
+					msg->refcount = 0;
+					if (size > 0)
+						memcpy(msg + 1, buf, size);
+					ret = fast_send(qcb, msg);
+					if (ret < 0)
+						heapobj_free(&qcb->hobj, msg);
+				} else
+					ret = -ENOMEM;
+			}
+			queue_leave(qcb);
+			if (ret > 0)
+				ret = wake_receivers(queue);
+			if (ret != -EAGAIN)
+				goto out;
+			ret = 0;
+		}
+	}
+
 	qcb = get_alchemy_queue(queue, &syns, &ret);
 	if (qcb == NULL)
 		goto out;
@@ -671,12 +1033,15 @@ enqueue:
 		goto done;
 
 	ret = -ENOMEM;
-	if (qcb->limit && qcb->mcount >= qcb->limit)
+	if (nwaiters == 0 && reserve_slot(qcb))
 		goto done;
 
 	msg = heapobj_alloc(&qcb->hobj, size + sizeof(*msg));
-	if (msg == NULL)
+	if (msg == NULL) {
+		if (nwaiters == 0)
+			atomic_sub_fetch(&qcb->mcount, 1);
 		goto done;
+	}
 
 	msg->size = size;
 	msg->refcount = 0;
@@ -685,11 +1050,7 @@ enqueue:
 
 	ret = 0;  /* # of tasks unblocked. */
 	if (nwaiters == 0) {
-		qcb->mcount++;
-		if (mode & Q_URGENT)
-			list_prepend(&msg->next, &qcb->mq);
-		else
-			list_append(&msg->next, &qcb->mq);
+		queue_message(qcb, msg, mode);
 		goto done;
 	}
 
@@ -810,20 +1171,38 @@ ssize_t rt_queue_receive_timed(RT_QUEUE *queue, void **bufp,
 
 	CANCEL_DEFER(svc);
 
+	/* Fast path: pull the next normal message from the ring. */
+	qcb = find_alchemy_queue(queue, &err);
+	if (qcb == NULL) {
+		ret = err;
+		goto out;
+	}
+
+	if (queue_enter(qcb)) {
+		msg = fast_dequeue(qcb);
+		if (msg) {
+			msg->refcount++;
+			*bufp = msg + 1;
+			ret = (ssize_t)msg->size;
+		}
+		queue_leave(qcb);
+		if (msg)
+			goto out;
+	}
+
 	qcb = get_alchemy_queue(queue, &syns, &err);
 	if (qcb == NULL) {
 		ret = err;
 		goto out;
 	}
 
-	if (list_empty(&qcb->mq))
+	msg = dequeue_message(qcb);
+	if (msg == NULL)
 		goto wait;
-
-	msg = list_pop_entry(&qcb->mq, struct alchemy_queue_msg, next);
+transfer:
 	msg->refcount++;
 	*bufp = msg + 1;
 	ret = (ssize_t)msg->size;
-	qcb->mcount--;
 	goto done;
 wait:
 	if (alchemy_poll_mode(abs_timeout)) {
@@ -831,6 +1210,18 @@ wait:
 		goto done;
 	}
 
+	/*
+	 * Tell lockless senders to take the slow path for waking us
+	 * up, then check the ring again for a message which might
+	 * have been pushed concurrently.
+	 */
+	atomic_add_fetch(&qcb->nwaiters, 1);
+	msg = dequeue_message(qcb);
+	if (msg) {
+		atomic_sub_fetch(&qcb->nwaiters, 1);
+		goto transfer;
+	}
+
 	wait = threadobj_prepare_wait(struct alchemy_queue_wait);
 	wait->local_bufsz = 0;
 
@@ -840,7 +1231,9 @@ wait:
 			threadobj_finish_wait();
 			goto out;
 		}
+		atomic_sub_fetch(&qcb->nwaiters, 1);
 	} else {
+		atomic_sub_fetch(&qcb->nwaiters, 1);
 		msg = __mptr(wait->msg);
 		*bufp = msg + 1;
 		ret = (ssize_t)msg->size;
@@ -970,30 +1363,54 @@ ssize_t rt_queue_read_timed(RT_QUEUE *queue,
 
 	CANCEL_DEFER(svc);
 
-	qcb = get_alchemy_queue(queue, &syns, &err);
+	qcb = find_alchemy_queue(queue, &err);
 	if (qcb == NULL) {
 		ret = err;
 		goto out;
 	}
 
-	if (list_empty(&qcb->mq))
-		goto wait;
+	if (queue_enter(qcb)) {
+		msg = fast_dequeue(qcb);
+		if (msg) {
+			ret = (ssize_t)(msg->size > size ? size : msg->size);
+			if (ret > 0)
+				memcpy(buf, msg + 1, ret);
+			heapobj_free(&qcb->hobj, msg);
+		}
+		queue_leave(qcb);
+		if (msg)
+			goto out;
+	}
 
-	msg = list_pop_entry(&qcb->mq, struct alchemy_queue_msg, next);
-	qcb->mcount--;
-	goto transfer;
-wait:
+	qcb = get_alchemy_queue(queue, &syns, &err);
+	if (qcb == NULL) {
+		ret = err;
+		goto out;
+	}
+
+	msg = dequeue_message(qcb);
+	if (msg)
+		goto transfer;
 	if (alchemy_poll_mode(abs_timeout)) {
 		ret = -EWOULDBLOCK;
 		goto done;
 	}
 
+	atomic_add_fetch(&qcb->nwaiters, 1);
+	msg = dequeue_message(qcb);
+	if (msg) {
+		atomic_sub_fetch(&qcb->nwaiters, 1);
+		goto transfer;
+	}
+
 	wait = threadobj_prepare_wait(struct alchemy_queue_wait);
 	wait->local_buf = buf;
 	wait->local_bufsz = size;
 	wait->msg = __moff_nullable(NULL);
 
 	ret = syncobj_wait_grant(&qcb->sobj, abs_timeout, &syns);
+	if (ret != -EIDRM)
+		atomic_sub_fetch(&qcb->nwaiters, 1);
 	if (ret) {
 		if (ret == -EIDRM) {
 			threadobj_finish_wait();
@@ -1035,7 +1452,7 @@ out:
  */
 int rt_queue_flush(RT_QUEUE *queue)
 {
-	struct alchemy_queue_msg *msg, *tmp;
+	struct alchemy_queue_msg *msg;
 	struct alchemy_queue *qcb;
 	struct syncstate syns;
 	struct service svc;
@@ -1047,20 +1464,16 @@ int rt_queue_flush(RT_QUEUE *queue)
 	if (qcb == NULL)
 		goto out;
 
-	ret = qcb->mcount;
-	qcb->mcount = 0;
-
 	/*
 	 * Flushing a message queue is not an operation we should see
 	 * in any fast path within an application, so locking out
 	 * other threads from using that queue while we flush it is
-	 * acceptable.
+	 * acceptable. Lockless receivers may still pull messages from
+	 * the ring concurrently, we only count those we drop.
 	 */
-	if (!list_empty(&qcb->mq)) {
-		list_for_each_entry_safe(msg, tmp, &qcb->mq, next) {
-			list_remove(&msg->next);
-			heapobj_free(&qcb->hobj, msg);
-		}
+	while ((msg = dequeue_message(qcb)) != NULL) {
+		heapobj_free(&qcb->hobj, msg);
+		ret++;
 	}
 
 	put_alchemy_queue(qcb, &syns);
@@ -1103,7 +1516,7 @@ int rt_queue_inquire(RT_QUEUE *queue, RT_QUEUE_INFO *info)
 		goto out;
 
 	info->nwaiters = syncobj_count_grant(&qcb->sobj);
-	info->nmessages = qcb->mcount;
+	info->nmessages = atomic_read(&qcb->mcount);
 	info->mode = qcb->mode;
 	info->qlimit = qcb->limit;
 	info->poolsize = heapobj_size(&qcb->hobj);
@@ -20,12 +20,18 @@
 #define _ALCHEMY_QUEUE_H
 
 #include <boilerplate/list.h>
+#include <boilerplate/atomic.h>
 #include <copperplate/syncobj.h>
 #include <copperplate/registry.h>
 #include <copperplate/cluster.h>
 #include <copperplate/heapobj.h>
 #include <alchemy/queue.h>
 
+struct alchemy_queue_cell {
+	unsigned long seq;
+	dref_type(struct alchemy_queue_msg *) msg;
+};
+
 struct alchemy_queue {
 	unsigned int magic;	/* Must be first. */
 	char name[XNOBJECT_NAME_LEN];
@@ -34,8 +40,19 @@ struct alchemy_queue {
 	struct heapobj hobj;
 	struct syncobj sobj;
 	struct clusterobj cobj;
-	struct listobj mq;
-	unsigned int mcount;
+	struct listobj mq;	/* Urgent messages. */
+	struct listobj oq;	/* Ring overflow. */
+	atomic_t mcount;
+	atomic_t nurgent;
+	atomic_t noverflow;
+	atomic_t nwaiters;
+	atomic_t nbusy;		/* Lockless callers in flight. */
+	struct {
+		unsigned long head;
+		unsigned long tail;
+		unsigned long mask;
+		dref_type(struct alchemy_queue_cell *) cells;
+	} ring;
 	struct fsobj fsobj;
 };
 
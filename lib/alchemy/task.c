@@ -76,6 +76,8 @@ static int task_registry_open(struct fsobj *fsobj, void *priv)
 
 	fsobstack_init(o);
 
+	fsobstack_grow_syncobj_stats(o, &tcb->sobj_msg);
+
 	fsobstack_finish(o);
 
 	return 0;
@@ -275,6 +277,8 @@ static int create_tcb(struct alchemy_task **tcbp, RT_TASK *task,
 	if (ret)
 		goto fail_syncinit;
 
+	syncobj_set_name(&tcb->sobj_msg, tcb->name);
+
 	tcb->suspends = 0;
 	tcb->flowgen = 0;
 
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <boilerplate/setup.h>
+#include <copperplate/traceobj.h>
+#include <copperplate/heapobj.h>
+#include <alchemy/task.h>
+
+/*
+ * Allocation benchmark: several processes sharing the session heap,
+ * plus several tasks within the parent process, allocate and release
+ * blocks of various sizes concurrently. The contents of every block
+ * is checked before release, so that a block handed out twice is
+ * detected. Beforehand, a process exits while one of its threads
+ * still holds cached blocks, which must return to the session heap.
+ */
+
+#define NPROCS   4
+#define NTASKS   4
+#define NLOOPS   20000
+#define NBLOCKS  64
+
+static struct traceobj trobj;
+
+static RT_TASK t_alloc[NTASKS];
+
+static const size_t sizes[] = {
+	16, 24, 48, 64, 100, 128, 200, 256, 600, 1500
+};
+
+static int check_block(const unsigned char *p, size_t len, unsigned char tag)
+{
+	size_t n;
+
+	for (n = 0; n < len; n++)
+		if (p[n] != tag)
+			return 0;
+
+	return 1;
+}
+
+static int alloc_loop(unsigned int seed)
+{
+	unsigned char *blocks[NBLOCKS], tags[NBLOCKS];
+	size_t lens[NBLOCKS];
+	int n, i, ret = 0;
+
+	memset(blocks, 0, sizeof(blocks));
+
+	for (n = 0; n < NLOOPS; n++) {
+		i = rand_r(&seed) % NBLOCKS;
+		if (blocks[i]) {
+			if (!check_block(blocks[i], lens[i], tags[i]))
+				ret = -EINVAL;
+			xnfree(blocks[i]);
+		}
+		lens[i] = sizes[rand_r(&seed) % (sizeof(sizes) / sizeof(sizes[0]))];
+		blocks[i] = xnmalloc(lens[i]);
+		if (blocks[i] == NULL) {
+			ret = -ENOMEM;
+			break;
+		}
+		tags[i] = rand_r(&seed);
+		memset(blocks[i], tags[i], lens[i]);
+	}
+
+	for (i = 0; i < NBLOCKS; i++) {
+		if (blocks[i] == NULL)
+			continue;
+		if (!check_block(blocks[i], lens[i], tags[i]))
+			ret = -EINVAL;
+		xnfree(blocks[i]);
+	}
+
+	return ret;
+}
+
+static volatile int loaded;
+
+static void *load_cache(void *arg)
+{
+	alloc_loop(1);
+	loaded = 1;
+
+	for (;;)
+		pause();
+
+	return NULL;
+}
+
+static int exit_loaded(void)
+{
+	pthread_t tid;
+
+	if (pthread_create(&tid, NULL, load_cache, NULL))
+		return EXIT_FAILURE;
+
+	while (!loaded)
+		usleep(1000);
+
+	/* Exit while our thread's cache is not empty. */
+	return EXIT_SUCCESS;
+}
+
+static void alloc_task(void *arg)
+{
+	int ret;
+
+	traceobj_enter(&trobj);
+
+	ret = alloc_loop((unsigned int)(long)arg);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	struct timespec start, end;
+	struct heapobj_stats stats;
+	pid_t pids[NPROCS];
+	int ret, n, status;
+	double elapsed;
+	size_t used;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	heapobj_inquire_stats(NULL, &stats);
+	used = stats.used;
+
+	pids[0] = fork();
+	traceobj_assert(&trobj, pids[0] >= 0);
+	if (pids[0] == 0)
+		exit(exit_loaded());
+
+	ret = waitpid(pids[0], &status, 0);
+	traceobj_assert(&trobj, ret == pids[0]);
+	traceobj_assert(&trobj, WIFEXITED(status) &&
+			WEXITSTATUS(status) == EXIT_SUCCESS);
+
+	heapobj_inquire_stats(NULL, &stats);
+	traceobj_assert(&trobj, stats.used == used);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < NPROCS; n++) {
+		pids[n] = fork();
+		traceobj_assert(&trobj, pids[n] >= 0);
+		if (pids[n] == 0)
+			exit(alloc_loop(n + 1) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	for (n = 0; n < NTASKS; n++) {
+		ret = rt_task_create(t_alloc + n, NULL, 0,  10, 0);
+		traceobj_check(&trobj, ret, 0);
+		ret = rt_task_start(t_alloc + n, alloc_task,
+				    (void *)(long)(NPROCS + n + 1));
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	traceobj_join(&trobj);
+
+	for (n = 0; n < NPROCS; n++) {
+		ret = waitpid(pids[n], &status, 0);
+		traceobj_assert(&trobj, ret == pids[n]);
+		traceobj_assert(&trobj, WIFEXITED(status) &&
+				WEXITSTATUS(status) == EXIT_SUCCESS);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	heapobj_inquire_stats(NULL, &stats);
+
+	if (__base_setup_data.verbosity_level > 0) {
+		elapsed = (end.tv_sec - start.tv_sec) * 1e9 +
+			(end.tv_nsec - start.tv_nsec);
+		printf("%d processes, %d tasks: %.0f alloc+free/s\n",
+		       NPROCS, NTASKS,
+		       (double)(NPROCS + NTASKS) * NLOOPS * 1e9 / elapsed);
+		printf("heap: %zu/%zu bytes used, %lu locks (%lu contended),"
+		       " %lu cache hits, %lu refills, %lu flushes\n",
+		       stats.used, stats.total,
+		       stats.lock_count, stats.lock_contended,
+		       stats.cache_hits, stats.cache_refills,
+		       stats.cache_flushes);
+	}
+
+	exit(0);
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <boilerplate/setup.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/buffer.h>
+
+/*
+ * Stream large frames through a buffer, first by copy with
+ * rt_buffer_write/read(), then in place with the reserve/commit
+ * and peek/consume services. The buffer size is not a multiple of
+ * the frame size, so that frames wrap at the end of the buffer
+ * memory.
+ */
+
+#define FRAMESZ   65536
+#define BUFSZ     (FRAMESZ * 3 + 4000)
+#define NFRAMES   2000
+
+static struct traceobj trobj;
+
+static RT_TASK t_prod, t_cons;
+
+static RT_BUFFER buffer;
+
+static char frame[FRAMESZ], rxframe[FRAMESZ];
+
+static void fill_span(RT_BUFFER_SPAN *span, int n)
+{
+	memset(span->ptr[0], n & 0xff, span->len[0]);
+	memset(span->ptr[1], n & 0xff, span->len[1]);
+}
+
+static int check_span(RT_BUFFER_SPAN *span, int n)
+{
+	char *p0 = span->ptr[0], *p1 = span->ptr[1];
+
+	if (p0[0] != (char)n || p0[span->len[0] - 1] != (char)n)
+		return 0;
+
+	return span->len[1] == 0 ||
+		(p1[0] == (char)n && p1[span->len[1] - 1] == (char)n);
+}
+
+static void producer_task(void *arg)
+{
+	int zerocopy = (long)arg, n;
+	RT_BUFFER_SPAN span;
+	ssize_t ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < NFRAMES; n++) {
+		if (zerocopy) {
+			ret = rt_buffer_reserve(&buffer, &span, FRAMESZ, TM_INFINITE);
+			traceobj_assert(&trobj, ret == FRAMESZ);
+			traceobj_assert(&trobj, span.len[0] + span.len[1] == FRAMESZ);
+			fill_span(&span, n);
+			ret = rt_buffer_commit(&buffer, FRAMESZ);
+			traceobj_check(&trobj, ret, 0);
+		} else {
+			memset(frame, n & 0xff, FRAMESZ);
+			ret = rt_buffer_write(&buffer, frame, FRAMESZ, TM_INFINITE);
+			traceobj_assert(&trobj, ret == FRAMESZ);
+		}
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static void consumer_task(void *arg)
+{
+	int zerocopy = (long)arg, n;
+	RT_BUFFER_SPAN span;
+	ssize_t ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < NFRAMES; n++) {
+		if (zerocopy) {
+			ret = rt_buffer_peek(&buffer, &span, FRAMESZ, TM_INFINITE);
+			traceobj_assert(&trobj, ret == FRAMESZ);
+			traceobj_assert(&trobj, check_span(&span, n));
+			ret = rt_buffer_consume(&buffer, FRAMESZ);
+			traceobj_check(&trobj, ret, 0);
+		} else {
+			ret = rt_buffer_read(&buffer, rxframe, FRAMESZ, TM_INFINITE);
+			traceobj_assert(&trobj, ret == FRAMESZ);
+			traceobj_assert(&trobj, rxframe[0] == (char)n &&
+					rxframe[FRAMESZ - 1] == (char)n);
+		}
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static void run_frames(int zerocopy)
+{
+	struct timespec start, end;
+	double elapsed;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* We run this twice, do not reuse names. */
+	ret = rt_task_create(&t_cons, NULL, 0, 11, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_create(&t_prod, NULL, 0, 10, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_start(&t_cons, consumer_task, (void *)(long)zerocopy);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_start(&t_prod, producer_task, (void *)(long)zerocopy);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_join(&t_prod);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_join(&t_cons);
+	traceobj_check(&trobj, ret, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (__base_setup_data.verbosity_level > 0) {
+		elapsed = (end.tv_sec - start.tv_sec) * 1e9 +
+			(end.tv_nsec - start.tv_nsec);
+		printf("%-9s: %.1f MB/s\n", zerocopy ? "zero-copy" : "copy",
+		       (double)NFRAMES * FRAMESZ * 1e3 / elapsed);
+	}
+}
+
+int main(int argc, char *const argv[])
+{
+	RT_BUFFER_SPAN span;
+	ssize_t ret;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = rt_buffer_create(&buffer, "BUFFER", BUFSZ, B_FIFO);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Single pending reservation, committing checks its length. */
+	ret = rt_buffer_reserve(&buffer, &span, 16, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == 16);
+	ret = rt_buffer_reserve(&buffer, &span, 16, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == -EWOULDBLOCK);
+	ret = rt_buffer_write(&buffer, "X", 1, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == -EWOULDBLOCK);
+	ret = rt_buffer_commit(&buffer, 17);
+	traceobj_check(&trobj, ret, -EINVAL);
+	ret = rt_buffer_commit(&buffer, 0);
+	traceobj_check(&trobj, ret, 0);
+	ret = rt_buffer_commit(&buffer, 0);
+	traceobj_check(&trobj, ret, -EINVAL);
+	ret = rt_buffer_peek(&buffer, &span, 1, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == -EWOULDBLOCK);
+
+	run_frames(0);
+	run_frames(1);
+
+	ret = rt_buffer_delete(&buffer);
+	traceobj_check(&trobj, ret, 0);
+
+	exit(0);
+}
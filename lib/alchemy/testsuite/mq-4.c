@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <boilerplate/setup.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/queue.h>
+
+/*
+ * Queue throughput with a single producer then several producers
+ * sending to a single consumer, through the lock-free ring and its
+ * overflow path. Each producer tags its messages with a sequence
+ * number, which the consumer checks for FIFO ordering. Then a task
+ * keeps going through the lockless paths while the queue it uses is
+ * deleted.
+ */
+
+#define NPRODUCERS  4
+#define NMESSAGES   200000
+#define QLIMIT      64
+#define POOLSZ      (256 * 1024)
+
+static struct traceobj trobj;
+
+static RT_TASK t_prod[NPRODUCERS], t_cons, t_churn;
+
+static RT_QUEUE q, ql, qd;
+
+struct message {
+	int producer;
+	int seq;
+};
+
+static void producer_task(void *arg)
+{
+	struct message *m;
+	int n, ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < NMESSAGES; n++) {
+		/* Alternate zero-copy and copy modes. */
+		if (n & 1) {
+			while ((m = rt_queue_alloc(&q, sizeof(*m))) == NULL)
+				rt_task_yield();
+			m->producer = (long)arg;
+			m->seq = n;
+			while ((ret = rt_queue_send(&q, m, sizeof(*m), Q_NORMAL)) == -ENOMEM)
+				rt_task_yield();
+		} else {
+			struct message msg = { .producer = (long)arg, .seq = n };
+			while ((ret = rt_queue_write(&q, &msg, sizeof(msg), Q_NORMAL)) == -ENOMEM)
+				rt_task_yield();
+		}
+		traceobj_assert(&trobj, ret >= 0);
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static void consumer_task(void *arg)
+{
+	int nprod = (long)arg, next[NPRODUCERS] = { 0 }, n;
+	struct message msg, *m;
+	ssize_t ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < nprod * NMESSAGES; n++) {
+		if (n & 1) {
+			ret = rt_queue_receive(&q, (void **)&m, TM_INFINITE);
+			traceobj_assert(&trobj, ret == sizeof(*m));
+			msg = *m;
+			ret = rt_queue_free(&q, m);
+			traceobj_check(&trobj, ret, 0);
+		} else {
+			ret = rt_queue_read(&q, &msg, sizeof(msg), TM_INFINITE);
+			traceobj_assert(&trobj, ret == sizeof(msg));
+		}
+		traceobj_assert(&trobj, msg.producer >= 0 && msg.producer < nprod);
+		traceobj_assert(&trobj, msg.seq == next[msg.producer]);
+		next[msg.producer]++;
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static void churn_task(void *arg)
+{
+	int n, msg;
+	ssize_t ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 1;; n++) {
+		ret = rt_queue_write(&qd, &n, sizeof(n), Q_NORMAL);
+		if (ret == -EINVAL)
+			break;
+		traceobj_assert(&trobj, ret == 0 || ret == -ENOMEM);
+		ret = rt_queue_read(&qd, &msg, sizeof(msg), TM_NONBLOCK);
+		if (ret == -EINVAL)
+			break;
+		traceobj_assert(&trobj, ret == sizeof(msg) ||
+				ret == -EWOULDBLOCK);
+		if ((n % 64) == 0)
+			rt_task_yield();
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static void run_producers(int nprod)
+{
+	struct timespec start, end;
+	double elapsed;
+	long n;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* We run this twice, do not reuse names. */
+	ret = rt_task_create(&t_cons, NULL, 0, 10, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+	ret = rt_task_start(&t_cons, consumer_task, (void *)(long)nprod);
+	traceobj_check(&trobj, ret, 0);
+
+	for (n = 0; n < nprod; n++) {
+		ret = rt_task_create(t_prod + n, NULL, 0, 10, T_JOINABLE);
+		traceobj_check(&trobj, ret, 0);
+		ret = rt_task_start(t_prod + n, producer_task, (void *)n);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	for (n = 0; n < nprod; n++) {
+		ret = rt_task_join(t_prod + n);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	ret = rt_task_join(&t_cons);
+	traceobj_check(&trobj, ret, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (__base_setup_data.verbosity_level > 0) {
+		elapsed = (end.tv_sec - start.tv_sec) * 1e9 +
+			(end.tv_nsec - start.tv_nsec);
+		printf("%d producer(s): %.0f msgs/s\n", nprod,
+		       (double)nprod * NMESSAGES * 1e9 / elapsed);
+	}
+}
+
+int main(int argc, char *const argv[])
+{
+	RT_QUEUE_INFO info;
+	int ret, msg, n;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = rt_queue_create(&q, "QUEUE", POOLSZ, Q_UNLIMITED, Q_FIFO);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_queue_create(&ql, "LIMITED", POOLSZ, QLIMIT, Q_FIFO);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Urgent messages still jump ahead of normal ones. */
+	for (msg = 0; msg < 3; msg++) {
+		ret = rt_queue_write(&q, &msg, sizeof(msg), Q_NORMAL);
+		traceobj_check(&trobj, ret, 0);
+	}
+	ret = rt_queue_write(&q, &msg, sizeof(msg), Q_URGENT);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.nmessages == 4);
+
+	ret = rt_queue_read(&q, &msg, sizeof(msg), TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == sizeof(msg) && msg == 3);
+	for (n = 0; n < 3; n++) {
+		ret = rt_queue_read(&q, &msg, sizeof(msg), TM_NONBLOCK);
+		traceobj_assert(&trobj, ret == sizeof(msg) && msg == n);
+	}
+	ret = rt_queue_read(&q, &msg, sizeof(msg), TM_NONBLOCK);
+	traceobj_check(&trobj, ret, -EWOULDBLOCK);
+
+	/* The limit still applies to messages going through the ring. */
+	for (n = 0; n < QLIMIT; n++) {
+		ret = rt_queue_write(&ql, &n, sizeof(n), Q_NORMAL);
+		traceobj_check(&trobj, ret, 0);
+	}
+	ret = rt_queue_write(&ql, &n, sizeof(n), Q_NORMAL);
+	traceobj_check(&trobj, ret, -ENOMEM);
+	ret = rt_queue_write(&ql, &n, sizeof(n), Q_URGENT);
+	traceobj_check(&trobj, ret, -ENOMEM);
+	ret = rt_queue_flush(&ql);
+	traceobj_check(&trobj, ret, QLIMIT);
+	ret = rt_queue_delete(&ql);
+	traceobj_check(&trobj, ret, 0);
+
+	run_producers(1);
+	run_producers(NPRODUCERS);
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.nmessages == 0);
+
+	ret = rt_queue_delete(&q);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_queue_create(&qd, "DELQ", POOLSZ, QLIMIT, Q_FIFO);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_create(&t_churn, NULL, 0, 10, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+	ret = rt_task_start(&t_churn, churn_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Preempt the churning task anywhere, lockless paths included. */
+	ret = rt_task_shadow(NULL, "main_task", 20, 0);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_sleep(10000000ULL);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_queue_delete(&qd);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_join(&t_churn);
+	traceobj_check(&trobj, ret, 0);
+
+	exit(0);
+}
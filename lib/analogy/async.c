@@ -159,6 +159,44 @@ int a4l_get_wakesize(a4l_desc_t * dsc, unsigned long *size)
 	return err;
 }
 
+/**
+ * @brief Set the wake-up watermarks of the asynchronous buffer
+ *
+ * A process waiting for data through a4l_poll() (or any service
+ * relying on it) is only awakened once @a size bytes are available
+ * in the buffer, or the acquisition is over. If @a us_timeout is not
+ * null, the waiter is also released once this delay has elapsed
+ * with less than @a size bytes pending, which bounds the latency on
+ * slow acquisitions.
+ *
+ * @param[in] dsc Device descriptor filled by a4l_open() (and
+ * optionally a4l_fill_desc())
+ * @param[in] size Wake-up threshold, in bytes
+ * @param[in] us_timeout Wake-up delay, in microseconds
+ *
+ * @return 0 on success. Otherwise:
+ *
+ * - -EINVAL is returned if some argument is missing or wrong, the
+ *    threshold cannot be higher than the buffer size (Please, type
+ *    "dmesg" for more info)
+ * - -EFAULT is returned if a user <-> kernel transfer went wrong
+ *
+ */
+int a4l_set_watermark(a4l_desc_t * dsc,
+		      unsigned long size, unsigned long us_timeout)
+{
+	a4l_bufcfg2_t cfg = {
+		.wake_count = size,
+		.wake_timeout = us_timeout,
+	};
+
+	/* Basic checking */
+	if (dsc == NULL || dsc->fd < 0)
+		return -EINVAL;
+
+	return __sys_ioctl(dsc->fd, A4L_BUFCFG2, &cfg);
+}
+
 /**
  * @brief Get the size of the asynchronous buffer
  *
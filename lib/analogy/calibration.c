@@ -29,6 +29,7 @@
 #include "iniparser/iniparser.h"
 #include "boilerplate/list.h"
 #include "calibration.h"
+#include "internal.h"
 
 #define CHK(func, ...)								\
 do {										\
@@ -378,6 +379,12 @@ int a4l_rawtodcal(a4l_chinfo_t *chan, double *dst, void *src,
 		return -EINVAL;
 	};
 
+	/* 16-bit samples are converted by vector instructions */
+	if (size == 2 && cnt > 0) {
+		__a4l_get_convert_ops()->u16todcal(dst, src, cnt, converter);
+		return cnt;
+	}
+
 	while (j < cnt) {
 		/* Properly retrieve the data */
 		tmp = datax_get(src + i);
@@ -387,7 +394,7 @@ int a4l_rawtodcal(a4l_chinfo_t *chan, double *dst, void *src,
 		term = 1.0;
 		for (k = 0; k < converter->nb_coeff; k++) {
 			dst[j] += converter->coeff[k] * term;
-			term *= tmp - converter->expansion;
+			term *= (double)tmp - converter->expansion;
 		}
 
 		/* Update the counters */
@@ -0,0 +1,412 @@
+/**
+ * @file
+ * Analogy for Linux, vectorized conversion of raw samples
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <rtdm/analogy.h>
+#include "internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_CONVERT_X86
+#endif
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+#define HAVE_CONVERT_NEON
+#endif
+
+/*
+ * All implementations must produce the very same results than the
+ * scalar one, lane by lane: each sample goes through the same
+ * sequence of IEEE-754 operations, no fused multiply-add is ever
+ * used (libanalogy is built with -ffp-contract=off for the same
+ * reason). Vector loops only handle whole vectors, the remaining
+ * samples are converted by the scalar code.
+ */
+
+#ifndef DOXYGEN_CPP
+
+static void u16tof_scalar(float *dst, const sampl_t *src,
+			  int cnt, float a, float b)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		dst[i] = a * src[i] + b;
+}
+
+static void u16tod_scalar(double *dst, const sampl_t *src,
+			  int cnt, double a, double b)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		dst[i] = a * src[i] + b;
+}
+
+static void u16todcal_scalar(double *dst, const sampl_t *src,
+			     int cnt, struct a4l_polynomial *p)
+{
+	double term, val;
+	int i, k;
+
+	for (i = 0; i < cnt; i++) {
+		val = 0.0;
+		term = 1.0;
+		for (k = 0; k < p->nb_coeff; k++) {
+			val += p->coeff[k] * term;
+			term *= (double)src[i] - p->expansion;
+		}
+		dst[i] = val;
+	}
+}
+
+static const struct a4l_convert_ops convert_scalar = {
+	.isa = A4L_CONVERT_SCALAR,
+	.u16tof = u16tof_scalar,
+	.u16tod = u16tod_scalar,
+	.u16todcal = u16todcal_scalar,
+};
+
+#ifdef HAVE_CONVERT_X86
+
+__attribute__((target("sse2")))
+static void u16tof_sse2(float *dst, const sampl_t *src,
+			int cnt, float a, float b)
+{
+	__m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), lo, hi;
+	__m128i zero = _mm_setzero_si128(), raw;
+	int i;
+
+	for (i = 0; i + 8 <= cnt; i += 8) {
+		raw = _mm_loadu_si128((const __m128i *)(src + i));
+		lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, zero));
+		hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(raw, zero));
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(va, lo), vb));
+		_mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_mul_ps(va, hi), vb));
+	}
+
+	u16tof_scalar(dst + i, src + i, cnt - i, a, b);
+}
+
+__attribute__((target("sse2")))
+static void u16tod_sse2(double *dst, const sampl_t *src,
+			int cnt, double a, double b)
+{
+	__m128d va = _mm_set1_pd(a), vb = _mm_set1_pd(b), lo, hi;
+	__m128i zero = _mm_setzero_si128(), raw;
+	int i;
+
+	for (i = 0; i + 4 <= cnt; i += 4) {
+		raw = _mm_loadl_epi64((const __m128i *)(src + i));
+		raw = _mm_unpacklo_epi16(raw, zero);
+		lo = _mm_cvtepi32_pd(raw);
+		hi = _mm_cvtepi32_pd(_mm_srli_si128(raw, 8));
+		_mm_storeu_pd(dst + i, _mm_add_pd(_mm_mul_pd(va, lo), vb));
+		_mm_storeu_pd(dst + i + 2, _mm_add_pd(_mm_mul_pd(va, hi), vb));
+	}
+
+	u16tod_scalar(dst + i, src + i, cnt - i, a, b);
+}
+
+__attribute__((target("sse2")))
+static void u16todcal_sse2(double *dst, const sampl_t *src,
+			   int cnt, struct a4l_polynomial *p)
+{
+	__m128d exp = _mm_set1_pd(p->expansion), x, val, term, coeff;
+	__m128i zero = _mm_setzero_si128(), raw;
+	int i, k, pair;
+
+	for (i = 0; i + 2 <= cnt; i += 2) {
+		memcpy(&pair, src + i, sizeof(pair));
+		raw = _mm_cvtsi32_si128(pair);
+		x = _mm_cvtepi32_pd(_mm_unpacklo_epi16(raw, zero));
+		x = _mm_sub_pd(x, exp);
+		val = _mm_setzero_pd();
+		term = _mm_set1_pd(1.0);
+		for (k = 0; k < p->nb_coeff; k++) {
+			coeff = _mm_set1_pd(p->coeff[k]);
+			val = _mm_add_pd(val, _mm_mul_pd(coeff, term));
+			term = _mm_mul_pd(term, x);
+		}
+		_mm_storeu_pd(dst + i, val);
+	}
+
+	u16todcal_scalar(dst + i, src + i, cnt - i, p);
+}
+
+static const struct a4l_convert_ops convert_sse2 = {
+	.isa = A4L_CONVERT_SSE2,
+	.u16tof = u16tof_sse2,
+	.u16tod = u16tod_sse2,
+	.u16todcal = u16todcal_sse2,
+};
+
+__attribute__((target("avx2")))
+static void u16tof_avx2(float *dst, const sampl_t *src,
+			int cnt, float a, float b)
+{
+	__m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= cnt; i += 16) {
+		lo = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+			_mm_loadu_si128((const __m128i *)(src + i))));
+		hi = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+			_mm_loadu_si128((const __m128i *)(src + i + 8))));
+		_mm256_storeu_ps(dst + i,
+				 _mm256_add_ps(_mm256_mul_ps(va, lo), vb));
+		_mm256_storeu_ps(dst + i + 8,
+				 _mm256_add_ps(_mm256_mul_ps(va, hi), vb));
+	}
+
+	u16tof_scalar(dst + i, src + i, cnt - i, a, b);
+}
+
+__attribute__((target("avx2")))
+static void u16tod_avx2(double *dst, const sampl_t *src,
+			int cnt, double a, double b)
+{
+	__m256d va = _mm256_set1_pd(a), vb = _mm256_set1_pd(b), lo, hi;
+	__m128i raw;
+	int i;
+
+	for (i = 0; i + 8 <= cnt; i += 8) {
+		raw = _mm_loadu_si128((const __m128i *)(src + i));
+		lo = _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(raw));
+		hi = _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(_mm_srli_si128(raw, 8)));
+		_mm256_storeu_pd(dst + i,
+				 _mm256_add_pd(_mm256_mul_pd(va, lo), vb));
+		_mm256_storeu_pd(dst + i + 4,
+				 _mm256_add_pd(_mm256_mul_pd(va, hi), vb));
+	}
+
+	u16tod_scalar(dst + i, src + i, cnt - i, a, b);
+}
+
+__attribute__((target("avx2")))
+static void u16todcal_avx2(double *dst, const sampl_t *src,
+			   int cnt, struct a4l_polynomial *p)
+{
+	__m256d exp = _mm256_set1_pd(p->expansion), x, val, term, coeff;
+	int i, k;
+
+	for (i = 0; i + 4 <= cnt; i += 4) {
+		x = _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(
+			_mm_loadl_epi64((const __m128i *)(src + i))));
+		x = _mm256_sub_pd(x, exp);
+		val = _mm256_setzero_pd();
+		term = _mm256_set1_pd(1.0);
+		for (k = 0; k < p->nb_coeff; k++) {
+			coeff = _mm256_set1_pd(p->coeff[k]);
+			val = _mm256_add_pd(val, _mm256_mul_pd(coeff, term));
+			term = _mm256_mul_pd(term, x);
+		}
+		_mm256_storeu_pd(dst + i, val);
+	}
+
+	u16todcal_scalar(dst + i, src + i, cnt - i, p);
+}
+
+static const struct a4l_convert_ops convert_avx2 = {
+	.isa = A4L_CONVERT_AVX2,
+	.u16tof = u16tof_avx2,
+	.u16tod = u16tod_avx2,
+	.u16todcal = u16todcal_avx2,
+};
+
+#endif /* HAVE_CONVERT_X86 */
+
+#ifdef HAVE_CONVERT_NEON
+
+static void u16tof_neon(float *dst, const sampl_t *src,
+			int cnt, float a, float b)
+{
+	float32x4_t va = vdupq_n_f32(a), vb = vdupq_n_f32(b), lo, hi;
+	uint16x8_t raw;
+	int i;
+
+	for (i = 0; i + 8 <= cnt; i += 8) {
+		raw = vld1q_u16(src + i);
+		lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(raw)));
+		hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(raw)));
+		vst1q_f32(dst + i, vaddq_f32(vmulq_f32(va, lo), vb));
+		vst1q_f32(dst + i + 4, vaddq_f32(vmulq_f32(va, hi), vb));
+	}
+
+	u16tof_scalar(dst + i, src + i, cnt - i, a, b);
+}
+
+static void u16tod_neon(double *dst, const sampl_t *src,
+			int cnt, double a, double b)
+{
+	float64x2_t va = vdupq_n_f64(a), vb = vdupq_n_f64(b), lo, hi;
+	uint32x4_t raw;
+	int i;
+
+	for (i = 0; i + 4 <= cnt; i += 4) {
+		raw = vmovl_u16(vld1_u16(src + i));
+		lo = vcvtq_f64_u64(vmovl_u32(vget_low_u32(raw)));
+		hi = vcvtq_f64_u64(vmovl_u32(vget_high_u32(raw)));
+		vst1q_f64(dst + i, vaddq_f64(vmulq_f64(va, lo), vb));
+		vst1q_f64(dst + i + 2, vaddq_f64(vmulq_f64(va, hi), vb));
+	}
+
+	u16tod_scalar(dst + i, src + i, cnt - i, a, b);
+}
+
+static void u16todcal_neon(double *dst, const sampl_t *src,
+			   int cnt, struct a4l_polynomial *p)
+{
+	float64x2_t exp = vdupq_n_f64(p->expansion), x, val, term, coeff;
+	uint32x2_t raw;
+	int i, k;
+
+	for (i = 0; i + 2 <= cnt; i += 2) {
+		raw = vset_lane_u32(src[i + 1], vdup_n_u32(src[i]), 1);
+		x = vsubq_f64(vcvtq_f64_u64(vmovl_u32(raw)), exp);
+		val = vdupq_n_f64(0.0);
+		term = vdupq_n_f64(1.0);
+		for (k = 0; k < p->nb_coeff; k++) {
+			coeff = vdupq_n_f64(p->coeff[k]);
+			val = vaddq_f64(val, vmulq_f64(coeff, term));
+			term = vmulq_f64(term, x);
+		}
+		vst1q_f64(dst + i, val);
+	}
+
+	u16todcal_scalar(dst + i, src + i, cnt - i, p);
+}
+
+static const struct a4l_convert_ops convert_neon = {
+	.isa = A4L_CONVERT_NEON,
+	.u16tof = u16tof_neon,
+	.u16tod = u16tod_neon,
+	.u16todcal = u16todcal_neon,
+};
+
+#endif /* HAVE_CONVERT_NEON */
+
+static const struct a4l_convert_ops *get_convert_ops(int isa)
+{
+	switch (isa) {
+	case A4L_CONVERT_SCALAR:
+		return &convert_scalar;
+#ifdef HAVE_CONVERT_X86
+	case A4L_CONVERT_SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2") ? &convert_sse2 : NULL;
+	case A4L_CONVERT_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? &convert_avx2 : NULL;
+#endif
+#ifdef HAVE_CONVERT_NEON
+	case A4L_CONVERT_NEON:
+		return &convert_neon;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static const struct a4l_convert_ops *convert_ops;
+
+const struct a4l_convert_ops *__a4l_get_convert_ops(void)
+{
+	const struct a4l_convert_ops *ops = convert_ops;
+	int isa;
+
+	if (ops)
+		return ops;
+
+	/* Pick the widest implementation the CPU supports. */
+	for (isa = A4L_CONVERT_NEON; isa > A4L_CONVERT_SCALAR; isa--) {
+		ops = get_convert_ops(isa);
+		if (ops)
+			break;
+	}
+
+	if (ops == NULL)
+		ops = &convert_scalar;
+
+	convert_ops = ops;
+
+	return ops;
+}
+
+#endif /* !DOXYGEN_CPP */
+
+/**
+ * @ingroup analogy_lib_rng2
+ * @{
+ */
+
+/**
+ * @brief Select the implementation of the conversion routines
+ *
+ * The conversion routines a4l_rawtof(), a4l_rawtod() and
+ * a4l_rawtodcal() process 16-bit samples with the vector
+ * instructions available on the CPU. By default, the widest
+ * implementation supported is picked at the first conversion; this
+ * service allows to override that choice. All implementations
+ * produce the very same results.
+ *
+ * @param[in] isa Implementation to use (A4L_CONVERT_SCALAR,
+ * A4L_CONVERT_SSE2, A4L_CONVERT_AVX2 or A4L_CONVERT_NEON), or
+ * A4L_CONVERT_BEST to restore the default choice
+ *
+ * @return 0 on success. Otherwise:
+ *
+ * - -EOPNOTSUPP is returned if the implementation is not available
+ *    on this CPU or architecture
+ *
+ */
+int a4l_set_convert_isa(int isa)
+{
+	const struct a4l_convert_ops *ops;
+
+	if (isa == A4L_CONVERT_BEST) {
+		convert_ops = NULL;
+		__a4l_get_convert_ops();
+		return 0;
+	}
+
+	ops = get_convert_ops(isa);
+	if (ops == NULL)
+		return -EOPNOTSUPP;
+
+	convert_ops = ops;
+
+	return 0;
+}
+
+/**
+ * @brief Get the implementation of the conversion routines in use
+ *
+ * @return A4L_CONVERT_SCALAR, A4L_CONVERT_SSE2, A4L_CONVERT_AVX2 or
+ * A4L_CONVERT_NEON.
+ *
+ */
+int a4l_get_convert_isa(void)
+{
+	return __a4l_get_convert_ops()->isa;
+}
+
+/** @} Range / conversion API */
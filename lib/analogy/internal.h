@@ -25,9 +25,22 @@
 #define MAGIC_CPLX_DESC 0xabcd1234
 
 #include <rtdm/rtdm.h>
+#include <rtdm/analogy.h>
 
 #ifndef DOXYGEN_CPP
 
+struct a4l_convert_ops {
+	int isa;
+	void (*u16tof)(float *dst, const sampl_t *src,
+		       int cnt, float a, float b);
+	void (*u16tod)(double *dst, const sampl_t *src,
+		       int cnt, double a, double b);
+	void (*u16todcal)(double *dst, const sampl_t *src,
+			  int cnt, struct a4l_polynomial *p);
+};
+
+const struct a4l_convert_ops *__a4l_get_convert_ops(void);
+
 static inline int __sys_open(const char *fname)
 {
 	return __RT(open(fname, 0));
@@ -344,6 +344,12 @@ int a4l_rawtof(a4l_chinfo_t * chan,
 		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
 	b = ((float)rng->min) / A4L_RNG_FACTOR;
 
+	/* 16-bit samples are converted by vector instructions */
+	if (size == 2 && cnt > 0) {
+		__a4l_get_convert_ops()->u16tof(dst, src, cnt, a, b);
+		return cnt;
+	}
+
 	while (j < cnt) {
 
 		/* Properly retrieve the data */
@@ -417,6 +423,12 @@ int a4l_rawtod(a4l_chinfo_t * chan,
 		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
 	b = ((double)rng->min) / A4L_RNG_FACTOR;
 
+	/* 16-bit samples are converted by vector instructions */
+	if (size == 2 && cnt > 0) {
+		__a4l_get_convert_ops()->u16tod(dst, src, cnt, a, b);
+		return cnt;
+	}
+
 	while (j < cnt) {
 
 		/* Properly retrieve the data */
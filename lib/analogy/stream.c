@@ -0,0 +1,267 @@
+/**
+ * @file
+ * Analogy for Linux, zero-copy streaming of asynchronous acquisitions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <rtdm/analogy.h>
+#include "internal.h"
+
+/**
+ * @ingroup analogy_lib_level2
+ * @defgroup analogy_lib_stream Streaming acquisition API
+ *
+ * The streaming services give access to the data of an input
+ * subdevice directly from the mapped ring-buffer, without any copy
+ * through read(). The acquired data are released to the driver once
+ * every consumer of the stream has processed them. A stream may be
+ * shared by several consumers, e.g. a logger and a control loop;
+ * each of them moves its own cursor forward independently, the
+ * slowest one sets the pace at which the ring-buffer is recycled.
+ *
+ * Wake-ups are driven by the watermarks set with
+ * a4l_set_watermark(), so that a consumer may be awakened once
+ * every N samples, or after T microseconds if less data arrived.
+ *
+ * All consumers of a stream must be served by the same thread, or
+ * their accesses must be serialized by the caller.
+ *
+ * @{
+ */
+
+static unsigned long stream_tail(a4l_stream_t *stm)
+{
+	unsigned long tail = stm->cursor[0];
+	unsigned int n;
+
+	for (n = 1; n < stm->nr_consumers; n++)
+		if ((long)(stm->cursor[n] - tail) < 0)
+			tail = stm->cursor[n];
+
+	return tail;
+}
+
+/**
+ * @brief Open a zero-copy stream on an input subdevice
+ *
+ * The asynchronous buffer of the subdevice is mapped into the
+ * caller's address space. This service should be called before the
+ * acquisition command is sent with a4l_snd_command(), and the stream
+ * must be reopened for every new command.
+ *
+ * @param[in] dsc Device descriptor filled by a4l_open() (and
+ * optionally a4l_fill_desc())
+ * @param[in] idx_subd Index of the input subdevice
+ * @param[in] nr_consumers Number of consumers sharing the stream, up
+ * to A4L_STREAM_MAX_CONSUMERS
+ * @param[out] stm Stream descriptor
+ *
+ * @return 0 on success. Otherwise:
+ *
+ * - -EINVAL is returned if some argument is missing or wrong
+ * - -EPERM is returned if the function is called in an RT context
+ * - -EBUSY is returned if the buffer is already mapped in user-space
+ * - -EFAULT is returned if a user <-> kernel transfer went wrong
+ *
+ */
+int a4l_stream_open(a4l_desc_t *dsc, unsigned int idx_subd,
+		    unsigned int nr_consumers, a4l_stream_t *stm)
+{
+	unsigned long size;
+	void *map;
+	int ret;
+
+	/* Basic checkings */
+	if (dsc == NULL || stm == NULL)
+		return -EINVAL;
+
+	if (nr_consumers == 0 || nr_consumers > A4L_STREAM_MAX_CONSUMERS)
+		return -EINVAL;
+
+	ret = a4l_get_bufsize(dsc, idx_subd, &size);
+	if (ret < 0)
+		return ret;
+
+	ret = a4l_mmap(dsc, idx_subd, size, &map);
+	if (ret < 0)
+		return ret;
+
+	memset(stm, 0, sizeof(*stm));
+	stm->dsc = dsc;
+	stm->idx_subd = idx_subd;
+	stm->map = map;
+	stm->size = size;
+	stm->nr_consumers = nr_consumers;
+
+	return 0;
+}
+
+/**
+ * @brief Close a zero-copy stream
+ *
+ * The ring-buffer is unmapped; the data which were not consumed are
+ * lost.
+ *
+ * @param[in] stm Stream descriptor filled by a4l_stream_open()
+ *
+ * @return 0 on success, otherwise -EINVAL if the stream is invalid.
+ *
+ */
+int a4l_stream_close(a4l_stream_t *stm)
+{
+	/* Basic checking */
+	if (stm == NULL || stm->map == NULL)
+		return -EINVAL;
+
+	munmap(stm->map, stm->size);
+	stm->map = NULL;
+
+	return 0;
+}
+
+/**
+ * @brief Wait for data to be available in a stream
+ *
+ * The data processed by all consumers since the former call are
+ * released to the driver first, then the caller waits until some
+ * data is pending for at least one of the consumers, according to
+ * the watermarks set with a4l_set_watermark().
+ *
+ * @param[in] stm Stream descriptor filled by a4l_stream_open()
+ * @param[in] ms_timeout The number of miliseconds to wait for some
+ * data to be available. Passing A4L_INFINITE causes the caller to
+ * block indefinitely until some data is available. Passing
+ * A4L_NONBLOCK causes the function to return immediately without
+ * waiting for any available data
+ *
+ * @return the count of bytes pending for the slowest consumer, 0 if
+ * the acquisition is over and all data were consumed. Otherwise:
+ *
+ * - -EINVAL is returned if some argument is missing or wrong
+ * - -ETIMEDOUT is returned if no data arrived in time
+ * - -EPIPE is returned if the acquisition failed
+ * - -EFAULT is returned if a user <-> kernel transfer went wrong
+ * - -EINTR is returned if calling task has been unblocked by a signal
+ *
+ */
+int a4l_stream_wait(a4l_stream_t *stm, unsigned long ms_timeout)
+{
+	unsigned long tail, count;
+	int ret;
+
+	/* Basic checking */
+	if (stm == NULL || stm->map == NULL)
+		return -EINVAL;
+
+	for (;;) {
+		/* Release what every consumer is done with, and
+		   retrieve the amount of data acquired meanwhile */
+		tail = stream_tail(stm);
+		ret = a4l_mark_bufrw(stm->dsc, stm->idx_subd,
+				     tail - stm->tail, &count);
+		if (ret == -ENOENT)
+			return 0;
+		if (ret < 0)
+			return ret;
+
+		stm->tail = tail;
+		stm->head = tail + count;
+
+		if (count > 0 || ms_timeout == A4L_NONBLOCK)
+			return (int)count;
+
+		ret = a4l_poll(stm->dsc, stm->idx_subd, ms_timeout);
+		if (ret == -ENOENT)
+			return 0;
+		if (ret <= 0)
+			return ret;
+	}
+}
+
+/**
+ * @brief Get the data pending in a stream for a consumer
+ *
+ * The pending data are described by two contiguous areas within the
+ * mapped ring-buffer, the second one being empty unless the data
+ * wrap at the end of the buffer. This service does not issue any
+ * system call; the view is refreshed by a4l_stream_wait().
+ *
+ * @param[in] stm Stream descriptor filled by a4l_stream_open()
+ * @param[in] consumer Index of the consumer
+ * @param[out] span Areas containing the pending data
+ *
+ * @return the count of pending bytes, otherwise -EINVAL if some
+ * argument is wrong.
+ *
+ */
+int a4l_stream_peek(a4l_stream_t *stm,
+		    unsigned int consumer, a4l_stream_span_t *span)
+{
+	unsigned long count, offset;
+
+	/* Basic checkings */
+	if (stm == NULL || stm->map == NULL || span == NULL)
+		return -EINVAL;
+
+	if (consumer >= stm->nr_consumers)
+		return -EINVAL;
+
+	count = stm->head - stm->cursor[consumer];
+	offset = stm->cursor[consumer] % stm->size;
+
+	span->ptr[0] = stm->map + offset;
+	span->len[0] = count < stm->size - offset ? count : stm->size - offset;
+	span->ptr[1] = stm->map;
+	span->len[1] = count - span->len[0];
+
+	return (int)count;
+}
+
+/**
+ * @brief Mark data of a stream as processed by a consumer
+ *
+ * The data remain valid in the ring-buffer until the next call to
+ * a4l_stream_wait(), which releases them to the driver once all
+ * consumers went past them.
+ *
+ * @param[in] stm Stream descriptor filled by a4l_stream_open()
+ * @param[in] consumer Index of the consumer
+ * @param[in] count Number of bytes processed
+ *
+ * @return 0 on success, otherwise -EINVAL if some argument is wrong,
+ * or @a count is larger than the amount of pending data.
+ *
+ */
+int a4l_stream_consume(a4l_stream_t *stm,
+		       unsigned int consumer, unsigned long count)
+{
+	/* Basic checkings */
+	if (stm == NULL || stm->map == NULL)
+		return -EINVAL;
+
+	if (consumer >= stm->nr_consumers ||
+	    count > stm->head - stm->cursor[consumer])
+		return -EINVAL;
+
+	stm->cursor[consumer] += count;
+
+	return 0;
+}
+
+/** @} Streaming acquisition API */
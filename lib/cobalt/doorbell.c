@@ -0,0 +1,76 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#include <stdint.h>
+#include <fcntl.h>
+#include <cobalt/sys/cobalt.h>
+#include <asm/xenomai/syscall.h>
+
+/*
+ * Doorbells let real-time threads notify a Linux event loop without
+ * leaving primary mode. The Linux side is a plain eventfd, which may
+ * be waited for with poll(), epoll or read() as usual. Counts rung
+ * from real-time context accumulate in the core until Linux gets the
+ * CPU back, and are then added to the eventfd counter in one go.
+ */
+
+/**
+ * Create a doorbell ringing an eventfd.
+ *
+ * @param efd Linux eventfd, as returned by eventfd(2), which receives
+ * the counts. The doorbell holds its own reference on it.
+ *
+ * @param flags 0 or O_CLOEXEC.
+ *
+ * @return The doorbell file descriptor upon success, otherwise:
+ *
+ * - -EBADF or -EINVAL, @a efd is not an eventfd.
+ * - -EINVAL, @a flags is invalid.
+ * - -ENOMEM, no memory available.
+ * - -EMFILE, no file descriptor available.
+ *
+ * @apitags{thread-unrestricted, switch-secondary}
+ */
+int cobalt_doorbell_create(int efd, int flags)
+{
+	return XENOMAI_SYSCALL2(sc_cobalt_doorbell_create, efd, flags);
+}
+
+/**
+ * Ring a doorbell.
+ *
+ * Add @a count to the eventfd counter attached to the doorbell. This
+ * call never blocks nor switches to secondary mode; the eventfd is
+ * updated and its waiters woken up as soon as Linux resumes.
+ *
+ * @param fd Doorbell file descriptor.
+ *
+ * @param count Value to add, ~0ULL is invalid. Zero is a no-op.
+ *
+ * @return 0 upon success, otherwise:
+ *
+ * - -EBADF, @a fd is not a valid doorbell.
+ * - -EINVAL, @a count is invalid.
+ *
+ * @apitags{unrestricted}
+ */
+int cobalt_doorbell_ring(int fd, uint64_t count)
+{
+	int ret;
+
+	ret = XENOMAI_SYSCALL3(sc_cobalt_write, fd, &count, sizeof(count));
+
+	return ret < 0 ? ret : 0;
+}
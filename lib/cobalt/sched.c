@@ -492,6 +492,9 @@ int sched_get_priority_max_ex(int policy)
  * config.tp depending on the number of time slots to be defined in
  * config.tp.windows[], as specified by config.tp.nr_windows.
  *
+ * @note sched_tp_compile_np() may be used for building the window
+ * table from a set of partition budgets and periods.
+ *
  * @par Settings applicable to SCHED_QUOTA
  *
  * This call manages thread groups running on @a cpu, defining
@@ -505,6 +508,15 @@ int sched_get_priority_max_ex(int policy)
  *      upon success. A new group is given no initial runtime budget
  *      when created. sched_quota_set should be issued to enable it.
  *
+ *    - sched_quota_add_ex for creating a new thread group on @a cpu,
+ *      nested into the group passed in config.quota.add.parent, or
+ *      at top level if the latter is negative. The percentages
+ *      later given to a nested group apply to the quota of its
+ *      parent. If config.quota.add.flags contains
+ *      SCHED_QUOTA_BORROW, the group may keep running on the budget
+ *      other groups left unused during the current quota interval,
+ *      once its own budget is exhausted.
+ *
  *    - sched_quota_remove for deleting a thread group on @a cpu. The
  *      group identifier should be passed in config.quota.remove.tgid.
  *
@@ -531,7 +543,8 @@ int sched_get_priority_max_ex(int policy)
  * - ENOMEM, lack of memory to perform the operation.
  *
  * - EBUSY, with @a policy equal to SCHED_QUOTA, if an attempt is made
- *   to remove a thread group which still manages threads.
+ *   to remove a thread group which still manages threads, or has
+ *   nested groups.
  *
  * - ESRCH, with @a policy equal to SCHED_QUOTA, if the group
  *   identifier required to perform the operation is not valid.
@@ -610,4 +623,233 @@ ssize_t sched_getconfig_np(int cpu, int policy,
 	return 0;
 }
 
+/*
+ * Upper bound on the number of jobs released over a hyperperiod by
+ * sched_tp_compile_np(), so that a set of periods with no sensible
+ * common multiple does not end up in a huge window table.
+ */
+#define TP_COMPILE_MAXJOBS  65536
+
+struct tp_job {
+	long long budget;
+	long long period;
+	long long release;
+	long long deadline;
+	long long remaining;
+};
+
+static long long tp_gcd(long long a, long long b)
+{
+	long long r;
+
+	while (b) {
+		r = a % b;
+		a = b;
+		b = r;
+	}
+
+	return a;
+}
+
+static int tp_emit_window(union sched_config *config, int max_windows,
+			  long long offset, long long duration, int ptid)
+{
+	struct sched_tp_window *w;
+	int nr = config->tp.nr_windows;
+
+	/* Merge with the previous window if it runs the same partition. */
+	if (nr > 0) {
+		w = &config->tp.windows[nr - 1];
+		if (w->ptid == ptid) {
+			duration += (long long)w->duration.tv_sec * 1000000000LL +
+				w->duration.tv_nsec;
+			w->duration.tv_sec = duration / 1000000000LL;
+			w->duration.tv_nsec = duration % 1000000000LL;
+			return 0;
+		}
+	}
+
+	if (nr >= max_windows)
+		return ENOSPC;
+
+	w = &config->tp.windows[nr];
+	w->offset.tv_sec = offset / 1000000000LL;
+	w->offset.tv_nsec = offset % 1000000000LL;
+	w->duration.tv_sec = duration / 1000000000LL;
+	w->duration.tv_nsec = duration % 1000000000LL;
+	w->ptid = ptid;
+	config->tp.nr_windows = nr + 1;
+
+	return 0;
+}
+
+/**
+ * Compile a SCHED_TP schedule from partition budgets
+ *
+ * This service builds the minimal window table granting each
+ * partition a given amount of CPU time over a recurring period,
+ * which can be installed on any CPU by a subsequent call to
+ * sched_setconfig_np(). No system call is issued, so the
+ * schedule of each CPU may be built and validated offline.
+ *
+ * The global time frame is the least common multiple of all
+ * periods. Over this frame, time windows are allotted to the
+ * partitions by earliest deadline first, switching partitions only
+ * when a budget is exhausted or a new period begins. Consecutive
+ * slots activating the same partition are merged into a single
+ * window, and the remaining time holes are assigned to the pseudo
+ * partition -1.
+ *
+ * @param budgets an array of @a nr_budgets descriptors. Each entry
+ * requests budgets[].budget of CPU time to be available to
+ * partition budgets[].ptid within every budgets[].period, starting
+ * from the beginning of the global time frame. A partition may
+ * appear multiple times with distinct rates.
+ *
+ * @param nr_budgets the number of entries in @a budgets.
+ *
+ * @param config a pointer to the configuration data to build, which
+ * receives a @a sched_tp_install request upon success.
+ *
+ * @param[in, out] len_r a pointer to a variable which must contain
+ * the amount of space available in @a config on entry. On success,
+ * the overall length of the configuration data is written back to
+ * this variable, suitable as the @a len argument to
+ * sched_setconfig_np().
+ *
+ * @return 0 on success;
+ * @return an error number if:
+ *
+ * - EINVAL, @a nr_budgets is not positive, a partition identifier is
+ * negative, or a budget is either null or larger than its period.
+ *
+ * - ERANGE, the budgets cannot be all met, i.e. the overall CPU
+ * utilization exceeds 100%.
+ *
+ * - E2BIG, the periods lead to an excessively long global time frame.
+ *
+ * - ENOSPC, @a config cannot hold the window table.
+ *
+ * - ENOMEM, lack of memory to perform the operation.
+ *
+ * @note Whether the partition identifiers are valid for the
+ * current kernel configuration is checked by sched_setconfig_np().
+ *
+ * @apitags{unrestricted}
+ */
+int sched_tp_compile_np(const struct sched_tp_budget *budgets,
+			int nr_budgets, union sched_config *config,
+			size_t *len_r)
+{
+	long long frame = 1, njobs = 0, t, next, run;
+	int n, pick, max_windows, ret = 0;
+	struct tp_job *jobs, *j;
+
+	if (nr_budgets <= 0)
+		return EINVAL;
+
+	if (*len_r < sched_tp_confsz(0))
+		return ENOSPC;
+
+	max_windows = (*len_r - sched_tp_confsz(0)) /
+		sizeof(struct sched_tp_window);
+
+	jobs = malloc(sizeof(*jobs) * nr_budgets);
+	if (jobs == NULL)
+		return ENOMEM;
+
+	for (n = 0, j = jobs; n < nr_budgets; n++, j++) {
+		if (budgets[n].ptid < 0) {
+			ret = EINVAL;
+			goto out;
+		}
+		j->budget = (long long)budgets[n].budget.tv_sec * 1000000000LL +
+			budgets[n].budget.tv_nsec;
+		j->period = (long long)budgets[n].period.tv_sec * 1000000000LL +
+			budgets[n].period.tv_nsec;
+		if (j->budget <= 0 || j->budget > j->period) {
+			ret = EINVAL;
+			goto out;
+		}
+		frame /= tp_gcd(frame, j->period);
+		if (frame > TP_COMPILE_MAXJOBS) {
+			ret = E2BIG;
+			goto out;
+		}
+		frame *= j->period;
+		j->release = 0;
+		j->remaining = 0;
+	}
+
+	for (n = 0; n < nr_budgets; n++) {
+		njobs += frame / jobs[n].period;
+		if (njobs > TP_COMPILE_MAXJOBS) {
+			ret = E2BIG;
+			goto out;
+		}
+	}
+
+	config->tp.op = sched_tp_install;
+	config->tp.nr_windows = 0;
+
+	for (t = 0; t < frame; t = next) {
+		/* Release the jobs due at this date. */
+		for (n = 0, j = jobs; n < nr_budgets; n++, j++) {
+			if (j->release > t)
+				continue;
+			if (j->remaining > 0) {
+				ret = ERANGE;
+				goto out;
+			}
+			j->remaining = j->budget;
+			j->deadline = t + j->period;
+			j->release = j->deadline;
+		}
+
+		next = frame;
+		pick = -1;
+		for (n = 0, j = jobs; n < nr_budgets; n++, j++) {
+			if (j->release < next)
+				next = j->release;
+			if (j->remaining > 0 &&
+			    (pick < 0 || j->deadline < jobs[pick].deadline))
+				pick = n;
+		}
+
+		if (pick < 0) {
+			ret = tp_emit_window(config, max_windows,
+					     t, next - t, -1);
+			if (ret)
+				goto out;
+			continue;
+		}
+
+		j = jobs + pick;
+		run = next - t;
+		if (run > j->remaining) {
+			run = j->remaining;
+			next = t + run;
+		}
+		j->remaining -= run;
+		ret = tp_emit_window(config, max_windows,
+				     t, run, budgets[pick].ptid);
+		if (ret)
+			goto out;
+	}
+
+	/* The last jobs of each partition are due at the end of frame. */
+	for (n = 0; n < nr_budgets; n++) {
+		if (jobs[n].remaining > 0) {
+			ret = ERANGE;
+			goto out;
+		}
+	}
+
+	*len_r = sched_tp_confsz(config->tp.nr_windows);
+out:
+	free(jobs);
+
+	return ret;
+}
+
 /** @} */
@@ -0,0 +1,146 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cobalt/sys/cobalt.h>
+
+/*
+ * Decoder for the binary output of the snapshot vfiles (see
+ * <cobalt/uapi/kernel/vfile.h>). The reader keeps a full copy of the
+ * record table, which incremental reads only patch with the records
+ * which changed since the previous update.
+ */
+
+int cobalt_vfile_open(struct cobalt_vfile_reader *r,
+		      const char *path, unsigned int type)
+{
+	memset(r, 0, sizeof(*r));
+
+	r->fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (r->fd < 0)
+		return -errno;
+
+	r->type = type;
+
+	return 0;
+}
+
+static ssize_t load_snapshot(struct cobalt_vfile_reader *r)
+{
+	size_t len = 0, bufsz;
+	ssize_t ret;
+	char *buf;
+
+	if (r->bufsz == 0) {
+		r->buf = malloc(4096);
+		if (r->buf == NULL)
+			return -ENOMEM;
+		r->bufsz = 4096;
+	}
+
+	/*
+	 * Reading from offset zero triggers a new snapshot, reads
+	 * beyond continue streaming it.
+	 */
+	for (;;) {
+		ret = pread(r->fd, r->buf + len, r->bufsz - len, len);
+		if (ret < 0)
+			return -errno;
+		if (ret == 0)
+			break;
+		len += ret;
+		if (len < r->bufsz)
+			continue;
+		bufsz = r->bufsz * 2;
+		buf = realloc(r->buf, bufsz);
+		if (buf == NULL)
+			return -ENOMEM;
+		r->buf = buf;
+		r->bufsz = bufsz;
+	}
+
+	return len;
+}
+
+int cobalt_vfile_update(struct cobalt_vfile_reader *r)
+{
+	const struct cobalt_vfile_header *hdr;
+	const struct cobalt_vfile_record *rec;
+	size_t cellsz;
+	ssize_t len;
+	void *recs;
+	int n;
+
+	len = load_snapshot(r);
+	if (len < 0)
+		return len;
+
+	hdr = (const struct cobalt_vfile_header *)r->buf;
+	if (len < sizeof(*hdr) ||
+	    hdr->magic != COBALT_VFILE_MAGIC ||
+	    hdr->abi != COBALT_VFILE_ABI)
+		return -EPROTO;
+
+	if (hdr->type != r->type)
+		return -EINVAL;
+
+	cellsz = sizeof(*rec) + hdr->recsz;
+	if (len != sizeof(*hdr) + hdr->nemit * cellsz)
+		return -EPROTO;
+
+	if (hdr->flags & COBALT_VFILE_DELTA) {
+		if (hdr->nrec != r->nrec || hdr->recsz != r->recsz)
+			return -EPROTO;
+	} else {
+		recs = realloc(r->recs, hdr->nrec * hdr->recsz);
+		if (recs == NULL && hdr->nrec > 0)
+			return -ENOMEM;
+		r->recs = recs;
+		r->nrec = hdr->nrec;
+		r->recsz = hdr->recsz;
+	}
+
+	for (n = 0, rec = cobalt_vfile_first(hdr); n < hdr->nemit;
+	     n++, rec = cobalt_vfile_next(hdr, rec)) {
+		if (rec->index >= r->nrec)
+			return -EPROTO;
+		memcpy((char *)r->recs + rec->index * r->recsz,
+		       cobalt_vfile_data(rec), r->recsz);
+	}
+
+	r->generation = hdr->generation;
+	r->date = hdr->date;
+
+	return hdr->nemit;
+}
+
+const void *cobalt_vfile_get(struct cobalt_vfile_reader *r, int index)
+{
+	if (index < 0 || index >= r->nrec)
+		return NULL;
+
+	return (const char *)r->recs + index * r->recsz;
+}
+
+void cobalt_vfile_close(struct cobalt_vfile_reader *r)
+{
+	close(r->fd);
+	free(r->recs);
+	free(r->buf);
+}
@@ -282,8 +282,14 @@ redo:
 
 	sc->d = d;
 
-	return syncobj_init(&d->sobj, CLOCK_COPPERPLATE,
-			    SYNCOBJ_FIFO, fnref_null);
+	ret = syncobj_init(&d->sobj, CLOCK_COPPERPLATE,
+			   SYNCOBJ_FIFO, fnref_null);
+	if (ret)
+		return ret;
+
+	syncobj_set_name(&d->sobj, name);
+
+	return 0;
 }
 
 int syncluster_addobj(struct syncluster *sc, const char *name,
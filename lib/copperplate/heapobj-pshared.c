@@ -40,6 +40,7 @@
 #include "boilerplate/list.h"
 #include "boilerplate/hash.h"
 #include "boilerplate/lock.h"
+#include "boilerplate/atomic.h"
 #include "copperplate/heapobj.h"
 #include "copperplate/debug.h"
 #include "xenomai/init.h"
@@ -62,6 +63,8 @@ struct shared_extent {
 	memoff_t memlim;	/* Offset limit of page array */
 	memoff_t bitmap;	/* Offset of allocation bitmap */
 	int bitwords;		/* 32bit words in bitmap */
+	memoff_t fullmap;	/* Offset of full word summary */
+	int fullwords;		/* 32bit words in summary */
 	struct page_entry pagemap[0]; /* Start of page map */
 };
 
@@ -101,6 +104,9 @@ struct sysgroup *__main_sysgroup;
 
 static struct heapobj main_pool;
 
+/* The main heap has a single extent, laid next to its descriptor. */
+#define main_extent	((struct shared_extent *)(&main_heap + 1))
+
 #define __shoff(b, p)		((caddr_t)(p) - (caddr_t)(b))
 #define __shoff_check(b, p)	((p) ? __shoff(b, p) : 0)
 #define __shref(b, o)		((void *)((caddr_t)(b) + (o)))
@@ -115,7 +121,7 @@ static inline size_t __align_to(size_t size, size_t al)
 static inline size_t get_pagemap_size(size_t h,
 				      memoff_t *bmapoff, int *bmapwords)
 {
-	int nrpages = h >> HOBJ_PAGE_SHIFT, bitmapw;
+	int nrpages = h >> HOBJ_PAGE_SHIFT, bitmapw, fullmapw;
 	size_t pagemapsz;
 
 	/*
@@ -123,12 +129,14 @@ static inline size_t get_pagemap_size(size_t h,
 	 * of user memory in pages of HOBJ_PAGE_SIZE bytes. The meta
 	 * data includes the length of the extent descriptor, plus the
 	 * length of the page mapping array followed by the allocation
-	 * bitmap. 'h' must be a multiple of HOBJ_PAGE_SIZE on entry.
+	 * bitmap, then by the summary of its full words. 'h' must be
+	 * a multiple of HOBJ_PAGE_SIZE on entry.
 	 */
 	assert((h & ~HOBJ_PAGE_MASK) == 0);
 	pagemapsz = __align_to(nrpages * sizeof(struct page_entry),
 			       sizeof(uint32_t));
 	bitmapw =__align_to(nrpages, 32) / 32;
+	fullmapw =__align_to(bitmapw, 32) / 32;
 	if (bmapoff)
 		*bmapoff = offsetof(struct shared_extent, pagemap) + pagemapsz;
 	if (bmapwords)
@@ -136,14 +144,31 @@ static inline size_t get_pagemap_size(size_t h,
 
 	return __align_to(pagemapsz
 			  + sizeof(struct shared_extent)
-			  + bitmapw * sizeof(uint32_t),
+			  + (bitmapw + fullmapw) * sizeof(uint32_t),
 			  HOBJ_MINALIGNSZ);
 }
 
+static inline void update_fullmap(uint32_t *bitmap, uint32_t *fullmap,
+				  int first, int last)
+{
+	int n;
+
+	/*
+	 * Bit #n of the summary is set iff word #n of the allocation
+	 * bitmap has no free page left.
+	 */
+	for (n = first; n <= last; n++) {
+		if (bitmap[n] == -1U)
+			fullmap[n / 32] |= 1U << (n & 31);
+		else
+			fullmap[n / 32] &= ~(1U << (n & 31));
+	}
+}
+
 static void init_extent(void *base, struct shared_extent *extent)
 {
-	int lastpgnum;
-	uint32_t *p;
+	int lastpgnum, lastword;
+	uint32_t *p, *f;
 
 	__holder_init_nocheck(base, &extent->link);
 
@@ -156,7 +181,7 @@ static void init_extent(void *base, struct shared_extent *extent)
 	assert(lastpgnum >= 1);
 
 	/* Mark all pages as free in the page map. */
-	memset(extent->pagemap, 0, lastpgnum * sizeof(struct page_entry));
+	memset(extent->pagemap, 0, (lastpgnum + 1) * sizeof(struct page_entry));
 
 	/* Clear the allocation bitmap. */
 	p = __shref(base, extent->bitmap);
@@ -167,6 +192,19 @@ static void init_extent(void *base, struct shared_extent *extent)
 	 * memory from the page pool.
 	 */
 	p[lastpgnum / 32] |= ~(-1U >> (31 - (lastpgnum & 31)));
+
+	/*
+	 * The summary follows the bitmap. Likewise, trailing bits
+	 * past the last bitmap word are marked as full, so that a
+	 * search never walks past the end of the bitmap.
+	 */
+	extent->fullmap = extent->bitmap + extent->bitwords * sizeof(uint32_t);
+	extent->fullwords = __align_to(extent->bitwords, 32) / 32;
+	f = __shref(base, extent->fullmap);
+	memset(f, 0, extent->fullwords * sizeof(uint32_t));
+	lastword = extent->bitwords - 1;
+	f[lastword / 32] |= ~(-1U >> (31 - (lastword & 31)));
+	update_fullmap(p, f, lastword, lastword);
 }
 
 static int init_heap(struct shared_heap *heap, void *base,
@@ -259,6 +297,10 @@ static int init_main_heap(struct session_heap *m_heap,
 	__list_init(m_heap, &m_heap->sysgroup.thread_list);
 	m_heap->sysgroup.heap_count = 0;
 	__list_init(m_heap, &m_heap->sysgroup.heap_list);
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+	m_heap->sysgroup.syncobj_count = 0;
+	__list_init(m_heap, &m_heap->sysgroup.syncobj_list);
+#endif
 
 	return 0;
 }
@@ -276,8 +318,34 @@ static inline void flip_page_range(uint32_t *p, int b, int nr)
 	}
 }
 
-static int reserve_page_range(uint32_t *bitmap, int bitwords, int nrpages)
+static int find_free_word(uint32_t *fullmap, int bitwords, int from)
+{
+	uint32_t v;
+	int n;
+
+	/*
+	 * Return the index of the first bitmap word at or after
+	 * 'from' which maps at least one free page, or -1 if none.
+	 */
+	if (from >= bitwords)
+		return -1;
+
+	n = from / 32;
+	v = fullmap[n] | ((1U << (from & 31)) - 1);
+	while (v == -1U) {
+		if (++n * 32 >= bitwords)
+			return -1;
+		v = fullmap[n];
+	}
+
+	return n * 32 + ctz(~v);
+}
+
+static int reserve_page_range(void *base, struct shared_extent *extent,
+			      int nrpages)
 {
+	uint32_t *bitmap = __shref(base, extent->bitmap);
+	uint32_t *fullmap = __shref(base, extent->fullmap);
 	int n, b, r, seq, beg, end;
 	uint32_t v = -1U;
 
@@ -286,9 +354,34 @@ static int reserve_page_range(uint32_t *bitmap, int bitwords, int nrpages)
 	 * page(s) in the bitmap. Once found, flip the corresponding
 	 * bit sequence from clear to set, then return the heading
 	 * page number. Otherwise, return -1 on failure.
+	 *
+	 * The summary of full words tells us where the first free
+	 * page lives, so that single page requests - by far the most
+	 * common ones - are served by two find-first-set operations
+	 * per 1024 pages, and longer requests skip busy areas
+	 * likewise.
 	 */
-	for (n = 0, seq = 0; n < bitwords; n++) {
+	n = find_free_word(fullmap, extent->bitwords, 0);
+	if (n < 0)
+		return -1;
+
+	if (nrpages == 1) {
+		b = ctz(~bitmap[n]);
+		bitmap[n] |= 1U << b;
+		update_fullmap(bitmap, fullmap, n, n);
+		return n * 32 + b;
+	}
+
+	for (seq = 0; n < extent->bitwords; n++) {
 		v = bitmap[n];
+		if (v == -1U) {
+			/* Any ongoing sequence stops here. */
+			seq = 0;
+			n = find_free_word(fullmap, extent->bitwords, n + 1);
+			if (n < 0)
+				return -1;
+			v = bitmap[n];
+		}
 		b = 0;
 		while (v != -1U) {
 			r = ctz(v);
@@ -299,6 +392,8 @@ static int reserve_page_range(uint32_t *bitmap, int bitwords, int nrpages)
 					end = beg + nrpages - 1;
 					flip_page_range(bitmap + end / 32,
 							end & 31, nrpages);
+					update_fullmap(bitmap, fullmap,
+						       beg / 32, end / 32);
 					return beg;
 				}
 			} else {
@@ -336,7 +431,6 @@ static caddr_t get_free_range(struct shared_heap *heap, size_t bsize, int log2si
 	struct shared_extent *extent;
 	void *base = main_base;
 	caddr_t block, eblock;
-	uint32_t *bitmap;
 	size_t areasz;
 	int pstart, n;
 
@@ -348,8 +442,7 @@ static caddr_t get_free_range(struct shared_heap *heap, size_t bsize, int log2si
 
 	areasz =__align_to(bsize, HOBJ_PAGE_SIZE) >> HOBJ_PAGE_SHIFT;
 	__list_for_each_entry(base, extent, &heap->extents, link) {
-		bitmap = __shref(base, extent->bitmap);
-		pstart = reserve_page_range(bitmap, extent->bitwords, areasz);
+		pstart = reserve_page_range(base, extent, areasz);
 		if (pstart >= 0)
 			goto splitpage;
 	}
@@ -412,12 +505,82 @@ align_alloc_size(size_t size)
 	return __align_to(size, HOBJ_MINALIGNSZ);
 }
 
-static void *alloc_block(struct shared_heap *heap, size_t size)
+static inline int get_log2size(size_t size)
+{
+	int log2size;
+
+	/* Find log2(size), size is aligned on entry. */
+	log2size = sizeof(size) * 8 - 1 - clz(size);
+	if (size & (size - 1))
+		log2size++;
+
+	return log2size;
+}
+
+static void lock_heap(struct shared_heap *heap)
+{
+	/*
+	 * Count the acquisitions which could not be granted
+	 * immediately, this tells us how hard the heap is contended
+	 * by the threads from all processes sharing it.
+	 */
+	if (write_trylock_nocancel(&heap->lock)) {
+		write_lock_nocancel(&heap->lock);
+		heap->stats.contended++;
+	}
+
+	heap->stats.locks++;
+}
+
+static void unlock_heap(struct shared_heap *heap)
+{
+	write_unlock(&heap->lock);
+}
+
+/* heap->lock held. */
+static caddr_t get_bucket_block(struct shared_heap *heap, int log2size)
 {
+	size_t pgnum, bsize = 1 << log2size;
+	int ilog = log2size - HOBJ_MINLOG2;
 	struct shared_extent *extent;
 	void *base = main_base;
-	size_t pgnum, bsize;
-	int log2size, ilog;
+	caddr_t block;
+
+	assert(ilog < HOBJ_NBUCKETS);
+
+	block = __shref_check(base, heap->buckets[ilog].freelist);
+	if (block == NULL) {
+		block = get_free_range(heap, bsize, log2size);
+		if (block == NULL)
+			return NULL;
+		if (bsize < HOBJ_PAGE_SIZE) {
+			heap->buckets[ilog].fcount += (HOBJ_PAGE_SIZE >> log2size) - 1;
+			heap->buckets[ilog].freelist = *((memoff_t *)block);
+		}
+	} else {
+		if (bsize < HOBJ_PAGE_SIZE)
+			--heap->buckets[ilog].fcount;
+
+		/* Search for the source extent of block. */
+		__list_for_each_entry(base, extent, &heap->extents, link) {
+			if (__shoff(base, block) >= extent->membase &&
+			    __shoff(base, block) < extent->memlim)
+				goto found;
+		}
+		assert(0);
+	found:
+		pgnum = (__shoff(base, block) - extent->membase) >> HOBJ_PAGE_SHIFT;
+		++extent->pagemap[pgnum].bcount;
+		heap->buckets[ilog].freelist = *((memoff_t *)block);
+	}
+
+	heap->ubytes += bsize;
+
+	return block;
+}
+
+static void *alloc_block(struct shared_heap *heap, size_t size)
+{
 	caddr_t block;
 
 	if (size == 0)
@@ -431,64 +594,29 @@ static void *alloc_block(struct shared_heap *heap, size_t size)
 	 * bucketed memory blocks.
 	 */
 	if (size <= HOBJ_PAGE_SIZE * 2) {
-		/* Find log2(size). */
-		log2size = sizeof(size) * 8 - 1 - clz(size);
-		if (size & (size - 1))
-			log2size++;
-		/* That is the actual block size we need. */
-		bsize = 1 << log2size;
-		ilog = log2size - HOBJ_MINLOG2;
-		assert(ilog < HOBJ_NBUCKETS);
-
-		write_lock_nocancel(&heap->lock);
-
-		block = __shref_check(base, heap->buckets[ilog].freelist);
-		if (block == NULL) {
-			block = get_free_range(heap, bsize, log2size);
-			if (block == NULL)
-				goto done;
-			if (bsize < HOBJ_PAGE_SIZE) {
-				heap->buckets[ilog].fcount += (HOBJ_PAGE_SIZE >> log2size) - 1;
-				heap->buckets[ilog].freelist = *((memoff_t *)block);
-			}
-		} else {
-			if (bsize < HOBJ_PAGE_SIZE)
-				--heap->buckets[ilog].fcount;
-
-			/* Search for the source extent of block. */
-			__list_for_each_entry(base, extent, &heap->extents, link) {
-				if (__shoff(base, block) >= extent->membase &&
-				    __shoff(base, block) < extent->memlim)
-					goto found;
-			}
-			assert(0);
-		found:
-			pgnum = (__shoff(base, block) - extent->membase) >> HOBJ_PAGE_SHIFT;
-			++extent->pagemap[pgnum].bcount;
-			heap->buckets[ilog].freelist = *((memoff_t *)block);
-		}
-
-		heap->ubytes += bsize;
+		lock_heap(heap);
+		block = get_bucket_block(heap, get_log2size(size));
 	} else {
 		if (size > heap->maxcont)
 			return NULL;
 
-		write_lock_nocancel(&heap->lock);
+		lock_heap(heap);
 
 		/* Directly request a free page range. */
 		block = get_free_range(heap, size, 0);
 		if (block)
 			heap->ubytes += size;
 	}
-done:
-	write_unlock(&heap->lock);
+
+	unlock_heap(heap);
 
 	return block;
 }
 
-static int free_block(struct shared_heap *heap, void *block)
+/* heap->lock held. */
+static int release_block(struct shared_heap *heap, void *block)
 {
-	int log2size, ret = 0, nblocks, xpage, ilog, pagenr,
+	int log2size, nblocks, xpage, ilog, pagenr,
 		maxpages, pghead, pgtail, n;
 	struct shared_extent *extent;
 	memoff_t *tailp, pgoff, boff;
@@ -497,8 +625,6 @@ static int free_block(struct shared_heap *heap, void *block)
 	uint32_t *bitmap;
 	size_t bsize;
 
-	write_lock_nocancel(&heap->lock);
-
 	/*
 	 * Find the extent from which the returned block is
 	 * originating from.
@@ -509,8 +635,7 @@ static int free_block(struct shared_heap *heap, void *block)
 			goto found;
 	}
 
-	ret = -EFAULT;
-	goto out;
+	return -EFAULT;
 found:
 	/* Compute the heading page number in the page map. */
 	pgoff = __shoff(base, block) - extent->membase;
@@ -520,8 +645,7 @@ found:
 	switch (extent->pagemap[pghead].type) {
 	case page_free:	/* Unallocated page? */
 	case page_cont:	/* Not a range heading page? */
-		ret = -EINVAL;
-		goto out;
+		return -EINVAL;
 
 	case page_list:
 		pagenr = 1;
@@ -545,15 +669,15 @@ found:
 		 * end of the bitfield mapping the area.
 		 */
 		flip_page_range(bitmap + pgtail / 32, pgtail & 31, pagenr);
+		update_fullmap(bitmap, __shref(base, extent->fullmap),
+			       pghead / 32, pgtail / 32);
 		break;
 
 	default:
 		log2size = extent->pagemap[pghead].type;
 		bsize = (1 << log2size);
-		if ((boff & (bsize - 1)) != 0) { /* Not at block start? */
-			ret = -EINVAL;
-			goto out;
-		}
+		if ((boff & (bsize - 1)) != 0) /* Not at block start? */
+			return -EINVAL;
 		/*
 		 * Return the page to the free pool if we've just
 		 * freed its last busy block. Pages from multi-page
@@ -638,8 +762,17 @@ found:
 	}
 
 	heap->ubytes -= bsize;
-out:
-	write_unlock(&heap->lock);
+
+	return 0;
+}
+
+static int free_block(struct shared_heap *heap, void *block)
+{
+	int ret;
+
+	lock_heap(heap);
+	ret = release_block(heap, block);
+	unlock_heap(heap);
 
 	return __bt(ret);
 }
@@ -691,6 +824,317 @@ out:
 	return ret;
 }
 
+#ifdef HAVE_TLS
+
+/*
+ * Per-thread caches of small blocks from the main heap. Objects
+ * from the real-time APIs are mostly carved from the main heap via
+ * xnmalloc(), and most of them are smaller than a page. A thread
+ * keeps a few free blocks of each small size at hand, which it
+ * refills from, or flushes to the main heap by batches, so that the
+ * heap lock is taken once every few allocation/release requests.
+ *
+ * Cached blocks are still accounted as busy in the heap. The amount
+ * of memory a thread may hold this way is bounded by
+ * HOBJ_CACHE_SIZE for each bucket.
+ *
+ * Active caches are linked to cache_list under the heap lock, so
+ * that the caches of all live threads can be drained back to the
+ * shared heap when the process exits. Since the owner works on its
+ * cache locklessly, the drainer marks the cache dead first, then
+ * waits for the owner to leave its current operation: the owner
+ * bypasses a dead cache from that point.
+ */
+#define HOBJ_CACHE_SIZE		1024
+#define HOBJ_CACHE_NBUCKETS	(HOBJ_PAGE_SHIFT - HOBJ_MINLOG2)
+
+#define HOBJ_CACHE_LIVE		0
+#define HOBJ_CACHE_DEAD		1
+#define HOBJ_CACHE_DRAINED	2
+
+struct heap_cache {
+	memoff_t freelist[HOBJ_CACHE_NBUCKETS];
+	int count[HOBJ_CACHE_NBUCKETS];
+	unsigned long hits;
+	int active;
+	int busy;
+	int state;
+	struct pvholder next;
+};
+
+static __thread __attribute__ ((tls_model (CONFIG_XENO_TLS_MODEL)))
+struct heap_cache heap_cache;
+
+static pthread_key_t heap_cache_key;
+
+static DEFINE_PRIVATE_LIST(cache_list);
+
+static inline int get_cache_depth(int log2size)
+{
+	return HOBJ_CACHE_SIZE >> log2size;
+}
+
+static void activate_cache(struct heap_cache *cache)
+{
+	struct shared_heap *heap = &main_heap.heap;
+
+	/* Have the cache flushed when the thread exits. */
+	if (!cache->active) {
+		pthread_setspecific(heap_cache_key, cache);
+		lock_heap(heap);
+		pvlist_append(&cache->next, &cache_list);
+		unlock_heap(heap);
+		cache->active = 1;
+	}
+}
+
+static inline int enter_cache(struct heap_cache *cache)
+{
+	ACCESS_ONCE(cache->busy) = 1;
+	smp_mb();
+	if (likely(ACCESS_ONCE(cache->state) == HOBJ_CACHE_LIVE))
+		return 1;
+
+	ACCESS_ONCE(cache->busy) = 0;
+
+	return 0;
+}
+
+static inline void leave_cache(struct heap_cache *cache)
+{
+	smp_mb();
+	ACCESS_ONCE(cache->busy) = 0;
+}
+
+static int refill_cache(struct heap_cache *cache, int log2size)
+{
+	int ilog = log2size - HOBJ_MINLOG2, n, nr;
+	struct shared_heap *heap = &main_heap.heap;
+	caddr_t block;
+
+	nr = get_cache_depth(log2size) / 2;
+
+	lock_heap(heap);
+
+	for (n = 0; n < nr; n++) {
+		block = get_bucket_block(heap, log2size);
+		if (block == NULL)
+			break;
+		*((memoff_t *)block) = cache->freelist[ilog];
+		cache->freelist[ilog] = __shoff(main_base, block);
+	}
+
+	cache->count[ilog] += n;
+	heap->stats.cache_refills++;
+	heap->stats.cache_hits += cache->hits;
+	cache->hits = 0;
+
+	unlock_heap(heap);
+
+	return n;
+}
+
+static void flush_cache(struct heap_cache *cache, int ilog, int nr)
+{
+	struct shared_heap *heap = &main_heap.heap;
+	caddr_t block;
+
+	lock_heap(heap);
+
+	while (nr-- > 0 && cache->count[ilog] > 0) {
+		block = __shref(main_base, cache->freelist[ilog]);
+		cache->freelist[ilog] = *((memoff_t *)block);
+		cache->count[ilog]--;
+		release_block(heap, block);
+	}
+
+	heap->stats.cache_flushes++;
+	heap->stats.cache_hits += cache->hits;
+	cache->hits = 0;
+
+	unlock_heap(heap);
+}
+
+static void flush_cache_all(struct heap_cache *cache)
+{
+	int ilog;
+
+	for (ilog = 0; ilog < HOBJ_CACHE_NBUCKETS; ilog++) {
+		if (cache->count[ilog] > 0)
+			flush_cache(cache, ilog, cache->count[ilog]);
+	}
+}
+
+static void release_cache(void *arg)
+{
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = 100000 };
+	struct shared_heap *heap = &main_heap.heap;
+	struct heap_cache *cache = arg;
+	int state;
+
+	lock_heap(heap);
+	state = cache->state;
+	if (state == HOBJ_CACHE_LIVE)
+		pvlist_remove_init(&cache->next);
+	unlock_heap(heap);
+
+	if (state == HOBJ_CACHE_LIVE) {
+		flush_cache_all(cache);
+		cache->active = 0;
+		return;
+	}
+
+	/* Being drained, our TLS has to stay around until done. */
+	while (ACCESS_ONCE(cache->state) != HOBJ_CACHE_DRAINED)
+		__STD(nanosleep(&delay, NULL));
+}
+
+static void drain_caches(void)
+{
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = 100000 };
+	struct shared_heap *heap = &main_heap.heap;
+	struct heap_cache *cache;
+	DEFINE_PRIVATE_LIST(dead_list);
+
+	lock_heap(heap);
+	while (!pvlist_empty(&cache_list)) {
+		cache = pvlist_pop_entry(&cache_list, struct heap_cache, next);
+		ACCESS_ONCE(cache->state) = HOBJ_CACHE_DEAD;
+		pvlist_append(&cache->next, &dead_list);
+	}
+	unlock_heap(heap);
+
+	smp_mb();
+
+	/*
+	 * Owners in the middle of a cache operation may be waiting
+	 * for the heap lock, or may have been preempted by us: do
+	 * not hold the lock, sleep, do not spin.
+	 */
+	while (!pvlist_empty(&dead_list)) {
+		cache = pvlist_pop_entry(&dead_list, struct heap_cache, next);
+		while (ACCESS_ONCE(cache->busy))
+			__STD(nanosleep(&delay, NULL));
+		flush_cache_all(cache);
+		smp_mb();
+		ACCESS_ONCE(cache->state) = HOBJ_CACHE_DRAINED;
+	}
+}
+
+static void drop_cache_atfork(void)
+{
+	/*
+	 * The blocks we inherited from the parent are still part of
+	 * its own cache, forget about them. Likewise, the caches of
+	 * the other threads did not survive the fork.
+	 */
+	memset(&heap_cache, 0, sizeof(heap_cache));
+	pvholder_init(&heap_cache.next);
+	pvlist_init(&cache_list);
+}
+
+static void *cache_alloc(size_t size)
+{
+	struct heap_cache *cache = &heap_cache;
+	int log2size, ilog;
+	caddr_t block;
+
+	if (!enter_cache(cache))
+		return alloc_block(&main_heap.heap, size);
+
+	log2size = get_log2size(align_alloc_size(size));
+	ilog = log2size - HOBJ_MINLOG2;
+
+	if (cache->count[ilog] > 0)
+		cache->hits++;
+	else if (refill_cache(cache, log2size) == 0) {
+		leave_cache(cache);
+		return NULL;
+	}
+
+	activate_cache(cache);
+	block = __shref(main_base, cache->freelist[ilog]);
+	cache->freelist[ilog] = *((memoff_t *)block);
+	cache->count[ilog]--;
+	leave_cache(cache);
+
+	return block;
+}
+
+static int cache_free(void *block)
+{
+	struct shared_extent *extent = main_extent;
+	struct heap_cache *cache = &heap_cache;
+	int log2size, ilog, depth;
+	memoff_t boff;
+
+	/*
+	 * The caller owns the block, so its page cannot be released
+	 * under our feet: we may safely look up the page map without
+	 * holding the heap lock. Anything but a well-formed small
+	 * block is left to free_block(), which does the error
+	 * checking.
+	 */
+	boff = __shoff(main_base, block);
+	if (boff < extent->membase || boff >= extent->memlim)
+		return -EFAULT;
+
+	boff -= extent->membase;
+	log2size = extent->pagemap[boff >> HOBJ_PAGE_SHIFT].type;
+	if (log2size < HOBJ_MINLOG2 || log2size >= HOBJ_PAGE_SHIFT ||
+	    (boff & ((1 << log2size) - 1)) != 0)
+		return -EINVAL;
+
+	if (!enter_cache(cache))
+		return -EAGAIN;
+
+	ilog = log2size - HOBJ_MINLOG2;
+	depth = get_cache_depth(log2size);
+	if (cache->count[ilog] >= depth)
+		flush_cache(cache, ilog, depth / 2);
+
+	activate_cache(cache);
+	*((memoff_t *)block) = cache->freelist[ilog];
+	cache->freelist[ilog] = __shoff(main_base, block);
+	cache->count[ilog]++;
+	leave_cache(cache);
+
+	return 0;
+}
+
+static int init_cache(void)
+{
+	int ret;
+
+	ret = pthread_key_create(&heap_cache_key, release_cache);
+	if (ret)
+		return __bt(-ret);
+
+	pthread_atfork(NULL, NULL, drop_cache_atfork);
+	atexit(drain_caches);
+
+	return 0;
+}
+
+#else /* !HAVE_TLS */
+
+static inline void *cache_alloc(size_t size)
+{
+	return alloc_block(&main_heap.heap, size);
+}
+
+static inline int cache_free(void *block)
+{
+	return -ENOSYS;
+}
+
+static inline int init_cache(void)
+{
+	return 0;
+}
+
+#endif /* !HAVE_TLS */
+
 #ifndef CONFIG_XENO_REGISTRY
 static void unlink_main_heap(void)
 {
@@ -1009,6 +1453,10 @@ int heapobj_init_array(struct heapobj *hobj, const char *name,
 		       size_t size, int elems)
 {
 	size = align_alloc_size(size);
+	/* Small blocks are served from power-of-two sized buckets. */
+	if (size <= HOBJ_PAGE_SIZE * 2)
+		size = 1UL << get_log2size(size);
+
 	return __bt(heapobj_init(hobj, name, size * elems));
 }
 
@@ -1091,14 +1539,39 @@ size_t heapobj_inquire(struct heapobj *hobj)
 	return heap->ubytes;
 }
 
+void heapobj_inquire_stats(struct heapobj *hobj,
+			   struct heapobj_stats *stats)
+{
+	struct shared_heap *heap;
+
+	/* A NULL heap object stands for the main heap. */
+	heap = hobj ? __mptr(hobj->pool_ref) : &main_heap.heap;
+	read_lock_nocancel(&heap->lock);
+	stats->total = heap->total;
+	stats->used = heap->ubytes;
+	stats->lock_count = heap->stats.locks;
+	stats->lock_contended = heap->stats.contended;
+	stats->cache_hits = heap->stats.cache_hits;
+	stats->cache_refills = heap->stats.cache_refills;
+	stats->cache_flushes = heap->stats.cache_flushes;
+	read_unlock(&heap->lock);
+}
+
 void *xnmalloc(size_t size)
 {
+	if (size == 0)
+		return NULL;
+
+	if (align_alloc_size(size) <= HOBJ_PAGE_SIZE / 2)
+		return cache_alloc(size);
+
 	return alloc_block(&main_heap.heap, size);
 }
 
 void xnfree(void *ptr)
 {
-	free_block(&main_heap.heap, ptr);
+	if (cache_free(ptr))
+		free_block(&main_heap.heap, ptr);
 }
 
 char *xnstrdup(const char *ptr)
@@ -1121,8 +1594,10 @@ int heapobj_pkg_init_shared(void)
 	if (ret == -EEXIST)
 		warning("session %s is still active (pid %d)\n",
 			__copperplate_setup_data.session_label, cnode);
+	if (ret)
+		return __bt(ret);
 
-	return __bt(ret);
+	return __bt(init_cache());
 }
 
 int heapobj_bind_session(const char *session)
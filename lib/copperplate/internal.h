@@ -70,6 +70,13 @@ struct shared_heap {
 		memoff_t freelist;
 		int fcount;
 	} buckets[HOBJ_NBUCKETS];
+	struct {
+		unsigned long locks;
+		unsigned long contended;
+		unsigned long cache_hits;
+		unsigned long cache_refills;
+		unsigned long cache_flushes;
+	} stats;
 };
 
 struct corethread_attributes {
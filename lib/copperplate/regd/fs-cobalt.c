@@ -138,6 +138,17 @@ struct sysreg_fsfile sysreg_files[] = {
 			.read = fsobj_obstack_read
 		},
 	},
+#if defined(CONFIG_XENO_PSHARED) && defined(CONFIG_XENO_SYNCOBJ_STATS)
+	{
+		.path = "/syncobjs",
+		.mode = O_RDONLY,
+		.ops = {
+			.open = open_syncobjs,
+			.release = fsobj_obstack_release,
+			.read = fsobj_obstack_read
+		},
+	},
+#endif /* CONFIG_XENO_PSHARED && CONFIG_XENO_SYNCOBJ_STATS */
 	{
 		.path = "/version",
 		.mode = O_RDONLY,
@@ -27,6 +27,7 @@
 #include <copperplate/heapobj.h>
 #include <copperplate/threadobj.h>
 #include <copperplate/clockobj.h>
+#include <copperplate/syncobj.h>
 #include <xenomai/version.h>
 #include "sysregfs.h"
 #include "../internal.h"
@@ -276,6 +277,91 @@ out:
 	return len < 0 ? len : 0;
 }
 
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+
+#define PERCENTILE(__histo, __pct)	\
+	syncobj_histo_percentile(__histo, SYNCOBJ_TIME_BUCKETS, __pct)
+
+int open_syncobjs(struct fsobj *fsobj, void *priv)
+{
+	struct syncobj_stats *stats_data, *p;
+	struct sysgroup_memspec *obj, *tmp;
+	struct fsobstack *o = priv;
+	int ret, count, len = 0;
+
+	ret = heapobj_bind_session(__copperplate_setup_data.session_label);
+	if (ret)
+		return ret;
+
+	fsobstack_init(o);
+
+	sysgroup_lock();
+	count = sysgroup_count(syncobj);
+	sysgroup_unlock();
+
+	if (count == 0)
+		goto out;
+
+	stats_data = p = malloc(sizeof(*p) * count);
+	if (stats_data == NULL) {
+		len = -ENOMEM;
+		goto out;
+	}
+
+	sysgroup_lock();
+
+	/*
+	 * Same as for heaps, a syncobj cannot vanish as long as we
+	 * hold the group lock. We don't grab the object lock for
+	 * reading the counters, so a snapshot may be slightly off
+	 * with respect to concurrent updates, which is fine for
+	 * statistics.
+	 */
+	for_each_sysgroup(obj, tmp, syncobj) {
+		if (p - stats_data >= count)
+			break;
+		*p = *container_of(obj, struct syncobj_stats, memspec);
+		p++;
+	}
+
+	sysgroup_unlock();
+
+	count = p - stats_data;
+	if (count == 0)
+		goto out_free;
+
+	len = fsobstack_grow_format(o, "%-6s %-16s %10s %8s %8s %5s"
+				    "  %10s %10s  %10s %10s\n",
+				    "PID", "NAME", "GRANTS", "TIMEOUTS",
+				    "FLUSHES", "MAXW", "WAIT50(ns)",
+				    "WAIT99(ns)", "HOLD50(ns)", "HOLD99(ns)");
+
+	for (p = stats_data; count > 0; count--, p++) {
+		if (kill(p->cnode, 0))
+			continue;
+		len += fsobstack_grow_format(o, "%-6d %-16.16s %10lu %8lu %8lu %5d"
+					     "  %10llu %10llu  %10llu %10llu\n",
+					     p->cnode, *p->name ? p->name : "-",
+					     p->grants, p->timeouts, p->flushes,
+					     p->max_waiters,
+					     PERCENTILE(p->wait_time, 50),
+					     PERCENTILE(p->wait_time, 99),
+					     PERCENTILE(p->hold_time, 50),
+					     PERCENTILE(p->hold_time, 99));
+	}
+
+out_free:
+	free(stats_data);
+out:
+	heapobj_unbind_session();
+
+	fsobstack_finish(o);
+
+	return len < 0 ? len : 0;
+}
+
+#endif /* CONFIG_XENO_SYNCOBJ_STATS */
+
 #endif /* CONFIG_XENO_PSHARED */
 
 int open_version(struct fsobj *fsobj, void *priv)
@@ -111,6 +111,17 @@ struct sysreg_fsfile sysreg_files[] = {
 			.read = fsobj_obstack_read
 		},
 	},
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+	{
+		.path = "/syncobjs",
+		.mode = O_RDONLY,
+		.ops = {
+			.open = open_syncobjs,
+			.release = fsobj_obstack_release,
+			.read = fsobj_obstack_read
+		},
+	},
+#endif /* CONFIG_XENO_SYNCOBJ_STATS */
 #endif /* CONFIG_XENO_PSHARED */
 	{
 		.path = "/version",
@@ -52,6 +52,8 @@ int open_threads(struct fsobj *fsobj, void *priv);
 
 int open_heaps(struct fsobj *fsobj, void *priv);
 
+int open_syncobjs(struct fsobj *fsobj, void *priv);
+
 int open_version(struct fsobj *fsobj, void *priv);
 
 char *format_thread_status(const struct thread_data *p,
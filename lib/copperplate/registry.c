@@ -1019,3 +1019,63 @@ int fsobstack_grow_syncobj_drain(struct fsobstack *o, struct syncobj *sobj,
 	return collect_wait_list(o, sobj, &sobj->drain_list,
 				 &sobj->drain_count, ops);
 }
+
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+
+static int grow_histo(struct fsobstack *o, const char *label,
+		      const unsigned long *histo, int nr_buckets,
+		      const char *unit)
+{
+	int n, len;
+
+	len = fsobstack_grow_format(o, "--\n[%s]\n", label);
+
+	for (n = 0; n < nr_buckets; n++) {
+		if (histo[n] == 0)
+			continue;
+		if (n == nr_buckets - 1)
+			len += fsobstack_grow_format(o, " >= %-10llu %s  %lu\n",
+						     1ULL << n, unit, histo[n]);
+		else
+			len += fsobstack_grow_format(o, "  < %-10llu %s  %lu\n",
+						     2ULL << n, unit, histo[n]);
+	}
+
+	return len;
+}
+
+int fsobstack_grow_syncobj_stats(struct fsobstack *o, struct syncobj *sobj)
+{
+	struct syncobj_stats stats;
+	struct syncstate syns;
+	struct service svc;
+	int ret;
+
+	CANCEL_DEFER(svc);
+
+	ret = syncobj_lock(sobj, &syns);
+	if (ret)
+		goto out;
+
+	syncobj_get_stats(sobj, &stats);
+	syncobj_unlock(sobj, &syns);
+
+	ret = fsobstack_grow_format(o, "--\n%10s  %10s  %10s  %10s\n",
+				    "[GRANTS]", "[TIMEOUTS]", "[FLUSHES]",
+				    "[MAXWAIT]");
+	ret += fsobstack_grow_format(o, "%10lu  %10lu  %10lu  %10d\n",
+				     stats.grants, stats.timeouts,
+				     stats.flushes, stats.max_waiters);
+	ret += grow_histo(o, "WAIT-TIME", stats.wait_time,
+			  SYNCOBJ_TIME_BUCKETS, "ns");
+	ret += grow_histo(o, "HOLD-TIME", stats.hold_time,
+			  SYNCOBJ_TIME_BUCKETS, "ns");
+	ret += grow_histo(o, "WAITERS-AT-GRANT", stats.waiters,
+			  SYNCOBJ_WAITER_BUCKETS, "");
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
+#endif /* CONFIG_XENO_SYNCOBJ_STATS */
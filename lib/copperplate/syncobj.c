@@ -18,9 +18,11 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
 #include "boilerplate/lock.h"
 #include "copperplate/threadobj.h"
 #include "copperplate/syncobj.h"
+#include "copperplate/clockobj.h"
 #include "copperplate/debug.h"
 #include "internal.h"
 
@@ -229,9 +231,152 @@ static inline void syncobj_cleanup_corespec(struct syncobj *sobj)
 
 #endif	/* CONFIG_XENO_MERCURY */
 
+#ifdef CONFIG_XENO_SYNCOBJ_STATS
+
+/*
+ * All counters are updated under the monitor lock, so that readers
+ * can get a consistent snapshot by grabbing the same lock.
+ */
+
+static inline void stats_init(struct syncobj *sobj)
+{
+	struct syncobj_stats *stats = &sobj->stats;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->cnode = __node_id;
+#ifdef CONFIG_XENO_PSHARED
+	/* Only objects peer processes can read are advertised. */
+	if (__main_sysgroup && __mchk(sobj))
+		sysgroup_add(syncobj, &stats->memspec);
+#endif
+}
+
+static inline void stats_cleanup(struct syncobj *sobj)
+{
+#ifdef CONFIG_XENO_PSHARED
+	if (__main_sysgroup && __mchk(sobj))
+		sysgroup_remove(syncobj, &sobj->stats.memspec);
+#endif
+}
+
+static inline ticks_t stats_elapsed(ticks_t date)
+{
+	return clockobj_tsc_to_ns(clockobj_get_tsc() - date);
+}
+
+static inline void stats_lock(struct syncobj *sobj)
+{
+	sobj->stats.lock_date = clockobj_get_tsc();
+}
+
+static inline void stats_unlock(struct syncobj *sobj)
+{
+	struct syncobj_stats *stats = &sobj->stats;
+	ticks_t hold = stats_elapsed(stats->lock_date);
+
+	stats->hold_time[syncobj_histo_bucket(hold, SYNCOBJ_TIME_BUCKETS)]++;
+}
+
+static inline void stats_grant(struct syncobj *sobj, int nwaiters)
+{
+	struct syncobj_stats *stats = &sobj->stats;
+
+	stats->grants++;
+	stats->waiters[syncobj_histo_bucket(nwaiters, SYNCOBJ_WAITER_BUCKETS)]++;
+	if (nwaiters > stats->max_waiters)
+		stats->max_waiters = nwaiters;
+}
+
+static inline ticks_t stats_wait_start(void)
+{
+	return clockobj_get_tsc();
+}
+
+static inline void stats_wait_end(struct syncobj *sobj,
+				  struct threadobj *current,
+				  ticks_t start, int ret)
+{
+	struct syncobj_stats *stats = &sobj->stats;
+	ticks_t wait = stats_elapsed(start);
+
+	stats->wait_time[syncobj_histo_bucket(wait, SYNCOBJ_TIME_BUCKETS)]++;
+
+	/* Still queued means not granted, see wait_epilogue(). */
+	if (ret == -ETIMEDOUT && current->wait_sobj)
+		stats->timeouts++;
+	else if (current->wait_status & SYNCOBJ_FLUSHED)
+		stats->flushes++;
+
+	stats_lock(sobj);
+}
+
+void syncobj_set_name(struct syncobj *sobj, const char *name)
+{
+	namecpy(sobj->stats.name, name);
+}
+
+void syncobj_get_stats(struct syncobj *sobj,
+		       struct syncobj_stats *stats)
+{
+	__syncobj_check_locked(sobj);
+	*stats = sobj->stats;
+}
+
+void syncobj_reset_stats(struct syncobj *sobj)
+{
+	struct syncobj_stats *stats = &sobj->stats;
+
+	__syncobj_check_locked(sobj);
+
+	stats->grants = 0;
+	stats->timeouts = 0;
+	stats->flushes = 0;
+	stats->max_waiters = 0;
+	memset(stats->wait_time, 0, sizeof(stats->wait_time));
+	memset(stats->hold_time, 0, sizeof(stats->hold_time));
+	memset(stats->waiters, 0, sizeof(stats->waiters));
+}
+
+#else /* !CONFIG_XENO_SYNCOBJ_STATS */
+
+static inline void stats_init(struct syncobj *sobj)
+{
+}
+
+static inline void stats_cleanup(struct syncobj *sobj)
+{
+}
+
+static inline void stats_lock(struct syncobj *sobj)
+{
+}
+
+static inline void stats_unlock(struct syncobj *sobj)
+{
+}
+
+static inline void stats_grant(struct syncobj *sobj, int nwaiters)
+{
+}
+
+static inline ticks_t stats_wait_start(void)
+{
+	return 0;
+}
+
+static inline void stats_wait_end(struct syncobj *sobj,
+				  struct threadobj *current,
+				  ticks_t start, int ret)
+{
+}
+
+#endif /* !CONFIG_XENO_SYNCOBJ_STATS */
+
 int syncobj_init(struct syncobj *sobj, clockid_t clk_id, int flags,
 		 fnref_type(void (*)(struct syncobj *sobj)) finalizer)
 {
+	int ret;
+
 	sobj->flags = flags;
 	list_init(&sobj->grant_list);
 	list_init(&sobj->drain_list);
@@ -241,7 +386,13 @@ int syncobj_init(struct syncobj *sobj, clockid_t clk_id, int flags,
 	sobj->finalizer = finalizer;
 	sobj->magic = SYNCOBJ_MAGIC;
 
-	return __bt(syncobj_init_corespec(sobj, clk_id));
+	ret = __bt(syncobj_init_corespec(sobj, clk_id));
+	if (ret)
+		return ret;
+
+	stats_init(sobj);
+
+	return 0;
 }
 
 int syncobj_lock(struct syncobj *sobj, struct syncstate *syns)
@@ -267,6 +418,7 @@ int syncobj_lock(struct syncobj *sobj, struct syncstate *syns)
 
 	syns->state = oldstate;
 	__syncobj_tag_locked(sobj);
+	stats_lock(sobj);
 	return 0;
 fail:
 	pthread_setcancelstate(oldstate, NULL);
@@ -275,6 +427,7 @@ fail:
 
 void syncobj_unlock(struct syncobj *sobj, struct syncstate *syns)
 {
+	stats_unlock(sobj);
 	__syncobj_tag_unlocked(sobj);
 	monitor_exit(sobj);
 	pthread_setcancelstate(syns->state, NULL);
@@ -289,6 +442,7 @@ static void __syncobj_finalize(struct syncobj *sobj)
 	 * thread finalizer, therefore we can't be wiped off in the
 	 * middle of the finalization process.
 	 */
+	stats_cleanup(sobj);
 	syncobj_cleanup_corespec(sobj);
 	fnref_get(finalizer, sobj->finalizer);
 	if (finalizer)
@@ -302,6 +456,8 @@ int __syncobj_broadcast_grant(struct syncobj *sobj, int reason)
 
 	assert(!list_empty(&sobj->grant_list));
 
+	stats_grant(sobj, sobj->grant_count);
+
 	do {
 		thobj = list_pop_entry(&sobj->grant_list,
 				       struct threadobj, wait_link);
@@ -323,6 +479,8 @@ int __syncobj_broadcast_drain(struct syncobj *sobj, int reason)
 
 	assert(!list_empty(&sobj->drain_list));
 
+	stats_grant(sobj, sobj->drain_count);
+
 	do {
 		thobj = list_pop_entry(&sobj->drain_list,
 				       struct threadobj, wait_link);
@@ -404,6 +562,7 @@ struct threadobj *syncobj_grant_one(struct syncobj *sobj)
 	if (list_empty(&sobj->grant_list))
 		return NULL;
 
+	stats_grant(sobj, sobj->grant_count);
 	thobj = list_pop_entry(&sobj->grant_list, struct threadobj, wait_link);
 	thobj->wait_status |= SYNCOBJ_SIGNALED;
 	thobj->wait_sobj = NULL;
@@ -417,6 +576,7 @@ void syncobj_grant_to(struct syncobj *sobj, struct threadobj *thobj)
 {
 	__syncobj_check_locked(sobj);
 
+	stats_grant(sobj, sobj->grant_count);
 	list_remove(&thobj->wait_link);
 	thobj->wait_status |= SYNCOBJ_SIGNALED;
 	thobj->wait_sobj = NULL;
@@ -526,6 +686,7 @@ int syncobj_wait_grant(struct syncobj *sobj, const struct timespec *timeout,
 		       struct syncstate *syns)
 {
 	struct threadobj *current = threadobj_current();
+	ticks_t start;
 	int ret, state;
 
 	__syncobj_check_locked(sobj);
@@ -548,6 +709,9 @@ int syncobj_wait_grant(struct syncobj *sobj, const struct timespec *timeout,
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &state);
 	assert(state == PTHREAD_CANCEL_DISABLE);
 
+	stats_unlock(sobj);
+	start = stats_wait_start();
+
 	do {
 		__syncobj_tag_unlocked(sobj);
 		ret = monitor_wait_grant(sobj, current, timeout);
@@ -557,6 +721,8 @@ int syncobj_wait_grant(struct syncobj *sobj, const struct timespec *timeout,
 
 	pthread_setcancelstate(state, NULL);
 
+	stats_wait_end(sobj, current, start, ret);
+
 	return wait_epilogue(sobj, syns, current, ret);
 }
 
@@ -564,6 +730,7 @@ int syncobj_wait_drain(struct syncobj *sobj, const struct timespec *timeout,
 		       struct syncstate *syns)
 {
 	struct threadobj *current = threadobj_current();
+	ticks_t start;
 	int ret, state;
 
 	__syncobj_check_locked(sobj);
@@ -587,6 +754,9 @@ int syncobj_wait_drain(struct syncobj *sobj, const struct timespec *timeout,
 	 * threads. Therefore the caller must check that the drain
 	 * condition is still true before proceeding.
 	 */
+	stats_unlock(sobj);
+	start = stats_wait_start();
+
 	do {
 		__syncobj_tag_unlocked(sobj);
 		ret = monitor_wait_drain(sobj, current, timeout);
@@ -595,6 +765,8 @@ int syncobj_wait_drain(struct syncobj *sobj, const struct timespec *timeout,
 
 	pthread_setcancelstate(state, NULL);
 
+	stats_wait_end(sobj, current, start, ret);
+
 	return wait_epilogue(sobj, syns, current, ret);
 }
 
@@ -622,5 +794,6 @@ void syncobj_uninit(struct syncobj *sobj)
 {
 	monitor_enter(sobj);
 	assert(sobj->wait_count == 0);
+	stats_cleanup(sobj);
 	syncobj_cleanup_corespec(sobj);
 }
@@ -23,7 +23,9 @@
 #include <memory.h>
 #include <boilerplate/ancillaries.h>
 #include <boilerplate/lock.h>
+#include <boilerplate/atomic.h>
 #include <copperplate/cluster.h>
+#include <copperplate/clockobj.h>
 #include <psos/psos.h>
 #include "internal.h"
 #include "pt.h"
@@ -38,15 +40,6 @@ pt->bitmap[((n) / (sizeof(u_long) * 8))]
 #define pt_block_pos(n) \
 (1L << ((n) % (sizeof(u_long) * 8)))
 
-#define pt_bitmap_setbit(pt,n) \
-(pt_bitmap_pos(pt,n) |= pt_block_pos(n))
-
-#define pt_bitmap_clrbit(pt,n) \
-(pt_bitmap_pos(pt,n) &= ~pt_block_pos(n))
-
-#define pt_bitmap_tstbit(pt,n) \
-(pt_bitmap_pos(pt,n) & pt_block_pos(n))
-
 struct pvcluster psos_pt_table;
 
 static unsigned long anon_ptids;
@@ -63,7 +56,7 @@ static unsigned long anon_ptids;
  * from cancellation points. You have been warned.
  */
 
-static struct psos_pt *get_pt_from_id(u_long ptid, int *err_r)
+static struct psos_pt *find_pt_from_id(u_long ptid, int *err_r)
 {
 	struct psos_pt *pt = (struct psos_pt *)ptid;
 
@@ -78,14 +71,8 @@ static struct psos_pt *get_pt_from_id(u_long ptid, int *err_r)
 	if (pt == NULL || ((uintptr_t)pt & (sizeof(uintptr_t)-1)) != 0)
 		goto objid_error;
 
-	if (pt->magic == pt_magic) {
-		if (__RT(pthread_mutex_lock(&pt->lock)) == 0) {
-			if (pt->magic == pt_magic)
-				return pt;
-			__RT(pthread_mutex_unlock(&pt->lock));
-			/* Will likely fall down to ERR_OBJDEL. */
-		}
-	}
+	if (pt->magic == pt_magic)
+		return pt;
 
 	if (pt->magic == ~pt_magic) {
 		*err_r = ERR_OBJDEL;
@@ -103,11 +90,114 @@ objid_error:
 	return NULL;
 }
 
+static struct psos_pt *get_pt_from_id(u_long ptid, int *err_r)
+{
+	struct psos_pt *pt;
+
+	pt = find_pt_from_id(ptid, err_r);
+	if (pt == NULL)
+		return NULL;
+
+	if (__RT(pthread_mutex_lock(&pt->lock)) == 0) {
+		if (pt->magic == pt_magic)
+			return pt;
+		__RT(pthread_mutex_unlock(&pt->lock));
+	}
+
+	*err_r = ERR_OBJDEL;
+
+	return NULL;
+}
+
 static inline void put_pt(struct psos_pt *pt)
 {
 	__RT(pthread_mutex_unlock(&pt->lock));
 }
 
+/*
+ * pt_getbuf() and pt_retbuf() do not take the partition lock, but
+ * count themselves in pt->busy while they access the partition.
+ * pt_delete() raises PT_BUSY_DEL, then waits for the callers already
+ * in flight to leave. Callers which find the bit raised wait for the
+ * outcome of the deletion on the partition lock, which the deleter
+ * holds meanwhile.
+ */
+#define PT_BUSY_DEL	(1UL << (sizeof(unsigned long) * 8 - 1))
+
+static int pt_enter(struct psos_pt *pt, int *err_r)
+{
+	unsigned long old;
+
+	for (;;) {
+		old = ACCESS_ONCE(pt->busy);
+		if (old & PT_BUSY_DEL) {
+			if (get_pt_from_id((u_long)pt, err_r) == NULL)
+				return 0;
+			put_pt(pt);
+			continue;
+		}
+		if (__sync_bool_compare_and_swap(&pt->busy, old, old + 1))
+			return 1;
+	}
+}
+
+static inline void pt_leave(struct psos_pt *pt)
+{
+	__sync_sub_and_fetch(&pt->busy, 1);
+}
+
+/* Partition lock held. */
+static void pt_quiesce(struct psos_pt *pt)
+{
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = 100000 };
+
+	__sync_fetch_and_or(&pt->busy, PT_BUSY_DEL);
+
+	/*
+	 * Callers in flight never block, but may have been preempted
+	 * by us: sleep, do not spin.
+	 */
+	while (ACCESS_ONCE(pt->busy) != PT_BUSY_DEL)
+		__RT(clock_nanosleep(CLOCK_COPPERPLATE, 0, &delay, NULL));
+}
+
+/*
+ * The free list is a lock-free stack of buffers. Each free buffer
+ * links to the next one by index (1-based, zero ends the list), and
+ * the list head carries a generation tag in the bits above the
+ * index, which is bumped on every update so that a stale head
+ * cannot be installed back by a preempted caller (ABA).
+ */
+static void *pt_pop_freelist(struct psos_pt *pt)
+{
+	unsigned long old, new, idx;
+	caddr_t buf;
+
+	for (;;) {
+		old = ACCESS_ONCE(pt->freehead);
+		idx = old & pt->imask;
+		if (idx == 0)
+			return NULL;
+		buf = pt->data + (idx - 1) * pt->bsize;
+		new = ((old | pt->imask) + 1) | ACCESS_ONCE(*(unsigned long *)buf);
+		if (__sync_bool_compare_and_swap(&pt->freehead, old, new))
+			return buf;
+	}
+}
+
+static void pt_push_freelist(struct psos_pt *pt, caddr_t buf)
+{
+	unsigned long old, new, idx;
+
+	idx = (buf - pt->data) / pt->bsize + 1;
+
+	do {
+		old = ACCESS_ONCE(pt->freehead);
+		*(unsigned long *)buf = old & pt->imask;
+		new = ((old | pt->imask) + 1) | idx;
+	} while (!__sync_bool_compare_and_swap(&pt->freehead, old, new));
+}
+
 static inline size_t pt_overhead(size_t psize, size_t bsize)
 {
 	size_t m = (bsize * 8);
@@ -169,17 +259,21 @@ u_long pt_create(const char *name,
 	}
 
 	pt->psize = pt->nblks * pt->bsize;
-	pt->data = (caddr_t)pt + overhead;
-	pt->freelist = mp = pt->data;
+	pt->data = mp = (caddr_t)pt + overhead;
 	pt->ublks = 0;
 
-	for (n = pt->nblks; n > 1; n--) {
-		caddr_t nmp = mp + pt->bsize;
-		*((void **)mp) = nmp;
-		mp = nmp;
+	/* Index bits must hold nblks, the generation tag gets the rest. */
+	for (pt->imask = 1; pt->imask <= pt->nblks; pt->imask = (pt->imask << 1) | 1)
+		;
+
+	for (n = 1; n < pt->nblks; n++) {
+		*((unsigned long *)mp) = n + 1;
+		mp += pt->bsize;
 	}
 
-	*((void **)mp) = NULL;
+	*((unsigned long *)mp) = 0;
+	pt->freehead = 1;
+	pt->busy = 0;
 	memset(pt->bitmap, 0, overhead - sizeof(*pt) + sizeof(pt->bitmap));
 	*nbuf = pt->nblks;
 
@@ -208,21 +302,32 @@ u_long pt_delete(u_long ptid)
 	if (pt == NULL)
 		return ret;
 
+	CANCEL_DEFER(svc);
+
+	pt_quiesce(pt);
+
 	if ((pt->flags & PT_DEL) == 0 && pt->ublks > 0) {
+		__sync_fetch_and_and(&pt->busy, ~PT_BUSY_DEL);
+		CANCEL_RESTORE(svc);
 		put_pt(pt);
 		return ERR_BUFINUSE;
 	}
 
-	CANCEL_DEFER(svc);
 	pvcluster_delobj(&psos_pt_table, &pt->cobj);
-	CANCEL_RESTORE(svc);
 	pt->magic = ~pt_magic; /* Prevent further reference. */
+	CANCEL_RESTORE(svc);
 	put_pt(pt);
 	__RT(pthread_mutex_destroy(&pt->lock));
 
 	return SUCCESS;
 }
 
+/*
+ * Getting and returning buffers never block and do not hold the
+ * partition lock, unless a deletion is pending (see pt_enter()). The
+ * allocation bitmap is updated atomically, so that returning a free
+ * buffer is still detected.
+ */
 u_long pt_getbuf(u_long ptid, void **bufaddr)
 {
 	struct psos_pt *pt;
@@ -230,23 +335,24 @@ u_long pt_getbuf(u_long ptid, void **bufaddr)
 	void *buf;
 	int ret;
 
-	pt = get_pt_from_id(ptid, &ret);
+	pt = find_pt_from_id(ptid, &ret);
 	if (pt == NULL)
 		return ret;
 
-	buf = pt->freelist;
-	if (buf) {
-		pt->freelist = *((void **)buf);
-		pt->ublks++;
-		numblk = ((caddr_t)buf - pt->data) / pt->bsize;
-		pt_bitmap_setbit(pt, numblk);
-	}
-
-	put_pt(pt);
+	if (!pt_enter(pt, &ret))
+		return ret;
 
+	buf = pt_pop_freelist(pt);
 	*bufaddr = buf;
-	if (buf == NULL)
+	if (buf == NULL) {
+		pt_leave(pt);
 		return ERR_NOBUF;
+	}
+
+	numblk = ((caddr_t)buf - pt->data) / pt->bsize;
+	__sync_fetch_and_or(&pt_bitmap_pos(pt, numblk), pt_block_pos(numblk));
+	__sync_add_and_fetch(&pt->ublks, 1);
+	pt_leave(pt);
 
 	return SUCCESS;
 }
@@ -254,36 +360,35 @@ u_long pt_getbuf(u_long ptid, void **bufaddr)
 u_long pt_retbuf(u_long ptid, void *buf)
 {
 	struct psos_pt *pt;
-	u_long numblk;
+	u_long numblk, old;
 	int ret;
 
-	pt = get_pt_from_id(ptid, &ret);
+	pt = find_pt_from_id(ptid, &ret);
 	if (pt == NULL)
 		return ret;
 
 	if ((caddr_t)buf < pt->data ||
 	    (caddr_t)buf >= pt->data + pt->psize ||
-	    (((caddr_t)buf - pt->data) % pt->bsize) != 0) {
-		ret = ERR_BUFADDR;
-		goto done;
-	}
+	    (((caddr_t)buf - pt->data) % pt->bsize) != 0)
+		return ERR_BUFADDR;
 
 	numblk = ((caddr_t)buf - pt->data) / pt->bsize;
 
-	if (!pt_bitmap_tstbit(pt, numblk)) {
-		ret = ERR_BUFFREE;
-		goto done;
+	if (!pt_enter(pt, &ret))
+		return ret;
+
+	old = __sync_fetch_and_and(&pt_bitmap_pos(pt, numblk),
+				   ~pt_block_pos(numblk));
+	if ((old & pt_block_pos(numblk)) == 0) {
+		pt_leave(pt);
+		return ERR_BUFFREE;
 	}
 
-	pt_bitmap_clrbit(pt, numblk);
-	*((void **)buf) = pt->freelist;
-	pt->freelist = buf;
-	pt->ublks--;
-	ret = SUCCESS;
-done:
-	put_pt(pt);
+	__sync_sub_and_fetch(&pt->ublks, 1);
+	pt_push_freelist(pt, buf);
+	pt_leave(pt);
 
-	return ret;
+	return SUCCESS;
 }
 
 u_long pt_ident(const char *name, u_long node, u_long *ptid_r)
@@ -36,7 +36,9 @@ struct psos_pt {
 	unsigned long nblks;
 	unsigned long ublks;
 
-	void *freelist;
+	unsigned long freehead;
+	unsigned long imask;
+	unsigned long busy;
 	caddr_t data;
 	unsigned long bitmap[1];
 };
@@ -115,6 +115,8 @@ static u_long __q_create(const char *name, u_long count,
 		goto fail_syncinit;
 	}
 
+	syncobj_set_name(&q->sobj, q->name);
+
 	list_init(&q->msg_list);
 	q->msgcount = 0;
 	q->magic = queue_magic;
@@ -299,11 +301,18 @@ done:
 	return SUCCESS;
 }
 
-static u_long __q_send(u_long qid, u_long flags, u_long *buffer, u_long bytes)
+/*
+ * Batches are sent under a single lock, each message being handed
+ * over to the next waiting receiver if any, or queued otherwise, so
+ * that every receiver is woken up once.
+ */
+static u_long __q_send(u_long qid, u_long flags, u_long *buffer, u_long bytes,
+		       u_long count, u_long *count_r)
 {
 	struct syncstate syns;
 	struct psos_queue *q;
 	struct service svc;
+	u_long n = 0;
 	int ret;
 
 	q = get_queue_from_id(qid, &ret);
@@ -327,33 +336,48 @@ static u_long __q_send(u_long qid, u_long flags, u_long *buffer, u_long bytes)
 		goto fail;
 	}
 
-	ret = __q_send_inner(q, flags, buffer, bytes);
+	for (ret = SUCCESS; n < count; n++) {
+		ret = __q_send_inner(q, flags,
+				     (u_long *)((caddr_t)buffer + n * bytes),
+				     bytes);
+		if (ret)
+			break;
+	}
 fail:
 	syncobj_unlock(&q->sobj, &syns);
 out:
 	CANCEL_RESTORE(svc);
 
+	if (count_r)
+		*count_r = n;
+
 	return ret;
 }
 
 u_long q_send(u_long qid, u_long msgbuf[4])
 {
-	return __q_send(qid, 0, msgbuf, sizeof(u_long[4]));
+	return __q_send(qid, 0, msgbuf, sizeof(u_long[4]), 1, NULL);
 }
 
 u_long q_vsend(u_long qid, void *msgbuf, u_long msglen)
 {
-	return __q_send(qid, Q_VARIABLE, msgbuf, msglen);
+	return __q_send(qid, Q_VARIABLE, msgbuf, msglen, 1, NULL);
+}
+
+u_long q_vsend_batch(u_long qid, void *msgbuf, u_long msglen,
+		     u_long count, u_long *count_r)
+{
+	return __q_send(qid, Q_VARIABLE, msgbuf, msglen, count, count_r);
 }
 
 u_long q_urgent(u_long qid, u_long msgbuf[4])
 {
-	return __q_send(qid, Q_JAMMED, msgbuf, sizeof(u_long[4]));
+	return __q_send(qid, Q_JAMMED, msgbuf, sizeof(u_long[4]), 1, NULL);
 }
 
 u_long q_vurgent(u_long qid, void *msgbuf, u_long msglen)
 {
-	return __q_send(qid, Q_VARIABLE | Q_JAMMED, msgbuf, msglen);
+	return __q_send(qid, Q_VARIABLE | Q_JAMMED, msgbuf, msglen, 1, NULL);
 }
 
 static u_long __q_broadcast(u_long qid, u_long flags,
@@ -411,17 +435,40 @@ u_long q_vbroadcast(u_long qid, void *msgbuf, u_long msglen, u_long *count_r)
 	return __q_broadcast(qid, Q_VARIABLE, msgbuf, msglen, count_r);
 }
 
+static u_long __q_pop_msg(struct psos_queue *q, void *buffer, u_long msglen)
+{
+	struct msgholder *msg;
+	u_long nbytes;
+
+	q->msgcount--;
+	msg = list_pop_entry(&q->msg_list, struct msgholder, link);
+	nbytes = msg->size;
+	if (nbytes > msglen)
+		nbytes = msglen;
+	if (nbytes > 0)
+		memcpy(buffer, msg + 1, nbytes);
+	xnfree(msg);
+
+	return nbytes;
+}
+
+/*
+ * Only the first message of a batch may be waited for, the
+ * following ones are pulled from the queue as long as available,
+ * each in a slot of msglen bytes.
+ */
 static u_long __q_receive(u_long qid, u_long flags, u_long timeout,
-			  void *buffer, u_long msglen, u_long *msglen_r)
+			  void *buffer, u_long msglen, u_long count,
+			  u_long *msglens, u_long *count_r)
 {
 	struct psos_queue_wait *wait = NULL;
 	struct timespec ts, *timespec;
-	struct msgholder *msg = NULL;
 	struct syncstate syns;
 	unsigned long nbytes;
 	struct psos_queue *q;
 	struct service svc;
 	int ret = SUCCESS;
+	u_long n = 0;
 
 	q = get_queue_from_id(qid, &ret);
 	if (q == NULL)
@@ -440,14 +487,7 @@ static u_long __q_receive(u_long qid, u_long flags, u_long timeout,
 	}
 retry:
 	if (!list_empty(&q->msg_list)) {
-		q->msgcount--;
-		msg = list_pop_entry(&q->msg_list, struct msgholder, link);
-		nbytes = msg->size;
-		if (nbytes > msglen)
-			nbytes = msglen;
-		if (nbytes > 0)
-			memcpy(buffer, msg + 1, nbytes);
-		xnfree(msg);
+		nbytes = __q_pop_msg(q, buffer, msglen);
 		goto done;
 	}
 
@@ -480,8 +520,13 @@ retry:
 	if (nbytes == -1UL)	/* No direct copy? */
 		goto retry;
 done:
-	if (msglen_r)
-		*msglen_r = nbytes;
+	for (;;) {
+		if (msglens)
+			msglens[n] = nbytes;
+		if (++n >= count || list_empty(&q->msg_list))
+			break;
+		nbytes = __q_pop_msg(q, (caddr_t)buffer + n * msglen, msglen);
+	}
 fail:
 	syncobj_unlock(&q->sobj, &syns);
 out:
@@ -490,18 +535,35 @@ out:
 
 	CANCEL_RESTORE(svc);
 
+	if (count_r)
+		*count_r = n;
+
 	return ret;
 }
 
 u_long q_receive(u_long qid, u_long flags, u_long timeout, u_long msgbuf[4])
 {
 	return __q_receive(qid, flags & ~Q_VARIABLE,
-			   timeout, msgbuf, sizeof(u_long[4]), NULL);
+			   timeout, msgbuf, sizeof(u_long[4]), 1, NULL, NULL);
 }
 
 u_long q_vreceive(u_long qid, u_long flags, u_long timeout,
 		  void *msgbuf, u_long msglen, u_long *msglen_r)
 {
 	return __q_receive(qid, flags | Q_VARIABLE,
-			   timeout, msgbuf, msglen, msglen_r);
+			   timeout, msgbuf, msglen, 1, msglen_r, NULL);
+}
+
+u_long q_vreceive_batch(u_long qid, u_long flags, u_long timeout,
+			void *msgbuf, u_long msglen, u_long count,
+			u_long *msglens, u_long *count_r)
+{
+	if (count == 0) {
+		if (count_r)
+			*count_r = 0;
+		return SUCCESS;
+	}
+
+	return __q_receive(qid, flags | Q_VARIABLE,
+			   timeout, msgbuf, msglen, count, msglens, count_r);
 }
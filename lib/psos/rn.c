@@ -149,6 +149,8 @@ u_long rn_create(const char *name, void *saddr, u_long length,
 		goto out;
 	}
 
+	syncobj_set_name(&rn->sobj, rn->name);
+
 	rn->magic = rn_magic;
 	*asize_r = rn->hobj.size;
 	*rnid_r = mainheap_ref(rn, u_long);
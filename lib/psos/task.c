@@ -310,6 +310,8 @@ u_long t_create(const char *name, u_long prio,
 	if (ret)
 		goto fail_syncinit;
 
+	syncobj_set_name(&task->sobj, task->name);
+
 	memset(task->notepad, 0, sizeof(task->notepad));
 	pvlist_init(&task->timer_list);
 	*tid_r = mainheap_ref(task, u_long);
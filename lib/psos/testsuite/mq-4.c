@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <boilerplate/setup.h>
+#include <copperplate/traceobj.h>
+#include <psos/psos.h>
+
+/*
+ * Stream bursts of small messages through a variable-length queue,
+ * first one message per call with q_vsend/q_vreceive(), then in
+ * batches with q_vsend_batch/q_vreceive_batch(), checking the
+ * sequence of every message.
+ */
+
+#define NMSGS    200000
+#define BURST    64
+#define MSGSZ    16
+
+struct msg {
+	u_long seq;
+	char payload[MSGSZ - sizeof(u_long)];
+};
+
+static struct traceobj trobj;
+
+static u_long qid;
+
+static void sender_task(u_long a0, u_long a1, u_long a2, u_long a3)
+{
+	struct msg msgs[BURST];
+	u_long n, i, sent;
+	int ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < NMSGS; n += BURST) {
+		for (i = 0; i < BURST; i++)
+			msgs[i].seq = n + i;
+		if (a0) {
+			ret = q_vsend_batch(qid, msgs, MSGSZ, BURST, &sent);
+			traceobj_assert(&trobj, ret == SUCCESS && sent == BURST);
+		} else {
+			for (i = 0; i < BURST; i++) {
+				ret = q_vsend(qid, msgs + i, MSGSZ);
+				traceobj_assert(&trobj, ret == SUCCESS);
+			}
+		}
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static void receiver_task(u_long a0, u_long a1, u_long a2, u_long a3)
+{
+	u_long lens[BURST], n = 0, i, count;
+	struct msg msgs[BURST];
+	int ret;
+
+	traceobj_enter(&trobj);
+
+	while (n < NMSGS) {
+		if (a0) {
+			ret = q_vreceive_batch(qid, Q_WAIT, 0, msgs, MSGSZ,
+					       BURST, lens, &count);
+			traceobj_assert(&trobj, ret == SUCCESS &&
+					count > 0 && count <= BURST);
+		} else {
+			ret = q_vreceive(qid, Q_WAIT, 0, msgs, MSGSZ, lens);
+			traceobj_assert(&trobj, ret == SUCCESS);
+			count = 1;
+		}
+		for (i = 0; i < count; i++, n++)
+			traceobj_assert(&trobj, lens[i] == MSGSZ &&
+					msgs[i].seq == n);
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static double run_stream(int batch)
+{
+	u_long args[] = { batch, 0, 0, 0 }, rtid, stid;
+	struct timespec start, end;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	ret = t_create("RECV", 21, 0, 0, 0, &rtid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = t_create("SEND", 20, 0, 0, 0, &stid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = t_start(rtid, 0, receiver_task, args);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = t_start(stid, 0, sender_task, args);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	traceobj_join(&trobj);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 +
+		(end.tv_nsec - start.tv_nsec)) / NMSGS;
+}
+
+int main(int argc, char *const argv[])
+{
+	u_long lens[BURST], n, count;
+	struct msg msgs[BURST];
+	double single, batch;
+	int ret;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	/* Partial batches: the queue only has room for BURST + 8. */
+	ret = q_vcreate("QLIM", Q_LIMIT, BURST + 8, MSGSZ, &qid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	for (n = 0; n < BURST; n++)
+		msgs[n].seq = n;
+	ret = q_vsend_batch(qid, msgs, MSGSZ, BURST, &count);
+	traceobj_assert(&trobj, ret == SUCCESS && count == BURST);
+	ret = q_vsend_batch(qid, msgs, MSGSZ, BURST, &count);
+	traceobj_assert(&trobj, ret == ERR_QFULL && count == 8);
+	ret = q_vsend_batch(qid, msgs, MSGSZ + 1, 1, &count);
+	traceobj_assert(&trobj, ret == ERR_MSGSIZ && count == 0);
+
+	ret = q_vreceive_batch(qid, Q_NOWAIT, 0, msgs, MSGSZ, BURST,
+			       lens, &count);
+	traceobj_assert(&trobj, ret == SUCCESS && count == BURST);
+	traceobj_assert(&trobj, msgs[BURST - 1].seq == BURST - 1);
+	ret = q_vreceive_batch(qid, Q_NOWAIT, 0, msgs, MSGSZ, BURST,
+			       lens, &count);
+	traceobj_assert(&trobj, ret == SUCCESS && count == 8);
+	traceobj_assert(&trobj, msgs[7].seq == 7 && lens[7] == MSGSZ);
+	ret = q_vreceive_batch(qid, Q_NOWAIT, 0, msgs, MSGSZ, BURST,
+			       lens, &count);
+	traceobj_assert(&trobj, ret == ERR_NOMSG && count == 0);
+
+	ret = q_vdelete(qid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = q_vcreate("QSTR", Q_NOLIMIT, 0, MSGSZ, &qid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	single = run_stream(0);
+	batch = run_stream(1);
+
+	if (__base_setup_data.verbosity_level > 0)
+		printf("%d-byte messages: %.0f ns/msg single, %.0f ns/msg "
+		       "batched (x%.1f)\n", MSGSZ, single, batch, single / batch);
+
+	ret = q_vdelete(qid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	exit(0);
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <boilerplate/setup.h>
+#include <copperplate/traceobj.h>
+#include <psos/psos.h>
+
+/*
+ * Buffer cycling benchmark: several tasks get buffers from a shared
+ * partition then return them, tagging each buffer while they own
+ * it, so that a buffer handed out twice is detected. Then a task
+ * keeps cycling a buffer while another partition is being deleted.
+ */
+
+#define NTASKS   4
+#define NLOOPS   200000
+#define NHELD    8
+#define BUFSZ    64
+
+static struct traceobj trobj;
+
+static u_long tids[NTASKS], ptid, del_tid, del_ptid, done_sem;
+
+static char pt_mem[65536], del_mem[8192];
+
+static void cycle_task(u_long a0, u_long a1, u_long a2, u_long a3)
+{
+	unsigned long *bufs[NHELD];
+	int n, i, ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < NLOOPS; n++) {
+		for (i = 0; i < NHELD; i++) {
+			ret = pt_getbuf(ptid, (void **)&bufs[i]);
+			traceobj_assert(&trobj, ret == SUCCESS);
+			bufs[i][0] = a0;
+			bufs[i][1] = i;
+		}
+		for (i = 0; i < NHELD; i++) {
+			traceobj_assert(&trobj, bufs[i][0] == a0 &&
+					bufs[i][1] == (unsigned long)i);
+			ret = pt_retbuf(ptid, bufs[i]);
+			traceobj_assert(&trobj, ret == SUCCESS);
+		}
+	}
+
+	ret = sm_v(done_sem);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	traceobj_exit(&trobj);
+}
+
+static void churn_task(u_long a0, u_long a1, u_long a2, u_long a3)
+{
+	unsigned long n;
+	void *buf;
+	int ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 1;; n++) {
+		ret = pt_getbuf(del_ptid, &buf);
+		if (ret == ERR_OBJDEL)
+			break;
+		traceobj_assert(&trobj, ret == SUCCESS);
+		/* Deletion fails while we hold the buffer. */
+		ret = pt_retbuf(del_ptid, buf);
+		traceobj_assert(&trobj, ret == SUCCESS);
+		if ((n % 64) == 0)
+			tm_wkafter(1);
+	}
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	u_long args[] = { 0, 0, 0, 0 }, nbufs;
+	struct timespec start, end;
+	double elapsed;
+	char name[5];
+	void *buf;
+	int ret, n;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = sm_create("DONE", 0, SM_FIFO, &done_sem);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = pt_create("PART", pt_mem, NULL, sizeof(pt_mem), BUFSZ,
+			PT_NODEL, &ptid, &nbufs);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	traceobj_assert(&trobj, nbufs >= NTASKS * NHELD);
+
+	/* Returning a free buffer is still caught. */
+	ret = pt_getbuf(ptid, &buf);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	ret = pt_retbuf(ptid, buf);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	ret = pt_retbuf(ptid, buf);
+	traceobj_assert(&trobj, ret == ERR_BUFFREE);
+	ret = pt_retbuf(ptid, (char *)buf + 1);
+	traceobj_assert(&trobj, ret == ERR_BUFADDR);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < NTASKS; n++) {
+		sprintf(name, "CYC%d", n);
+		ret = t_create(name, 20, 0, 0, 0, &tids[n]);
+		traceobj_assert(&trobj, ret == SUCCESS);
+		args[0] = n + 1;
+		ret = t_start(tids[n], 0, cycle_task, args);
+		traceobj_assert(&trobj, ret == SUCCESS);
+	}
+
+	/* Tasks may not all have entered the trace object yet. */
+	for (n = 0; n < NTASKS; n++) {
+		ret = sm_p(done_sem, SM_WAIT, 0);
+		traceobj_assert(&trobj, ret == SUCCESS);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (__base_setup_data.verbosity_level > 0) {
+		elapsed = (end.tv_sec - start.tv_sec) * 1e9 +
+			(end.tv_nsec - start.tv_nsec);
+		printf("%d tasks: %.0f getbuf+retbuf/s\n", NTASKS,
+		       (double)NTASKS * NLOOPS * NHELD * 1e9 / elapsed);
+	}
+
+	ret = pt_delete(ptid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = pt_create("DELP", del_mem, NULL, sizeof(del_mem), BUFSZ,
+			PT_NODEL, &del_ptid, &nbufs);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = t_create("CHRN", 20, 0, 0, 0, &del_tid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	ret = t_start(del_tid, 0, churn_task, args);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	for (n = 0;; n++) {
+		ret = pt_delete(del_ptid);
+		if (ret == SUCCESS)
+			break;
+		traceobj_assert(&trobj, ret == ERR_BUFINUSE);
+		if ((n % 16) == 0)
+			tm_wkafter(1);
+	}
+
+	traceobj_join(&trobj);
+
+	exit(0);
+}
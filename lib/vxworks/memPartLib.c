@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <memory.h>
 #include <boilerplate/lock.h>
+#include <boilerplate/atomic.h>
 #include <boilerplate/ancillaries.h>
 #include <copperplate/heapobj.h>
 #include <vxworks/errnoLib.h>
@@ -29,6 +30,22 @@
 
 #define mempart_magic	0x5a6b7c8d
 
+/*
+ * Every block starts with a header recording the size requested and
+ * the size class it belongs to, padded so that the payload keeps the
+ * alignment of the underlying allocator.
+ */
+union mempart_header {
+	struct {
+		unsigned int size;
+		int class;
+	} h;
+	char __pad[2 * sizeof(void *)];
+};
+
+#define MEMPART_UNCACHED	-1
+#define MEMPART_ALIAS		-2	/* Aligned block, size is the offset. */
+
 static struct wind_mempart *find_mempart_from_id(PART_ID partId)
 {
 	struct wind_mempart *mp = mainheap_deref(partId, struct wind_mempart);
@@ -43,11 +60,151 @@ static struct wind_mempart *find_mempart_from_id(PART_ID partId)
 	return mp;
 }
 
+/*
+ * Released blocks of small sizes are parked into a per-class cache,
+ * from which memPartAlloc() picks them without grabbing the
+ * partition lock. Each cache is a bounded multi-producer /
+ * multi-consumer ring: every cell carries a sequence number telling
+ * whether it may be filled or emptied at the current position, which
+ * callers advance by compare-and-swap. Only cache misses and
+ * overflows go through the locked heap.
+ */
+static void init_cache(struct wind_mempart_cache *cache)
+{
+	int n;
+
+	cache->head = cache->tail = 0;
+	for (n = 0; n < WIND_MEMPART_CACHESZ; n++) {
+		cache->cells[n].seq = n;
+		cache->cells[n].blk = NULL;
+	}
+}
+
+static int push_cache(struct wind_mempart_cache *cache, void *blk)
+{
+	unsigned long pos, seq;
+	long dif;
+
+	pos = ACCESS_ONCE(cache->tail);
+
+	for (;;) {
+		seq = ACCESS_ONCE(cache->cells[pos % WIND_MEMPART_CACHESZ].seq);
+		smp_rmb();
+		dif = (long)(seq - pos);
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&cache->tail,
+							 pos, pos + 1))
+				break;
+		} else if (dif < 0)
+			return 0;	/* Full. */
+
+		pos = ACCESS_ONCE(cache->tail);
+	}
+
+	ACCESS_ONCE(cache->cells[pos % WIND_MEMPART_CACHESZ].blk) = blk;
+	smp_wmb();
+	ACCESS_ONCE(cache->cells[pos % WIND_MEMPART_CACHESZ].seq) = pos + 1;
+
+	return 1;
+}
+
+static void *pop_cache(struct wind_mempart_cache *cache)
+{
+	unsigned long pos, seq;
+	long dif;
+	void *blk;
+
+	pos = ACCESS_ONCE(cache->head);
+
+	for (;;) {
+		seq = ACCESS_ONCE(cache->cells[pos % WIND_MEMPART_CACHESZ].seq);
+		smp_rmb();
+		dif = (long)(seq - (pos + 1));
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&cache->head,
+							 pos, pos + 1))
+				break;
+		} else if (dif < 0)
+			return NULL;	/* Empty. */
+
+		pos = ACCESS_ONCE(cache->head);
+	}
+
+	blk = ACCESS_ONCE(cache->cells[pos % WIND_MEMPART_CACHESZ].blk);
+	smp_mb();
+	ACCESS_ONCE(cache->cells[pos % WIND_MEMPART_CACHESZ].seq) =
+		pos + WIND_MEMPART_CACHESZ;
+
+	return blk;
+}
+
+/*
+ * Give the cached blocks back to the heap, so that a fixed-size
+ * partition may still serve a request the caches were starving.
+ * Called with mp->lock held.
+ */
+static int drain_caches(struct wind_mempart *mp)
+{
+	void *blk;
+	int n, count = 0;
+
+	for (n = 0; n < WIND_MEMPART_NCLASSES; n++) {
+		while ((blk = pop_cache(mp->cache + n)) != NULL) {
+			heapobj_free(&mp->hobj, blk);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static inline int size_class(unsigned int nBytes)
+{
+	int class = 0;
+
+	while ((1U << (class + WIND_MEMPART_MINSHIFT)) < nBytes)
+		if (++class >= WIND_MEMPART_NCLASSES)
+			return MEMPART_UNCACHED;
+
+	return class;
+}
+
+/*
+ * Statistics are updated atomically, so that the lockless paths do
+ * not have to grab the partition lock for maintaining them.
+ */
+static void account_alloc(struct wind_mempart *mp, unsigned int nBytes)
+{
+	unsigned long max, bytes;
+
+	bytes = __sync_add_and_fetch(&mp->stats.numBytesAlloc, nBytes);
+	__sync_add_and_fetch(&mp->stats.numBlocksAlloc, 1);
+	__sync_sub_and_fetch(&mp->stats.numBytesFree, nBytes);
+	__sync_sub_and_fetch(&mp->stats.numBlocksFree, 1);
+
+	for (;;) {
+		max = ACCESS_ONCE(mp->stats.maxBytesAlloc);
+		if (bytes <= max ||
+		    __sync_bool_compare_and_swap(&mp->stats.maxBytesAlloc,
+						 max, bytes))
+			break;
+	}
+}
+
+static void account_free(struct wind_mempart *mp, unsigned int nBytes)
+{
+	__sync_sub_and_fetch(&mp->stats.numBytesAlloc, nBytes);
+	__sync_sub_and_fetch(&mp->stats.numBlocksAlloc, 1);
+	__sync_add_and_fetch(&mp->stats.numBytesFree, nBytes);
+	__sync_add_and_fetch(&mp->stats.numBlocksFree, 1);
+}
+
 PART_ID memPartCreate(char *pPool, unsigned int poolSize)
 {
 	pthread_mutexattr_t mattr;
 	struct wind_mempart *mp;
 	struct service svc;
+	int n;
 
 	CANCEL_DEFER(svc);
 
@@ -72,6 +229,8 @@ PART_ID memPartCreate(char *pPool, unsigned int poolSize)
 	memset(&mp->stats, 0, sizeof(mp->stats));
 	mp->stats.numBytesFree = poolSize;
 	mp->stats.numBlocksFree = 1;
+	for (n = 0; n < WIND_MEMPART_NCLASSES; n++)
+		init_cache(mp->cache + n);
 	mp->magic = mempart_magic;
 
 	CANCEL_RESTORE(svc);
@@ -105,8 +264,8 @@ STATUS memPartAddToPool(PART_ID partId,
 		errno = S_memLib_INVALID_NBYTES;
 		ret = ERROR;
 	} else {
-		mp->stats.numBytesFree += poolSize;
-		mp->stats.numBlocksFree++;
+		__sync_add_and_fetch(&mp->stats.numBytesFree, poolSize);
+		__sync_add_and_fetch(&mp->stats.numBlocksFree, 1);
 	}
 
 	__RT(pthread_mutex_unlock(&mp->lock));
@@ -119,8 +278,9 @@ STATUS memPartAddToPool(PART_ID partId,
 void *memPartAlignedAlloc(PART_ID partId,
 			  unsigned int nBytes, unsigned int alignment)
 {
+	union mempart_header *hdr;
 	unsigned int xtra = 0;
-	void *ptr;
+	void *ptr, *aligned;
 
 	/*
 	 * XXX: We assume that our underlying allocator (TLSF, pshared
@@ -133,19 +293,31 @@ void *memPartAlignedAlloc(PART_ID partId,
 		alignment = 8;
 	}
 	else if (alignment > 8)
-		xtra = alignment;
+		xtra = alignment + sizeof(*hdr);
 
 	ptr = memPartAlloc(partId, nBytes + xtra);
-	if (ptr == NULL)
-		return NULL;
+	if (ptr == NULL || xtra == 0)
+		return ptr;
 
-	return (void *)(((uintptr_t)ptr + xtra) & ~(alignment - 1));
+	/*
+	 * The aligned address is past the original one by at least
+	 * the size of a header, which we set up for memPartFree() to
+	 * find the original block.
+	 */
+	aligned = (void *)(((uintptr_t)ptr + xtra) & ~((uintptr_t)alignment - 1));
+	hdr = (union mempart_header *)aligned - 1;
+	hdr->h.class = MEMPART_ALIAS;
+	hdr->h.size = (caddr_t)aligned - (caddr_t)ptr;
+
+	return aligned;
 }
 
 void *memPartAlloc(PART_ID partId, unsigned int nBytes)
 {
+	union mempart_header *hdr;
 	struct wind_mempart *mp;
-	void *p;
+	size_t size = nBytes;
+	int class;
 
 	if (nBytes == 0)
 		return NULL;
@@ -154,29 +326,34 @@ void *memPartAlloc(PART_ID partId, unsigned int nBytes)
 	if (mp == NULL)
 		return NULL;
 
-	__RT(pthread_mutex_lock(&mp->lock));
+	class = size_class(nBytes);
+	if (class != MEMPART_UNCACHED) {
+		hdr = pop_cache(mp->cache + class);
+		if (hdr)
+			goto done;
+		size = 1U << (class + WIND_MEMPART_MINSHIFT);
+	}
 
-	p = heapobj_alloc(&mp->hobj, nBytes);
-	if (p == NULL)
-		goto out;
-
-	mp->stats.numBytesAlloc += nBytes;
-	mp->stats.numBlocksAlloc++;
-	mp->stats.numBytesFree -= nBytes;
-	mp->stats.numBlocksFree--;
-	if (mp->stats.numBytesAlloc > mp->stats.maxBytesAlloc)
-		mp->stats.maxBytesAlloc = mp->stats.numBytesAlloc;
-out:
+	__RT(pthread_mutex_lock(&mp->lock));
+	hdr = heapobj_alloc(&mp->hobj, size + sizeof(*hdr));
+	if (hdr == NULL && drain_caches(mp))
+		hdr = heapobj_alloc(&mp->hobj, size + sizeof(*hdr));
 	__RT(pthread_mutex_unlock(&mp->lock));
+	if (hdr == NULL)
+		return NULL;
+done:
+	hdr->h.size = nBytes;
+	hdr->h.class = class;
+	account_alloc(mp, nBytes);
 
-	return p;
+	return hdr + 1;
 }
 
 STATUS memPartFree(PART_ID partId, char *pBlock)
 {
+	union mempart_header *hdr;
 	struct wind_mempart *mp;
 	struct service svc;
-	size_t size;
 
 	if (pBlock == NULL)
 		return ERROR;
@@ -185,18 +362,20 @@ STATUS memPartFree(PART_ID partId, char *pBlock)
 	if (mp == NULL)
 		return ERROR;
 
-	CANCEL_DEFER(svc);
+	hdr = (union mempart_header *)pBlock - 1;
+	if (hdr->h.class == MEMPART_ALIAS)
+		hdr = (union mempart_header *)(pBlock - hdr->h.size) - 1;
 
-	__RT(pthread_mutex_lock(&mp->lock));
+	account_free(mp, hdr->h.size);
 
-	heapobj_free(&mp->hobj, pBlock);
+	if (hdr->h.class != MEMPART_UNCACHED &&
+	    push_cache(mp->cache + hdr->h.class, hdr))
+		return OK;
 
-	size = heapobj_validate(&mp->hobj, pBlock);
-	mp->stats.numBytesAlloc -= size;
-	mp->stats.numBlocksAlloc--;
-	mp->stats.numBytesFree += size;
-	mp->stats.numBlocksFree++;
-	
+	CANCEL_DEFER(svc);
+
+	__RT(pthread_mutex_lock(&mp->lock));
+	heapobj_free(&mp->hobj, hdr);
 	__RT(pthread_mutex_unlock(&mp->lock));
 
 	CANCEL_RESTORE(svc);
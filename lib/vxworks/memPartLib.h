@@ -22,11 +22,26 @@
 #include <copperplate/heapobj.h>
 #include <vxworks/memPartLib.h>
 
+/* Size classes cached: 16 bytes to 1k. */
+#define WIND_MEMPART_MINSHIFT	4
+#define WIND_MEMPART_NCLASSES	7
+#define WIND_MEMPART_CACHESZ	32	/* Must be a power of two. */
+
+struct wind_mempart_cache {
+	unsigned long head;
+	unsigned long tail;
+	struct {
+		unsigned long seq;
+		void *blk;
+	} cells[WIND_MEMPART_CACHESZ];
+};
+
 struct wind_mempart {
 	unsigned int magic;
 	struct heapobj hobj;
 	pthread_mutex_t lock;
 	struct wind_part_stats stats;
+	struct wind_mempart_cache cache[WIND_MEMPART_NCLASSES];
 };
 
 #endif /* _VXWORKS_MEMPARTLIB_H */
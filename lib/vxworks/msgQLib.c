@@ -108,6 +108,11 @@ MSG_Q_ID msgQCreate(int maxMsgs, int maxMsgLength, int options)
 	if (ret)
 		goto fail_syncinit;
 		
+	/* Queues are anonymous, label them with their identifier. */
+	snprintf(mq->name, sizeof(mq->name), "msgQ:%#lx",
+		 mainheap_ref(mq, unsigned long));
+	syncobj_set_name(&mq->sobj, mq->name);
+
 	mq->options = options;
 	mq->maxmsg = maxMsgs;
 	mq->msgsize = maxMsgLength;
@@ -164,16 +169,37 @@ STATUS msgQDelete(MSG_Q_ID msgQId)
 	return OK;
 }
 
-int msgQReceive(MSG_Q_ID msgQId, char *buffer, UINT maxNBytes, int timeout)
+static UINT pop_msg(struct wind_mq *mq, char *buffer, UINT maxNBytes)
+{
+	struct msgholder *msg;
+	UINT nbytes;
+
+	mq->msgcount--;
+	msg = list_pop_entry(&mq->msg_list, struct msgholder, link);
+	nbytes = msg->size;
+	if (nbytes > maxNBytes)
+		nbytes = maxNBytes;
+	if (nbytes > 0)
+		memcpy(buffer, msg + 1, nbytes);
+	heapobj_free(&mq->pool, msg);
+
+	return nbytes;
+}
+
+/*
+ * Only the first message may be waited for, the following ones are
+ * pulled from the queue as long as available, each in a slot of
+ * maxNBytes. Senders waiting for room are released once per call.
+ */
+static int receive_msgs(MSG_Q_ID msgQId, char *buffer, UINT maxNBytes,
+			UINT *sizes, int nMsgs, int timeout)
 {
 	struct wind_queue_wait *wait = NULL;
 	struct timespec ts, *timespec;
-	struct msgholder *msg = NULL;
-	UINT nbytes = (UINT)ERROR;
 	struct syncstate syns;
 	struct wind_mq *mq;
 	struct service svc;
-	int ret;
+	int ret, n = ERROR;
 
 	if (threadobj_irq_p()) {
 		errno = S_intLib_NOT_ISR_CALLABLE;
@@ -195,16 +221,8 @@ int msgQReceive(MSG_Q_ID msgQId, char *buffer, UINT maxNBytes, int timeout)
 
 retry:
 	if (!list_empty(&mq->msg_list)) {
-		mq->msgcount--;
-		msg = list_pop_entry(&mq->msg_list, struct msgholder, link);
-		nbytes = msg->size;
-		if (nbytes > maxNBytes)
-			nbytes = maxNBytes;
-		if (nbytes > 0)
-			memcpy(buffer, msg + 1, nbytes);
-		heapobj_free(&mq->pool, msg);
-		syncobj_drain(&mq->sobj);
-		goto done;
+		sizes[0] = pop_msg(mq, buffer, maxNBytes);
+		goto drain;
 	}
 
 	if (timeout == NO_WAIT) {
@@ -231,9 +249,12 @@ retry:
 		errno = S_objLib_OBJ_TIMEOUT;
 		goto done;
 	}
-	nbytes = wait->size;
-	if (nbytes == -1L)	/* No direct copy? */
+	if (wait->size == -1L)	/* No direct copy? */
 		goto retry;
+	sizes[0] = wait->size;
+drain:
+	for (n = 1; n < nMsgs && !list_empty(&mq->msg_list); n++)
+		sizes[n] = pop_msg(mq, buffer + n * maxNBytes, maxNBytes);
 	syncobj_drain(&mq->sobj);
 done:
 	syncobj_unlock(&mq->sobj, &syns);
@@ -243,40 +264,41 @@ out:
 
 	CANCEL_RESTORE(svc);
 
+	return n;
+}
+
+int msgQReceive(MSG_Q_ID msgQId, char *buffer, UINT maxNBytes, int timeout)
+{
+	UINT nbytes;
+
+	if (receive_msgs(msgQId, buffer, maxNBytes,
+			 &nbytes, 1, timeout) == ERROR)
+		return ERROR;
+
 	return nbytes;
 }
 
-STATUS msgQSend(MSG_Q_ID msgQId, const char *buffer, UINT bytes,
-		int timeout, int prio)
+int msgQReceiveN(MSG_Q_ID msgQId, char *buffer, UINT maxNBytes,
+		 UINT *sizes, int nMsgs, int timeout)
+{
+	if (nMsgs <= 0)
+		return 0;
+
+	return receive_msgs(msgQId, buffer, maxNBytes, sizes, nMsgs, timeout);
+}
+
+/*
+ * Hand a message over to the first waiting receiver, or queue it.
+ * Returns 1 if posted, zero if the queue is full, or -ENOMEM.
+ */
+static int post_msg(struct wind_mq *mq, const char *buffer, UINT bytes,
+		    int prio)
 {
-	struct timespec ts, *timespec;
 	struct wind_queue_wait *wait;
 	struct threadobj *thobj;
 	struct msgholder *msg;
-	struct syncstate syns;
-	struct wind_mq *mq;
-	struct service svc;
-	int ret = ERROR;
 	UINT maxbytes;
 
-	CANCEL_DEFER(svc);
-
-	mq = find_mq_from_id(msgQId);
-	if (mq == NULL)
-		goto objid_error;
-
-	if (syncobj_lock(&mq->sobj, &syns)) {
-		CANCEL_RESTORE(svc);
-	objid_error:
-		errno = S_objLib_OBJ_ID_ERROR;
-		return ERROR;
-	}
-
-	if (bytes > mq->msgsize) {
-		errno = S_msgQLib_INVALID_MSG_LENGTH;
-		goto fail;
-	}
-
 	thobj = syncobj_peek_grant(&mq->sobj);
 	if (thobj && threadobj_local_p(thobj)) {
 		/* Fast path: direct copy to the receiver's buffer. */
@@ -290,46 +312,12 @@ STATUS msgQSend(MSG_Q_ID msgQId, const char *buffer, UINT bytes,
 		goto done;
 	}
 
-	if (mq->msgcount < mq->maxmsg)
-		goto enqueue;
-
-	if (timeout == NO_WAIT) {
-		errno = S_objLib_OBJ_UNAVAILABLE;
-		goto fail;
-	}
-
-	if (threadobj_irq_p()) {
-		errno = S_msgQLib_NON_ZERO_TIMEOUT_AT_INT_LEVEL;
-		goto fail;
-	}
-
-	if (timeout != WAIT_FOREVER) {
-		timespec = &ts;
-		clockobj_ticks_to_timeout(&wind_clock, timeout, timespec);
-	} else
-		timespec = NULL;
-
-	do {
-		ret = syncobj_wait_drain(&mq->sobj, timespec, &syns);
-		if (ret == -EIDRM) {
-			errno = S_objLib_OBJ_DELETED;
-			ret = ERROR;
-			goto out;
-		}
-		if (ret == -ETIMEDOUT) {
-			errno = S_objLib_OBJ_TIMEOUT;
-			ret = ERROR;
-			goto fail;
-		}
-	} while (mq->msgcount >= mq->maxmsg);
+	if (mq->msgcount >= mq->maxmsg)
+		return 0;
 
-enqueue:
 	msg = heapobj_alloc(&mq->pool, bytes + sizeof(*msg));
-	if (msg == NULL) {
-		errno = S_memLib_NOT_ENOUGH_MEMORY;
-		ret = ERROR;
-		goto fail;
-	}
+	if (msg == NULL)
+		return -ENOMEM;
 
 	mq->msgcount++;
 	assert(mq->msgcount <= mq->maxmsg); /* Paranoid. */
@@ -357,13 +345,106 @@ done:
 	if (thobj)	/* Wakeup waiter. */
 		syncobj_grant_to(&mq->sobj, thobj);
 
-	ret = OK;
+	return 1;
+}
+
+/*
+ * Messages are posted under a single lock, each waiting receiver
+ * being woken up once. The caller may only wait for room until the
+ * first message is posted.
+ */
+static int send_msgs(MSG_Q_ID msgQId, const char *buffer, UINT bytes,
+		     int nMsgs, int timeout, int prio)
+{
+	struct timespec ts, *timespec = NULL;
+	struct syncstate syns;
+	struct wind_mq *mq;
+	struct service svc;
+	int ret, n = ERROR;
+
+	CANCEL_DEFER(svc);
+
+	mq = find_mq_from_id(msgQId);
+	if (mq == NULL)
+		goto objid_error;
+
+	if (syncobj_lock(&mq->sobj, &syns)) {
+		CANCEL_RESTORE(svc);
+	objid_error:
+		errno = S_objLib_OBJ_ID_ERROR;
+		return ERROR;
+	}
+
+	if (bytes > mq->msgsize) {
+		errno = S_msgQLib_INVALID_MSG_LENGTH;
+		goto fail;
+	}
+
+	for (n = 0; n < nMsgs; ) {
+		ret = post_msg(mq, buffer + n * bytes, bytes, prio);
+		if (ret > 0) {
+			n++;
+			continue;
+		}
+		if (n > 0)
+			break;
+		if (ret < 0) {
+			errno = S_memLib_NOT_ENOUGH_MEMORY;
+			n = ERROR;
+			goto fail;
+		}
+
+		if (timeout == NO_WAIT) {
+			errno = S_objLib_OBJ_UNAVAILABLE;
+			n = ERROR;
+			goto fail;
+		}
+
+		if (threadobj_irq_p()) {
+			errno = S_msgQLib_NON_ZERO_TIMEOUT_AT_INT_LEVEL;
+			n = ERROR;
+			goto fail;
+		}
+
+		if (timeout != WAIT_FOREVER && timespec == NULL) {
+			timespec = &ts;
+			clockobj_ticks_to_timeout(&wind_clock, timeout, timespec);
+		}
+
+		ret = syncobj_wait_drain(&mq->sobj, timespec, &syns);
+		if (ret == -EIDRM) {
+			errno = S_objLib_OBJ_DELETED;
+			n = ERROR;
+			goto out;
+		}
+		if (ret == -ETIMEDOUT) {
+			errno = S_objLib_OBJ_TIMEOUT;
+			n = ERROR;
+			goto fail;
+		}
+	}
 fail:
 	syncobj_unlock(&mq->sobj, &syns);
 out:
 	CANCEL_RESTORE(svc);
 
-	return ret;
+	return n;
+}
+
+STATUS msgQSend(MSG_Q_ID msgQId, const char *buffer, UINT bytes,
+		int timeout, int prio)
+{
+	return send_msgs(msgQId, buffer, bytes, 1, timeout, prio) == ERROR ?
+		ERROR : OK;
+}
+
+int msgQSendN(MSG_Q_ID msgQId, const char *buffer, UINT bytes,
+	      int nMsgs, int timeout, int prio)
+{
+	if (nMsgs <= 0)
+		return 0;
+
+	return send_msgs(msgQId, buffer, bytes, nMsgs, timeout, prio);
 }
 
 int msgQNumMsgs(MSG_Q_ID msgQId)
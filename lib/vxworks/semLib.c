@@ -197,6 +197,7 @@ static SEM_ID alloc_xsem(int options, int initval, int maxval)
 {
 	int sobj_flags = 0, ret;
 	struct wind_sem *sem;
+	char label[32];
 
 	if (options & ~SEM_Q_PRIORITY) {
 		errno = S_semLib_INVALID_OPTION;
@@ -222,6 +223,11 @@ static SEM_ID alloc_xsem(int options, int initval, int maxval)
 		return (SEM_ID)0;
 	}
 
+	/* Semaphores are anonymous, label them with their identifier. */
+	snprintf(label, sizeof(label), "sem:%#lx",
+		 mainheap_ref(sem, unsigned long));
+	syncobj_set_name(&sem->u.xsem.sobj, label);
+
 	return mainheap_ref(sem, SEM_ID);
 }
 
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <boilerplate/setup.h>
+#include <copperplate/traceobj.h>
+#include <vxworks/errnoLib.h>
+#include <vxworks/taskLib.h>
+#include <vxworks/memPartLib.h>
+
+/*
+ * Allocation benchmark: several tasks allocate and release blocks
+ * of various sizes from a shared memory partition, most of them
+ * small enough to be served from the size-class caches. The
+ * contents of every block is checked before release.
+ */
+
+#define NTASKS   4
+#define NLOOPS   100000
+#define NBLOCKS  16
+
+static struct traceobj trobj;
+
+static char pool[256 * 1024];
+
+static char small_pool[16 * 1024];
+
+static PART_ID part;
+
+static const unsigned int sizes[] = {
+	8, 16, 24, 40, 64, 100, 128, 250, 500, 1000, 3000
+};
+
+static void allocTask(long arg, ...)
+{
+	unsigned char *blocks[NBLOCKS], tags[NBLOCKS];
+	unsigned int lens[NBLOCKS], seed = arg;
+	int n, i, ret;
+
+	traceobj_enter(&trobj);
+
+	memset(blocks, 0, sizeof(blocks));
+
+	for (n = 0; n < NLOOPS; n++) {
+		i = rand_r(&seed) % NBLOCKS;
+		if (blocks[i]) {
+			traceobj_assert(&trobj, blocks[i][0] == tags[i] &&
+					blocks[i][lens[i] - 1] == tags[i]);
+			ret = memPartFree(part, (char *)blocks[i]);
+			traceobj_assert(&trobj, ret == OK);
+		}
+		lens[i] = sizes[rand_r(&seed) % (sizeof(sizes) / sizeof(sizes[0]))];
+		blocks[i] = memPartAlloc(part, lens[i]);
+		traceobj_assert(&trobj, blocks[i] != NULL);
+		tags[i] = rand_r(&seed);
+		memset(blocks[i], tags[i], lens[i]);
+	}
+
+	for (i = 0; i < NBLOCKS; i++) {
+		ret = memPartFree(part, (char *)blocks[i]);
+		traceobj_assert(&trobj, ret == OK);
+	}
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	struct timespec start, end;
+	MEM_PART_STATS stats;
+	TASK_ID tids[NTASKS];
+	char *blocks[32];
+	double elapsed;
+	char name[16];
+	void *p;
+	int ret, n;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	part = memPartCreate(pool, sizeof(pool));
+	traceobj_assert(&trobj, part != 0);
+
+	p = memPartAlignedAlloc(part, 100, 256);
+	traceobj_assert(&trobj, p != NULL && ((uintptr_t)p & 255) == 0);
+	memset(p, 0xaa, 100);
+	ret = memPartFree(part, p);
+	traceobj_assert(&trobj, ret == OK);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < NTASKS; n++) {
+		sprintf(name, "allocTask%d", n);
+		tids[n] = taskSpawn(name, 50, 0, 0, allocTask,
+				    n + 1, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		traceobj_assert(&trobj, tids[n] != ERROR);
+	}
+
+	traceobj_join(&trobj);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ret = memPartInfoGet(part, &stats);
+	traceobj_assert(&trobj, ret == OK);
+	traceobj_assert(&trobj, stats.numBytesAlloc == 0 &&
+			stats.numBlocksAlloc == 0);
+	traceobj_assert(&trobj, stats.numBytesFree == sizeof(pool));
+
+	/*
+	 * Fill a small partition with cacheable blocks and release
+	 * them all, the caches then hold most of the pool, which must
+	 * be drained to serve a larger request.
+	 */
+	part = memPartCreate(small_pool, sizeof(small_pool));
+	traceobj_assert(&trobj, part != 0);
+
+	for (n = 0; n < 32; n++) {
+		blocks[n] = memPartAlloc(part, 1000);
+		if (blocks[n] == NULL)
+			break;
+	}
+	traceobj_assert(&trobj, n > 0);
+
+	while (--n >= 0) {
+		ret = memPartFree(part, blocks[n]);
+		traceobj_assert(&trobj, ret == OK);
+	}
+
+	p = memPartAlloc(part, sizeof(small_pool) / 2);
+	traceobj_assert(&trobj, p != NULL);
+	ret = memPartFree(part, p);
+	traceobj_assert(&trobj, ret == OK);
+
+	if (__base_setup_data.verbosity_level > 0) {
+		elapsed = (end.tv_sec - start.tv_sec) * 1e9 +
+			(end.tv_nsec - start.tv_nsec);
+		printf("%d tasks: %.0f alloc+free/s, %lu bytes peak\n",
+		       NTASKS, (double)NTASKS * NLOOPS * 1e9 / elapsed,
+		       stats.maxBytesAlloc);
+	}
+
+	exit(0);
+}
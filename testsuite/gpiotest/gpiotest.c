@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <smokey/smokey.h>
 #include <rtdm/gpio.h>
 
@@ -57,6 +58,18 @@ smokey_test_plugin(write_value,
    "\tdevice=<device-path>."
 );
 
+smokey_test_plugin(event_queue,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_STRING(device),
+			   SMOKEY_STRING(loopback),
+			   SMOKEY_INT(count),
+		   ),
+   "Check timestamped edge events through a GPIO loopback.\n"
+   "\tdevice=<device-path>, input pin receiving the edges\n"
+   "\tloopback=<device-path>, output pin wired to the input\n"
+   "\tcount=<number-of-edges>, defaults to 1024."
+);
+
 static int run_interrupt(struct smokey_test *t, int argc, char *const argv[])
 {
 	static struct {
@@ -215,6 +228,170 @@ static int run_write_value(struct smokey_test *t, int argc, char *const argv[])
 	return 0;
 }
 
+static int check_events(const struct rtdm_gpio_event *ev, int nr,
+			unsigned int *seq, nanosecs_abs_t *date)
+{
+	int n;
+
+	for (n = 0; n < nr; n++, ev++) {
+		if (!__Fassert(ev->sequence != *seq))
+			return -EPROTO;
+		if (!__Fassert(ev->timestamp < *date))
+			return -EPROTO;
+		/* Edges alternate, starting with a rising one. */
+		if (!__Fassert(ev->value != !(*seq & 1)))
+			return -EPROTO;
+		*date = ev->timestamp;
+		(*seq)++;
+	}
+
+	return 0;
+}
+
+static int toggle_pin(int ofd, int start, int count)
+{
+	int n, ret, value;
+
+	for (n = start; n < start + count; n++) {
+		value = !(n & 1);
+		ret = write(ofd, &value, sizeof(value));
+		if (ret < 0)
+			return -errno;
+	}
+
+	return 0;
+}
+
+static int run_event_queue(struct smokey_test *t, int argc, char *const argv[])
+{
+	int ifd, ofd, ret, value = 0, nr_events = 256, trigger, count = 1024, n;
+	const char *device, *loopback;
+	struct rtdm_gpio_event ev[32];
+	struct rtdm_gpio_evq_header stat, *hdr;
+	struct rtdm_gpio_event *ring;
+	nanosecs_abs_t date = 0;
+	unsigned int seq = 0;
+	size_t maplen;
+	void *p;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (!SMOKEY_ARG_ISSET(event_queue, device) ||
+	    !SMOKEY_ARG_ISSET(event_queue, loopback)) {
+		warning("missing device= or loopback= specification");
+		return -EINVAL;
+	}
+
+	if (SMOKEY_ARG_ISSET(event_queue, count))
+		count = SMOKEY_ARG_INT(event_queue, count);
+
+	device = SMOKEY_ARG_STRING(event_queue, device);
+	ifd = open(device, O_RDWR);
+	if (ifd < 0) {
+		ret = -errno;
+		warning("cannot open device %s [%s]",
+			device, symerror(ret));
+		return ret;
+	}
+
+	loopback = SMOKEY_ARG_STRING(event_queue, loopback);
+	ofd = open(loopback, O_RDWR);
+	if (ofd < 0) {
+		ret = -errno;
+		warning("cannot open device %s [%s]",
+			loopback, symerror(ret));
+		close(ifd);
+		return ret;
+	}
+
+	if (!__T(ret, ioctl(ofd, GPIO_RTIOC_DIR_OUT, &value)))
+		goto out;
+
+	if (!__T(ret, ioctl(ifd, GPIO_RTIOC_EVQ_SETUP, &nr_events)))
+		goto out;
+
+	trigger = GPIO_TRIGGER_EDGE_RISING|GPIO_TRIGGER_EDGE_FALLING;
+	if (!__T(ret, ioctl(ifd, GPIO_RTIOC_IRQEN, &trigger)))
+		goto out;
+
+	/*
+	 * Burst of edges larger than the ring: the events which did
+	 * not fit must show up in the overflow count, and the
+	 * sequence numbers must account for them.
+	 */
+	ret = toggle_pin(ofd, 0, count);
+	if (ret)
+		goto out;
+
+	if (!__T(ret, ioctl(ifd, GPIO_RTIOC_EVQ_STAT, &stat)))
+		goto out;
+
+	n = count < nr_events ? count : nr_events;
+	if (!__Tassert(stat.head - stat.tail == n) ||
+	    !__Tassert(stat.overflows == count - n)) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	/* Drain in batches through read(2). */
+	fcntl(ifd, F_SETFL, fcntl(ifd, F_GETFL) | O_NONBLOCK);
+	for (;;) {
+		ret = read(ifd, ev, sizeof(ev));
+		if (ret < 0) {
+			ret = -errno;
+			if (ret == -EAGAIN)
+				break;
+			goto out;
+		}
+		ret = check_events(ev, ret / sizeof(ev[0]), &seq, &date);
+		if (ret)
+			goto out;
+	}
+
+	if (!__Tassert(seq == n)) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	/* Now consume directly from the mapped ring. */
+	maplen = sizeof(*hdr) + nr_events * sizeof(*ring);
+	maplen = (maplen + getpagesize() - 1) & ~(getpagesize() - 1);
+	p = mmap(NULL, maplen, PROT_READ|PROT_WRITE, MAP_SHARED, ifd, 0);
+	if (p == MAP_FAILED) {
+		ret = -errno;
+		warning("cannot map event queue [%s]", symerror(ret));
+		goto out;
+	}
+
+	hdr = p;
+	ring = rtdm_gpio_evq_ring(hdr);
+	seq = count;
+	n = nr_events / 2;
+	ret = toggle_pin(ofd, count, n);
+	if (ret == 0) {
+		while (hdr->tail != hdr->head) {
+			__sync_synchronize();
+			ret = check_events(ring + (hdr->tail & (nr_events - 1)),
+					   1, &seq, &date);
+			if (ret)
+				break;
+			__sync_synchronize();
+			hdr->tail++;
+		}
+		if (ret == 0 && !__Tassert(seq == count + n))
+			ret = -EPROTO;
+	}
+
+	munmap(p, maplen);
+
+	smokey_trace("%d edges, %u overflows", count + n, stat.overflows);
+out:
+	close(ofd);
+	close(ifd);
+
+	return ret;
+}
+
 int main(int argc, char *const argv[])
 {
 	struct smokey_test *t;
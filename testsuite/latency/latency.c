@@ -85,6 +85,10 @@ int test_loops = 0;		/* outer loop count */
 #define HISTOGRAM_CELLS 300
 int histogram_size = HISTOGRAM_CELLS;
 int32_t *histogram_avg = NULL, *histogram_max = NULL, *histogram_min = NULL;
+int32_t *histogram_hdr = NULL;
+
+struct rttst_bench_sample *worst = NULL;
+int worst_count = 0, nr_worst = 0;
 
 char *do_gnuplot = NULL;
 int do_histogram = 0, do_stats = 0, finished = 0;
@@ -105,6 +109,35 @@ static inline long long diff_ts(struct timespec *left, struct timespec *right)
 		+ left->tv_nsec - right->tv_nsec;
 }
 
+/*
+ * Keep the worst samples sorted by decreasing latency. Only the
+ * in-kernel tests can observe the core events leading to the wake
+ * up, so there is no breakdown for user-mode samples.
+ */
+static void add_worst(struct timespec *date, int32_t dt)
+{
+	struct rttst_bench_sample *p;
+	int n;
+
+	if (nr_worst == worst_count) {
+		if (dt <= worst[nr_worst - 1].latency)
+			return;
+		nr_worst--;
+	}
+
+	for (n = nr_worst; n > 0 && worst[n - 1].latency < dt; n--)
+		worst[n] = worst[n - 1];
+
+	p = worst + n;
+	p->date = (uint64_t)date->tv_sec * ONE_BILLION + date->tv_nsec;
+	p->latency = dt;
+	p->irq = RTTST_BENCH_NOSTAMP;
+	p->tick = RTTST_BENCH_NOSTAMP;
+	p->sched = RTTST_BENCH_NOSTAMP;
+	p->switched = RTTST_BENCH_NOSTAMP;
+	nr_worst++;
+}
+
 static void *latency(void *cookie)
 {
 	int err, count, nsamples, warmup = 1;
@@ -183,6 +216,8 @@ static void *latency(void *cookie)
 				error(1, errno, "read()");
 			if (ticks > 1)
 				overrun += ticks - 1;
+			if (!(finished || warmup) && worst_count)
+				add_worst(&expected, dt);
 			expected.tv_nsec += (ticks * period_ns) % ONE_BILLION;
 			expected.tv_sec += (ticks * period_ns) / ONE_BILLION;
 			if (expected.tv_nsec > ONE_BILLION) {
@@ -196,8 +231,10 @@ static void *latency(void *cookie)
 				gmaxjitter = dt;
 			}
 
-			if (!(finished || warmup) && need_histo())
+			if (!(finished || warmup) && need_histo()) {
 				add_histogram(histogram_avg, dt);
+				histogram_hdr[rttst_hdr_index(dt >= 0 ? dt : -dt)]++;
+			}
 		}
 
 		if (!warmup) {
@@ -260,6 +297,7 @@ static void *display(void *cookie)
 		config.histogram_size = need_histo() ? histogram_size : 0;
 		config.histogram_bucketsize = bucketsize;
 		config.freeze_max = freeze_max;
+		config.worst_count = worst_count;
 
 		err = ioctl(benchdev, RTTST_RTIOC_TMBENCH_START, &config);
 		if (err)
@@ -458,6 +496,76 @@ static void dump_stats(int32_t *histogram, char *kind, double avg)
 	       kind, total_hits, avg, variance);
 }
 
+static void dump_hdr_histogram(void)
+{
+	static const double percentiles[] = {
+		50.0, 90.0, 99.0, 99.9, 99.99, 99.999, 100.0
+	};
+	long long total_hits = 0, hits = 0;
+	int n, p;
+
+	for (n = 0; n < RTTST_HDR_CELLS; n++)
+		total_hits += histogram_hdr[n];
+
+	if (total_hits == 0)
+		return;
+
+	if (do_histogram) {
+		printf("HDH|------from-|--------to-|---samples-|--cumul-%%\n");
+		for (n = 0; n < RTTST_HDR_CELLS; n++) {
+			if (histogram_hdr[n] == 0)
+				continue;
+			hits += histogram_hdr[n];
+			printf("HDD|%11.3f|%11.3f|%11d|%9.5f\n",
+			       (double)rttst_hdr_value(n) / 1000,
+			       (double)rttst_hdr_value(n + 1) / 1000,
+			       histogram_hdr[n], hits * 100.0 / total_hits);
+		}
+	}
+
+	if (!do_stats)
+		return;
+
+	/* Report the upper bound of the cell each percentile falls in. */
+	printf("HSP|--percentile|------value-\n");
+	for (n = 0, p = 0, hits = 0; n < RTTST_HDR_CELLS; n++) {
+		hits += histogram_hdr[n];
+		while (p < sizeof(percentiles) / sizeof(percentiles[0]) &&
+		       hits * 100.0 >= percentiles[p] * total_hits) {
+			printf("HSP| %10.3f%%|%11.3f\n", percentiles[p],
+			       (double)rttst_hdr_value(n + 1) / 1000);
+			p++;
+		}
+	}
+}
+
+static void dump_stage(int32_t offset)
+{
+	if (offset == RTTST_BENCH_NOSTAMP)
+		printf("|%11s", "-");
+	else
+		printf("|%11.3f", (double)offset / 1000);
+}
+
+static void dump_worst(void)
+{
+	struct rttst_bench_sample *p;
+	int n;
+
+	printf("WSH|-----date (s)-|----latency|--irq entry|---tick out|"
+	       "--sched run|--switch to\n");
+
+	for (n = 0, p = worst; n < nr_worst; n++, p++) {
+		printf("WSD|%14.6f|%11.3f", (double)p->date / ONE_BILLION,
+		       (double)p->latency / 1000);
+		dump_stage(p->irq);
+		dump_stage(p->tick);
+		dump_stage(p->sched);
+		dump_stage(p->switched);
+		putchar('\n');
+	}
+}
+
 static void dump_hist_stats(time_t duration)
 {
 	double minavg, maxavg, avgavg;
@@ -473,6 +581,8 @@ static void dump_hist_stats(time_t duration)
 	dump_stats(histogram_avg, "avg", avgavg);
 	dump_stats(histogram_max, "max", maxavg);
 
+	dump_hdr_histogram();
+
 	if (do_gnuplot)
 		dump_histo_gnuplot(histogram_avg, duration);
 }
@@ -501,7 +611,11 @@ static void cleanup(void)
 		overall.histogram_min = histogram_min;
 		overall.histogram_max = histogram_max;
 		overall.histogram_avg = histogram_avg;
+		overall.histogram_hdr = histogram_hdr;
+		overall.worst = worst;
+		overall.nr_worst = 0;
 		ioctl(benchdev, RTTST_RTIOC_TMBENCH_STOP, &overall);
+		nr_worst = overall.nr_worst;
 		gminjitter = overall.result.min;
 		gmaxjitter = overall.result.max;
 		gavgjitter = overall.result.avg;
@@ -515,6 +629,9 @@ static void cleanup(void)
 	if (need_histo())
 		dump_hist_stats(actual_duration);
 
+	if (nr_worst > 0)
+		dump_worst();
+
 	printf
 	    ("---|-----------|-----------|-----------|--------|------|-------------------------\n"
 	     "RTS|%11.3f|%11.3f|%11.3f|%8d|%6u|    %.2ld:%.2ld:%.2ld/%.2d:%.2d:%.2d\n",
@@ -533,6 +650,10 @@ static void cleanup(void)
 		free(histogram_max);
 	if (histogram_min)
 		free(histogram_min);
+	if (histogram_hdr)
+		free(histogram_hdr);
+	if (worst)
+		free(worst);
 
 	exit(0);
 }
@@ -612,6 +733,7 @@ void application_usage(void)
 		"-c <cpu>                        pin measuring task down to given CPU\n"
 		"-P <priority>                   task priority (test mode 0 and 1 only)\n"
 		"-b                              break upon mode switch\n"
+		"-W <count>                      dump a breakdown of the <count> worst samples\n"
 		);
 }
 
@@ -646,7 +768,7 @@ int main(int argc, char *const *argv)
 	cpu_set_t cpus;
 	sigset_t mask;
 
-	while ((c = getopt(argc, argv, "g:hp:l:T:qH:B:sD:t:fc:P:b")) != EOF)
+	while ((c = getopt(argc, argv, "g:hp:l:T:qH:B:sD:t:fc:P:bW:")) != EOF)
 		switch (c) {
 		case 'g':
 			do_gnuplot = strdup(optarg);
@@ -720,6 +842,14 @@ int main(int argc, char *const *argv)
 			stop_upon_switch = 1;
 			break;
 
+		case 'W':
+			worst_count = atoi(optarg);
+			if (worst_count <= 0 ||
+			    worst_count > RTTST_BENCH_MAX_WORST)
+				error(1, EINVAL, "-W count must be within [1-%d]",
+				      RTTST_BENCH_MAX_WORST);
+			break;
+
 		default:
 			xenomai_usage();
 			exit(2);
@@ -743,10 +873,17 @@ int main(int argc, char *const *argv)
 	histogram_avg = calloc(histogram_size, sizeof(int32_t));
 	histogram_max = calloc(histogram_size, sizeof(int32_t));
 	histogram_min = calloc(histogram_size, sizeof(int32_t));
+	histogram_hdr = calloc(RTTST_HDR_CELLS, sizeof(int32_t));
 
-	if (!(histogram_avg && histogram_max && histogram_min))
+	if (!(histogram_avg && histogram_max && histogram_min && histogram_hdr))
 		cleanup();
 
+	if (worst_count) {
+		worst = calloc(worst_count, sizeof(*worst));
+		if (worst == NULL)
+			cleanup();
+	}
+
 	if (period_ns == 0)
 		period_ns = CONFIG_XENO_DEFAULT_PERIOD;	/* ns */
 
@@ -0,0 +1,231 @@
+/*
+ * Check the vectorized raw-to-physical conversion routines of
+ * libanalogy against the scalar ones.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <smokey/smokey.h>
+#include <rtdm/analogy.h>
+
+smokey_test_plugin(analogy_convert,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(samples),
+			   SMOKEY_INT(loops),
+		   ),
+   "Check the vectorized conversion routines of libanalogy against\n"
+   "\tthe scalar code, results must be bit-exact.\n"
+   "\tsamples=<N>\tsamples converted per block (default 65537)\n"
+   "\tloops=<N>\tconversions per implementation for timing (default 100)"
+);
+
+static const char *isa_names[] = {
+	[A4L_CONVERT_SCALAR] = "scalar",
+	[A4L_CONVERT_SSE2] = "sse2",
+	[A4L_CONVERT_AVX2] = "avx2",
+	[A4L_CONVERT_NEON] = "neon",
+};
+
+static double coeffs[] = { -1.25e-2, 3.0517578125e-4, 1.5e-10, -2.0e-15 };
+
+static struct a4l_polynomial poly = {
+	.expansion = 32767,
+	.order = 3,
+	.nb_coeff = 4,
+	.coeff = coeffs,
+};
+
+static a4l_chinfo_t chan = {
+	.chan_flags = 0,
+	.nb_rng = 1,
+	.nb_bits = 16,
+};
+
+static a4l_rnginfo_t rng = {
+	.min = -10000000,
+	.max = 10000000,
+	.flags = A4L_RNG_VOLT_UNIT,
+};
+
+struct results {
+	float *f;
+	double *d;
+	double *cal;
+};
+
+static int convert(struct results *r, sampl_t *raw, int count)
+{
+	int ret;
+
+	ret = a4l_rawtof(&chan, &rng, r->f, raw, count);
+	if (!__Tassert(ret == count))
+		return -EINVAL;
+
+	ret = a4l_rawtod(&chan, &rng, r->d, raw, count);
+	if (!__Tassert(ret == count))
+		return -EINVAL;
+
+	ret = a4l_rawtodcal(&chan, r->cal, raw, count, &poly);
+	if (!__Tassert(ret == count))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int alloc_results(struct results *r, int count)
+{
+	r->f = malloc(count * sizeof(float));
+	r->d = malloc(count * sizeof(double));
+	r->cal = malloc(count * sizeof(double));
+
+	return r->f && r->d && r->cal ? 0 : -ENOMEM;
+}
+
+static void free_results(struct results *r)
+{
+	free(r->f);
+	free(r->d);
+	free(r->cal);
+}
+
+static int compare_results(struct results *ref, struct results *r,
+			   int count, const char *isa, const char *what)
+{
+	if (memcmp(ref->f, r->f, count * sizeof(float))) {
+		smokey_warning("%s: a4l_rawtof() mismatch (%s)", isa, what);
+		return -EINVAL;
+	}
+
+	if (memcmp(ref->d, r->d, count * sizeof(double))) {
+		smokey_warning("%s: a4l_rawtod() mismatch (%s)", isa, what);
+		return -EINVAL;
+	}
+
+	if (memcmp(ref->cal, r->cal, count * sizeof(double))) {
+		smokey_warning("%s: a4l_rawtodcal() mismatch (%s)", isa, what);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void time_conversions(struct results *r, sampl_t *raw,
+			     int count, int loops, const char *isa)
+{
+	struct timespec start, end;
+	double elapsed;
+	int n;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < loops; n++)
+		a4l_rawtod(&chan, &rng, r->d, raw, count);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) * 1e9 +
+		(end.tv_nsec - start.tv_nsec);
+	smokey_trace("%-6s: a4l_rawtod() %.1f MS/s", isa,
+		     (double)count * loops * 1e3 / elapsed);
+}
+
+static int run_analogy_convert(struct smokey_test *t,
+			       int argc, char *const argv[])
+{
+	int count = 65537, loops = 100, isa, n, ret = 0;
+	struct results ref = { NULL }, r = { NULL };
+	sampl_t *raw;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(analogy_convert, samples))
+		count = SMOKEY_ARG_INT(analogy_convert, samples);
+	if (SMOKEY_ARG_ISSET(analogy_convert, loops))
+		loops = SMOKEY_ARG_INT(analogy_convert, loops);
+
+	if (count < 2 || loops < 1)
+		return -EINVAL;
+
+	/* One more sample, for converting from an odd address. */
+	raw = malloc((count + 1) * sizeof(sampl_t));
+	if (raw == NULL)
+		return -ENOMEM;
+
+	if (alloc_results(&ref, count) || alloc_results(&r, count)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* Cover the full scale, including both ends. */
+	srandom(count);
+	for (n = 0; n <= count; n++)
+		raw[n] = random();
+	raw[0] = 0;
+	raw[1] = 0xffff;
+
+	ret = a4l_set_convert_isa(A4L_CONVERT_SCALAR);
+	if (!__Tassert(ret == 0))
+		goto out;
+
+	time_conversions(&ref, raw, count, loops, "scalar");
+
+	for (isa = A4L_CONVERT_SSE2; isa <= A4L_CONVERT_NEON; isa++) {
+		ret = a4l_set_convert_isa(isa);
+		if (ret == -EOPNOTSUPP) {
+			smokey_trace("%-6s: not available", isa_names[isa]);
+			ret = 0;
+			continue;
+		}
+		if (!__Tassert(ret == 0))
+			goto out;
+
+		/* Whole block, then unaligned with an odd count. */
+		a4l_set_convert_isa(A4L_CONVERT_SCALAR);
+		ret = convert(&ref, raw, count);
+		if (ret)
+			goto out;
+		a4l_set_convert_isa(isa);
+		ret = convert(&r, raw, count);
+		if (ret)
+			goto out;
+		ret = compare_results(&ref, &r, count, isa_names[isa], "aligned");
+		if (ret)
+			goto out;
+
+		a4l_set_convert_isa(A4L_CONVERT_SCALAR);
+		ret = convert(&ref, raw + 1, count - 1);
+		if (ret)
+			goto out;
+		a4l_set_convert_isa(isa);
+		ret = convert(&r, raw + 1, count - 1);
+		if (ret)
+			goto out;
+		ret = compare_results(&ref, &r, count - 1,
+				      isa_names[isa], "unaligned");
+		if (ret)
+			goto out;
+
+		time_conversions(&r, raw, count, loops, isa_names[isa]);
+	}
+out:
+	a4l_set_convert_isa(A4L_CONVERT_BEST);
+	free_results(&ref);
+	free_results(&r);
+	free(raw);
+
+	return ret;
+}
@@ -13,15 +13,25 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
 #include <smokey/smokey.h>
 #include <rtdm/ipc.h>
 
 smokey_test_plugin(bufp,
-		   SMOKEY_NOARGS,
-		   "Check RTIPC/BUFP protocol."
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(mbytes),
+		   ),
+		   "Check RTIPC/BUFP protocol, measuring the stream throughput\n"
+		   "\tthrough the socket calls and the mapped ring."
 );
 
 #define BUFP_SVPORT 12
+#define BUFP_STREAMPORT 13
+
+#define STREAM_BUFSZ	(256 * 1024)
+#define STREAM_CHUNK	(16 * 1024)
 
 static pthread_t svtid, cltid;
 
@@ -132,12 +142,335 @@ static void *client(void *arg)
 	return NULL;
 }
 
+struct stream {
+	int s;
+	size_t total;
+	volatile struct bufp_ring_hdr *hdr;
+};
+
+/*
+ * The stream is made of 64bit words carrying their own index, which
+ * the consumer checks. Transfers are multiples of the word size, and
+ * so is the ring size.
+ */
+static void fill_words(void *p, size_t len, uint64_t *seq)
+{
+	uint64_t *w = p;
+	size_t n;
+
+	for (n = 0; n < len / sizeof(*w); n++)
+		w[n] = (*seq)++;
+}
+
+static int check_words(const void *p, size_t len, uint64_t *seq)
+{
+	const uint64_t *w = p;
+	size_t n;
+
+	for (n = 0; n < len / sizeof(*w); n++, (*seq)++) {
+		if (w[n] != *seq) {
+			smokey_warning("data mismatch at word %llu",
+				       (unsigned long long)*seq);
+			return -EPROTO;
+		}
+	}
+
+	return 0;
+}
+
+static inline size_t stream_need(struct stream *st, size_t off)
+{
+	return st->total - off < STREAM_CHUNK ? st->total - off : STREAM_CHUNK;
+}
+
+static void *syscall_producer(void *arg)
+{
+	struct stream *st = arg;
+	uint64_t seq = 0;
+	size_t off, len;
+	long ret = 0;
+	char *buf;
+
+	buf = malloc(STREAM_CHUNK);
+	if (buf == NULL)
+		return (void *)-ENOMEM;
+
+	for (off = 0; off < st->total; off += len) {
+		len = stream_need(st, off);
+		fill_words(buf, len, &seq);
+		ret = smokey_check_errno(write(st->s, buf, len));
+		if (ret < 0)
+			break;
+		ret = 0;
+	}
+
+	free(buf);
+
+	return (void *)ret;
+}
+
+static void *syscall_consumer(void *arg)
+{
+	struct stream *st = arg;
+	uint64_t seq = 0;
+	long ret = 0;
+	size_t off;
+	char *buf;
+
+	buf = malloc(STREAM_CHUNK);
+	if (buf == NULL)
+		return (void *)-ENOMEM;
+
+	for (off = 0; off < st->total; off += ret) {
+		ret = smokey_check_errno(read(st->s, buf, stream_need(st, off)));
+		if (ret < 0)
+			goto out;
+		if (check_words(buf, ret, &seq)) {
+			ret = -EPROTO;
+			goto out;
+		}
+	}
+	ret = 0;
+out:
+	free(buf);
+
+	return (void *)ret;
+}
+
+static void *ring_producer(void *arg)
+{
+	struct stream *st = arg;
+	struct iovec iov[2];
+	size_t off, len, n;
+	uint64_t seq = 0;
+	int ret;
+
+	for (off = 0; off < st->total; off += len) {
+		len = bufp_ring_writev(st->hdr, iov);
+		if (len < stream_need(st, off)) {
+			ret = smokey_check_errno(ioctl(st->s, BUFP_RTIOC_WAIT_SPACE,
+						       stream_need(st, off)));
+			if (ret < 0)
+				return (void *)(long)ret;
+			len = 0;
+			continue;
+		}
+		if (len > st->total - off)
+			len = st->total - off;
+		/* Build the data in place, no copy. */
+		n = len < iov[0].iov_len ? len : iov[0].iov_len;
+		fill_words(iov[0].iov_base, n, &seq);
+		fill_words(iov[1].iov_base, len - n, &seq);
+		if (bufp_ring_produce(st->hdr, len) &&
+		    !__Terrno(ret, ioctl(st->s, BUFP_RTIOC_NOTIFY)))
+			return (void *)(long)ret;
+	}
+
+	return NULL;
+}
+
+static void *ring_consumer(void *arg)
+{
+	struct stream *st = arg;
+	struct iovec iov[2];
+	uint64_t seq = 0;
+	size_t off, len;
+	int ret;
+
+	for (off = 0; off < st->total; off += len) {
+		len = bufp_ring_readv(st->hdr, iov);
+		if (len < stream_need(st, off)) {
+			ret = smokey_check_errno(ioctl(st->s, BUFP_RTIOC_WAIT_DATA,
+						       stream_need(st, off)));
+			if (ret < 0)
+				return (void *)(long)ret;
+			len = 0;
+			continue;
+		}
+		/* Check the data in place, no copy. */
+		if (check_words(iov[0].iov_base, iov[0].iov_len, &seq) ||
+		    check_words(iov[1].iov_base, iov[1].iov_len, &seq))
+			return (void *)-EPROTO;
+		if (bufp_ring_consume(st->hdr, len) &&
+		    !__Terrno(ret, ioctl(st->s, BUFP_RTIOC_NOTIFY)))
+			return (void *)(long)ret;
+	}
+
+	return NULL;
+}
+
+static int map_ring(int s, volatile struct bufp_ring_hdr **hdrp)
+{
+	volatile struct bufp_ring_hdr *hdr;
+	size_t size;
+	int ret;
+
+	/* Peek at the header first, for the size of the mapping. */
+	hdr = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, s, 0);
+	if (hdr == MAP_FAILED)
+		goto fail;
+	size = hdr->map_size;
+	munmap((void *)hdr, getpagesize());
+
+	hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s, 0);
+	if (hdr == MAP_FAILED)
+		goto fail;
+
+	if (!__Tassert(hdr->size == STREAM_BUFSZ)) {
+		munmap((void *)hdr, size);
+		return -EINVAL;
+	}
+
+	*hdrp = hdr;
+
+	return 0;
+fail:
+	ret = -errno;
+	smokey_warning("mmap: %s", strerror(-ret));
+
+	return ret;
+}
+
+static int start_stream_thread(pthread_t *tid, void *(*fn)(void *),
+			       struct stream *st, int prio)
+{
+	struct sched_param param = { .sched_priority = prio };
+	pthread_attr_t attr;
+	int ret;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+	__T(ret, pthread_create(tid, &attr, fn, st));
+	pthread_attr_destroy(&attr);
+
+	return ret;
+}
+
+/*
+ * Stream @total bytes from a producer to a consumer thread, either
+ * through the regular socket calls, or by moving the indices of the
+ * mapped ring directly.
+ */
+static int run_stream(size_t total, int mapped)
+{
+	struct stream rx = { .total = total }, tx = { .total = total };
+	struct timeval tv = { .tv_sec = 5, .tv_usec = 0 };
+	size_t bufsz = STREAM_BUFSZ, rxsize = 0, txsize = 0;
+	void *rxret = NULL, *txret = NULL;
+	struct timespec start, end;
+	struct sockaddr_ipc saddr;
+	pthread_t rxtid, txtid;
+	long long ns;
+	int ret;
+
+	rx.s = smokey_check_errno(socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP));
+	if (rx.s < 0)
+		return rx.s;
+
+	tx.s = smokey_check_errno(socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP));
+	if (tx.s < 0) {
+		ret = tx.s;
+		goto out_rx;
+	}
+
+	if (!__Terrno(ret, setsockopt(rx.s, SOL_BUFP, BUFP_BUFSZ,
+				      &bufsz, sizeof(bufsz))))
+		goto out;
+
+	if (!__Terrno(ret, setsockopt(rx.s, SOL_BUFP, BUFP_MAPPED,
+				      &mapped, sizeof(mapped))))
+		goto out;
+
+	if (!__Terrno(ret, setsockopt(rx.s, SOL_SOCKET, SO_RCVTIMEO,
+				      &tv, sizeof(tv))))
+		goto out;
+
+	if (!__Terrno(ret, setsockopt(tx.s, SOL_SOCKET, SO_SNDTIMEO,
+				      &tv, sizeof(tv))))
+		goto out;
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = BUFP_STREAMPORT;
+	if (!__Terrno(ret, bind(rx.s, (struct sockaddr *)&saddr,
+				sizeof(saddr))))
+		goto out;
+
+	if (!__Terrno(ret, connect(tx.s, (struct sockaddr *)&saddr,
+				   sizeof(saddr))))
+		goto out;
+
+	if (mapped) {
+		/* The consumer maps its own ring, the producer its peer's. */
+		ret = map_ring(rx.s, &rx.hdr);
+		if (ret)
+			goto out;
+		rxsize = rx.hdr->map_size;
+		ret = map_ring(tx.s, &tx.hdr);
+		if (ret)
+			goto out;
+		txsize = tx.hdr->map_size;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	ret = start_stream_thread(&rxtid, mapped ? ring_consumer :
+				  syscall_consumer, &rx, 71);
+	if (ret)
+		goto out;
+
+	ret = start_stream_thread(&txtid, mapped ? ring_producer :
+				  syscall_producer, &tx, 70);
+	if (ret) {
+		pthread_cancel(rxtid);
+		pthread_join(rxtid, NULL);
+		goto out;
+	}
+
+	pthread_join(txtid, &txret);
+	pthread_join(rxtid, &rxret);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ret = (long)txret ?: (long)rxret;
+	if (ret)
+		goto out;
+
+	ns = (end.tv_sec - start.tv_sec) * 1000000000LL +
+		end.tv_nsec - start.tv_nsec;
+	smokey_trace("%s: %zu MB streamed in %lld us, %.2f GB/s",
+		     mapped ? "mapped ring" : "socket calls",
+		     total >> 20, ns / 1000, (double)total / ns);
+out:
+	if (tx.hdr)
+		munmap((void *)tx.hdr, txsize);
+	if (rx.hdr)
+		munmap((void *)rx.hdr, rxsize);
+	close(tx.s);
+out_rx:
+	close(rx.s);
+
+	return ret;
+}
+
 static int run_bufp(struct smokey_test *t, int argc, char *const argv[])
 {
 	struct sched_param svparam = {.sched_priority = 71 };
 	struct sched_param clparam = {.sched_priority = 70 };
 	pthread_attr_t svattr, clattr;
-	int s;
+	int s, ret, mbytes = 64;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(bufp, mbytes))
+		mbytes = SMOKEY_ARG_INT(bufp, mbytes);
+	if (mbytes < 1) {
+		smokey_warning("mbytes must be positive");
+		return -EINVAL;
+	}
 
 	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_BUFP);
 	if (s < 0) {
@@ -170,5 +503,9 @@ static int run_bufp(struct smokey_test *t, int argc, char *const argv[])
 	pthread_cancel(svtid);
 	pthread_join(svtid, NULL);
 
-	return 0;
+	ret = run_stream((size_t)mbytes << 20, 0);
+	if (ret)
+		return ret;
+
+	return run_stream((size_t)mbytes << 20, 1);
 }
@@ -0,0 +1,271 @@
+/*
+ * CAN raw socket receive ring and batch send test, running over the
+ * virtual CAN bus (rtcan_virt).
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <smokey/smokey.h>
+#include <rtdm/can.h>
+
+smokey_test_plugin(can_ring,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(frames),
+		   ),
+		   "Check the shared receive ring and batch send of CAN raw sockets."
+);
+
+#define RING_SLOTS	64
+
+static int get_ifindex(int s, const char *name, int *ifindex)
+{
+	struct can_ifreq ifr;
+	int ret;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, name, IFNAMSIZ);
+	ret = ioctl(s, SIOCGIFINDEX, &ifr);
+	if (ret) {
+		ret = -errno;
+		smokey_note("%s: %s", name, strerror(-ret));
+		return ret == -ENODEV ? -ENOSYS : ret;
+	}
+
+	ifr.ifr_ifru.mode = CAN_MODE_START;
+	if (!__Terrno(ret, ioctl(s, SIOCSCANMODE, &ifr)))
+		return ret;
+
+	*ifindex = ifr.ifr_ifindex;
+
+	return 0;
+}
+
+static int send_frames(int s, int first, int count)
+{
+	nanosecs_abs_t stamps[RTCAN_TX_BATCH_MAX];
+	struct can_frame frames[RTCAN_TX_BATCH_MAX];
+	struct msghdr msg;
+	struct iovec iov;
+	int ret, n, i, on = 1;
+
+	if (!__Terrno(ret, setsockopt(s, SOL_CAN_RAW, CAN_RAW_TX_TIMESTAMP,
+				      &on, sizeof(on))))
+		return ret;
+
+	/* Send in batches, collecting the TX timestamps. */
+	while (count > 0) {
+		n = count < RTCAN_TX_BATCH_MAX ? count : RTCAN_TX_BATCH_MAX;
+		for (i = 0; i < n; i++) {
+			memset(&frames[i], 0, sizeof(frames[i]));
+			frames[i].can_id = (first + i) & CAN_SFF_MASK;
+			frames[i].can_dlc = (first + i) % 9;
+			memset(frames[i].data, first + i, frames[i].can_dlc);
+		}
+		iov.iov_base = frames;
+		iov.iov_len = n * sizeof(frames[0]);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = stamps;
+		msg.msg_controllen = n * sizeof(stamps[0]);
+		ret = smokey_check_errno(sendmsg(s, &msg, 0));
+		if (ret < 0)
+			return ret;
+		if (!__Tassert(ret == n * (int)sizeof(frames[0])))
+			return -EPROTO;
+		for (i = 0; i < n; i++) {
+			if (stamps[i] == 0 || (i > 0 && stamps[i] < stamps[i - 1])) {
+				smokey_warning("bad TX timestamp for frame #%d",
+					       first + i);
+				return -EPROTO;
+			}
+		}
+		first += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
+static int check_frames(volatile struct can_ring_hdr *hdr,
+			int first, int count, int ifindex)
+{
+	struct can_ring_slot *slots, *slot;
+	unsigned int tail = hdr->tail;
+	nanosecs_abs_t last = 0;
+	int n, i;
+
+	slots = (void *)hdr + hdr->slot_off;
+
+	for (n = first; n < first + count; n++, tail++) {
+		slot = &slots[tail & (hdr->nr_slots - 1)];
+		if (slot->frame.can_id != (n & CAN_SFF_MASK) ||
+		    slot->frame.can_dlc != n % 9 ||
+		    slot->ifindex != ifindex ||
+		    slot->timestamp < last) {
+			smokey_warning("bad frame #%d in slot %u", n,
+				       tail & (hdr->nr_slots - 1));
+			return -EPROTO;
+		}
+		for (i = 0; i < slot->frame.can_dlc; i++) {
+			if (slot->frame.data[i] != (uint8_t)n) {
+				smokey_warning("bad payload in frame #%d", n);
+				return -EPROTO;
+			}
+		}
+		last = slot->timestamp;
+	}
+
+	hdr->tail = tail;
+
+	return 0;
+}
+
+static int run_can_ring(struct smokey_test *t, int argc, char *const argv[])
+{
+	volatile struct can_ring_hdr *hdr = MAP_FAILED;
+	int tx, rx, ret, tx_ifindex, rx_ifindex, nframes = 48;
+	nanosecs_rel_t timeout = RTDM_TIMEOUT_NONE;
+	struct sockaddr_can addr;
+	struct sched_param param;
+	size_t size = 0;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(can_ring, frames))
+		nframes = SMOKEY_ARG_INT(can_ring, frames);
+	if (nframes < 1 || nframes > RING_SLOTS) {
+		smokey_warning("frames must be within [1-%d]", RING_SLOTS);
+		return -EINVAL;
+	}
+
+	tx = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+	if (tx < 0) {
+		ret = -errno;
+		smokey_note("socket: %s", strerror(-ret));
+		return ret == -EAFNOSUPPORT ? -ENOSYS : ret;
+	}
+
+	rx = smokey_check_errno(socket(PF_CAN, SOCK_RAW, CAN_RAW));
+	if (rx < 0) {
+		ret = rx;
+		goto out_tx;
+	}
+
+	/* rtcan_virt loops rtcan0 and rtcan1 together. */
+	ret = get_ifindex(tx, "rtcan0", &tx_ifindex);
+	if (ret)
+		goto out;
+
+	ret = get_ifindex(rx, "rtcan1", &rx_ifindex);
+	if (ret)
+		goto out;
+
+	param.sched_priority = 10;
+	if (!__T(ret, pthread_setschedparam(pthread_self(),
+					     SCHED_FIFO, &param)))
+		goto out;
+
+	if (!__Fassert(ioctl(rx, RTCAN_RTIOC_RING_WAIT, 1) == 0 ||
+		       errno != ENXIO)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (!__Terrno(ret, ioctl(rx, RTCAN_RTIOC_RING_SETUP, RING_SLOTS)))
+		goto out;
+
+	if (!__Fassert(ioctl(rx, RTCAN_RTIOC_RING_SETUP, RING_SLOTS) == 0 ||
+		       errno != EBUSY)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	hdr = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, rx, 0);
+	if (hdr == MAP_FAILED) {
+		ret = -errno;
+		smokey_warning("mmap: %s", strerror(-ret));
+		goto out;
+	}
+	size = hdr->map_size;
+	munmap((void *)hdr, getpagesize());
+
+	hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rx, 0);
+	if (hdr == MAP_FAILED) {
+		ret = -errno;
+		smokey_warning("mmap: %s", strerror(-ret));
+		goto out;
+	}
+
+	if (!__Tassert(hdr->nr_slots == RING_SLOTS)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = rx_ifindex;
+	if (!__Terrno(ret, bind(rx, (struct sockaddr *)&addr, sizeof(addr))))
+		goto out;
+
+	addr.can_ifindex = tx_ifindex;
+	if (!__Terrno(ret, bind(tx, (struct sockaddr *)&addr, sizeof(addr))))
+		goto out;
+
+	/* Nothing received yet, a non-blocking wait must fail. */
+	if (!__Terrno(ret, ioctl(rx, RTCAN_RTIOC_RCV_TIMEOUT, &timeout)))
+		goto out;
+
+	if (!__Fassert(ioctl(rx, RTCAN_RTIOC_RING_WAIT, 1) == 0 ||
+		       errno != EAGAIN)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* Receive a batch at once. */
+	ret = send_frames(tx, 0, nframes);
+	if (ret)
+		goto out;
+
+	ret = smokey_check_errno(ioctl(rx, RTCAN_RTIOC_RING_WAIT, nframes));
+	if (ret < 0)
+		goto out;
+
+	if (!__Tassert(ret == nframes)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = check_frames(hdr, 0, nframes, rx_ifindex);
+	if (ret)
+		goto out;
+
+	smokey_trace("%d frames received through the ring", nframes);
+
+	/* Overflow the ring, excess frames must be counted. */
+	ret = send_frames(tx, nframes, RING_SLOTS + 8);
+	if (ret)
+		goto out;
+
+	if (!__Tassert(hdr->head - hdr->tail == RING_SLOTS &&
+		       hdr->overruns == 8)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = check_frames(hdr, nframes, RING_SLOTS, rx_ifindex);
+out:
+	if (hdr != MAP_FAILED)
+		munmap((void *)hdr, size);
+	close(rx);
+out_tx:
+	close(tx);
+
+	return ret;
+}
@@ -0,0 +1,164 @@
+/*
+ * Cobalt doorbell test, ringing a Linux eventfd from primary mode.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(doorbell,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(rings),
+		   ),
+		   "Check Cobalt doorbells, forwarding counts to a Linux eventfd."
+);
+
+/* Collect counts from the eventfd until @total is reached. */
+static int drain_eventfd(int efd, uint64_t total, int *wakeups)
+{
+	struct pollfd pfd = {
+		.fd = efd,
+		.events = POLLIN,
+	};
+	uint64_t sum = 0, value;
+	int ret;
+
+	*wakeups = 0;
+
+	while (sum < total) {
+		ret = smokey_check_errno(poll(&pfd, 1, 1000));
+		if (ret < 0)
+			return ret;
+		if (ret == 0) {
+			smokey_warning("eventfd not signaled, got %llu/%llu",
+				       (unsigned long long)sum,
+				       (unsigned long long)total);
+			return -ETIMEDOUT;
+		}
+		ret = smokey_check_errno(read(efd, &value, sizeof(value)));
+		if (ret < 0)
+			return ret;
+		sum += value;
+		(*wakeups)++;
+	}
+
+	if (sum != total) {
+		smokey_warning("eventfd counted %llu, expected %llu",
+			       (unsigned long long)sum,
+			       (unsigned long long)total);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static int run_doorbell(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sched_param param;
+	int efd, db, ret, n, p[2], wakeups, nrings = 1000;
+	uint64_t total = 0;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(doorbell, rings))
+		nrings = SMOKEY_ARG_INT(doorbell, rings);
+	if (nrings < 1) {
+		smokey_warning("rings must be positive");
+		return -EINVAL;
+	}
+
+	efd = smokey_check_errno(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+	if (efd < 0)
+		return efd;
+
+	/* Only eventfds may be attached. */
+	if (!__Terrno(ret, pipe(p)))
+		goto out_efd;
+
+	ret = cobalt_doorbell_create(p[0], 0);
+	close(p[0]);
+	close(p[1]);
+	if (ret == -ENOSYS) {
+		smokey_note("doorbells not supported by the core");
+		goto out_efd;
+	}
+	if (!__Tassert(ret == -EINVAL)) {
+		ret = -EINVAL;
+		goto out_efd;
+	}
+
+	if (!__Tassert(cobalt_doorbell_create(efd, O_NONBLOCK) == -EINVAL)) {
+		ret = -EINVAL;
+		goto out_efd;
+	}
+
+	db = cobalt_doorbell_create(efd, O_CLOEXEC);
+	if (db < 0) {
+		ret = db;
+		smokey_warning("cobalt_doorbell_create: %s", strerror(-ret));
+		goto out_efd;
+	}
+
+	if (!__Tassert(cobalt_doorbell_ring(db, ~0ULL) == -EINVAL)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	param.sched_priority = 10;
+	if (!__T(ret, pthread_setschedparam(pthread_self(),
+					     SCHED_FIFO, &param)))
+		goto out;
+
+	/*
+	 * Ring from primary mode: Linux may not resume on this CPU
+	 * before we are done, so the counts should mostly reach the
+	 * eventfd at once.
+	 */
+	cobalt_thread_harden();
+
+	for (n = 1; n <= nrings; n++) {
+		ret = cobalt_doorbell_ring(db, n);
+		if (ret) {
+			smokey_warning("cobalt_doorbell_ring: %s",
+				       strerror(-ret));
+			goto out;
+		}
+		total += n;
+	}
+
+	if (!__Tassert((cobalt_thread_mode() & XNRELAX) == 0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = drain_eventfd(efd, total, &wakeups);
+	if (ret)
+		goto out;
+
+	smokey_trace("%d rings delivered in %d eventfd wakeup(s)",
+		     nrings, wakeups);
+
+	/* A ring from secondary mode must get through as well. */
+	cobalt_thread_relax();
+
+	ret = cobalt_doorbell_ring(db, 1);
+	if (ret)
+		goto out;
+
+	ret = drain_eventfd(efd, 1, &wakeups);
+out:
+	close(db);
+out_efd:
+	close(efd);
+
+	return ret;
+}
@@ -13,16 +13,36 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
 #include <smokey/smokey.h>
 #include <rtdm/ipc.h>
 
 smokey_test_plugin(iddp,
-		   SMOKEY_NOARGS,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(msgs),
+		   ),
 		   "Check RTIPC/IDDP protocol."
 );
 
 #define IDDP_SVPORT 12
 #define IDDP_CLPORT 13
+#define IDDP_BNPORT 14
+
+#define BENCH_MSGSZ	64
+#define BENCH_BATCH	32
+
+enum {
+	BENCH_HEAP,
+	BENCH_SLAB,
+	BENCH_MMSG,
+};
+
+static const char *bench_modes[] = {
+	[BENCH_HEAP] = "heap",
+	[BENCH_SLAB] = "slab",
+	[BENCH_MMSG] = "slab+batch",
+};
 
 static pthread_t svtid, cltid;
 
@@ -136,12 +156,169 @@ static void *client(void *arg)
 	return NULL;
 }
 
+static int xfer_batch(int s, struct sockaddr_ipc *saddr, int mode,
+		      char txbufs[][BENCH_MSGSZ], char rxbufs[][BENCH_MSGSZ],
+		      int count)
+{
+	struct mmsghdr msgvec[BENCH_BATCH];
+	struct iovec iov[BENCH_BATCH];
+	struct iddp_mmsg_req req;
+	int ret, n;
+
+	if (mode != BENCH_MMSG) {
+		for (n = 0; n < count; n++) {
+			ret = smokey_check_errno(
+				sendto(s, txbufs[n], BENCH_MSGSZ, 0,
+				       (struct sockaddr *)saddr, sizeof(*saddr)));
+			if (ret < 0)
+				return ret;
+		}
+		for (n = 0; n < count; n++) {
+			ret = smokey_check_errno(recv(s, rxbufs[n], BENCH_MSGSZ, 0));
+			if (ret < 0)
+				return ret;
+			if (!__Tassert(ret == BENCH_MSGSZ))
+				return -EPROTO;
+		}
+		return 0;
+	}
+
+	memset(msgvec, 0, sizeof(msgvec));
+	for (n = 0; n < count; n++) {
+		iov[n].iov_base = txbufs[n];
+		iov[n].iov_len = BENCH_MSGSZ;
+		msgvec[n].msg_hdr.msg_name = saddr;
+		msgvec[n].msg_hdr.msg_namelen = sizeof(*saddr);
+		msgvec[n].msg_hdr.msg_iov = &iov[n];
+		msgvec[n].msg_hdr.msg_iovlen = 1;
+	}
+
+	req.msgvec = msgvec;
+	req.vlen = count;
+	req.flags = 0;
+	ret = smokey_check_errno(ioctl(s, IDDP_RTIOC_SENDMMSG, &req));
+	if (ret < 0)
+		return ret;
+	if (!__Tassert(ret == count))
+		return -EPROTO;
+
+	for (n = 0; n < count; n++) {
+		iov[n].iov_base = rxbufs[n];
+		iov[n].iov_len = BENCH_MSGSZ;
+		msgvec[n].msg_hdr.msg_name = NULL;
+		msgvec[n].msg_hdr.msg_namelen = 0;
+		msgvec[n].msg_len = 0;
+	}
+
+	ret = smokey_check_errno(ioctl(s, IDDP_RTIOC_RECVMMSG, &req));
+	if (ret < 0)
+		return ret;
+	if (!__Tassert(ret == count))
+		return -EPROTO;
+
+	for (n = 0; n < count; n++) {
+		if (!__Tassert(msgvec[n].msg_len == BENCH_MSGSZ))
+			return -EPROTO;
+	}
+
+	return 0;
+}
+
+/*
+ * Loop small datagrams back to the sending socket, allocating the
+ * message buffers from the system heap or from a per-socket slab,
+ * one call per datagram or one call per batch.
+ */
+static int run_bench(int mode, int nmsgs)
+{
+	char txbufs[BENCH_BATCH][BENCH_MSGSZ], rxbufs[BENCH_BATCH][BENCH_MSGSZ];
+	struct iddp_slab_config slabcf;
+	struct timespec start, end;
+	struct sockaddr_ipc saddr;
+	int s, ret, sent, n, i;
+	long long ns;
+
+	s = smokey_check_errno(socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP));
+	if (s < 0)
+		return s;
+
+	if (mode != BENCH_HEAP) {
+		slabcf.msgsz = BENCH_MSGSZ;
+		slabcf.count = BENCH_BATCH;
+		if (!__Terrno(ret, setsockopt(s, SOL_IDDP, IDDP_SLAB,
+					      &slabcf, sizeof(slabcf))))
+			goto out;
+	}
+
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = IDDP_BNPORT;
+	if (!__Terrno(ret, bind(s, (struct sockaddr *)&saddr, sizeof(saddr))))
+		goto out;
+
+	if (mode != BENCH_HEAP &&
+	    !__Fassert(setsockopt(s, SOL_IDDP, IDDP_SLAB,
+				  &slabcf, sizeof(slabcf)) == 0 ||
+		       errno != EALREADY)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (sent = 0; sent < nmsgs; sent += n) {
+		n = nmsgs - sent < BENCH_BATCH ? nmsgs - sent : BENCH_BATCH;
+		/*
+		 * Receive into separate buffers filled with something
+		 * else, so that a datagram which did not make it
+		 * cannot go unnoticed.
+		 */
+		for (i = 0; i < n; i++) {
+			memset(txbufs[i], sent + i, BENCH_MSGSZ);
+			memset(rxbufs[i], ~(sent + i), BENCH_MSGSZ);
+		}
+		ret = xfer_batch(s, &saddr, mode, txbufs, rxbufs, n);
+		if (ret)
+			goto out;
+		for (i = 0; i < n; i++) {
+			if (memcmp(rxbufs[i], txbufs[i], BENCH_MSGSZ)) {
+				smokey_warning("%s: bad payload in datagram #%d",
+					       bench_modes[mode], sent + i);
+				ret = -EPROTO;
+				goto out;
+			}
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ns = (end.tv_sec - start.tv_sec) * 1000000000LL +
+		end.tv_nsec - start.tv_nsec;
+	smokey_trace("%s: %d x %d bytes in %lld us, %lld msgs/s",
+		     bench_modes[mode], nmsgs, BENCH_MSGSZ, ns / 1000,
+		     ns > 0 ? nmsgs * 1000000000LL / ns : 0);
+	ret = 0;
+out:
+	close(s);
+
+	return ret;
+}
+
 static int run_iddp(struct smokey_test *t, int argc, char *const argv[])
 {
 	struct sched_param svparam = {.sched_priority = 71 };
 	struct sched_param clparam = {.sched_priority = 70 };
+	struct sched_param param = {.sched_priority = 10 };
 	pthread_attr_t svattr, clattr;
-	int s;
+	int s, ret, mode, nmsgs = 100000;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(iddp, msgs))
+		nmsgs = SMOKEY_ARG_INT(iddp, msgs);
+	if (nmsgs < 1) {
+		smokey_warning("msgs must be positive");
+		return -EINVAL;
+	}
 
 	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
 	if (s < 0) {
@@ -174,5 +351,15 @@ static int run_iddp(struct smokey_test *t, int argc, char *const argv[])
 	pthread_cancel(svtid);
 	pthread_join(svtid, NULL);
 
+	if (!__T(ret, pthread_setschedparam(pthread_self(),
+					     SCHED_FIFO, &param)))
+		return ret;
+
+	for (mode = BENCH_HEAP; mode <= BENCH_MMSG; mode++) {
+		ret = run_bench(mode, nmsgs);
+		if (ret)
+			return ret;
+	}
+
 	return 0;
 }
@@ -0,0 +1,361 @@
+/*
+ * RTnet virtual Ethernet pair test, bouncing UDP datagrams between
+ * both ends of a rt_veth pair.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+#include <rtnet_chrdev.h>
+#include <ipv4_chrdev.h>
+
+smokey_test_plugin(net_veth,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(count),
+		   ),
+		   "Check the rt_veth pair driver, bouncing UDP datagrams\n"
+		   "\tbetween both ends of a pair.\n"
+		   "\tthe count parameter sets the number of round trips"
+);
+
+#define VETH_PORT	7
+#define VETH_MAXLEN	1400
+
+static struct veth_end {
+	const char *name;
+	const char *ip;
+	struct in_addr addr;
+	__u8 dev_addr[DEV_ADDR_LEN];
+	int s;
+} ends[2] = {
+	{ .name = "rtveth0", .ip = "10.255.0.1", .s = -1 },
+	{ .name = "rtveth1", .ip = "10.255.0.2", .s = -1 },
+};
+
+static int modprobe(const char *args)
+{
+	char cmd[128];
+	int status;
+
+	snprintf(cmd, sizeof(cmd), "modprobe -q %s", args);
+	status = system(cmd);
+	if (status < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		return -ENOSYS;
+
+	return 0;
+}
+
+static int rmmod(const char *mod)
+{
+	char cmd[128];
+	int status;
+
+	snprintf(cmd, sizeof(cmd), "rmmod %s", mod);
+	status = smokey_check_errno(system(cmd));
+	if (status < 0)
+		return status;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		smokey_warning("%s: abnormal exit", cmd);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int get_info(int fd, struct veth_end *end, __u32 *flags)
+{
+	struct rtnet_core_cmd cmd;
+	int ret;
+
+	memset(&cmd, 0, sizeof(cmd));
+	snprintf(cmd.head.if_name, sizeof(cmd.head.if_name), "%s", end->name);
+	ret = smokey_check_errno(ioctl(fd, IOC_RT_IFINFO, &cmd));
+	if (ret < 0)
+		return ret;
+
+	memcpy(end->dev_addr, cmd.args.info.dev_addr, sizeof(end->dev_addr));
+	*flags = cmd.args.info.flags;
+
+	return 0;
+}
+
+static int set_up(int fd, struct veth_end *end)
+{
+	struct rtnet_core_cmd cmd;
+
+	if (!inet_aton(end->ip, &end->addr))
+		return -EINVAL;
+
+	memset(&cmd, 0, sizeof(cmd));
+	snprintf(cmd.head.if_name, sizeof(cmd.head.if_name), "%s", end->name);
+	cmd.args.up.ip_addr = end->addr.s_addr;
+	cmd.args.up.broadcast_ip = end->addr.s_addr | htonl(0xff);
+	cmd.args.up.dev_addr_type = 0xffff;
+
+	return smokey_check_errno(ioctl(fd, IOC_RT_IFUP, &cmd));
+}
+
+static int set_down(int fd, struct veth_end *end)
+{
+	struct rtnet_core_cmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	snprintf(cmd.head.if_name, sizeof(cmd.head.if_name), "%s", end->name);
+
+	return smokey_check_errno(ioctl(fd, IOC_RT_IFDOWN, &cmd));
+}
+
+/* Route the peer's address through @end, to the peer's MAC. */
+static int add_route(int fd, struct veth_end *end, struct veth_end *peer)
+{
+	struct ipv4_cmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	snprintf(cmd.head.if_name, sizeof(cmd.head.if_name), "%s", end->name);
+	cmd.args.addhost.ip_addr = peer->addr.s_addr;
+	memcpy(cmd.args.addhost.dev_addr, peer->dev_addr,
+	       sizeof(cmd.args.addhost.dev_addr));
+
+	return smokey_check_errno(ioctl(fd, IOC_RT_HOST_ROUTE_ADD, &cmd));
+}
+
+static int wait_running(int fd)
+{
+	__u32 flags0, flags1;
+	int ret, n;
+
+	for (n = 0; n < 50; n++) {
+		ret = get_info(fd, &ends[0], &flags0);
+		if (ret)
+			return ret;
+		ret = get_info(fd, &ends[1], &flags1);
+		if (ret)
+			return ret;
+		if ((flags0 & flags1 & (IFF_UP | IFF_RUNNING)) ==
+		    (IFF_UP | IFF_RUNNING))
+			return 0;
+		usleep(100000);
+	}
+
+	smokey_warning("no carrier on the pair");
+
+	return -ETIMEDOUT;
+}
+
+static int open_end(struct veth_end *end)
+{
+	struct sockaddr_in sin;
+	int s, ret;
+
+	s = smokey_check_errno(__RT(socket(PF_INET, SOCK_DGRAM, 0)));
+	if (s < 0)
+		return s;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(VETH_PORT);
+	sin.sin_addr = end->addr;
+	ret = smokey_check_errno(__RT(bind(s, (struct sockaddr *)&sin,
+					   sizeof(sin))));
+	if (ret) {
+		__RT(close(s));
+		return ret;
+	}
+
+	end->s = s;
+
+	return 0;
+}
+
+static void fill(unsigned char *buf, size_t len, unsigned int seq)
+{
+	size_t n;
+
+	for (n = 0; n < len; n++)
+		buf[n] = (unsigned char)(seq + n);
+}
+
+/* Send @len bytes from @from to @to, check what @to receives. */
+static int bounce(struct veth_end *from, struct veth_end *to,
+		  unsigned int seq, size_t len)
+{
+	unsigned char tx[VETH_MAXLEN], rx[VETH_MAXLEN];
+	struct timeval timeout = { .tv_sec = 1 };
+	struct sockaddr_in sin;
+	fd_set set;
+	int ret;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(VETH_PORT);
+	sin.sin_addr = to->addr;
+
+	fill(tx, len, seq);
+	ret = smokey_check_errno(__RT(sendto(from->s, tx, len, 0,
+					     (struct sockaddr *)&sin,
+					     sizeof(sin))));
+	if (ret < 0)
+		return ret;
+
+	FD_ZERO(&set);
+	FD_SET(to->s, &set);
+	ret = smokey_check_errno(__RT(select(to->s + 1, &set,
+					     NULL, NULL, &timeout)));
+	if (ret < 0)
+		return ret;
+	if (ret == 0) {
+		smokey_warning("datagram #%u lost on %s", seq, to->name);
+		return -ETIMEDOUT;
+	}
+
+	memset(rx, 0, len);
+	ret = smokey_check_errno(__RT(recv(to->s, rx, sizeof(rx), 0)));
+	if (ret < 0)
+		return ret;
+
+	if (ret != (int)len || memcmp(rx, tx, len)) {
+		smokey_warning("datagram #%u corrupted on %s (%d/%zu bytes)",
+			       seq, to->name, ret, len);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static int run_pair(int count)
+{
+	struct sched_param param = { .sched_priority = 20 };
+	unsigned int seq;
+	size_t len;
+	int ret;
+
+	ret = smokey_check_status(pthread_setschedparam(pthread_self(),
+							SCHED_FIFO, &param));
+	if (ret)
+		return ret;
+
+	for (seq = 0; seq < (unsigned int)count; seq++) {
+		/* Sweep frame sizes, including minimal frames. */
+		len = 1 + (seq * 97) % VETH_MAXLEN;
+		ret = bounce(&ends[0], &ends[1], seq, len);
+		if (ret)
+			break;
+		ret = bounce(&ends[1], &ends[0], seq, len);
+		if (ret)
+			break;
+	}
+
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+	return ret;
+}
+
+static int run_net_veth(struct smokey_test *t, int argc, char *const argv[])
+{
+	int net_config, fd, ret, tmp, n, count = 1000;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, count))
+		count = SMOKEY_ARG_INT(*t, count);
+
+	ret = cobalt_corectl(_CC_COBALT_GET_NET_CONFIG,
+			     &net_config, sizeof(net_config));
+	if (ret == -EINVAL)
+		return -ENOSYS;
+	if (ret < 0)
+		return ret;
+
+	if ((net_config & (_CC_COBALT_NET | _CC_COBALT_NET_IPV4 |
+			   _CC_COBALT_NET_UDP)) !=
+	    (_CC_COBALT_NET | _CC_COBALT_NET_IPV4 | _CC_COBALT_NET_UDP))
+		return -ENOSYS;
+
+	if (modprobe("rt_veth pairs=1"))
+		return -ENOSYS;
+
+	ret = modprobe("rtipv4");
+	if (ret == 0)
+		ret = modprobe("rtudp");
+	if (ret) {
+		smokey_warning("cannot load the RTnet UDP/IP stack");
+		rmmod("rt_veth");
+		return -EINVAL;
+	}
+
+	fd = smokey_check_errno(open("/dev/rtnet", O_RDWR));
+	if (fd < 0) {
+		ret = fd;
+		goto unload;
+	}
+
+	smokey_trace("bringing up %s and %s", ends[0].name, ends[1].name);
+
+	ret = set_up(fd, &ends[0]);
+	if (ret)
+		goto down;
+
+	ret = set_up(fd, &ends[1]);
+	if (ret)
+		goto down;
+
+	ret = wait_running(fd);
+	if (ret)
+		goto down;
+
+	ret = add_route(fd, &ends[0], &ends[1]);
+	if (ret)
+		goto down;
+
+	ret = add_route(fd, &ends[1], &ends[0]);
+	if (ret)
+		goto down;
+
+	for (n = 0; n < 2; n++) {
+		ret = open_end(&ends[n]);
+		if (ret)
+			goto close;
+	}
+
+	smokey_trace("bouncing %d datagrams each way", count);
+	ret = run_pair(count);
+close:
+	for (n = 0; n < 2; n++) {
+		if (ends[n].s >= 0) {
+			__RT(close(ends[n].s));
+			ends[n].s = -1;
+		}
+	}
+down:
+	for (n = 0; n < 2; n++) {
+		tmp = set_down(fd, &ends[n]);
+		if (ret == 0)
+			ret = tmp;
+	}
+	close(fd);
+unload:
+	tmp = rmmod("rtudp");
+	if (ret == 0)
+		ret = tmp;
+	tmp = rmmod("rt_veth");
+	if (ret == 0)
+		ret = tmp;
+	tmp = rmmod("rtipv4");
+	if (ret == 0)
+		ret = tmp;
+
+	return ret;
+}
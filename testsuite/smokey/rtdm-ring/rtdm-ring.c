@@ -0,0 +1,576 @@
+/*
+ * Asynchronous I/O rings for RTDM.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <smokey/smokey.h>
+#include <rtdm/ipc.h>
+#include <rtdm/can.h>
+#include <rtdm/testing.h>
+#include <rtdm/ring.h>
+
+smokey_test_plugin(rtdm_ring,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(messages),
+		   ),
+   "Check asynchronous I/O rings for RTDM, then compare plain system\n"
+   "\tcalls with batched ring submissions over IDDP, rtcan_virt and\n"
+   "\ttimerbench, when available.\n"
+   "\tmessages=<N>\tmessages exchanged per benchmark run (default 10000)"
+);
+
+#define BATCH		16
+#define MAXMSGSZ	64
+#define IDDP_PORT	14
+
+#define TX_DATA		0x10000
+#define RX_DATA		0x20000
+
+struct ring {
+	int fd;
+	struct rtdm_ring_header *hdr;
+	struct rtdm_ring_sqe *sq;
+	struct rtdm_ring_cqe *cq;
+	char *buf;
+	size_t size;
+};
+
+struct bench {
+	const char *name;
+	int tx, rx;
+	size_t msgsz;
+	void *daddr;
+	socklen_t daddrlen;
+	void (*fill)(void *p, int seq);
+	int (*check)(const void *p, int seq);
+};
+
+static struct msghdr txmsg[BATCH], rxmsg[BATCH];
+
+static struct iovec txiov[BATCH], rxiov[BATCH];
+
+static char txbuf[BATCH][MAXMSGSZ], rxbuf[BATCH][MAXMSGSZ];
+
+static int open_ring(struct ring *r, unsigned int entries, unsigned int bufsz)
+{
+	struct rtdm_ring_params p = {
+		.sq_entries = entries,
+		.cq_entries = 0,
+		.buf_size = bufsz,
+	};
+	int ret;
+
+	r->fd = open("/dev/rtdm/ring", O_RDWR);
+	if (r->fd < 0)
+		return errno == ENOENT ? -ENOSYS : -errno;
+
+	if (!__Terrno(ret, ioctl(r->fd, RTDM_RING_RTIOC_SETUP, &p)))
+		goto fail;
+
+	r->hdr = mmap(NULL, p.map_size, PROT_READ|PROT_WRITE,
+		      MAP_SHARED, r->fd, 0);
+	if (r->hdr == MAP_FAILED) {
+		ret = -errno;
+		smokey_warning("mmap: %s", symerror(ret));
+		goto fail;
+	}
+
+	r->size = p.map_size;
+	r->sq = rtdm_ring_sq(r->hdr);
+	r->cq = rtdm_ring_cq(r->hdr);
+	r->buf = rtdm_ring_buf(r->hdr);
+
+	return 0;
+fail:
+	close(r->fd);
+
+	return ret;
+}
+
+static void close_ring(struct ring *r)
+{
+	munmap(r->hdr, r->size);
+	close(r->fd);
+}
+
+static void push_sqe(struct ring *r, int opcode, int flags, int fd,
+		     unsigned long addr, size_t len, unsigned int op_flags,
+		     __u64 user_data)
+{
+	struct rtdm_ring_header *hdr = r->hdr;
+	unsigned int tail = hdr->sq_tail;
+	struct rtdm_ring_sqe *sqe;
+
+	sqe = r->sq + (tail & (hdr->sq_entries - 1));
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->flags = flags;
+	sqe->fd = fd;
+	sqe->addr = addr;
+	sqe->len = len;
+	sqe->op_flags = op_flags;
+	sqe->user_data = user_data;
+	__atomic_store_n(&hdr->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int enter_ring(struct ring *r, unsigned int to_submit,
+		      unsigned int min_complete, long long timeout)
+{
+	struct rtdm_ring_enter e = {
+		.to_submit = to_submit,
+		.min_complete = min_complete,
+		.timeout = timeout,
+	};
+	int ret;
+
+	ret = ioctl(r->fd, RTDM_RING_RTIOC_ENTER, &e);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static int reap_cqe(struct ring *r, struct rtdm_ring_cqe *cqe)
+{
+	struct rtdm_ring_header *hdr = r->hdr;
+	unsigned int head = hdr->cq_head;
+
+	if (head == __atomic_load_n(&hdr->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+
+	*cqe = r->cq[head & (hdr->cq_entries - 1)];
+	__atomic_store_n(&hdr->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+static int check_basics(void)
+{
+	static const int expected[] = { -EINVAL, -EFAULT, -EINVAL, -EBADF };
+	struct rtdm_ring_cqe cqe;
+	struct ring r;
+	int ret, n;
+
+	ret = open_ring(&r, 8, 4096);
+	if (ret)
+		return ret;
+
+	push_sqe(&r, RTDM_RING_OP_NOP, 0, -1, 0, 0, 0, 42);
+	if (!__Tassert(enter_ring(&r, 1, 1, 0) == 1) ||
+	    !__Tassert(reap_cqe(&r, &cqe) == 1) ||
+	    !__Tassert(cqe.user_data == 42 && cqe.res == 0))
+		goto fail;
+
+	/* Bad opcode, bad fixed buffer, ring nesting, bad fd. */
+	push_sqe(&r, 255, 0, -1, 0, 0, 0, 0);
+	push_sqe(&r, RTDM_RING_OP_READ, RTDM_RING_F_FIXED, r.fd,
+		 4000, 200, 0, 1);
+	push_sqe(&r, RTDM_RING_OP_READ, 0, r.fd,
+		 (unsigned long)&cqe, sizeof(cqe), 0, 2);
+	push_sqe(&r, RTDM_RING_OP_READ, 0, -1,
+		 (unsigned long)&cqe, sizeof(cqe), 0, 3);
+	if (!__Tassert(enter_ring(&r, 4, 4, 0) == 4))
+		goto fail;
+
+	for (n = 0; n < 4; n++) {
+		if (!__Tassert(reap_cqe(&r, &cqe) == 1) ||
+		    !__Tassert(cqe.user_data < 4) ||
+		    !__Tassert(cqe.res == expected[cqe.user_data]))
+			goto fail;
+	}
+
+	/* Fill the CQ, the next submission must be refused. */
+	for (n = 0; n < 16; n++) {
+		push_sqe(&r, RTDM_RING_OP_NOP, 0, -1, 0, 0, 0, n);
+		if (n % 8 == 7 && !__Tassert(enter_ring(&r, 8, 0, 0) == 8))
+			goto fail;
+	}
+
+	push_sqe(&r, RTDM_RING_OP_NOP, 0, -1, 0, 0, 0, 16);
+	if (!__Tassert(enter_ring(&r, 1, 0, 0) == -EBUSY))
+		goto fail;
+
+	for (n = 0; n < 16; n++)
+		if (!__Tassert(reap_cqe(&r, &cqe) == 1 && cqe.user_data == n))
+			goto fail;
+
+	if (!__Tassert(enter_ring(&r, 1, 1, 0) == 1) ||
+	    !__Tassert(reap_cqe(&r, &cqe) == 1 && cqe.user_data == 16) ||
+	    !__Tassert(r.hdr->cq_overflow == 0))
+		goto fail;
+
+	/* Nothing in flight: time out, or return at once. */
+	if (!__Tassert(enter_ring(&r, 0, 1, 1000000) == -ETIMEDOUT) ||
+	    !__Tassert(enter_ring(&r, 0, 1, -1) == 0))
+		goto fail;
+
+	close_ring(&r);
+
+	return 0;
+fail:
+	close_ring(&r);
+
+	return -EINVAL;
+}
+
+static inline long long diff_ns(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000000LL +
+		(end->tv_nsec - start->tv_nsec);
+}
+
+static void setup_msgs(struct bench *b)
+{
+	int n;
+
+	for (n = 0; n < BATCH; n++) {
+		txiov[n].iov_base = txbuf[n];
+		txiov[n].iov_len = b->msgsz;
+		memset(txmsg + n, 0, sizeof(txmsg[n]));
+		txmsg[n].msg_name = b->daddr;
+		txmsg[n].msg_namelen = b->daddrlen;
+		txmsg[n].msg_iov = txiov + n;
+		txmsg[n].msg_iovlen = 1;
+		rxiov[n].iov_base = rxbuf[n];
+		rxiov[n].iov_len = b->msgsz;
+		memset(rxmsg + n, 0, sizeof(rxmsg[n]));
+		rxmsg[n].msg_iov = rxiov + n;
+		rxmsg[n].msg_iovlen = 1;
+	}
+}
+
+static int run_plain(struct bench *b, int nmsgs)
+{
+	struct timespec start, end;
+	int n, ret;
+
+	setup_msgs(b);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < nmsgs; n++) {
+		b->fill(txbuf[0], n);
+		ret = sendmsg(b->tx, txmsg, 0);
+		if (!__Tassert(ret == b->msgsz))
+			return ret < 0 ? -errno : -EINVAL;
+		rxiov[0].iov_len = b->msgsz;
+		ret = recvmsg(b->rx, rxmsg, 0);
+		if (!__Tassert(ret == b->msgsz) ||
+		    !__Tassert(b->check(rxbuf[0], n)))
+			return ret < 0 ? -errno : -EINVAL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	smokey_trace("%s, plain syscalls: %lld ns/msg",
+		     b->name, diff_ns(&start, &end) / nmsgs);
+
+	return 0;
+}
+
+/*
+ * Each batch carries BATCH sends and BATCH receives, submitted and
+ * collected with a single system call. With @fixed set, reads are
+ * queued first, so that the driver may complete them directly from
+ * the sender context into the ring buffer area.
+ */
+static int run_ring(struct bench *b, struct ring *r, int nmsgs, int fixed)
+{
+	struct rtdm_ring_cqe cqe;
+	struct timespec start, end;
+	int n, j, ret, seq;
+	const void *p;
+
+	setup_msgs(b);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (seq = 0; seq + BATCH <= nmsgs; seq += BATCH) {
+		for (j = 0; j < BATCH; j++) {
+			b->fill(txbuf[j], seq + j);
+			rxiov[j].iov_len = b->msgsz;
+			if (fixed)
+				push_sqe(r, RTDM_RING_OP_READ, RTDM_RING_F_FIXED,
+					 b->rx, j * b->msgsz, b->msgsz, 0,
+					 RX_DATA | j);
+		}
+
+		for (j = 0; j < BATCH; j++) {
+			push_sqe(r, RTDM_RING_OP_SENDMSG, 0, b->tx,
+				 (unsigned long)(txmsg + j), 0, 0, TX_DATA | j);
+			if (!fixed)
+				push_sqe(r, RTDM_RING_OP_RECVMSG, 0, b->rx,
+					 (unsigned long)(rxmsg + j), 0, 0,
+					 RX_DATA | j);
+		}
+
+		ret = enter_ring(r, BATCH * 2, BATCH * 2, 1000000000LL);
+		if (!__Tassert(ret == BATCH * 2))
+			return ret < 0 ? ret : -EINVAL;
+
+		for (n = 0; n < BATCH * 2; n++) {
+			if (!__Tassert(reap_cqe(r, &cqe) == 1) ||
+			    !__Tassert(cqe.res == b->msgsz))
+				return -EINVAL;
+			if ((cqe.user_data & RX_DATA) == 0)
+				continue;
+			j = cqe.user_data & (BATCH - 1);
+			p = fixed ? r->buf + j * b->msgsz : rxbuf[j];
+			if (!__Tassert(b->check(p, seq + j)))
+				return -EINVAL;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	smokey_trace("%s, %s ring: %lld ns/msg", b->name,
+		     fixed ? "fixed" : "generic",
+		     diff_ns(&start, &end) / seq);
+
+	return 0;
+}
+
+static void iddp_fill(void *p, int seq)
+{
+	memset(p, seq, MAXMSGSZ);
+	memcpy(p, &seq, sizeof(seq));
+}
+
+static int iddp_check(const void *p, int seq)
+{
+	const char *data = p;
+
+	return memcmp(p, &seq, sizeof(seq)) == 0 &&
+		data[MAXMSGSZ - 1] == (char)seq;
+}
+
+static int bench_iddp(struct ring *r, int nmsgs)
+{
+	struct sockaddr_ipc saddr = {
+		.sipc_family = AF_RTIPC,
+		.sipc_port = IDDP_PORT,
+	};
+	struct bench b = {
+		.name = "IDDP",
+		.msgsz = MAXMSGSZ,
+		.daddr = &saddr,
+		.daddrlen = sizeof(saddr),
+		.fill = iddp_fill,
+		.check = iddp_check,
+	};
+	int ret;
+
+	b.rx = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (b.rx < 0) {
+		if (errno == EAFNOSUPPORT) {
+			smokey_note("IDDP not available, skipping");
+			return 0;
+		}
+		return -errno;
+	}
+
+	b.tx = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (b.tx < 0) {
+		ret = -errno;
+		goto out_rx;
+	}
+
+	if (!__Terrno(ret, bind(b.rx, (struct sockaddr *)&saddr,
+				sizeof(saddr))))
+		goto out;
+
+	ret = run_plain(&b, nmsgs);
+	if (ret)
+		goto out;
+
+	ret = run_ring(&b, r, nmsgs, 0);
+	if (ret)
+		goto out;
+
+	ret = run_ring(&b, r, nmsgs, 1);
+out:
+	close(b.tx);
+out_rx:
+	close(b.rx);
+
+	return ret;
+}
+
+static void can_fill(void *p, int seq)
+{
+	struct can_frame *frame = p;
+
+	memset(frame, 0, sizeof(*frame));
+	frame->can_id = seq & CAN_SFF_MASK;
+	frame->can_dlc = sizeof(seq);
+	memcpy(frame->data, &seq, sizeof(seq));
+}
+
+static int can_check(const void *p, int seq)
+{
+	const struct can_frame *frame = p;
+
+	return frame->can_id == (seq & CAN_SFF_MASK) &&
+		memcmp(frame->data, &seq, sizeof(seq)) == 0;
+}
+
+static int can_socket(const char *ifname)
+{
+	struct sockaddr_can addr;
+	struct can_ifreq ifr;
+	int s, ret;
+
+	s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+	if (s < 0)
+		return -ENOSYS;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	ret = ioctl(s, SIOCGIFINDEX, &ifr);
+	if (ret)
+		goto fail;
+
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+
+	ifr.ifr_ifru.mode = CAN_MODE_START;
+	ret = ioctl(s, SIOCSCANMODE, &ifr);
+	if (ret)
+		goto fail;
+
+	ret = bind(s, (struct sockaddr *)&addr, sizeof(addr));
+	if (ret)
+		goto fail;
+
+	return s;
+fail:
+	close(s);
+
+	return -ENOSYS;
+}
+
+static int bench_can(struct ring *r, int nmsgs)
+{
+	struct bench b = {
+		.name = "rtcan_virt",
+		.msgsz = sizeof(struct can_frame),
+		.daddr = NULL,
+		.daddrlen = 0,
+		.fill = can_fill,
+		.check = can_check,
+	};
+	int ret;
+
+	b.tx = can_socket("rtcan0");
+	if (b.tx < 0)
+		goto skip;
+
+	b.rx = can_socket("rtcan1");
+	if (b.rx < 0) {
+		close(b.tx);
+		goto skip;
+	}
+
+	/* rtcan supports no read/write, the generic path only. */
+	ret = run_plain(&b, nmsgs);
+	if (ret == 0)
+		ret = run_ring(&b, r, nmsgs, 0);
+
+	close(b.rx);
+	close(b.tx);
+
+	return ret;
+skip:
+	smokey_note("rtcan_virt not available, skipping");
+
+	return 0;
+}
+
+static int bench_timerbench(struct ring *r)
+{
+	struct rttst_tmbench_config config = {
+		.mode = RTTST_TMBENCH_HANDLER,
+		.period = 100000,
+		.warmup_loops = 1,
+	};
+	struct rttst_overall_bench_res overall;
+	struct rttst_interm_bench_res res;
+	struct rtdm_ring_cqe cqe;
+	int fd, ret, n;
+
+	fd = open("/dev/rtdm/timerbench", O_RDWR);
+	if (fd < 0) {
+		smokey_note("timerbench not available, skipping");
+		return 0;
+	}
+
+	if (!__Terrno(ret, ioctl(fd, RTTST_RTIOC_TMBENCH_START, &config)))
+		goto out;
+
+	/*
+	 * The owner does not wait in the driver for intermediate
+	 * results, which are posted from the timer handler directly.
+	 */
+	for (n = 0; n < 2; n++) {
+		push_sqe(r, RTDM_RING_OP_IOCTL, RTDM_RING_F_FIXED, fd,
+			 0, sizeof(res), RTTST_RTIOC_INTERM_BENCH_RES, n);
+		ret = enter_ring(r, 1, 1, 5000000000LL);
+		if (!__Tassert(ret == 1) ||
+		    !__Tassert(reap_cqe(r, &cqe) == 1) ||
+		    !__Tassert(cqe.user_data == n && cqe.res == 0)) {
+			ret = -EINVAL;
+			break;
+		}
+		memcpy(&res, r->buf, sizeof(res));
+		smokey_trace("timerbench, ring result #%d: "
+			     "min %d, avg %d, max %d ns",
+			     n, res.last.min, res.last.avg, res.last.max);
+		ret = 0;
+	}
+
+	memset(&overall, 0, sizeof(overall));
+	ioctl(fd, RTTST_RTIOC_TMBENCH_STOP, &overall);
+out:
+	close(fd);
+
+	return ret;
+}
+
+static int run_rtdm_ring(struct smokey_test *t, int argc, char *const argv[])
+{
+	int nmsgs = 10000, ret;
+	struct ring r;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(rtdm_ring, messages))
+		nmsgs = SMOKEY_ARG_INT(rtdm_ring, messages);
+
+	if (nmsgs < BATCH)
+		return -EINVAL;
+
+	ret = check_basics();
+	if (ret)
+		return ret;
+
+	ret = open_ring(&r, BATCH * 2, BATCH * MAXMSGSZ);
+	if (ret)
+		return ret;
+
+	ret = bench_iddp(&r, nmsgs);
+	if (ret == 0)
+		ret = bench_can(&r, nmsgs);
+	if (ret == 0)
+		ret = bench_timerbench(&r);
+
+	close_ring(&r);
+
+	return ret;
+}
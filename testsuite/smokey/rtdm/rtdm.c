@@ -164,6 +164,39 @@ static int test_handover(int fd)
 	return (int)(long)p;
 }
 
+static int test_irq_thread(int fd, unsigned int batch,
+			   unsigned int nevents, unsigned long long delay)
+{
+	struct rttst_rtdm_irq_thread args = {
+		.batch = batch,
+		.nevents = nevents,
+		.delay = delay,
+	};
+	unsigned int tail = batch > 1 ? batch - 1 : 0;
+	int ret;
+
+	if (!__T(ret, ioctl(fd, RTTST_RTIOC_RTDM_IRQ_THREAD, &args)))
+		return ret;
+
+	/* Every event reaches the primary handler. */
+	if (!__Tassert(args.nhandled == nevents + tail))
+		return -EINVAL;
+
+	/* One run per full batch, then one for the remainder. */
+	if (!__Tassert(args.nruns_batch == nevents / batch))
+		return -EINVAL;
+
+	if (!__Tassert(args.nruns_delay ==
+		       args.nruns_batch + !!(nevents % batch)))
+		return -EINVAL;
+
+	/* Nothing runs once the IRQ was released. */
+	if (!__Tassert(args.nruns_late == args.nruns_free))
+		return -EINVAL;
+
+	return 0;
+}
+
 static int run_rtdm(struct smokey_test *t, int argc, char *const argv[])
 {
 	unsigned long long start;
@@ -208,6 +241,16 @@ static int run_rtdm(struct smokey_test *t, int argc, char *const argv[])
 	check("close", close(dev), 0);
 	dev = check("open", open(devname, O_RDWR), dev);
 
+	smokey_trace("Threaded IRQ");
+	status = test_irq_thread(dev, 1, 16, 0);
+	if (status)
+		return status;
+
+	smokey_trace("Threaded IRQ coalescing and teardown");
+	status = test_irq_thread(dev, 8, 8 * 4 + 3, 5 * NS_PER_MS);
+	if (status)
+		return status;
+
 	smokey_trace("Deferred module unload");
 	check("ioctl", ioctl(dev, RTTST_RTIOC_RTDM_DEFER_CLOSE,
 			     RTTST_RTDM_DEFER_CLOSE_CONTEXT), 0);
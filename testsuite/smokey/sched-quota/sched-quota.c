@@ -38,7 +38,10 @@ smokey_test_plugin(sched_quota,
    "\tSCHED_QUOTA group over a second is calculated.\n\n"
    "\tA successful test shows that the effective percentage of runtime\n"
    "\tobserved with the SCHED_QUOTA group closely matches the allotted\n"
-   "\tquota (barring rounding errors and marginal latency)."
+   "\tquota (barring rounding errors and marginal latency).\n\n"
+   "\tWith quota <= 50%, the pool is then run in a group nested into a\n"
+   "\tparent twice as large, then as a borrowing group next to an idle\n"
+   "\tgroup, which should double its runtime."
 );
 
 #define MAX_THREADS 8
@@ -156,21 +159,24 @@ static void __create_fifo_thread(pthread_t *tid, const char *name,
 #define create_fifo_thread(__tid, __label, __count)	\
 	__create_fifo_thread(&(__tid), __label, &(__count))
 
-static double run_quota(int quota)
+static int create_group(int parent, int flags, int quota)
 {
 	size_t len = sched_quota_confsz();
-	unsigned long long count;
 	union sched_config cf;
-	struct timespec req;
-	int ret, tgid, n;
-	double percent;
-	char label[8];
-
-	cf.quota.op = sched_quota_add;
-	cf.quota.add.pshared = 0;
+	int ret, tgid;
+
+	if (parent < 0 && flags == 0) {
+		cf.quota.op = sched_quota_add;
+		cf.quota.add.pshared = 0;
+	} else {
+		cf.quota.op = sched_quota_add_ex;
+		cf.quota.add.pshared = 0;
+		cf.quota.add.parent = parent;
+		cf.quota.add.flags = flags;
+	}
 	ret = sched_setconfig_np(0, SCHED_QUOTA, &cf, len);
 	if (ret)
-		error(1, ret, "sched_setconfig_np(add-quota-group)");
+		return -ret;
 
 	tgid = cf.quota.info.tgid;
 	cf.quota.op = sched_quota_set;
@@ -184,6 +190,30 @@ static double run_quota(int quota)
 	smokey_trace("new thread group #%d on CPU0, quota sum is %d%%",
 		     tgid, cf.quota.info.quota_sum);
 
+	return tgid;
+}
+
+static void remove_group(int tgid)
+{
+	size_t len = sched_quota_confsz();
+	union sched_config cf;
+	int ret;
+
+	cf.quota.op = sched_quota_remove;
+	cf.quota.remove.tgid = tgid;
+	ret = sched_setconfig_np(0, SCHED_QUOTA, &cf, len);
+	if (ret)
+		error(1, ret, "sched_setconfig_np(remove-quota-group)");
+}
+
+static double run_group(int tgid)
+{
+	unsigned long long count;
+	struct timespec req;
+	double percent;
+	char label[8];
+	int n;
+
 	for (n = 0; n < nrthreads; n++) {
 		sprintf(label, "t%d", n);
 		create_quota_thread(threads[n], label, tgid, counts[n]);
@@ -212,15 +242,77 @@ static double run_quota(int quota)
 		pthread_join(threads[n], NULL);
 	}
 
-	cf.quota.op = sched_quota_remove;
-	cf.quota.remove.tgid = tgid;
-	ret = sched_setconfig_np(0, SCHED_QUOTA, &cf, len);
-	if (ret)
-		error(1, ret, "sched_setconfig_np(remove-quota-group)");
+	started = 0;
+
+	return percent;
+}
+
+static double run_quota(int quota)
+{
+	double percent;
+	int tgid;
+
+	tgid = create_group(-1, 0, quota);
+	if (tgid < 0)
+		error(1, -tgid, "sched_setconfig_np(add-quota-group)");
+
+	percent = run_group(tgid);
+	remove_group(tgid);
 
 	return percent;
 }
 
+/*
+ * Run the pool in a group nested into a parent group twice as
+ * large, which receives half of the parent's share.
+ */
+static int run_nested(int quota, double *effective_r)
+{
+	int parent, child;
+
+	parent = create_group(-1, 0, quota * 2);
+	if (parent < 0)
+		error(1, -parent, "sched_setconfig_np(add-quota-group)");
+
+	child = create_group(parent, 0, 50);
+	if (child < 0) {
+		remove_group(parent);
+		return child;
+	}
+
+	*effective_r = run_group(child);
+	remove_group(child);
+	remove_group(parent);
+
+	return 0;
+}
+
+/*
+ * Run the pool in a borrowing group, next to an idle group with the
+ * same quota. The pool should get the share of the idle group on top
+ * of its own.
+ */
+static int run_borrow(int quota, double *effective_r)
+{
+	int idle, borrower;
+
+	idle = create_group(-1, 0, quota);
+	if (idle < 0)
+		error(1, -idle, "sched_setconfig_np(add-quota-group)");
+
+	borrower = create_group(-1, SCHED_QUOTA_BORROW, quota);
+	if (borrower < 0) {
+		remove_group(idle);
+		return borrower;
+	}
+
+	*effective_r = run_group(borrower);
+	remove_group(borrower);
+	remove_group(idle);
+
+	return 0;
+}
+
 static unsigned long long calibrate(void)
 {
 	struct timespec start, end, delta;
@@ -333,5 +425,39 @@ static int run_sched_quota(struct smokey_test *t, int argc, char *const argv[])
 		return -EPROTO;
 	}
 
+	if (quota > 50)
+		return 0;
+
+	ret = run_nested(quota, &effective);
+	if (ret == -EINVAL) {
+		smokey_note("nested groups not supported, skipping");
+		return 0;
+	}
+	if (ret)
+		return ret;
+
+	smokey_trace("nested: parent=%d%%, child=50%%, effective=%.1f%%",
+		     quota * 2, effective);
+
+	if (!smokey_on_vm && fabs(effective - (double)quota) > 0.5) {
+		smokey_warning("out of nested quota: %.1f%%",
+			       effective - (double)quota);
+		return -EPROTO;
+	}
+
+	ret = run_borrow(quota, &effective);
+	if (ret)
+		return ret;
+
+	smokey_trace("borrowing: cap=%d%%, idle share=%d%%, "
+		     "effective=%.1f%% (+%.1f%%)",
+		     quota, quota, effective, effective - (double)quota);
+
+	if (!smokey_on_vm && fabs(effective - (double)quota * 2) > 1.0) {
+		smokey_warning("borrowing off target: %.1f%%",
+			       effective - (double)quota * 2);
+		return -EPROTO;
+	}
+
 	return 0;
 }
@@ -123,10 +123,180 @@ static void __create_thread(pthread_t *tid, const char *name, int seq)
 }
 
 #define create_thread(tid, n) __create_thread(&(tid), # tid, n)
-#define NR_WINDOWS  4
+#define NR_WINDOWS  6
+
+static void set_window(union sched_config *p, int n,
+		       long offset_ms, long duration_ms, int ptid)
+{
+	p->tp.windows[n].offset.tv_sec = 0;
+	p->tp.windows[n].offset.tv_nsec = offset_ms * 1000000;
+	p->tp.windows[n].duration.tv_sec = 0;
+	p->tp.windows[n].duration.tv_nsec = duration_ms * 1000000;
+	p->tp.windows[n].ptid = ptid;
+}
+
+static void set_budget(struct sched_tp_budget *b, int ptid,
+		       long budget_ms, long period_ms)
+{
+	b->ptid = ptid;
+	b->budget.tv_sec = budget_ms / 1000;
+	b->budget.tv_nsec = (budget_ms % 1000) * 1000000;
+	b->period.tv_sec = period_ms / 1000;
+	b->period.tv_nsec = (period_ms % 1000) * 1000000;
+}
+
+static int count_switches(const union sched_config *p)
+{
+	int n, nr = p->tp.nr_windows, count = 0;
+
+	for (n = 0; n < nr; n++)
+		if (p->tp.windows[n].ptid != p->tp.windows[(n + 1) % nr].ptid)
+			count++;
+
+	return count;
+}
+
+/*
+ * Collect the number of shots of the TP timer on CPU #0 from the
+ * timer statistics, returns -1 if unavailable.
+ */
+static long get_tp_ticks(void)
+{
+	unsigned long scheduled, fired;
+	char buf[BUFSIZ], name[64];
+	long ticks = -1;
+	unsigned int cpu;
+	FILE *fp;
+
+	fp = fopen("/proc/xenomai/timer/coreclk", "r");
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (sscanf(buf, "%u %lu/%lu %*s %*s %63s",
+			   &cpu, &scheduled, &fired, name) != 4)
+			continue;
+		if (cpu == 0 && (strcmp(name, "[tp-tick/0]") == 0 ||
+				 strcmp(name, "[tp-tick]") == 0)) {
+			ticks = fired;
+			break;
+		}
+	}
+
+	fclose(fp);
+
+	return ticks;
+}
+
+static int check_compiler(void)
+{
+	struct sched_tp_budget b[3];
+	union sched_config *p;
+	long long t, frame;
+	int ret, n, nr_raw;
+	size_t len;
+
+	len = sched_tp_confsz(64);
+	p = malloc(len);
+	if (p == NULL)
+		return -ENOMEM;
+
+	/*
+	 * Budgets equivalent to the hand-written schedule used by the
+	 * test, which should compile to the same four windows.
+	 */
+	set_budget(b + 0, 2, 100, 400);
+	set_budget(b + 1, 1, 50, 400);
+	set_budget(b + 2, 0, 20, 400);
+	ret = sched_tp_compile_np(b, 3, p, &len);
+	if (!__Tassert(ret == 0))
+		goto out;
+	if (!__Tassert(len == sched_tp_confsz(4) && p->tp.nr_windows == 4))
+		goto fail;
+	if (!__Tassert(p->tp.windows[0].ptid == 2 &&
+		       p->tp.windows[1].ptid == 1 &&
+		       p->tp.windows[2].ptid == 0 &&
+		       p->tp.windows[3].ptid == -1 &&
+		       p->tp.windows[3].offset.tv_nsec == 170000000 &&
+		       p->tp.windows[3].duration.tv_nsec == 230000000))
+		goto fail;
+
+	/*
+	 * Multi-rate set: 10 ms every 100 ms for #0, 30 ms every
+	 * 200 ms for #1, 60 ms every 400 ms for #2. Windows must
+	 * be contiguous, and only alternate between distinct
+	 * partitions.
+	 */
+	set_budget(b + 0, 0, 10, 100);
+	set_budget(b + 1, 1, 30, 200);
+	set_budget(b + 2, 2, 60, 400);
+	len = sched_tp_confsz(64);
+	ret = sched_tp_compile_np(b, 3, p, &len);
+	if (!__Tassert(ret == 0))
+		goto out;
+
+	for (n = 0, t = 0; n < p->tp.nr_windows; n++) {
+		if (!__Tassert(p->tp.windows[n].offset.tv_sec * 1000000000LL +
+			       p->tp.windows[n].offset.tv_nsec == t))
+			goto fail;
+		if (!__Tassert(n == 0 || p->tp.windows[n].ptid !=
+			       p->tp.windows[n - 1].ptid))
+			goto fail;
+		t += p->tp.windows[n].duration.tv_sec * 1000000000LL +
+			p->tp.windows[n].duration.tv_nsec;
+	}
+	frame = 400000000LL;
+	if (!__Tassert(t == frame))
+		goto fail;
+
+	/*
+	 * A table written by slicing the frame at every release date
+	 * (i.e. every 100 ms) would need one more window each time a
+	 * partition keeps running across a release.
+	 */
+	nr_raw = p->tp.nr_windows;
+	for (n = 0; n < p->tp.nr_windows; n++) {
+		t = p->tp.windows[n].offset.tv_sec * 1000000000LL +
+			p->tp.windows[n].offset.tv_nsec;
+		nr_raw += (t + p->tp.windows[n].duration.tv_sec * 1000000000LL +
+			   p->tp.windows[n].duration.tv_nsec - 1) / 100000000LL -
+			t / 100000000LL;
+	}
+	smokey_trace("compiled schedule: %d windows (%d sliced), "
+		     "%d switches per %lld ms frame",
+		     p->tp.nr_windows, nr_raw, count_switches(p),
+		     frame / 1000000);
+
+	/* Overload, bad budget, short buffer. */
+	set_budget(b + 0, 0, 80, 100);
+	len = sched_tp_confsz(64);
+	ret = sched_tp_compile_np(b, 3, p, &len);
+	if (!__Tassert(ret == ERANGE))
+		goto fail;
+	set_budget(b + 0, 0, 110, 100);
+	ret = sched_tp_compile_np(b, 3, p, &len);
+	if (!__Tassert(ret == EINVAL))
+		goto fail;
+	set_budget(b + 0, 0, 10, 100);
+	len = sched_tp_confsz(2);
+	ret = sched_tp_compile_np(b, 3, p, &len);
+	if (!__Tassert(ret == ENOSPC))
+		goto fail;
+
+	ret = 0;
+out:
+	free(p);
+
+	return ret ? -ret : 0;
+fail:
+	free(p);
+
+	return -EINVAL;
+}
 
 static int run_sched_tp(struct smokey_test *t, int argc, char *const argv[])
 {
+	long ticks_start, ticks_end, expected;
 	union sched_config *p;
 	int ret, n, policies;
 	size_t len;
@@ -135,6 +305,10 @@ static int run_sched_tp(struct smokey_test *t, int argc, char *const argv[])
 	ret = cobalt_corectl(_CC_COBALT_GET_POLICIES, &policies, sizeof(policies));
 	if (ret || (policies & _CC_COBALT_SCHED_TP) == 0)
 		return -ENOSYS;
+
+	ret = check_compiler();
+	if (ret)
+		return ret;
 	
 	/*
 	 * For a recurring global time frame of 400 ms, we define a TP
@@ -155,6 +329,11 @@ static int run_sched_tp(struct smokey_test *t, int argc, char *const argv[])
 	 * - when the previous time slot ends, no TP thread shall be
 	 * allowed to run until the global time frame ends (special
 	 * setting of ptid == -1), i.e. 230 ms.
+	 *
+	 * The slots of partition #2 and of the time hole are each
+	 * split in two consecutive windows, which do not change the
+	 * resulting schedule, but cause redundant window switches
+	 * the kernel may skip (CONFIG_XENO_OPT_SCHED_TP_MERGE).
 	 */
 	len = sched_tp_confsz(NR_WINDOWS);
 	p = malloc(len);
@@ -163,26 +342,12 @@ static int run_sched_tp(struct smokey_test *t, int argc, char *const argv[])
 
 	p->tp.op = sched_tp_install;
 	p->tp.nr_windows = NR_WINDOWS;
-	p->tp.windows[0].offset.tv_sec = 0;
-	p->tp.windows[0].offset.tv_nsec = 0;
-	p->tp.windows[0].duration.tv_sec = 0;
-	p->tp.windows[0].duration.tv_nsec = 100000000;
-	p->tp.windows[0].ptid = 2;
-	p->tp.windows[1].offset.tv_sec = 0;
-	p->tp.windows[1].offset.tv_nsec = 100000000;
-	p->tp.windows[1].duration.tv_sec = 0;
-	p->tp.windows[1].duration.tv_nsec = 50000000;
-	p->tp.windows[1].ptid = 1;
-	p->tp.windows[2].offset.tv_sec = 0;
-	p->tp.windows[2].offset.tv_nsec = 150000000;
-	p->tp.windows[2].duration.tv_sec = 0;
-	p->tp.windows[2].duration.tv_nsec = 20000000;
-	p->tp.windows[2].ptid = 0;
-	p->tp.windows[3].offset.tv_sec = 0;
-	p->tp.windows[3].offset.tv_nsec = 170000000;
-	p->tp.windows[3].duration.tv_sec = 0;
-	p->tp.windows[3].duration.tv_nsec = 230000000;
-	p->tp.windows[3].ptid = -1;
+	set_window(p, 0, 0, 60, 2);
+	set_window(p, 1, 60, 40, 2);
+	set_window(p, 2, 100, 50, 1);
+	set_window(p, 3, 150, 20, 0);
+	set_window(p, 4, 170, 115, -1);
+	set_window(p, 5, 285, 115, -1);
 
  	/* Assign the TP schedule to CPU #0 */
 	ret = sched_setconfig_np(0, SCHED_TP, p, len);
@@ -196,7 +361,7 @@ static int run_sched_tp(struct smokey_test *t, int argc, char *const argv[])
 		error(1, ret, "sched_getconfig_np");
 
 	smokey_trace("check: %d windows", p->tp.nr_windows);
-	for (n = 0; n < 4; n++)
+	for (n = 0; n < p->tp.nr_windows; n++)
 		smokey_trace("[%d] offset = { %ld s, %ld ns }, duration = { %ld s, %ld ns }, ptid = %d",
 			     n,
 			     p->tp.windows[n].offset.tv_sec,
@@ -205,6 +370,8 @@ static int run_sched_tp(struct smokey_test *t, int argc, char *const argv[])
 			     p->tp.windows[n].duration.tv_nsec,
 			     p->tp.windows[n].ptid);
 
+	expected = count_switches(p);
+
 	sem_init(&barrier, 0, 0);
 	create_thread(threadA, 0);
 	create_thread(threadB, 1);
@@ -217,9 +384,23 @@ static int run_sched_tp(struct smokey_test *t, int argc, char *const argv[])
 	if (ret)
 		error(1, ret, "sched_setconfig_np(start)");
 
+	ticks_start = get_tp_ticks();
 	sem_post(&barrier);
 	sleep(5);
+	ticks_end = get_tp_ticks();
 	cleanup();
+
+	/*
+	 * A time frame of 400 ms runs 2.5 times per second. Report
+	 * how many timer events were spared by skipping the
+	 * redundant switches.
+	 */
+	if (ticks_start >= 0 && ticks_end >= ticks_start)
+		smokey_trace("window switches: %ld/s, %ld/s skipped "
+			     "(%ld/s effective)",
+			     (ticks_end - ticks_start) / 5,
+			     NR_WINDOWS * 5 / 2 - (ticks_end - ticks_start) / 5,
+			     expected * 5 / 2);
 	sem_destroy(&barrier);
 	free(p);
 
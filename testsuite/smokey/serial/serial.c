@@ -0,0 +1,210 @@
+/*
+ * RTDM serial driver test, running the port in loopback mode.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <smokey/smokey.h>
+#include <rtdm/serial.h>
+
+smokey_test_plugin(serial,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(port),
+		   ),
+		   "Check the RTDM serial driver in loopback mode (rtser<port>)."
+);
+
+#define BURSTS		4
+#define BURST_SIZE	48
+#define BURST_GAP	20000000	/* ns */
+#define STREAM_SIZE	512
+
+static int setup(int fd, int fifo_depth)
+{
+	struct rtser_config config;
+	int ret;
+
+	memset(&config, 0, sizeof(config));
+	config.config_mask = RTSER_SET_BAUD | RTSER_SET_FIFO_DEPTH |
+		RTSER_SET_TIMEOUT_RX | RTSER_SET_TIMESTAMP_HISTORY;
+	config.baud_rate = 115200;
+	config.fifo_depth = fifo_depth;
+	config.rx_timeout = 500000000;
+	config.timestamp_history = RTSER_RX_TIMESTAMP_HISTORY;
+
+	if (!__Terrno(ret, ioctl(fd, RTSER_RTIOC_SET_CONFIG, &config)))
+		return ret;
+
+	if (!__Terrno(ret, ioctl(fd, RTSER_RTIOC_SET_CONTROL,
+				 RTSER_MCR_LOOP | RTSER_MCR_DTR |
+				 RTSER_MCR_RTS | RTSER_MCR_OUT2)))
+		return ret;
+
+	return 0;
+}
+
+static int check_chunks(int fd)
+{
+	struct rtser_chunk chunks[BURSTS * BURST_SIZE];
+	char buf[BURSTS * BURST_SIZE];
+	struct timespec gap = {
+		.tv_sec = 0,
+		.tv_nsec = BURST_GAP,
+	};
+	struct rtser_read_chunks req;
+	char data[BURST_SIZE];
+	int ret, n, len, i, gaps;
+
+	for (n = 0; n < BURSTS; n++) {
+		for (i = 0; i < BURST_SIZE; i++)
+			data[i] = n * BURST_SIZE + i;
+		ret = smokey_check_errno(write(fd, data, BURST_SIZE));
+		if (ret < 0)
+			return ret;
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &gap, NULL);
+	}
+
+	for (len = 0, gaps = 0; len < (int)sizeof(buf); len += ret) {
+		req.buf = buf + len;
+		req.size = sizeof(buf) - len;
+		req.chunks = chunks;
+		req.nr_chunks = sizeof(chunks) / sizeof(chunks[0]);
+		ret = smokey_check_errno(ioctl(fd, RTSER_RTIOC_READ_CHUNKS, &req));
+		if (ret < 0)
+			return ret;
+
+		for (i = 0, n = 0; i < req.nr_chunks; i++) {
+			n += chunks[i].length;
+			if (i > 0 && chunks[i].timestamp < chunks[i - 1].timestamp) {
+				smokey_warning("chunk timestamps out of order");
+				return -EPROTO;
+			}
+			if (i > 0 && chunks[i].timestamp -
+			    chunks[i - 1].timestamp >= BURST_GAP / 2)
+				gaps++;
+		}
+		if (n != ret) {
+			smokey_warning("chunks account for %d bytes, read %d",
+				       n, ret);
+			return -EPROTO;
+		}
+		smokey_trace("read %d bytes in %d chunks", ret, req.nr_chunks);
+	}
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != (char)i) {
+			smokey_warning("data mismatch at offset %d", i);
+			return -EPROTO;
+		}
+	}
+
+	/*
+	 * Each burst ends with a pause in the traffic, which must
+	 * show in the timestamps unless a burst straddles two reads.
+	 */
+	if (gaps == 0) {
+		smokey_warning("no gap between bursts in chunk timestamps");
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static int check_adaptive(int fd)
+{
+	struct rtser_config config;
+	char data[STREAM_SIZE], buf[STREAM_SIZE];
+	int ret, len;
+
+	ret = setup(fd, RTSER_FIFO_DEPTH_1 | RTSER_FIFO_DEPTH_ADAPTIVE);
+	if (ret)
+		return ret;
+
+	memset(data, 0x55, sizeof(data));
+	ret = smokey_check_errno(write(fd, data, sizeof(data)));
+	if (ret < 0)
+		return ret;
+
+	for (len = 0; len < (int)sizeof(buf); len += ret) {
+		ret = smokey_check_errno(read(fd, buf + len, sizeof(buf) - len));
+		if (ret < 0)
+			return ret;
+	}
+
+	if (!__Terrno(ret, ioctl(fd, RTSER_RTIOC_GET_CONFIG, &config)))
+		return ret;
+
+	smokey_trace("FIFO threshold adapted to 0x%x", config.fifo_depth);
+
+	/* A continuous stream must have raised the threshold. */
+	if (!(config.fifo_depth & RTSER_FIFO_DEPTH_ADAPTIVE) ||
+	    (config.fifo_depth & ~RTSER_FIFO_DEPTH_ADAPTIVE) ==
+	    RTSER_FIFO_DEPTH_1) {
+		smokey_warning("FIFO threshold did not adapt");
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static int run_serial(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct rtser_buffers buffers;
+	struct sched_param param;
+	char devname[32];
+	int fd, ret, port = 0;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(serial, port))
+		port = SMOKEY_ARG_INT(serial, port);
+
+	snprintf(devname, sizeof(devname), "/dev/rtdm/rtser%d", port);
+	fd = open(devname, O_RDWR);
+	if (fd < 0) {
+		ret = -errno;
+		smokey_note("%s: %s", devname, strerror(-ret));
+		return ret == -ENOENT ? -ENOSYS : ret;
+	}
+
+	param.sched_priority = 10;
+	if (!__T(ret, pthread_setschedparam(pthread_self(),
+					     SCHED_FIFO, &param)))
+		goto out;
+
+	/* Invalid sizes must be rejected. */
+	buffers.rx_size = 100;
+	buffers.tx_size = 0;
+	if (!__Fassert(ioctl(fd, RTSER_RTIOC_SET_BUFFERS, &buffers) == 0 ||
+		       errno != EINVAL)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	buffers.rx_size = 1024;
+	buffers.tx_size = 256;
+	if (!__Terrno(ret, ioctl(fd, RTSER_RTIOC_SET_BUFFERS, &buffers)))
+		goto out;
+
+	ret = setup(fd, RTSER_FIFO_DEPTH_8);
+	if (ret)
+		goto out;
+
+	ret = check_chunks(fd);
+	if (ret)
+		goto out;
+
+	ret = check_adaptive(fd);
+out:
+	close(fd);
+
+	return ret;
+}
@@ -47,6 +47,20 @@ smokey_test_plugin(spi_transfer,
    "\tlatency"
 );
 
+smokey_test_plugin(spi_batch,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_STRING(device),
+			   SMOKEY_STRING(peer),
+			   SMOKEY_INT(count),
+			   SMOKEY_BOOL(loopback),
+		   ),
+   "Run batches of SPI transfers through the submission queue.\n"
+   "\tdevice=<device-path>\n"
+   "\tpeer=<device-path>, second slave on the same master (optional)\n"
+   "\tcount=<number-of-batches>, defaults to 1000\n"
+   "\tloopback, check that input data echoes output data"
+);
+
 #define ONE_BILLION	1000000000
 #define TEN_MILLIONS	10000000
 
@@ -421,6 +435,163 @@ static int run_spi_transfer(struct smokey_test *t, int argc, char *const argv[])
 	return 0;
 }
 
+#define BATCH_XFERS	30
+#define BATCH_XFER_LEN	8
+#define BATCH_DEPTH	2
+
+struct batch_frame {
+	struct rtdm_spi_xfer xfers[BATCH_XFERS];
+	unsigned char tx[BATCH_XFERS][BATCH_XFER_LEN];
+	unsigned char rx[BATCH_XFERS][BATCH_XFER_LEN];
+};
+
+static void fill_batch(struct batch_frame *f, int peer_fd, unsigned int round)
+{
+	struct rtdm_spi_xfer *x;
+	int n, b;
+
+	for (n = 0; n < BATCH_XFERS; n++) {
+		x = f->xfers + n;
+		for (b = 0; b < BATCH_XFER_LEN; b++)
+			f->tx[n][b] = (unsigned char)(round + n + b);
+		memset(f->rx[n], 0, BATCH_XFER_LEN);
+		x->tx_buf = (unsigned long)f->tx[n];
+		x->rx_buf = (unsigned long)f->rx[n];
+		x->len = BATCH_XFER_LEN;
+		/* Alternate slaves by pairs, keeping CS within a pair. */
+		x->fd = (n & 2) ? peer_fd : -1;
+		x->flags = (n & 1) ? 0 : SPI_XFER_CS_KEEP;
+		x->delay_us = 0;
+		x->status = -EINPROGRESS;
+	}
+}
+
+static int check_batch(struct batch_frame *f, int loopback)
+{
+	int n;
+
+	for (n = 0; n < BATCH_XFERS; n++) {
+		if (!__Tassert(f->xfers[n].status == 0))
+			return -EPROTO;
+		if (loopback &&
+		    !__Tassert(memcmp(f->tx[n], f->rx[n], BATCH_XFER_LEN) == 0))
+			return -EPROTO;
+	}
+
+	return 0;
+}
+
+static int run_spi_batch(struct smokey_test *t, int argc, char *const argv[])
+{
+	int fd, peer_fd = -1, ret, n, count = 1000, loopback = 0;
+	struct batch_frame frames[BATCH_DEPTH];
+	unsigned char buf[BATCH_XFER_LEN];
+	struct rtdm_spi_config config;
+	struct rtdm_spi_batch batch;
+	struct timespec start, now;
+	struct sched_param param;
+	const char *device;
+	long long single_ns, batch_ns;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (!SMOKEY_ARG_ISSET(spi_batch, device)) {
+		warning("missing device= specification");
+		return -EINVAL;
+	}
+
+	if (SMOKEY_ARG_ISSET(spi_batch, count))
+		count = SMOKEY_ARG_INT(spi_batch, count);
+
+	if (SMOKEY_ARG_ISSET(spi_batch, loopback))
+		loopback = SMOKEY_ARG_BOOL(spi_batch, loopback);
+
+	device = SMOKEY_ARG_STRING(spi_batch, device);
+	fd = open(device, O_RDWR);
+	if (fd < 0) {
+		ret = -errno;
+		warning("cannot open device %s [%s]",
+			device, symerror(ret));
+		return ret;
+	}
+
+	config.mode = SPI_MODE_0;
+	config.bits_per_word = 8;
+	config.speed_hz = 10000000;
+	if (!__T(ret, ioctl(fd, SPI_RTIOC_SET_CONFIG, &config)))
+		goto out;
+
+	if (SMOKEY_ARG_ISSET(spi_batch, peer)) {
+		device = SMOKEY_ARG_STRING(spi_batch, peer);
+		peer_fd = open(device, O_RDWR);
+		if (peer_fd < 0) {
+			ret = -errno;
+			warning("cannot open device %s [%s]",
+				device, symerror(ret));
+			goto out;
+		}
+		if (!__T(ret, ioctl(peer_fd, SPI_RTIOC_SET_CONFIG, &config)))
+			goto out;
+	}
+
+	param.sched_priority = 10;
+	if (!__T(ret, pthread_setschedparam(pthread_self(),
+				    SCHED_FIFO, &param)))
+		goto out;
+
+	/* Reference: one syscall per transfer. */
+	memset(buf, 0xa5, sizeof(buf));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < count * BATCH_XFERS; n++) {
+		ret = write((n & 2) && peer_fd >= 0 ? peer_fd : fd,
+			    buf, sizeof(buf));
+		if (ret < 0) {
+			ret = -errno;
+			goto out;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	single_ns = diff_ts(&now, &start);
+
+	/*
+	 * Batched: keep BATCH_DEPTH batches in flight, so that the
+	 * next one is queued while the previous one is running.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < count + BATCH_DEPTH - 1; n++) {
+		if (n >= BATCH_DEPTH - 1) {
+			if (!__T(ret, ioctl(fd, SPI_RTIOC_COMPLETE, &batch)))
+				goto out;
+			ret = check_batch(frames + batch.seq % BATCH_DEPTH,
+					  loopback);
+			if (ret)
+				goto out;
+		}
+		if (n < count) {
+			fill_batch(frames + n % BATCH_DEPTH,
+				   peer_fd >= 0 ? peer_fd : -1, n);
+			batch.xfers = (unsigned long)frames[n % BATCH_DEPTH].xfers;
+			batch.nr_xfers = BATCH_XFERS;
+			if (!__T(ret, ioctl(fd, SPI_RTIOC_SUBMIT, &batch)))
+				goto out;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	batch_ns = diff_ts(&now, &start);
+
+	smokey_trace("%d transfers: %Ld ns/xfer single, %Ld ns/xfer batched",
+		     count * BATCH_XFERS,
+		     single_ns / (count * BATCH_XFERS),
+		     batch_ns / (count * BATCH_XFERS));
+	ret = 0;
+out:
+	if (peer_fd >= 0)
+		close(peer_fd);
+	close(fd);
+
+	return ret;
+}
+
 int main(int argc, char *const argv[])
 {
 	struct smokey_test *t;
@@ -22,11 +22,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <sys/mman.h>
 #include <errno.h>
 #include <error.h>
 #include <getopt.h>
 #include <string.h>
+#include <time.h>
 #include <signal.h>
 #include <pthread.h>
 #include <rtdm/analogy.h>
@@ -51,8 +51,11 @@ static char *str_chans = "0,1,2,3";
 static char *filename = FILENAME;
 
 static unsigned long wake_count = 0;
+static unsigned long wake_timeout = 0;
+static unsigned int nr_consumers = 1;
 static int real_time = 0;
 static int use_mmap = 0;
+static int bench = 0;
 static int verbose = 0;
 
 #define exit_err(fmt, args ...) error(1,0, fmt "\n", ##args)
@@ -87,6 +90,9 @@ struct option cmd_read_opts[] = {
 	{"mmap", no_argument, NULL, 'm'},
 	{"raw", no_argument, NULL, 'w'},
 	{"wake-count", required_argument, NULL, 'k'},
+	{"wake-timeout", required_argument, NULL, 't'},
+	{"consumers", required_argument, NULL, 'n'},
+	{"bench", no_argument, NULL, 'b'},
 	{"help", no_argument, NULL, 'h'},
 	{0},
 };
@@ -103,9 +109,17 @@ static void do_print_usage(void)
 	output("\t\t -m, --mmap: mmap the buffer");
 	output("\t\t -w, --raw: dump data in raw format");
 	output("\t\t -k, --wake-count: space available before waking up the process");
+	output("\t\t -t, --wake-timeout: delay (us) before waking up the process anyway");
+	output("\t\t -n, --consumers: consumers sharing the mmapped buffer");
+	output("\t\t -b, --bench: report the sustained acquisition rate");
 	output("\t\t -h, --help: output this help");
 }
 
+static inline int dump_none(a4l_desc_t *dsc, a4l_cmd_t *cmd, unsigned char *buf, int size)
+{
+	return 0;
+}
+
 static inline int dump_raw(a4l_desc_t *dsc, a4l_cmd_t *cmd, unsigned char *buf, int size)
 {
 	return fwrite(buf, size, 1, stdout);
@@ -191,72 +205,61 @@ static int fetch_data(a4l_desc_t *dsc, void *buf, unsigned int *cnt, dump_functi
 	return ret;
 }
 
-static int fetch_data_mmap(a4l_desc_t *dsc, unsigned int *cnt, dump_function_t dump,
-			   void *map, unsigned long buf_size)
+static int fetch_data_mmap(a4l_desc_t *dsc, unsigned int *cnt,
+			   dump_function_t dump, a4l_stream_t *stm)
 {
-	unsigned long cnt_current = 0, cnt_updated = 0;
+	a4l_stream_span_t span;
+	unsigned int n;
 	int ret;
 
 	for (;;) {
+		/* Release the data consumed so far and wait for more */
+		ret = a4l_stream_wait(stm, A4L_INFINITE);
+		if (ret < 0)
+			exit_err("a4l_stream_wait() failed (ret=%d)", ret);
 
-		/* Retrieve and update the buffer's state
-		 * In input case, recover how many bytes are available to read
-		 */
-		ret = a4l_mark_bufrw(dsc, cmd.idx_subd, cnt_current, &cnt_updated);
-
-		if (ret == -ENOENT)
+		if (ret == 0) {
+			debug("no more data in the buffer ");
 			break;
-
-		if (ret < 0)
-			exit_err("a4l_mark_bufrw() failed (ret=%d)", ret);
-
-		/* If there is nothing to read, wait for an event
-		   (Note that a4l_poll() also retrieves the data amount
-		   to read; in our case it is useless as we have to update
-		   the data read counter) */
-		if (!cnt_updated) {
-			ret = a4l_poll(dsc, cmd.idx_subd, A4L_INFINITE);
-			if (ret < 0)
-				exit_err("a4l_poll() failed (ret=%d)", ret);
-
-			if (ret == 0)
-				break;
-
-			cnt_current = cnt_updated;
-			continue;
 		}
 
-		ret = dump(dsc, &cmd, map + (*cnt % buf_size), cnt_updated);
-		if (ret < 0)
-			return -EIO;
-
-		*cnt += cnt_updated;
-		cnt_current = cnt_updated;
+		/* Every consumer processes its pending data in place,
+		   the first one dumps them, the others are mere
+		   placeholders for additional processing stages */
+		for (n = 0; n < nr_consumers; n++) {
+			ret = a4l_stream_peek(stm, n, &span);
+			if (ret <= 0)
+				continue;
+
+			if (n == 0) {
+				if (dump(dsc, &cmd, span.ptr[0], span.len[0]) < 0)
+					return -EIO;
+				if (span.len[1] > 0 &&
+				    dump(dsc, &cmd, span.ptr[1], span.len[1]) < 0)
+					return -EIO;
+				*cnt += ret;
+			}
+
+			a4l_stream_consume(stm, n, ret);
+		}
 	}
 
 	return 0;
 }
 
-static int map_subdevice_buffer(a4l_desc_t *dsc, unsigned long *buf_size, void **map)
+static void report_rate(unsigned int cnt, unsigned int scan_size,
+			struct timespec *start)
 {
-	void *buf;
-	int ret;
+	struct timespec now;
+	double secs, samples;
 
-	/* Get the buffer size to map */
-	ret = a4l_get_bufsize(dsc, cmd.idx_subd, buf_size);
-	if (ret < 0)
-		exit_err("a4l_get_bufsize() failed (ret=%d)", ret);
-	debug("buffer size = %lu bytes", *buf_size);
-
-	/* Map the analog input subdevice buffer */
-	ret = a4l_mmap(dsc, cmd.idx_subd, *buf_size, &buf);
-	if (ret < 0)
-		exit_err("a4l_mmap() failed (ret=%d)", ret);
-	debug("mmap done (map=0x%p)", buf);
-
-	*map = buf;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	secs = (now.tv_sec - start->tv_sec) +
+		(now.tv_nsec - start->tv_nsec) / 1e9;
+	samples = (double)cnt / scan_size * cmd.nb_chan;
 
-	return 0;
+	fprintf(stderr, "%.0f samples in %.3f s: %.3f MS/s (%.3f MB/s)\n",
+		samples, secs, samples / secs / 1e6, cnt / secs / 1e6);
 }
 
 static int cmd_read(struct arguments *arg)
@@ -264,13 +267,13 @@ static int cmd_read(struct arguments *arg)
 	unsigned int i, scan_size = 0, cnt = 0, ret = 0, len, ofs;
 	dump_function_t dump_function = dump_text;
 	a4l_desc_t dsc = { .sbdata = NULL };
-	unsigned long buf_size;
 	char **argv = arg->argv;
 	int argc = arg->argc;
-	void *map = NULL;
+	a4l_stream_t stm;
+	struct timespec start;
 
 	for (;;) {
-		ret = getopt_long(argc, argv, "vrd:s:S:c:mwk:h",
+		ret = getopt_long(argc, argv, "vrd:s:S:c:mwk:t:n:bh",
 				  cmd_read_opts, NULL);
 
 		if (ret == -1)
@@ -304,6 +307,16 @@ static int cmd_read(struct arguments *arg)
 		case 'k':
 			wake_count = strtoul(optarg, NULL, 0);
 			break;
+		case 't':
+			wake_timeout = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_consumers = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			bench = 1;
+			dump_function = dump_none;
+			break;
 		case 'h':
 		default:
 			do_print_usage();
@@ -373,15 +386,19 @@ static int cmd_read(struct arguments *arg)
 	a4l_snd_cancel(&dsc, cmd.idx_subd);
 
 	if (use_mmap) {
-		ret = map_subdevice_buffer(&dsc, &buf_size, &map);
-		if (ret)
-			goto out;
+		ret = a4l_stream_open(&dsc, cmd.idx_subd, nr_consumers, &stm);
+		if (ret < 0)
+			exit_err("a4l_stream_open() failed (ret=%d)", ret);
+		debug("buffer mapped (map=0x%p, size=%lu)", stm.map, stm.size);
 	}
 
-	ret = a4l_set_wakesize(&dsc, wake_count);
+	ret = a4l_set_watermark(&dsc, wake_count, wake_timeout);
 	if (ret < 0)
-		exit_err("a4l_set_wakesize failed (ret=%d)", ret);
-	debug("wake size successfully set (%lu)", wake_count);
+		exit_err("a4l_set_watermark failed (ret=%d)", ret);
+	debug("wake size successfully set (%lu, %lu us)",
+	      wake_count, wake_timeout);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	/* Send the command to the input device */
 	ret = a4l_snd_command(&dsc, &cmd);
@@ -390,7 +407,7 @@ static int cmd_read(struct arguments *arg)
 	debug("command sent");
 
 	if (use_mmap) {
-		ret = fetch_data_mmap(&dsc, &cnt, dump_function, map, buf_size);
+		ret = fetch_data_mmap(&dsc, &cnt, dump_function, &stm);
 		if (ret)
 			exit_err("failed to fetch_data_mmap (ret=%d)", ret);
 	}
@@ -401,11 +418,11 @@ static int cmd_read(struct arguments *arg)
 	}
 	debug("%d bytes successfully received (ret=%d)", cnt, ret);
 
-	return 0;
+	if (bench)
+		report_rate(cnt, scan_size, &start);
 
-out:
 	if (use_mmap)
-		munmap(map, buf_size);
+		a4l_stream_close(&stm);
 
 	/* Free the buffer used as device descriptor */
 	if (dsc.sbdata != NULL)
@@ -5,6 +5,7 @@
 #include <time.h>
 #include <errno.h>
 #include <getopt.h>
+#include <sys/mman.h>
 
 #include <alchemy/task.h>
 
@@ -22,6 +23,8 @@ static void print_usage(char *prg)
 	    " -R, --timestamp-rel   with relative timestamp\n"
 	    " -v, --verbose         be verbose\n"
 	    " -p, --print=MODULO    print every MODULO message\n"
+	    " -r, --ring=SLOTS      zero-copy reception through a ring of SLOTS frames\n"
+	    " -b, --batch=COUNT     wait for COUNT frames at once (with --ring)\n"
 	    " -h, --help            this help\n",
 	    prg);
 }
@@ -30,6 +33,7 @@ static void print_usage(char *prg)
 extern int optind, opterr, optopt;
 
 static int s = -1, verbose = 0, print = 1;
+static unsigned int ring_slots = 0, batch = 1;
 static nanosecs_rel_t timeout = 0, with_timestamp = 0, timestamp_rel = 0;
 
 RT_TASK rt_task_desc;
@@ -77,15 +81,127 @@ static void cleanup_and_exit(int sig)
     exit(0);
 }
 
+static void print_frame(int count, int ifindex, struct can_frame *frame,
+			int has_timestamp, nanosecs_abs_t timestamp)
+{
+    static nanosecs_abs_t timestamp_prev;
+    int i;
+
+    printf("#%d: (%d) ", count, ifindex);
+    if (has_timestamp) {
+	if (timestamp_rel) {
+	    printf("%lldns ", (long long)(timestamp - timestamp_prev));
+	    timestamp_prev = timestamp;
+	} else
+	    printf("%lldns ", (long long)timestamp);
+    }
+    if (frame->can_id & CAN_ERR_FLAG)
+	printf("!0x%08x!", frame->can_id & CAN_ERR_MASK);
+    else if (frame->can_id & CAN_EFF_FLAG)
+	printf("<0x%08x>", frame->can_id & CAN_EFF_MASK);
+    else
+	printf("<0x%03x>", frame->can_id & CAN_SFF_MASK);
+
+    printf(" [%d]", frame->can_dlc);
+    if (!(frame->can_id & CAN_RTR_FLAG))
+	for (i = 0; i < frame->can_dlc; i++) {
+	    printf(" %02x", frame->data[i]);
+	}
+    if (frame->can_id & CAN_ERR_FLAG) {
+	printf(" ERROR ");
+	if (frame->can_id & CAN_ERR_BUSOFF)
+	    printf("bus-off");
+	if (frame->can_id & CAN_ERR_CRTL)
+	    printf("controller problem");
+    } else if (frame->can_id & CAN_RTR_FLAG)
+	printf(" remote request");
+    printf("\n");
+}
+
+static void rt_task_ring(void)
+{
+    volatile struct can_ring_hdr *hdr;
+    struct can_ring_slot *slots, *slot;
+    unsigned int head, tail, mask;
+    int ret, count = 0;
+    size_t size;
+
+    ret = ioctl(s, RTCAN_RTIOC_RING_SETUP, ring_slots);
+    if (ret) {
+	fprintf(stderr, "ioctl RING_SETUP: %s\n", strerror(-ret));
+	return;
+    }
+
+    /* Map the control block first to learn the ring size. */
+    hdr = mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, s, 0);
+    if (hdr == MAP_FAILED) {
+	perror("mmap");
+	return;
+    }
+    size = hdr->map_size;
+    munmap((void *)hdr, sizeof(*hdr));
+
+    hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s, 0);
+    if (hdr == MAP_FAILED) {
+	perror("mmap");
+	return;
+    }
+    slots = (void *)hdr + hdr->slot_off;
+    mask = hdr->nr_slots - 1;
+
+    if (verbose)
+	printf("Ring: %u slots, %zu bytes mapped\n", hdr->nr_slots, size);
+
+    tail = hdr->tail;
+
+    while (1) {
+	ret = ioctl(s, RTCAN_RTIOC_RING_WAIT, batch);
+	if (ret < 0) {
+	    switch (ret) {
+	    case -ETIMEDOUT:
+		if (verbose)
+		    printf("recv: timed out");
+		/* Drain what a partial batch left in the ring. */
+		break;
+	    case -EBADF:
+		if (verbose)
+		    printf("recv: aborted because socket was closed");
+		return;
+	    default:
+		fprintf(stderr, "recv: %s\n", strerror(-ret));
+		return;
+	    }
+	}
+
+	head = hdr->head;
+	__sync_synchronize();
+
+	for (; tail != head; tail++) {
+	    slot = &slots[tail & mask];
+	    if (print && (count % print) == 0)
+		print_frame(count, slot->ifindex, &slot->frame,
+			    with_timestamp, slot->timestamp);
+	    count++;
+	}
+
+	/* Hand the slots back to the driver. */
+	__sync_synchronize();
+	hdr->tail = tail;
+
+	if (verbose && hdr->overruns)
+	    printf("Ring: %u frames dropped so far\n", hdr->overruns);
+    }
+}
+
 static void rt_task(void)
 {
-    int i, ret, count = 0;
+    int ret, count = 0;
     struct can_frame frame;
     struct sockaddr_can addr;
     socklen_t addrlen = sizeof(addr);
     struct msghdr msg;
     struct iovec iov;
-    nanosecs_abs_t timestamp, timestamp_prev = 0;
+    nanosecs_abs_t timestamp = 0;
 
     if (with_timestamp) {
 	msg.msg_iov = &iov;
@@ -120,37 +236,9 @@ static void rt_task(void)
 	    break;
 	}
 
-	if (print && (count % print) == 0) {
-	    printf("#%d: (%d) ", count, addr.can_ifindex);
-	    if (with_timestamp && msg.msg_controllen) {
-		if (timestamp_rel) {
-		printf("%lldns ", (long long)(timestamp - timestamp_prev));
-		    timestamp_prev = timestamp;
-		} else
-		    printf("%lldns ", (long long)timestamp);
-	    }
-	    if (frame.can_id & CAN_ERR_FLAG)
-		printf("!0x%08x!", frame.can_id & CAN_ERR_MASK);
-	    else if (frame.can_id & CAN_EFF_FLAG)
-		printf("<0x%08x>", frame.can_id & CAN_EFF_MASK);
-	    else
-		printf("<0x%03x>", frame.can_id & CAN_SFF_MASK);
-
-	    printf(" [%d]", frame.can_dlc);
-	    if (!(frame.can_id & CAN_RTR_FLAG))
-		for (i = 0; i < frame.can_dlc; i++) {
-		    printf(" %02x", frame.data[i]);
-		}
-	    if (frame.can_id & CAN_ERR_FLAG) {
-		printf(" ERROR ");
-		if (frame.can_id & CAN_ERR_BUSOFF)
-		    printf("bus-off");
-		if (frame.can_id & CAN_ERR_CRTL)
-		    printf("controller problem");
-	    } else if (frame.can_id & CAN_RTR_FLAG)
-		printf(" remote request");
-	    printf("\n");
-	}
+	if (print && (count % print) == 0)
+	    print_frame(count, addr.can_ifindex, &frame,
+			with_timestamp && msg.msg_controllen, timestamp);
 	count++;
     }
 }
@@ -172,13 +260,15 @@ int main(int argc, char **argv)
 	{ "timeout", required_argument, 0, 't'},
 	{ "timestamp", no_argument, 0, 'T'},
 	{ "timestamp-rel", no_argument, 0, 'R'},
+	{ "ring", required_argument, 0, 'r'},
+	{ "batch", required_argument, 0, 'b'},
 	{ 0, 0, 0, 0},
     };
 
     signal(SIGTERM, cleanup_and_exit);
     signal(SIGINT, cleanup_and_exit);
 
-    while ((opt = getopt_long(argc, argv, "hve:f:t:p:RT",
+    while ((opt = getopt_long(argc, argv, "hve:f:t:p:r:b:RT",
 			      long_options, NULL)) != -1) {
 	switch (opt) {
 	case 'h':
@@ -193,6 +283,14 @@ int main(int argc, char **argv)
 	    verbose = 1;
 	    break;
 
+	case 'r':
+	    ring_slots = strtoul(optarg, NULL, 0);
+	    break;
+
+	case 'b':
+	    batch = strtoul(optarg, NULL, 0);
+	    break;
+
 	case 'e':
 	    err_mask = strtoul(optarg, NULL, 0);
 	    break;
@@ -314,7 +412,10 @@ int main(int argc, char **argv)
 	goto failure;
     }
 
-    rt_task();
+    if (ring_slots)
+	rt_task_ring();
+    else
+	rt_task();
     /* never returns */
 
  failure:
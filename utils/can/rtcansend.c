@@ -26,6 +26,7 @@ static void print_usage(char *prg)
 	    " -c, --count           message count in data[0-3]\n"
 	    " -d, --delay=MS        delay in ms (default = 1ms)\n"
 	    " -s, --send            use send instead of sendto\n"
+	    " -b, --batch=COUNT     send up to COUNT messages per call\n"
 	    " -t, --timeout=MS      timeout in ms\n"
 	    " -L, --loopback=0|1    switch local loopback off or on\n"
 	    " -v, --verbose         be verbose\n"
@@ -39,9 +40,9 @@ RT_TASK rt_task_desc;
 
 static int s=-1, dlc=0, rtr=0, extended=0, verbose=0, loops=1;
 static SRTIME delay=1000000;
-static int count=0, print=1, use_send=0, loopback=-1;
+static int count=0, print=1, use_send=0, loopback=-1, batch=1;
 static nanosecs_rel_t timeout = 0;
-static struct can_frame frame;
+static struct can_frame frame, frames[RTCAN_TX_BATCH_MAX];
 static struct sockaddr_can to_addr;
 
 
@@ -72,9 +73,73 @@ static void cleanup_and_exit(int sig)
     exit(0);
 }
 
+static void print_frame(struct can_frame *frame)
+{
+    int j;
+
+    if (frame->can_id & CAN_EFF_FLAG)
+	printf("<0x%08x>", frame->can_id & CAN_EFF_MASK);
+    else
+	printf("<0x%03x>", frame->can_id & CAN_SFF_MASK);
+    printf(" [%d]", frame->can_dlc);
+    for (j = 0; j < frame->can_dlc; j++) {
+	printf(" %02x", frame->data[j]);
+    }
+    printf("\n");
+}
+
+static int send_batch(int first, int n)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    int i, c;
+
+    for (i = 0; i < n; i++) {
+	frames[i] = frame;
+	if (count) {
+	    c = first + i;
+	    memcpy(&frames[i].data[0], &c, sizeof(c));
+	}
+    }
+
+    iov.iov_base = frames;
+    iov.iov_len = n * sizeof(can_frame_t);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (!use_send) {
+	msg.msg_name = &to_addr;
+	msg.msg_namelen = sizeof(to_addr);
+    }
+
+    return sendmsg(s, &msg, 0);
+}
+
 static void rt_task(void)
 {
-    int i, j, ret;
+    int i, j, n, ret;
+    RTIME start = rt_timer_read();
+
+    if (batch > 1) {
+	for (i = 0; i < loops; i += n) {
+	    if (delay)
+		rt_task_sleep(rt_timer_ns2ticks(delay));
+	    n = loops - i < batch ? loops - i : batch;
+	    ret = send_batch(i, n);
+	    if (ret < 0) {
+		fprintf(stderr, "sendmsg: %s\n", strerror(-ret));
+		break;
+	    }
+	    /* Only account for the messages which went out. */
+	    n = ret / sizeof(can_frame_t);
+	    if (verbose)
+		for (j = 0; j < n; j++)
+		    if ((i + j) % print == 0)
+			print_frame(&frames[j]);
+	}
+	loops = i;
+	goto out;
+    }
 
     for (i = 0; i < loops; i++) {
 	rt_task_sleep(rt_timer_ns2ticks(delay));
@@ -103,17 +168,16 @@ static void rt_task(void)
 	    i = loops;		/* abort */
 	    break;
 	}
-	if (verbose && (i % print) == 0) {
-	    if (frame.can_id & CAN_EFF_FLAG)
-		printf("<0x%08x>", frame.can_id & CAN_EFF_MASK);
-	    else
-		printf("<0x%03x>", frame.can_id & CAN_SFF_MASK);
-	    printf(" [%d]", frame.can_dlc);
-	    for (j = 0; j < frame.can_dlc; j++) {
-		printf(" %02x", frame.data[j]);
-	    }
-	    printf("\n");
-	}
+	if (verbose && (i % print) == 0)
+	    print_frame(&frame);
+    }
+    loops = i;
+ out:
+    if (verbose) {
+	RTIME elapsed = rt_timer_ticks2ns(rt_timer_read() - start) / 1000;
+	printf("%d messages sent in %llu us (%llu messages/s)\n",
+	       loops, (unsigned long long)elapsed,
+	       elapsed ? (unsigned long long)loops * 1000000 / elapsed : 0ULL);
     }
 }
 
@@ -136,6 +200,7 @@ int main(int argc, char **argv)
 	{ "send", no_argument, 0, 's'},
 	{ "timeout", required_argument, 0, 't'},
 	{ "loopback", required_argument, 0, 'L'},
+	{ "batch", required_argument, 0, 'b'},
 	{ 0, 0, 0, 0},
     };
 
@@ -144,7 +209,7 @@ int main(int argc, char **argv)
 
     frame.can_id = 1;
 
-    while ((opt = getopt_long(argc, argv, "hvi:l:red:t:cp:sL:",
+    while ((opt = getopt_long(argc, argv, "hvi:l:red:t:cp:sL:b:",
 			      long_options, NULL)) != -1) {
 	switch (opt) {
 	case 'h':
@@ -194,6 +259,15 @@ int main(int argc, char **argv)
 	    loopback = strtoul(optarg, NULL, 0);
 	    break;
 
+	case 'b':
+	    batch = strtoul(optarg, NULL, 0);
+	    if (batch < 1 || batch > RTCAN_TX_BATCH_MAX) {
+		fprintf(stderr, "batch must be within [1-%d]\n",
+			RTCAN_TX_BATCH_MAX);
+		exit(1);
+	    }
+	    break;
+
 	default:
 	    fprintf(stderr, "Unknown option %c\n", opt);
 	    break;
@@ -25,6 +25,7 @@
 #include <error.h>
 #include <fcntl.h>
 #include <copperplate/cluster.h>
+#include <copperplate/syncobj.h>
 #include <xenomai/init.h>
 
 static const struct option options[] = {
@@ -33,6 +34,11 @@ static const struct option options[] = {
 		.name = "dump-cluster",
 		.has_arg = required_argument,
 	},
+	{
+#define dump_syncobjs_opt	1
+		.name = "dump-syncobjs",
+		.has_arg = no_argument,
+	},
 	{ /* Sentinel */ }
 };
 
@@ -40,6 +46,7 @@ void application_usage(void)
 {
         fprintf(stderr, "usage: %s <option>:\n", get_program_name());
 	fprintf(stderr, "--dump-cluster <name>		dump cluster <name>\n");
+	fprintf(stderr, "--dump-syncobjs			dump synchronization object statistics\n");
 }
 
 static int check_shared_heap(const char *cmd)
@@ -113,10 +120,86 @@ static int dump_cluster(const char *name)
 	return cluster_walk(&cluster, walk_cluster);
 }
 
+#if defined(CONFIG_XENO_PSHARED) && defined(CONFIG_XENO_SYNCOBJ_STATS)
+
+static void print_histo(const char *label, const unsigned long *histo,
+			int nr_buckets, const char *unit)
+{
+	int n;
+
+	printf("  %s:", label);
+
+	for (n = 0; n < nr_buckets; n++) {
+		if (histo[n] == 0)
+			continue;
+		/* The last bucket collects anything beyond. */
+		if (n == nr_buckets - 1)
+			printf(" >=%llu%s:%lu", 1ULL << n, unit, histo[n]);
+		else
+			printf(" <%llu%s:%lu", 2ULL << n, unit, histo[n]);
+	}
+
+	putchar('\n');
+}
+
+static int dump_syncobjs(void)
+{
+	struct sysgroup_memspec *obj, *tmp;
+	struct syncobj_stats *stats;
+	char pid[16];
+
+	/*
+	 * Dumping directly from the shared heap, we don't want to
+	 * stall real-time threads by grabbing the object locks, so
+	 * values may be slightly off under heavy traffic.
+	 */
+	sysgroup_lock();
+
+	for_each_sysgroup(obj, tmp, syncobj) {
+		stats = container_of(obj, struct syncobj_stats, memspec);
+		snprintf(pid, sizeof(pid), "[%d]", stats->cnode);
+		printf("%-9s %-20s grants=%lu timeouts=%lu flushes=%lu"
+		       " max_waiters=%d\n", pid,
+		       *stats->name ? stats->name : "-",
+		       stats->grants, stats->timeouts, stats->flushes,
+		       stats->max_waiters);
+		print_histo("wait", stats->wait_time,
+			    SYNCOBJ_TIME_BUCKETS, "ns");
+		print_histo("hold", stats->hold_time,
+			    SYNCOBJ_TIME_BUCKETS, "ns");
+		print_histo("waiters", stats->waiters,
+			    SYNCOBJ_WAITER_BUCKETS, "");
+	}
+
+	sysgroup_unlock();
+
+	return 0;
+}
+
+#else
+
+static int dump_syncobjs(void)
+{
+	int ret;
+
+	ret = check_shared_heap("--dump-syncobjs");
+	if (ret)
+		return ret;
+
+	fprintf(stderr,
+		"--dump-syncobjs requires --enable-syncobj-stats to\n"
+		" be given for building this particular instance of the\n"
+		" hdb program.\n");
+
+	return -ENOTSUP;
+}
+
+#endif
+
 int main(int argc, char *const argv[])
 {
 	const char *cluster_name = NULL;
-	int lindex, c, ret = 0;
+	int lindex, c, ret = 0, syncobjs = 0;
 
 	for (;;) {
 		c = getopt_long_only(argc, argv, "", options, &lindex);
@@ -133,6 +216,9 @@ int main(int argc, char *const argv[])
 		case dump_cluster_opt:
 			cluster_name = optarg;
 			break;
+		case dump_syncobjs_opt:
+			syncobjs = 1;
+			break;
 		default:
 			return EINVAL;
 		}
@@ -141,6 +227,9 @@ int main(int argc, char *const argv[])
 	if (cluster_name)
 		ret = dump_cluster(cluster_name);
 
+	if (ret == 0 && syncobjs)
+		ret = dump_syncobjs();
+
 	if (ret)
 		error(1, -ret, "hdb");
 
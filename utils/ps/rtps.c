@@ -21,8 +21,10 @@
 #include <error.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <cobalt/sys/cobalt.h>
 
 #define PROC_ACCT  "/proc/xenomai/sched/acct"
+#define PROC_ACCT_BIN  PROC_ACCT ".bin"
 #define PROC_PID  "/proc/%d/cmdline"
 
 #define ACCT_FMT_1  "%u %d %lu %lu %lu %lx %Lu %Lu %Lu"
@@ -30,23 +32,84 @@
 #define ACCT_NFMT_1 9
 #define ACCT_NFMT_2 10
 
-int main(int argc, char *argv[])
+static void print_thread(int pid, unsigned long long exectime_total,
+			 const char *name)
+{
+	char cmdpath[sizeof(PROC_PID) + 32], cmdbuf[BUFSIZ];
+	unsigned int hr, min, msec, usec;
+	unsigned long long v;
+	unsigned long sec;
+	FILE *cmdfp;
+
+	snprintf(cmdpath, sizeof(cmdpath), PROC_PID, pid);
+	cmdfp = fopen(cmdpath, "r");
+
+	if (cmdfp == NULL ||
+	    fgets(cmdbuf, sizeof(cmdbuf), cmdfp) == NULL)
+		strcpy(cmdbuf, "-");
+
+	if (cmdfp)
+		fclose(cmdfp);
+
+	v = exectime_total;
+	sec = v / 1000000000LL;
+	v %= 1000000000LL;
+	msec = v / 1000000LL;
+	v %= 1000000LL;
+	usec = v / 1000LL;
+	hr = sec / (60 * 60);
+	sec %= (60 * 60);
+	min = sec / 60;
+	sec %= 60;
+	printf("%-6d %.3u:%.2u:%.2lu.%.3u,%.3u   %-24s %s\n",
+	       pid,
+	       hr, min, sec, msec, usec,
+	       name, cmdbuf);
+}
+
+static int dump_binary(void)
 {
-	char cmdpath[sizeof(PROC_PID) + 32], cmdbuf[BUFSIZ], acctbuf[BUFSIZ], name[64];
-	unsigned long ssw, csw, pf, state, sec;
+	const struct cobalt_vfile_thread *t;
+	struct cobalt_vfile_reader r;
+	char name[XNOBJECT_NAME_LEN + 1];
+	int ret, n;
+
+	ret = cobalt_vfile_open(&r, PROC_ACCT_BIN, COBALT_VFILE_THREAD);
+	if (ret)
+		return ret;
+
+	ret = cobalt_vfile_update(&r);
+	if (ret < 0)
+		goto out;
+
+	for (n = 0; n < r.nrec; n++) {
+		t = cobalt_vfile_get(&r, n);
+		memcpy(name, t->name, sizeof(t->name));
+		name[sizeof(t->name)] = '\0';
+		print_thread(t->pid, t->exectime_total, name);
+	}
+
+	ret = 0;
+out:
+	cobalt_vfile_close(&r);
+
+	return ret;
+}
+
+static void dump_text(void)
+{
+	unsigned long ssw, csw, pf, state;
 	unsigned long long account_period,
-		exectime_period, exectime_total, v;
-	unsigned int cpu, hr, min, msec, usec;
-	FILE *acctfp, *cmdfp;
+		exectime_period, exectime_total;
+	char acctbuf[BUFSIZ], name[64];
+	unsigned int cpu;
+	FILE *acctfp;
 	int pid;
 
 	acctfp = fopen(PROC_ACCT, "r");
 	if (acctfp == NULL)
 		error(1, errno, "cannot open %s\n", PROC_ACCT);
 
-	printf("%-6s %-17s   %-24s %s\n\n",
-	       "PID", "TIME", "THREAD", "CMD");
-
 	while (fgets(acctbuf, sizeof(acctbuf), acctfp) != NULL) {
 		if (sscanf(acctbuf, ACCT_FMT_2,
 		      &cpu, &pid, &ssw, &csw, &pf, &state,
@@ -60,32 +123,23 @@ int main(int argc, char *argv[])
 				break;
 			}
 		}
-
-		snprintf(cmdpath, sizeof(cmdpath), PROC_PID, pid);
-		cmdfp = fopen(cmdpath, "r");
-
-		if (cmdfp == NULL ||
-		    fgets(cmdbuf, sizeof(cmdbuf), cmdfp) == NULL)
-			strcpy(cmdbuf, "-");
-
-		if (cmdfp)
-			fclose(cmdfp);
-
-		v = exectime_total;
-		sec = v / 1000000000LL;
-		v %= 1000000000LL;
-		msec = v / 1000000LL;
-		v %= 1000000LL;
-		usec = v / 1000LL;
-		hr = sec / (60 * 60);
-		sec %= (60 * 60);
-		min = sec / 60;
-		sec %= 60;
-		printf("%-6d %.3u:%.2u:%.2lu.%.3u,%.3u   %-24s %s\n",
-		       pid,
-		       hr, min, sec, msec, usec,
-		       name, cmdbuf);
+		print_thread(pid, exectime_total, name);
 	}
 
+	fclose(acctfp);
+}
+
+int main(int argc, char *argv[])
+{
+	printf("%-6s %-17s   %-24s %s\n\n",
+	       "PID", "TIME", "THREAD", "CMD");
+
+	/*
+	 * Prefer the binary output, fall back to parsing the text
+	 * format from kernels which do not provide it.
+	 */
+	if (dump_binary())
+		dump_text();
+
 	exit(0);
 }
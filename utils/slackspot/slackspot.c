@@ -16,11 +16,15 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  *
  * This utility parses the output of the /proc/xenomai/debug/relax
- * vfile, to get backtraces of spurious relaxes.
+ * vfile, to get backtraces of spurious relaxes. In live mode, it
+ * continuously scans the relax event rings mapped from
+ * /proc/xenomai/debug/relax-ring instead, displaying the busiest
+ * spots.
  */
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdio.h>
 #include <error.h>
 #include <stdint.h>
@@ -34,7 +38,9 @@
 #include <malloc.h>
 #include <getopt.h>
 #include <signal.h>
+#include <fcntl.h>
 #include <cobalt/uapi/signal.h>
+#include <cobalt/uapi/kernel/relax.h>
 
 static const struct option base_options[] = {
 	{
@@ -67,6 +73,16 @@ static const struct option base_options[] = {
 		.name = "filter-out",
 		.has_arg = required_argument,
 	},
+#define live_opt	6
+	{
+		.name = "live",
+		.has_arg = no_argument,
+	},
+#define interval_opt	7
+	{
+		.name = "interval",
+		.has_arg = required_argument,
+	},
 	{ /* Sentinel */ }
 };
 
@@ -90,11 +106,14 @@ struct location {
 	char *function;
 	char *file;
 	int lineno;
+	int resolved;
 	struct location *next;	/* next in mapping. */
 };
 
 struct mapping {
 	char *name;
+	/* Offset of the name in the trace string table (live mode). */
+	__u32 offset;
 	struct location *locs;
 	struct mapping *next;
 } *mapping_list = NULL;
@@ -107,6 +126,7 @@ struct relax_spot {
 	char *reason;
 	pid_t pid;
 	int hits;
+	int last_hits;
 	int depth;
 	struct backtrace {
 		unsigned long pc;
@@ -114,6 +134,7 @@ struct relax_spot {
 		const struct location *where;
 	} backtrace[SIGSHADOW_BACKTRACE_DEPTH];
 	struct relax_spot *next;
+	struct relax_spot *h_next;
 } *spot_list = NULL;
 
 int spot_count, filtered_count = 0;
@@ -460,6 +481,8 @@ static void resolve_spots(void)
 	for (p = spot_list; p; p = p->next) {
 		for (depth = 0; depth < p->depth; depth++) {
 			b = p->backtrace + depth;
+			if (b->where != &undefined_location)
+				continue; /* Resolved in a previous pass. */
 			l = find_location(b->mapping->locs, b->pc);
 			if (l) {
 				/* PC found in mapping cache. */
@@ -475,6 +498,7 @@ static void resolve_spots(void)
 			l->function = NULL;
 			l->file = NULL;
 			l->lineno = 0;
+			l->resolved = 0;
 			b->where = l;
 			l->next = b->mapping->locs;
 			b->mapping->locs = l;
@@ -483,15 +507,24 @@ static void resolve_spots(void)
 
 	/*
 	 * For each mapping, try resolving PC values as source
-	 * locations.
+	 * locations. Locations are resolved once, so that live mode
+	 * only runs addr2line for the call sites which showed up
+	 * since the previous pass.
 	 */
 	for (m = mapping_list; m; m = m->next) {
-		if (*m->name == '?')
+		for (l = m->locs; l; l = l->next) {
+			if (!l->resolved)
+				break;
+		}
+		if (l == NULL)
 			continue;
 
-		ret = stat(m->name, &sbuf);
-		if (ret || !S_ISREG(sbuf.st_mode))
+		ret = *m->name == '?' ? -1 : stat(m->name, &sbuf);
+		if (ret || !S_ISREG(sbuf.st_mode)) {
+			for (; l; l = l->next)
+				l->resolved = 1;
 			continue;
+		}
 
 		ret = asprintf(&a2l,
 			       "%saddr2line --demangle --inlines --functions --exe=%s",
@@ -499,7 +532,9 @@ static void resolve_spots(void)
 		if (ret < 0)
 			goto no_mem;
 
-		for (l = m->locs, s = a2l, a2lcmd = NULL; l; l = l->next) {
+		for (s = a2l, a2lcmd = NULL; l; l = l->next) {
+			if (l->resolved)
+				continue;
 			ret = asprintf(&a2lcmd, "%s 0x%lx", s, l->pc);
 			if (ret < 0)
 				goto no_mem;
@@ -512,6 +547,9 @@ static void resolve_spots(void)
 			error(1, errno, "cannot run %s", a2lcmd);
 
 		for (l = m->locs; l; l = l->next) {
+			if (l->resolved)
+				continue;
+			l->resolved = 1;
 			ret = fscanf(fp, "%ms\n", &l->function);
 			if (ret != 1)
 				goto bad_output;
@@ -594,6 +632,287 @@ static void display_spots(void)
 		       hits, spot_count);
 }
 
+static const char *reason_str[] = {
+    [SIGDEBUG_UNDEFINED] = "undefined",
+    [SIGDEBUG_MIGRATE_SIGNAL] = "signal",
+    [SIGDEBUG_MIGRATE_SYSCALL] = "syscall",
+    [SIGDEBUG_MIGRATE_FAULT] = "fault",
+    [SIGDEBUG_MIGRATE_PRIOINV] = "pi-error",
+    [SIGDEBUG_NOMLOCK] = "mlock-check",
+    [SIGDEBUG_WATCHDOG] = "runaway-break",
+    [SIGDEBUG_RESCNT_IMBALANCE] = "resource-count-imbalance",
+    [SIGDEBUG_MUTEX_SLEEP] = "sleep-holding-mutex",
+    [SIGDEBUG_LOCK_BREAK] = "scheduler-lock-break",
+};
+
+#define SPOT_HSLOTS	(1 << 8)
+
+static struct relax_spot *spot_hash[SPOT_HSLOTS];
+
+static const struct cobalt_relax_trace *trace;
+
+static __u32 *ring_tails;
+
+static unsigned long event_count, lost_count;
+
+static const struct cobalt_relax_trace *map_trace(const char *ring_file)
+{
+	const struct cobalt_relax_trace *t;
+	size_t size;
+	int fd;
+
+	fd = open(ring_file, O_RDONLY);
+	if (fd < 0)
+		error(1, errno, "cannot open relax ring %s", ring_file);
+
+	/* Map the header first, to figure out the whole size. */
+	size = getpagesize();
+	t = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (t == MAP_FAILED)
+		error(1, errno, "cannot map relax ring %s", ring_file);
+
+	if (t->magic != COBALT_RELAX_MAGIC || t->abi != COBALT_RELAX_ABI)
+		error(1, 0, "unsupported relax ring format in %s", ring_file);
+
+	size = t->size;
+	munmap((void *)t, getpagesize());
+	t = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (t == MAP_FAILED)
+		error(1, errno, "cannot map relax ring %s", ring_file);
+
+	close(fd);
+
+	return t;
+}
+
+static struct mapping *get_mapping(__u32 offset)
+{
+	struct mapping *m;
+	char *name;
+
+	for (m = mapping_list; m; m = m->next) {
+		if (m->offset == offset)
+			return m;
+	}
+
+	name = strdup(offset ? cobalt_relax_string(trace, offset) : "?");
+	if (name == NULL)
+		goto no_mem;
+
+	m = malloc(sizeof(*m));
+	if (m == NULL)
+		goto no_mem;
+
+	m->name = resolve_path(name);
+	m->offset = offset;
+	m->locs = NULL;
+	m->next = mapping_list;
+	mapping_list = m;
+
+	return m;
+no_mem:
+	error(1, ENOMEM, "get_mapping failed");
+	return NULL;		/* not reached. */
+}
+
+static unsigned int hash_event(const struct cobalt_relax_event *e)
+{
+	unsigned int hash = e->pid ^ (e->reason << 16);
+	int depth;
+
+	for (depth = 0; depth < e->depth; depth++)
+		hash = hash * 31 + (unsigned int)e->backtrace[depth].pc;
+
+	return hash & (SPOT_HSLOTS - 1);
+}
+
+static int match_event(struct relax_spot *p,
+		       const struct cobalt_relax_event *e)
+{
+	struct backtrace *b;
+	int depth;
+
+	if (p->pid != e->pid || p->depth != e->depth ||
+	    strcmp(p->reason, reason_str[e->reason]))
+		return 0;
+
+	for (depth = 0, b = p->backtrace; depth < p->depth; b++, depth++) {
+		/* Remember that we moved back to the call site. */
+		if (b->pc != e->backtrace[depth].pc - 1 ||
+		    b->mapping->offset != e->backtrace[depth].mapname)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void count_event(const struct cobalt_relax_event *e)
+{
+	struct relax_spot *p, **h;
+	int depth;
+
+	h = spot_hash + hash_event(e);
+	for (p = *h; p; p = p->h_next) {
+		if (match_event(p, e)) {
+			p->hits++;
+			return;
+		}
+	}
+
+	p = malloc(sizeof(*p));
+	if (p == NULL)
+		goto no_mem;
+
+	p->exe_path = strdup(e->exe_path ?
+			     cobalt_relax_string(trace, e->exe_path) : "?");
+	p->thread_name = strndup(e->thread, sizeof(e->thread));
+	if (p->exe_path == NULL || p->thread_name == NULL)
+		goto no_mem;
+
+	p->reason = (char *)reason_str[e->reason];
+	p->pid = e->pid;
+	p->hits = 1;
+	p->last_hits = 0;
+	p->depth = e->depth;
+	for (depth = 0; depth < p->depth; depth++) {
+		p->backtrace[depth].pc = e->backtrace[depth].pc - 1;
+		p->backtrace[depth].mapping =
+			get_mapping(e->backtrace[depth].mapname);
+		p->backtrace[depth].where = &undefined_location;
+	}
+
+	p->next = spot_list;
+	spot_list = p;
+	p->h_next = *h;
+	*h = p;
+	spot_count++;
+
+	return;
+no_mem:
+	error(1, ENOMEM, "count_event failed");
+}
+
+static void scan_ring(int cpu)
+{
+	const struct cobalt_relax_event *e;
+	struct cobalt_relax_event ev;
+	__u32 head, tail, seq;
+	int depth;
+
+	head = trace->rings[cpu].head;
+	__sync_synchronize();
+	tail = ring_tails[cpu];
+
+	if (head - tail > trace->nr_events) {
+		lost_count += head - tail - trace->nr_events;
+		tail = head - trace->nr_events;
+	}
+
+	for (; tail != head; tail++) {
+		/*
+		 * Snapshot the record, which the kernel may overwrite
+		 * at any time, then make sure it did not.
+		 */
+		e = cobalt_relax_event(trace, cpu, tail);
+		seq = e->seq;
+		__sync_synchronize();
+		ev = *e;
+		__sync_synchronize();
+		if (seq != tail + 1 || e->seq != seq ||
+		    ev.depth > SIGSHADOW_BACKTRACE_DEPTH ||
+		    ev.reason >= sizeof(reason_str) / sizeof(reason_str[0]) ||
+		    ev.exe_path >= trace->strtab_len) {
+			lost_count++;
+			continue;
+		}
+		for (depth = 0; depth < ev.depth; depth++) {
+			if (ev.backtrace[depth].mapname >= trace->strtab_len)
+				ev.backtrace[depth].mapname = 0;
+		}
+		count_event(&ev);
+		event_count++;
+	}
+
+	ring_tails[cpu] = tail;
+}
+
+static int compare_spots(const void *a, const void *b)
+{
+	const struct relax_spot *p = *(struct relax_spot **)a,
+		*q = *(struct relax_spot **)b;
+	int d;
+
+	/* Busiest spots in the last interval first, then overall. */
+	d = (q->hits - q->last_hits) - (p->hits - p->last_hits);
+
+	return d ?: q->hits - p->hits;
+}
+
+static void display_live_spots(int interval)
+{
+	struct relax_spot *p, **spots;
+	int n, nr, depth;
+
+	spots = malloc(spot_count * sizeof(*spots));
+	if (spots == NULL)
+		error(1, ENOMEM, "display_live_spots failed");
+
+	for (p = spot_list, nr = 0; p; p = p->next) {
+		if (match_filter_list(p))
+			p->last_hits = p->hits;
+		else
+			spots[nr++] = p;
+	}
+
+	qsort(spots, nr, sizeof(*spots), compare_spots);
+
+	printf("\033[H\033[2J");
+	printf("%lu relax events, %lu lost, %d spots (%d shown), "
+	       "refresh %ds\n", event_count, lost_count,
+	       spot_count, nr, interval);
+
+	for (n = 0; n < nr; n++) {
+		p = spots[n];
+		printf("\n%8d %+6d Thread[%d] \"%s\" started by %s\n",
+		       p->hits, p->hits - p->last_hits,
+		       p->pid, p->thread_name, p->exe_path);
+		printf("Caused by: %s\n", p->reason);
+		for (depth = 0; depth < p->depth; depth++)
+			put_location(p, depth);
+		p->last_hits = p->hits;
+	}
+
+	fflush(stdout);
+	free(spots);
+}
+
+static void run_live(const char *ring_file, int interval)
+{
+	__u32 head;
+	int cpu;
+
+	trace = map_trace(ring_file);
+
+	ring_tails = malloc(trace->nr_cpus * sizeof(*ring_tails));
+	if (ring_tails == NULL)
+		error(1, ENOMEM, "run_live failed");
+
+	/* Start with the events still available from the rings. */
+	for (cpu = 0; cpu < trace->nr_cpus; cpu++) {
+		head = trace->rings[cpu].head;
+		ring_tails[cpu] = head > trace->nr_events ?
+			head - trace->nr_events : 0;
+	}
+
+	for (;;) {
+		for (cpu = 0; cpu < trace->nr_cpus; cpu++)
+			scan_ring(cpu);
+		resolve_spots();
+		display_live_spots(interval);
+		sleep(interval);
+	}
+}
+
 static void usage(void)
 {
 	fprintf(stderr, "usage: slackspot [CROSS_COMPILE=<toolchain-prefix>] [options]\n");
@@ -602,14 +921,16 @@ static void usage(void)
 	fprintf(stderr, "   --filter-in <name=exp[,name...]>		exclude non-matching spots\n");
 	fprintf(stderr, "   --filter <name=exp[,name...]>		alias for --filter-in\n");
 	fprintf(stderr, "   --filter-out <name=exp[,name...]>		exclude matching spots\n");
+	fprintf(stderr, "   --live					monitor the relax event rings continuously\n");
+	fprintf(stderr, "   --interval <seconds>			refresh period in live mode (default 1)\n");
 	fprintf(stderr, "   --help					print this help\n");
 }
 
 int main(int argc, char *const argv[])
 {
 	const char *trace_file, *filters;
+	int c, lindex, ret, live = 0, interval = 1;
 	const char *ldpath;
-	int c, lindex, ret;
 	FILE *fp;
 
 	trace_file = NULL;
@@ -646,11 +967,30 @@ int main(int argc, char *const argv[])
 		case filter_opt:
 			filters = optarg;
 			break;
+		case live_opt:
+			live = 1;
+			break;
+		case interval_opt:
+			interval = atoi(optarg);
+			if (interval <= 0) {
+				usage();
+				return EINVAL;
+			}
+			break;
 		default:
 			return EINVAL;
 		}
 	}
 
+	if (live) {
+		ret = build_filter_list(filters);
+		if (ret)
+			error(1, 0, "bad filter expression: %s", filters);
+		build_ldpath_list(ldpath);
+		run_live(trace_file ?: "/proc/xenomai/debug/relax-ring",
+			 interval);
+	}
+
 	fp = stdin;
 	if (trace_file == NULL) {
 		if (isatty(fileno(stdin))) {